@@ -140,6 +140,7 @@ void term_exit(void)
 
 static volatile int received_sigterm = 0;
 static volatile int received_nb_signals = 0;
+static volatile int received_stats_request = 0;
 static atomic_int transcode_init_done = 0;
 static volatile int ffmpeg_exited = 0;
 static int64_t copy_ts_first_pts = AV_NOPTS_VALUE;
@@ -159,6 +160,13 @@ sigterm_handler(int sig)
     }
 }
 
+#ifdef SIGUSR1
+static void sched_stats_handler(int sig)
+{
+    received_stats_request = 1;
+}
+#endif
+
 #if HAVE_SETCONSOLECTRLHANDLER
 static BOOL WINAPI CtrlHandler(DWORD fdwCtrlType)
 {
@@ -255,6 +263,10 @@ void term_init(void)
 #ifdef SIGPIPE
     signal(SIGPIPE, SIG_IGN); /* Broken pipe (POSIX). */
 #endif
+#ifdef SIGUSR1
+    if (sched_stats_file)
+        SIGNAL(SIGUSR1, sched_stats_handler);
+#endif
 #if HAVE_SETCONSOLECTRLHANDLER
     SetConsoleCtrlHandler((PHANDLER_ROUTINE) CtrlHandler, TRUE);
 #endif
@@ -360,6 +372,8 @@ static void ffmpeg_cleanup(int ret)
 
     av_freep(&print_graphs_file);
     av_freep(&print_graphs_format);
+    av_freep(&sched_stats_file);
+    av_freep(&profile_pipeline_file);
 
     av_freep(&input_files);
     av_freep(&output_files);
@@ -780,6 +794,15 @@ static void print_stream_maps(void)
             continue;
         }
 
+        if (ost->enc_src) {
+            /* packets from the encoder of another output */
+            av_log(NULL, AV_LOG_INFO, "  Stream #%d:%d (%s) -> #%d:%d (shared)\n",
+                   ost->enc_src->file->index, ost->enc_src->index,
+                   ost->enc_src->enc->enc_ctx->codec->name,
+                   ost->file->index, ost->index);
+            continue;
+        }
+
         av_log(NULL, AV_LOG_INFO, "  Stream #%d:%d -> #%d:%d",
                ost->ist->file->index,
                ost->ist->index,
@@ -895,6 +918,92 @@ static int check_keyboard_interaction(int64_t cur_time)
     return 0;
 }
 
+static void write_sched_stats(Scheduler *sch)
+{
+    AVIOContext *avio = NULL;
+    AVBPrint bp;
+    int ret;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    sch_print_stats(sch, &bp);
+    if (!av_bprint_is_complete(&bp)) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    ret = avio_open2(&avio, sched_stats_file, AVIO_FLAG_WRITE, &int_cb, NULL);
+    if (ret < 0)
+        goto fail;
+
+    avio_write(avio, bp.str, bp.len);
+    ret = avio_closep(&avio);
+
+fail:
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Error writing scheduler statistics to '%s': %s\n",
+               sched_stats_file, av_err2str(ret));
+    av_bprint_finalize(&bp, NULL);
+}
+
+static void write_pipeline_profile(Scheduler *sch, int64_t elapsed)
+{
+    AVIOContext *avio = NULL;
+    AVBPrint bp;
+    int nb_printed = 0, ret;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    av_bprintf(&bp, "{\n\"elapsed_us\": %"PRId64",\n", elapsed);
+
+    av_bprintf(&bp, "\"inputs\": [");
+    for (int i = 0; i < nb_input_files; i++) {
+        av_bprintf(&bp, "%s\n", i ? "," : "");
+        ifile_print_profile(input_files[i], &bp);
+    }
+    av_bprintf(&bp, "\n],\n\"filtergraphs\": [");
+    for (int i = 0; i < nb_filtergraphs; i++) {
+        av_bprintf(&bp, "%s\n", nb_printed++ ? "," : "");
+        fg_print_profile(filtergraphs[i], &bp);
+    }
+    // simple filtergraphs are owned by their output streams
+    for (int i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+        for (int j = 0; j < of->nb_streams; j++) {
+            if (!of->streams[j]->fg_simple)
+                continue;
+            av_bprintf(&bp, "%s\n", nb_printed++ ? "," : "");
+            fg_print_profile(of->streams[j]->fg_simple, &bp);
+        }
+    }
+    av_bprintf(&bp, "\n],\n\"outputs\": [");
+    for (int i = 0; i < nb_output_files; i++) {
+        av_bprintf(&bp, "%s\n", i ? "," : "");
+        of_print_profile(output_files[i], &bp);
+    }
+    av_bprintf(&bp, "\n],\n\"scheduler\": ");
+    sch_print_stats(sch, &bp);
+    av_bprintf(&bp, "}\n");
+
+    if (!av_bprint_is_complete(&bp)) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    ret = avio_open2(&avio, profile_pipeline_file, AVIO_FLAG_WRITE, &int_cb, NULL);
+    if (ret < 0)
+        goto fail;
+
+    avio_write(avio, bp.str, bp.len);
+    ret = avio_closep(&avio);
+
+fail:
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Error writing pipeline profile to '%s': %s\n",
+               profile_pipeline_file, av_err2str(ret));
+    av_bprint_finalize(&bp, NULL);
+}
+
 /*
  * The following code is the main loop of the file converter
  */
@@ -907,6 +1016,9 @@ static int transcode(Scheduler *sch)
 
     atomic_store(&transcode_init_done, 1);
 
+    if (sched_stats_file || profile_pipeline_file)
+        sch_enable_stats(sch);
+
     ret = sch_start(sch);
     if (ret < 0)
         return ret;
@@ -928,18 +1040,29 @@ static int transcode(Scheduler *sch)
             if (check_keyboard_interaction(cur_time) < 0)
                 break;
 
+        if (received_stats_request) {
+            received_stats_request = 0;
+            write_sched_stats(sch);
+        }
+
         /* dump report by using the output first video and audio streams */
         print_report(0, timer_start, cur_time, transcode_ts);
     }
 
     ret = sch_stop(sch, &transcode_ts);
 
+    if (sched_stats_file)
+        write_sched_stats(sch);
+
     /* write the trailer if needed */
     for (int i = 0; i < nb_output_files; i++) {
         int err = of_write_trailer(output_files[i]);
         ret = err_merge(ret, err);
     }
 
+    if (profile_pipeline_file)
+        write_pipeline_profile(sch, av_gettime_relative() - timer_start);
+
     term_exit();
 
     /* dump report by using the first video and audio streams */
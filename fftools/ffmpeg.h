@@ -125,6 +125,8 @@ typedef struct StreamMap {
     int stream_index;
     int group_index;
     char *linklabel;       /* name of an output link, for mapping lavfi outputs */
+    int enc_shared;         /* file_index:stream_index refer to an output stream
+                               whose encoder is shared (-map_enc) */
 
     ViewSpecifier vs;
 } StreamMap;
@@ -183,6 +185,7 @@ typedef struct OptionsContext {
     float shortest_buf_duration;
     int shortest;
     int bitexact;
+    int numa_node;
 
     int video_disable;
     int audio_disable;
@@ -224,6 +227,8 @@ typedef struct OptionsContext {
     SpecifierOptList canvas_sizes;
     SpecifierOptList pass;
     SpecifierOptList passlogfiles;
+    SpecifierOptList enc_chunks;
+    SpecifierOptList enc_chunk_frames;
     SpecifierOptList max_muxing_queue_size;
     SpecifierOptList muxing_queue_data_threshold;
     SpecifierOptList guess_layout_max;
@@ -460,6 +465,10 @@ typedef struct Decoder {
     uint64_t         frames_decoded;
     uint64_t         samples_decoded;
     uint64_t         decode_errors;
+
+    // time spent in the decoder in microseconds, only measured when
+    // -profile_pipeline is used
+    int64_t          decode_time;
 } Decoder;
 
 typedef struct InputStream {
@@ -623,6 +632,10 @@ typedef struct Encoder {
     // number of frames/samples sent to the encoder
     uint64_t                frames_encoded;
     uint64_t                samples_encoded;
+
+    // time spent in the encoder in microseconds, only measured when
+    // -profile_pipeline is used
+    atomic_int_least64_t    encode_time;
 } Encoder;
 
 enum CroppingType {
@@ -650,6 +663,9 @@ typedef struct OutputStream {
     AVStream *st;            /* stream in the output file */
 
     Encoder *enc;
+    /* output stream whose encoder feeds this stream, for streams
+     * sharing the encoder of another output (-map_enc) */
+    struct OutputStream *enc_src;
 
     int bitexact;
     int bits_per_raw_sample;
@@ -772,6 +788,8 @@ extern int vstats_version;
 extern int print_graphs;
 extern char *print_graphs_file;
 extern char *print_graphs_format;
+extern char *sched_stats_file;
+extern char *profile_pipeline_file;
 extern int auto_conversion_filters;
 
 extern const AVIOInterruptCB int_cb;
@@ -835,6 +853,12 @@ int fg_create(FilterGraph **pfg, char **graph_desc, Scheduler *sch,
 
 void fg_free(FilterGraph **pfg);
 
+/**
+ * Print the profiling data collected for this filtergraph to bp, as a JSON
+ * object.
+ */
+void fg_print_profile(FilterGraph *fg, AVBPrint *bp);
+
 void fg_send_command(FilterGraph *fg, double time, const char *target,
                      const char *command, const char *arg, int all_filters);
 
@@ -905,6 +929,27 @@ void enc_free(Encoder **penc);
 
 int enc_open(void *opaque, const AVFrame *frame);
 
+/*
+ * Register an output stream of another output file which receives the packets
+ * produced by this encoder. Its parameters are initialized when the encoder is
+ * opened, or with the headers of the first packet if its muxer needs global
+ * headers and the encoder does not export them. The encoder is not changed
+ * for the muxer of ost.
+ *
+ * @param fmt_flags AVFMT_* flags of the muxer of ost
+ */
+int enc_add_subscriber(Encoder *enc, OutputStream *ost, int fmt_flags);
+
+/*
+ * Enable chunked encoding: the input is split into chunks of chunk_frames
+ * frames starting with a forced keyframe, encoded concurrently by nb_workers
+ * separate encoder instances.
+ * Must be called after all the encoder options and flags have been set.
+ *
+ * @param chunk_frames number of frames in a chunk
+ */
+int enc_chunks_init(Encoder *enc, int nb_workers, int chunk_frames);
+
 int enc_loopback(Encoder *enc);
 
 /*
@@ -915,16 +960,35 @@ int enc_loopback(Encoder *enc);
  */
 int of_stream_init(OutputFile *of, OutputStream *ost,
                    const AVCodecContext *enc_ctx);
+/*
+ * Like of_stream_init(), for a stream sharing the encoder of another output
+ * stream (-map_enc). If the muxer needs headers in-band that the encoder
+ * exports, they are inserted with the dump_extra bitstream filter.
+ *
+ * @param headers headers to use as extradata when the encoder exports none
+ */
+int of_stream_init_shared(OutputStream *ost, const AVCodecContext *enc_ctx,
+                          const uint8_t *headers, int headers_size);
 int of_write_trailer(OutputFile *of);
 int of_open(const OptionsContext *o, const char *filename, Scheduler *sch);
 void of_free(OutputFile **pof);
+void of_print_profile(OutputFile *of, AVBPrint *bp);
 
 void of_enc_stats_close(void);
 
 int64_t of_filesize(OutputFile *of);
 
 int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch);
+/**
+ * Open nb_files input files, with o[i] holding the options and the URL for
+ * the i-th one. Opening the files and probing their streams is done on up to
+ * nb_threads threads concurrently, otherwise the result is the same as
+ * calling ifile_open() for each of them in order.
+ */
+int ifile_open_multi(const OptionsContext *o, int nb_files, Scheduler *sch,
+                     int nb_threads);
 void ifile_close(InputFile **f);
+void ifile_print_profile(InputFile *f, AVBPrint *bp);
 
 int ist_use(InputStream *ist, int decoding_needed,
             const ViewSpecifier *vs, SchedulerNode *src);
@@ -693,6 +693,7 @@ static int packet_decode(DecoderPriv *dp, AVPacket *pkt, AVFrame *frame)
 {
     AVCodecContext *dec = dp->dec_ctx;
     const char *type_desc = av_get_media_type_string(dec->codec_type);
+    int64_t t0;
     int ret;
 
     if (dec->codec_type == AVMEDIA_TYPE_SUBTITLE)
@@ -716,7 +717,10 @@ static int packet_decode(DecoderPriv *dp, AVPacket *pkt, AVFrame *frame)
         fd->wallclock[LATENCY_PROBE_DEC_PRE] = av_gettime_relative();
     }
 
+    t0 = profile_pipeline_file ? av_gettime_relative() : 0;
     ret = avcodec_send_packet(dec, pkt);
+    if (profile_pipeline_file)
+        dp->dec.decode_time += av_gettime_relative() - t0;
     if (ret < 0 && !(ret == AVERROR_EOF && !pkt)) {
         // In particular, we don't expect AVERROR(EAGAIN), because we read all
         // decoded frames with avcodec_receive_frame() until done.
@@ -746,7 +750,10 @@ static int packet_decode(DecoderPriv *dp, AVPacket *pkt, AVFrame *frame)
         av_frame_unref(frame);
 
         update_benchmark(NULL);
+        t0 = profile_pipeline_file ? av_gettime_relative() : 0;
         ret = avcodec_receive_frame_flags(dec, frame, flags);
+        if (profile_pipeline_file)
+            dp->dec.decode_time += av_gettime_relative() - t0;
         update_benchmark("decode_%s %s", type_desc, dp->parent_name);
 
         if (ret == AVERROR(EAGAIN)) {
@@ -1592,8 +1599,20 @@ static int dec_open(DecoderPriv *dp, AVDictionary **dec_opts,
     dp->dec_ctx->get_buffer2           = get_buffer;
     dp->dec_ctx->pkt_timebase          = o->time_base;
 
-    if (!av_dict_get(*dec_opts, "threads", NULL, 0))
-        av_dict_set(dec_opts, "threads", "auto", 0);
+    if (!av_dict_get(*dec_opts, "threads", NULL, 0)) {
+        const SchedulerNode node = SCH_DEC_IN(dp->sch_idx);
+        int nb_threads;
+
+        sch_set_threadable(dp->sch, node, !!(codec->capabilities &
+                           (AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_SLICE_THREADS |
+                            AV_CODEC_CAP_OTHER_THREADS)));
+        nb_threads = sch_get_thread_count(dp->sch, node);
+        if (nb_threads > 0)
+            av_dict_set_int(dec_opts, "threads", nb_threads, 0);
+        else
+            av_dict_set(dec_opts, "threads", "auto", 0);
+    } else
+        sch_set_threadable(dp->sch, SCH_DEC_IN(dp->sch_idx), 0);
 
     ret = hw_device_setup_for_decode(dp, codec, o->hwaccel_device);
     if (ret < 0) {
@@ -988,6 +988,39 @@ static void demux_final_stats(Demuxer *d)
            total_packets, total_size);
 }
 
+void ifile_print_profile(InputFile *f, AVBPrint *bp)
+{
+    int first = 1;
+
+    av_bprintf(bp, "  { \"index\": %d, \"url\": ", f->index);
+    bprint_json_string(bp, f->ctx->url);
+    av_bprintf(bp, ", \"streams\": [");
+
+    for (int i = 0; i < f->nb_streams; i++) {
+        InputStream *ist = f->streams[i];
+        DemuxStream  *ds = ds_from_ist(ist);
+        enum AVMediaType type = ist->par->codec_type;
+
+        if (ds->discard || type == AVMEDIA_TYPE_ATTACHMENT)
+            continue;
+
+        av_bprintf(bp, "%s\n    { \"index\": %d, \"type\": \"%s\", \"codec\": \"%s\""
+                   ", \"packets\": %"PRIu64", \"bytes\": %"PRIu64,
+                   first ? "" : ",", i, av_get_media_type_string(type),
+                   avcodec_get_name(ist->par->codec_id),
+                   ds->nb_packets, ds->data_size);
+        if (ds->decoding_needed)
+            av_bprintf(bp, ", \"frames_decoded\": %"PRIu64", \"decode_errors\": %"PRIu64
+                       ", \"decode_time_us\": %"PRId64,
+                       ist->decoder->frames_decoded, ist->decoder->decode_errors,
+                       ist->decoder->decode_time);
+        av_bprintf(bp, " }");
+        first = 0;
+    }
+
+    av_bprintf(bp, "\n  ] }");
+}
+
 static void ist_free(InputStream **pist)
 {
     InputStream *ist = *pist;
@@ -2243,15 +2276,32 @@ static Demuxer *demux_alloc(void)
     return d;
 }
 
-int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
+/* Opening an input is split into three stages. Only the second one, which
+ * opens the file and probes its streams, may run concurrently for several
+ * inputs; it only touches the demuxer being opened. */
+typedef struct DemuxOpen {
+    const OptionsContext *o;
+    const char           *filename;
+
+    Demuxer              *d;
+    // allocated, but not yet opened format context
+    AVFormatContext      *ic;
+    const AVInputFormat  *iformat;
+    int64_t               recording_time;
+    int                   scan_all_pmts_set;
+
+    // return code of ifile_open_probe()
+    int                   ret;
+} DemuxOpen;
+
+static int ifile_open_prepare(DemuxOpen *op, Scheduler *sch)
 {
+    const OptionsContext *o = op->o;
+    const char *filename = op->filename;
     Demuxer   *d;
-    InputFile *f;
     AVFormatContext *ic;
     const AVInputFormat *file_iformat = NULL;
-    int err, ret = 0;
-    int64_t timestamp;
-    AVDictionary *opts_used = NULL;
+    int ret = 0;
     const char*    video_codec_name = NULL;
     const char*    audio_codec_name = NULL;
     const char* subtitle_codec_name = NULL;
@@ -2259,15 +2309,13 @@ int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
     int scan_all_pmts_set = 0;
 
     int64_t start_time     = o->start_time;
-    int64_t start_time_eof = o->start_time_eof;
     int64_t stop_time      = o->stop_time;
     int64_t recording_time = o->recording_time;
 
     d = demux_alloc();
     if (!d)
         return AVERROR(ENOMEM);
-
-    f = &d->f;
+    op->d = d;
 
     ret = sch_add_demux(sch, input_thread, d);
     if (ret < 0)
@@ -2387,24 +2435,43 @@ int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
         av_dict_set(&o->g->format_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
         scan_all_pmts_set = 1;
     }
+
+    op->filename          = filename;
+    op->ic                = ic;
+    op->iformat           = file_iformat;
+    op->recording_time    = recording_time;
+    op->scan_all_pmts_set = scan_all_pmts_set;
+
+    return 0;
+}
+
+static int ifile_open_probe(DemuxOpen *op)
+{
+    const OptionsContext *o = op->o;
+    Demuxer         *d = op->d;
+    InputFile       *f = &d->f;
+    AVFormatContext *ic;
+    int err, ret;
+
     /* open the input file with generic avformat function */
-    err = avformat_open_input(&ic, filename, file_iformat, &o->g->format_opts);
+    err = avformat_open_input(&op->ic, op->filename, op->iformat, &o->g->format_opts);
     if (err < 0) {
         if (err != AVERROR_EXIT)
             av_log(d, AV_LOG_ERROR,
                    "Error opening input: %s\n", av_err2str(err));
         if (err == AVERROR_PROTOCOL_NOT_FOUND)
-            av_log(d, AV_LOG_ERROR, "Did you mean file:%s?\n", filename);
+            av_log(d, AV_LOG_ERROR, "Did you mean file:%s?\n", op->filename);
         return err;
     }
-    f->ctx = ic;
+    f->ctx = ic = op->ic;
+    op->ic = NULL;
 
     av_strlcat(d->log_name, "/",               sizeof(d->log_name));
     av_strlcat(d->log_name, ic->iformat->name, sizeof(d->log_name));
     av_freep(&ic->name);
     ic->name = av_strdup(d->log_name);
 
-    if (scan_all_pmts_set)
+    if (op->scan_all_pmts_set)
         av_dict_set(&o->g->format_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE);
     remove_avoptions(&o->g->format_opts, o->g->codec_opts);
 
@@ -2444,6 +2511,22 @@ int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
         }
     }
 
+    return 0;
+}
+
+static int ifile_open_finish(DemuxOpen *op)
+{
+    const OptionsContext *o = op->o;
+    Demuxer         *d = op->d;
+    InputFile       *f = &d->f;
+    AVFormatContext *ic = f->ctx;
+    int64_t timestamp;
+    AVDictionary *opts_used = NULL;
+    int ret;
+
+    int64_t start_time     = o->start_time;
+    int64_t start_time_eof = o->start_time_eof;
+
     if (start_time != AV_NOPTS_VALUE && start_time_eof != AV_NOPTS_VALUE) {
         av_log(d, AV_LOG_WARNING, "Cannot use -ss and -sseof both, using -ss\n");
         start_time_eof = AV_NOPTS_VALUE;
@@ -2493,7 +2576,7 @@ int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
     }
 
     f->start_time = start_time;
-    d->recording_time = recording_time;
+    d->recording_time = op->recording_time;
     f->input_sync_ref = o->input_sync_ref;
     f->input_ts_offset = o->input_ts_offset;
     f->ts_offset  = o->input_ts_offset - (copy_ts ? (start_at_zero && ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0) : timestamp);
@@ -2560,7 +2643,7 @@ int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
     }
 
     /* dump the file content */
-    av_dump_format(ic, f->index, filename, 0);
+    av_dump_format(ic, f->index, op->filename, 0);
 
     /* check if all codec options have been used */
     ret = check_avoptions_used(o->g->codec_opts, opts_used, d, 1);
@@ -2582,3 +2665,103 @@ int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
 
     return 0;
 }
+
+int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
+{
+    DemuxOpen op = { .o = o, .filename = filename };
+    int ret;
+
+    ret = ifile_open_prepare(&op, sch);
+    if (ret < 0)
+        return ret;
+
+    ret = ifile_open_probe(&op);
+    if (ret < 0)
+        return ret;
+
+    return ifile_open_finish(&op);
+}
+
+typedef struct ProbeWorkers {
+    DemuxOpen  *ops;
+    int      nb_ops;
+    atomic_int next;
+} ProbeWorkers;
+
+static void *probe_thread(void *arg)
+{
+    ProbeWorkers *pw = arg;
+    int idx;
+
+    ff_thread_setname("probe");
+
+    while ((idx = atomic_fetch_add(&pw->next, 1)) < pw->nb_ops)
+        pw->ops[idx].ret = ifile_open_probe(&pw->ops[idx]);
+
+    return NULL;
+}
+
+int ifile_open_multi(const OptionsContext *o, int nb_files, Scheduler *sch,
+                     int nb_threads)
+{
+    ProbeWorkers pw = { .nb_ops = nb_files };
+    pthread_t *threads = NULL;
+    int nb_started = 0, ret = 0;
+
+    pw.ops = av_calloc(nb_files, sizeof(*pw.ops));
+    if (!pw.ops)
+        return AVERROR(ENOMEM);
+    atomic_init(&pw.next, 0);
+
+    for (int i = 0; i < nb_files; i++) {
+        pw.ops[i].o        = &o[i];
+        pw.ops[i].filename = o[i].g->arg;
+
+        ret = ifile_open_prepare(&pw.ops[i], sch);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Error opening input file %s.\n",
+                   o[i].g->arg);
+            goto finish;
+        }
+    }
+
+    nb_threads = av_clip(nb_threads, 1, nb_files);
+    threads    = av_calloc(nb_threads, sizeof(*threads));
+    if (!threads) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    av_log(NULL, AV_LOG_VERBOSE, "Opening %d input files using %d threads\n",
+           nb_files, nb_threads);
+
+    for (; nb_started < nb_threads; nb_started++)
+        if (pthread_create(&threads[nb_started], NULL, probe_thread, &pw))
+            break;
+    // if no thread could be created, do the work here
+    if (!nb_started) {
+        for (int i = 0; i < nb_files; i++)
+            pw.ops[i].ret = ifile_open_probe(&pw.ops[i]);
+    }
+
+    for (int i = 0; i < nb_started; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < nb_files && ret >= 0; i++) {
+        ret = pw.ops[i].ret;
+        if (ret >= 0)
+            ret = ifile_open_finish(&pw.ops[i]);
+        if (ret < 0)
+            av_log(NULL, AV_LOG_ERROR, "Error opening input file %s.\n",
+                   o[i].g->arg);
+    }
+
+finish:
+    // free the contexts of inputs that never got opened
+    for (int i = 0; i < nb_files; i++)
+        avformat_free_context(pw.ops[i].ic);
+    av_freep(&threads);
+    av_freep(&pw.ops);
+
+    return ret;
+}
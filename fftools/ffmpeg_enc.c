@@ -39,6 +39,14 @@
 
 #include "libavcodec/avcodec.h"
 
+typedef struct EncSubscriber {
+    OutputStream *ost;
+    // AVFMT_* flags of its muxer
+    int           fmt_flags;
+    // initialized from the first packet, see subscribers_init()
+    int           pending;
+} EncSubscriber;
+
 typedef struct EncoderPriv {
     Encoder        e;
 
@@ -57,6 +65,24 @@ typedef struct EncoderPriv {
 
     Scheduler      *sch;
     unsigned        sch_idx;
+
+    // chunked encoding, see enc_chunks_init()
+    Encoder       **chunk_workers;
+    int          nb_chunk_workers;
+    int             chunk_frames;
+    // number of frames sent in the current chunk
+    int             chunk_nb_frames;
+    // for chunk workers, the encoder they work for
+    Encoder        *chunk_leader;
+
+    // output streams of other files that receive our packets
+    EncSubscriber  *subscribers;
+    int          nb_subscribers;
+    // set while subscribers wait for the headers of the first packet,
+    // see subscribers_init()
+    atomic_int      subscribers_pending;
+    // number of chunk workers that finished
+    atomic_int      chunk_workers_done;
 } EncoderPriv;
 
 static EncoderPriv *ep_from_enc(Encoder *enc)
@@ -73,9 +99,16 @@ typedef struct EncoderThread {
 void enc_free(Encoder **penc)
 {
     Encoder *enc = *penc;
+    EncoderPriv *ep;
 
     if (!enc)
         return;
+    ep = ep_from_enc(enc);
+
+    for (int i = 0; i < ep->nb_chunk_workers; i++)
+        enc_free(&ep->chunk_workers[i]);
+    av_freep(&ep->chunk_workers);
+    av_freep(&ep->subscribers);
 
     if (enc->enc_ctx)
         av_freep(&enc->enc_ctx->stats_in);
@@ -225,12 +258,10 @@ static int apply_enc_options(Encoder *e, AVDictionary **opts)
     return 0;
 }
 
-static int enc_reopen(void *opaque, const AVFrame *frame,
+static int enc_reopen(OutputStream *ost, Encoder *e, const AVFrame *frame,
                       AVDictionary **extra_encoder_opts)
 {
-    OutputStream *ost = opaque;
     InputStream *ist = ost->ist;
-    Encoder              *e = ost->enc;
     EncoderPriv         *ep = ep_from_enc(e);
     AVCodecContext *enc_ctx = e->enc_ctx;
     Decoder            *dec = NULL;
@@ -240,7 +271,7 @@ static int enc_reopen(void *opaque, const AVFrame *frame,
     int threads_manual;
     int ret;
 
-    ret = av_dict_copy(&encoder_opts, ost->enc->encoder_opts, 0);
+    ret = av_dict_copy(&encoder_opts, e->encoder_opts, 0);
     if (ret < 0)
         return ret;
 
@@ -257,9 +288,9 @@ static int enc_reopen(void *opaque, const AVFrame *frame,
             return ret;
     }
 
-    // default to automatic thread count
+    // default to automatic thread count, or to our share of the thread budget
     if (!threads_manual)
-        enc_ctx->thread_count = 0;
+        enc_ctx->thread_count = FFMAX(sch_get_thread_count(ep->sch, SCH_ENC(ep->sch_idx)), 0);
 
     // frame is always non-NULL for audio and video
     av_assert0(frame || (enc->type != AVMEDIA_TYPE_VIDEO && enc->type != AVMEDIA_TYPE_AUDIO));
@@ -277,7 +308,7 @@ static int enc_reopen(void *opaque, const AVFrame *frame,
     if (ist)
         dec = ist->decoder;
 
-    if (ost->enc->codec_tag)
+    if (e->codec_tag)
         enc_ctx->codec_tag  = e->codec_tag;
     enc_ctx->flags         |= e->flags;
     enc_ctx->flags2        |= e->flags2;
@@ -434,7 +465,7 @@ int enc_open(void *opaque, const AVFrame *frame)
     if (ep->opened)
         return 0;
 
-    ret = enc_reopen(opaque, frame, NULL);
+    ret = enc_reopen(ost, e, frame, NULL);
     if (ret < 0)
         return ret;
 
@@ -445,9 +476,156 @@ int enc_open(void *opaque, const AVFrame *frame)
     if (ret < 0)
         return ret;
 
+    for (int i = 0; i < ep->nb_subscribers; i++) {
+        EncSubscriber *sub = &ep->subscribers[i];
+
+        if (sub->fmt_flags & AVFMT_FIXED_FRAMESIZE &&
+            enc_ctx->codec_type == AVMEDIA_TYPE_AUDIO && !enc_ctx->frame_size) {
+            av_log(sub->ost, AV_LOG_ERROR, "The muxer needs fixed-size audio "
+                   "frames, which the shared encoder does not produce\n");
+            return AVERROR(EINVAL);
+        }
+
+        // the encoder is not changed for the subscribers, so the headers it
+        // keeps in-band must be taken from its first packet
+        if (sub->fmt_flags & AVFMT_GLOBALHEADER &&
+            !(enc_ctx->flags & AV_CODEC_FLAG_GLOBAL_HEADER) &&
+            !enc_ctx->extradata_size) {
+            sub->pending = 1;
+            atomic_store(&ep->subscribers_pending, 1);
+            continue;
+        }
+
+        ret = of_stream_init_shared(sub->ost, enc_ctx, NULL, 0);
+        if (ret < 0)
+            return ret;
+    }
+
     return frame_samples;
 }
 
+int enc_add_subscriber(Encoder *enc, OutputStream *ost, int fmt_flags)
+{
+    EncoderPriv *ep = ep_from_enc(enc);
+    EncSubscriber *sub;
+
+    sub = av_dynarray2_add((void**)&ep->subscribers, &ep->nb_subscribers,
+                           sizeof(*sub), NULL);
+    if (!sub)
+        return AVERROR(ENOMEM);
+
+    sub->ost       = ost;
+    sub->fmt_flags = fmt_flags;
+    sub->pending   = 0;
+
+    return 0;
+}
+
+/* Take the headers of an encoder that does not export them from a packet */
+static int extract_headers(Encoder *e, const AVPacket *pkt,
+                           uint8_t **headers, int *headers_size)
+{
+    const AVBitStreamFilter *filter = av_bsf_get_by_name("extract_extradata");
+    AVCodecContext *enc_ctx = e->enc_ctx;
+    AVBSFContext *bsf = NULL;
+    AVPacket *tmp = NULL;
+    const uint8_t *data;
+    size_t size;
+    int ret;
+
+    if (!filter)
+        return 0;
+    for (const enum AVCodecID *id = filter->codec_ids; *id != enc_ctx->codec_id; id++)
+        if (*id == AV_CODEC_ID_NONE)
+            return 0;
+
+    ret = av_bsf_alloc(filter, &bsf);
+    if (ret < 0)
+        return ret;
+
+    ret = avcodec_parameters_from_context(bsf->par_in, enc_ctx);
+    if (ret < 0)
+        goto fail;
+    bsf->time_base_in = enc_ctx->time_base;
+
+    ret = av_bsf_init(bsf);
+    if (ret < 0)
+        goto fail;
+
+    tmp = av_packet_alloc();
+    if (!tmp) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    ret = av_packet_ref(tmp, pkt);
+    if (ret < 0)
+        goto fail;
+
+    ret = av_bsf_send_packet(bsf, tmp);
+    if (ret < 0)
+        goto fail;
+    ret = av_bsf_receive_packet(bsf, tmp);
+    if (ret < 0)
+        goto fail;
+
+    data = av_packet_get_side_data(tmp, AV_PKT_DATA_NEW_EXTRADATA, &size);
+    if (data && size <= INT_MAX) {
+        *headers = av_memdup(data, size);
+        if (!*headers) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        *headers_size = size;
+    }
+
+    ret = 0;
+fail:
+    av_packet_free(&tmp);
+    av_bsf_free(&bsf);
+    return ret;
+}
+
+/*
+ * Initialize the subscribers whose muxer needs global headers that the
+ * encoder keeps in-band, with the headers of its first packet. Called for
+ * every packet while they are pending, possibly concurrently by the chunk
+ * workers, and without a packet when none was produced.
+ */
+static int subscribers_init(Encoder *enc, const AVPacket *pkt)
+{
+    EncoderPriv *ep = ep_from_enc(enc);
+    uint8_t *headers = NULL;
+    int headers_size = 0;
+    int ret = 0;
+
+    if (!atomic_exchange(&ep->subscribers_pending, 0))
+        return 0;
+
+    if (pkt) {
+        ret = extract_headers(enc, pkt, &headers, &headers_size);
+        if (ret < 0)
+            return ret;
+    }
+    if (!headers_size)
+        av_log(enc, AV_LOG_WARNING, "Could not find the headers of the "
+               "encoder for the outputs that need them out of band\n");
+
+    for (int i = 0; i < ep->nb_subscribers; i++) {
+        EncSubscriber *sub = &ep->subscribers[i];
+
+        if (!sub->pending)
+            continue;
+        sub->pending = 0;
+
+        ret = of_stream_init_shared(sub->ost, enc->enc_ctx, headers, headers_size);
+        if (ret < 0)
+            break;
+    }
+
+    av_free(headers);
+    return ret;
+}
+
 static int check_recording_time(OutputStream *ost, int64_t ts, AVRational tb)
 {
     OutputFile *of = ost->file;
@@ -626,9 +804,9 @@ static inline double psnr(double d)
     return -10.0 * log10(d);
 }
 
-static int update_video_stats(OutputStream *ost, const AVPacket *pkt, int write_vstats)
+static int update_video_stats(OutputStream *ost, Encoder *e,
+                              const AVPacket *pkt, int write_vstats)
 {
-    Encoder        *e = ost->enc;
     EncoderPriv   *ep = ep_from_enc(e);
     const uint8_t *sd = av_packet_get_side_data(pkt, AV_PKT_DATA_QUALITY_STATS,
                                                 NULL);
@@ -691,46 +869,26 @@ static int update_video_stats(OutputStream *ost, const AVPacket *pkt, int write_
     return 0;
 }
 
-static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame,
-                        AVPacket *pkt)
+static int encode_frame(OutputFile *of, OutputStream *ost, Encoder *e,
+                        AVFrame *frame, AVPacket *pkt)
 {
-    Encoder            *e = ost->enc;
     EncoderPriv       *ep = ep_from_enc(e);
+    Encoder       *leader = ep->chunk_leader ? ep->chunk_leader : e;
     AVCodecContext   *enc = e->enc_ctx;
     const char *type_desc = av_get_media_type_string(enc->codec_type);
     const char    *action = frame ? "encode" : "flush";
+    int64_t t0;
     int ret;
 
-    if (frame) {
-        FrameData *fd = frame_data(frame);
-
-        if (!fd)
-            return AVERROR(ENOMEM);
-
-        fd->wallclock[LATENCY_PROBE_ENC_PRE] = av_gettime_relative();
-
-        if (ost->enc_stats_pre.io)
-            enc_stats_write(ost, &ost->enc_stats_pre, frame, NULL,
-                            e->frames_encoded);
-
-        e->frames_encoded++;
-        e->samples_encoded += frame->nb_samples;
-
-        if (debug_ts) {
-            av_log(e, AV_LOG_INFO, "encoder <- type:%s "
-                   "frame_pts:%s frame_pts_time:%s time_base:%d/%d\n",
-                   type_desc,
-                   av_ts2str(frame->pts), av_ts2timestr(frame->pts, &enc->time_base),
-                   enc->time_base.num, enc->time_base.den);
-        }
-
-        if (frame->sample_aspect_ratio.num && !ost->frame_aspect_ratio.num)
-            enc->sample_aspect_ratio = frame->sample_aspect_ratio;
-    }
+    if (frame && frame->sample_aspect_ratio.num && !ost->frame_aspect_ratio.num)
+        enc->sample_aspect_ratio = frame->sample_aspect_ratio;
 
     update_benchmark(NULL);
 
+    t0 = profile_pipeline_file ? av_gettime_relative() : 0;
     ret = avcodec_send_frame(enc, frame);
+    if (profile_pipeline_file)
+        atomic_fetch_add(&e->encode_time, av_gettime_relative() - t0);
     if (ret < 0 && !(ret == AVERROR_EOF && !frame)) {
         av_log(e, AV_LOG_ERROR, "Error submitting %s frame to the encoder\n",
                type_desc);
@@ -742,7 +900,10 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame,
 
         av_packet_unref(pkt);
 
+        t0 = profile_pipeline_file ? av_gettime_relative() : 0;
         ret = avcodec_receive_packet(enc, pkt);
+        if (profile_pipeline_file)
+            atomic_fetch_add(&e->encode_time, av_gettime_relative() - t0);
         update_benchmark("%s_%s %d.%d", action, type_desc,
                          of->index, ost->index);
 
@@ -766,8 +927,10 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame,
             return AVERROR(ENOMEM);
         fd->wallclock[LATENCY_PROBE_ENC_POST] = av_gettime_relative();
 
-        // attach extradata to first packet if the encoder was reinitialized
-        if (!ep->got_first_packet && ep->packets_encoded && enc->extradata_size) {
+        // attach extradata to first packet if the encoder was reinitialized;
+        // chunk workers reopen the encoder with the same parameters
+        if (!ep->got_first_packet && ep->packets_encoded && enc->extradata_size &&
+            !ep->chunk_leader) {
             uint8_t *extradata = av_packet_new_side_data(pkt, AV_PKT_DATA_NEW_EXTRADATA,
                                                          enc->extradata_size);
             if (!extradata)
@@ -793,7 +956,7 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame,
         pkt->flags |= AV_PKT_FLAG_TRUSTED;
 
         if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
-            ret = update_video_stats(ost, pkt, !!vstats_filename);
+            ret = update_video_stats(ost, e, pkt, !!vstats_filename);
             if (ret < 0)
                 return ret;
         }
@@ -816,6 +979,14 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame,
 
         ep->packets_encoded++;
 
+        if (atomic_load(&ep_from_enc(leader)->subscribers_pending)) {
+            ret = subscribers_init(leader, pkt);
+            if (ret < 0) {
+                av_packet_unref(pkt);
+                return ret;
+            }
+        }
+
         ret = sch_enc_send(ep->sch, ep->sch_idx, pkt);
         if (ret < 0) {
             av_packet_unref(pkt);
@@ -875,9 +1046,33 @@ force_keyframe:
     return AV_PICTURE_TYPE_I;
 }
 
+static int enc_chunk_send(OutputStream *ost, AVFrame *frame)
+{
+    Encoder     *e = ost->enc;
+    EncoderPriv *ep = ep_from_enc(e);
+    int new_chunk;
+
+    if (frame->hw_frames_ctx) {
+        av_log(e, AV_LOG_ERROR,
+               "Hardware frames are not supported with chunked encoding\n");
+        return AVERROR(ENOSYS);
+    }
+
+    // chunks have a fixed length and start with a forced keyframe, like
+    // with -force_key_frames
+    new_chunk = ep->chunk_nb_frames >= ep->chunk_frames;
+    if (new_chunk)
+        ep->chunk_nb_frames = 0;
+    if (!ep->chunk_nb_frames++)
+        frame->pict_type = AV_PICTURE_TYPE_I;
+
+    return sch_enc_chunk_send(ep->sch, ep->sch_idx, frame, new_chunk);
+}
+
 static int frame_encode(OutputStream *ost, AVFrame *frame, AVPacket *pkt)
 {
     Encoder *e = ost->enc;
+    EncoderPriv *ep = ep_from_enc(e);
     OutputFile *of = ost->file;
     enum AVMediaType type = ost->type;
 
@@ -907,7 +1102,37 @@ static int frame_encode(OutputStream *ost, AVFrame *frame, AVPacket *pkt)
         }
     }
 
-    return encode_frame(of, ost, frame, pkt);
+    if (frame) {
+        AVCodecContext *enc = e->enc_ctx;
+        FrameData *fd = frame_data(frame);
+
+        if (!fd)
+            return AVERROR(ENOMEM);
+
+        fd->wallclock[LATENCY_PROBE_ENC_PRE] = av_gettime_relative();
+
+        if (ost->enc_stats_pre.io)
+            enc_stats_write(ost, &ost->enc_stats_pre, frame, NULL,
+                            e->frames_encoded);
+
+        e->frames_encoded++;
+        e->samples_encoded += frame->nb_samples;
+
+        if (debug_ts) {
+            av_log(e, AV_LOG_INFO, "encoder <- type:%s "
+                   "frame_pts:%s frame_pts_time:%s time_base:%d/%d\n",
+                   av_get_media_type_string(type),
+                   av_ts2str(frame->pts), av_ts2timestr(frame->pts, &enc->time_base),
+                   enc->time_base.num, enc->time_base.den);
+        }
+    }
+
+    // the chunk workers flush their encoders when the scheduler
+    // tells them that no more frames will arrive
+    if (ep->nb_chunk_workers)
+        return frame ? enc_chunk_send(ost, frame) : AVERROR_EOF;
+
+    return encode_frame(of, ost, e, frame, pkt);
 }
 
 static void enc_thread_set_name(const OutputStream *ost)
@@ -996,7 +1221,7 @@ static int reinit_encoder(OutputStream *ost, EncoderThread *et)
     if (ret < 0)
         goto end;
     av_log(e, AV_LOG_DEBUG, "Restarting encoder\n");
-    ret = enc_reopen(ost, et->frame, &copy);
+    ret = enc_reopen(ost, e, et->frame, &copy);
     if (ret < 0)
         goto end;
 
@@ -1089,12 +1314,152 @@ int encoder_thread(void *arg)
     if (ret == AVERROR_EOF)
         ret = 0;
 
+    // no packet was produced; the chunk workers do this when they finish
+    if (ret >= 0 && !ep->nb_chunk_workers)
+        ret = subscribers_init(e, NULL);
+
 finish:
     enc_thread_uninit(&et);
 
     return ret;
 }
 
+static int enc_chunk_finish(OutputStream *ost, Encoder *e, EncoderThread *et)
+{
+    EncoderPriv *ep = ep_from_enc(e);
+    int ret;
+
+    ret = encode_frame(ost->file, ost, e, NULL, et->pkt);
+    if (ret < 0 && ret != AVERROR_EOF) {
+        av_log(e, AV_LOG_ERROR, "Error flushing encoder: %s\n",
+               av_err2str(ret));
+        return ret;
+    }
+
+    ep->opened = 0;
+
+    return sch_enc_chunk_end(ep->sch, ep->sch_idx);
+}
+
+static int enc_chunk_thread(void *arg)
+{
+    Encoder        *e = arg;
+    EncoderPriv   *ep = ep_from_enc(e);
+    OutputStream *ost = ep->log_parent;
+    EncoderThread et;
+    int ret = 0, name_set = 0;
+
+    ret = enc_thread_init(&et);
+    if (ret < 0)
+        goto finish;
+
+    while (1) {
+        ret = sch_enc_receive(ep->sch, ep->sch_idx, et.frame);
+        if (ret == AVERROR_EOF) {
+            av_log(e, AV_LOG_VERBOSE, "Encoder thread received EOF\n");
+            ret = ep->opened ? enc_chunk_finish(ost, e, &et) : 0;
+            break;
+        } else if (ret < 0) {
+            av_log(e, AV_LOG_ERROR, "Error receiving a frame for encoding: %s\n",
+                   av_err2str(ret));
+            break;
+        }
+
+        // an empty frame finishes the current chunk
+        if (!et.frame->buf[0]) {
+            ret = enc_chunk_finish(ost, e, &et);
+            if (ret < 0)
+                break;
+            continue;
+        }
+
+        // every chunk is encoded by a newly opened encoder
+        if (!ep->opened) {
+            ret = enc_realloc(e, e->enc_ctx->codec);
+            if (ret < 0)
+                break;
+
+            ret = enc_reopen(ost, e, et.frame, NULL);
+            if (ret < 0)
+                break;
+        }
+
+        if (!name_set) {
+            enc_thread_set_name(ost);
+            name_set = 1;
+        }
+
+        ret = encode_frame(ost->file, ost, e, et.frame, et.pkt);
+
+        av_packet_unref(et.pkt);
+        av_frame_unref(et.frame);
+
+        if (ret < 0) {
+            av_log(e, AV_LOG_ERROR, "Error encoding a frame: %s\n",
+                   av_err2str(ret));
+            break;
+        }
+    }
+
+finish:
+    enc_thread_uninit(&et);
+
+    atomic_fetch_add(&ep->chunk_leader->encode_time, atomic_load(&e->encode_time));
+
+    if (atomic_fetch_add(&ep_from_enc(ep->chunk_leader)->chunk_workers_done, 1) + 1 ==
+        ep_from_enc(ep->chunk_leader)->nb_chunk_workers && ret >= 0)
+        ret = subscribers_init(ep->chunk_leader, NULL);
+
+    return ret;
+}
+
+int enc_chunks_init(Encoder *enc, int nb_workers, int chunk_frames)
+{
+    EncoderPriv *ep = ep_from_enc(enc);
+    const AVCodec *codec = enc->enc_ctx->codec;
+    int ret;
+
+    ep->chunk_frames = chunk_frames;
+
+    for (int i = 0; i < nb_workers; i++) {
+        EncoderPriv *wp;
+        Encoder *w;
+
+        ret = enc_alloc(&w, codec, ep->sch, 0, ep->log_parent);
+        if (ret < 0)
+            return ret;
+
+        ret = GROW_ARRAY(ep->chunk_workers, ep->nb_chunk_workers);
+        if (ret < 0) {
+            enc_free(&w);
+            return ret;
+        }
+        ep->chunk_workers[ep->nb_chunk_workers - 1] = w;
+
+        wp = ep_from_enc(w);
+        wp->chunk_leader = enc;
+        snprintf(wp->log_name, sizeof(wp->log_name), "enc:%s:w%d", codec->name, i);
+
+        // the same options are applied to every chunk encoder, like
+        // when reinitializing the encoder
+        ret = av_dict_copy(&w->encoder_opts, enc->encoder_opts, 0);
+        if (ret < 0)
+            return ret;
+        w->codec_tag      = enc->codec_tag;
+        w->flags          = enc->flags;
+        w->flags2         = enc->flags2;
+        w->global_quality = enc->global_quality;
+
+        ret = sch_add_enc_chunk(ep->sch, ep->sch_idx, enc_chunk_thread, w,
+                                chunk_frames);
+        if (ret < 0)
+            return ret;
+        wp->sch_idx = ret;
+    }
+
+    return 0;
+}
+
 int enc_loopback(Encoder *enc)
 {
     EncoderPriv *ep = ep_from_enc(enc);
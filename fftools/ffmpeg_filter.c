@@ -51,6 +51,10 @@ typedef struct FilterGraphPriv {
     // true when the filtergraph contains only meta filters
     // that do not modify the frame data
     int              is_meta;
+    // true when the filtergraph is a single input connected to a single
+    // output through filters that pass frames through unchanged; frames
+    // then bypass the graph entirely
+    int              passthrough;
     int              disable_conversions;
 
     unsigned         nb_outputs_done;
@@ -64,6 +68,12 @@ typedef struct FilterGraphPriv {
 
     Scheduler       *sch;
     unsigned         sch_idx;
+
+    // profiling data accumulated over all graph (re)configurations,
+    // the time is only measured with -profile_pipeline
+    int64_t          time;
+    uint64_t         nb_frames_in;
+    uint64_t         nb_frames_out;
 } FilterGraphPriv;
 
 static FilterGraphPriv *fgp_from_fg(FilterGraph *fg)
@@ -1197,6 +1207,7 @@ int fg_create(FilterGraph **pfg, char **graph_desc, Scheduler *sch,
 
     AVFilterInOut *inputs, *outputs;
     AVFilterGraph *graph;
+    int have_video = 0;
     int ret = 0;
 
     fgp = av_mallocz(sizeof(*fgp));
@@ -1328,6 +1339,12 @@ int fg_create(FilterGraph **pfg, char **graph_desc, Scheduler *sch,
         goto fail;
     fgp->sch_idx = ret;
 
+    // only video filters make use of slice threading
+    for (int i = 0; i < fg->nb_outputs; i++)
+        have_video |= fg->outputs[i]->type == AVMEDIA_TYPE_VIDEO;
+    sch_set_threadable(sch, SCH_FILTER_IN(fgp->sch_idx, 0),
+                       have_video && !filter_complex_nbthreads);
+
 fail:
     avfilter_inout_free(&inputs);
     avfilter_inout_free(&outputs);
@@ -1358,6 +1375,11 @@ int fg_create_simple(FilterGraph **pfg,
 
     fgp->is_simple = 1;
 
+    // a thread count set explicitly for this graph is not taken from the budget
+    sch_set_threadable(sch, SCH_FILTER_IN(fgp->sch_idx, 0),
+                       type == AVMEDIA_TYPE_VIDEO && !filter_nbthreads &&
+                       opts->nb_threads < 0);
+
     snprintf(fgp->log_name, sizeof(fgp->log_name), "%cf%s",
              av_get_media_type_string(type)[0], opts->name);
 
@@ -2121,8 +2143,20 @@ static int configure_input_filter(FilterGraph *fg, AVFilterGraph *graph,
     }
 }
 
+void fg_print_profile(FilterGraph *fg, AVBPrint *bp)
+{
+    const FilterGraphPriv *fgp = fgp_from_fg(fg);
+
+    av_bprintf(bp, "  { \"name\": \"%s\", \"simple\": %s, \"frames_in\": %"PRIu64
+               ", \"frames_out\": %"PRIu64", \"time_us\": %"PRId64" }",
+               fgp->log_name, fgp->is_simple ? "true" : "false",
+               fgp->nb_frames_in, fgp->nb_frames_out, fgp->time);
+}
+
 static void cleanup_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
 {
+    fgp_from_fg(fg)->passthrough = 0;
+
     for (int i = 0; i < fg->nb_outputs; i++)
         fg->outputs[i]->filter = NULL;
     for (int i = 0; i < fg->nb_inputs; i++)
@@ -2154,6 +2188,39 @@ static int graph_is_meta(AVFilterGraph *graph)
     return 1;
 }
 
+static int graph_is_passthrough(const FilterGraph *fg, AVFilterGraph *graph)
+{
+    static const char * const passthrough_filters[] = {
+        "buffer", "abuffer", "buffersink", "abuffersink",
+        "null", "anull", "format", "aformat",
+    };
+    const InputFilterPriv *ifp;
+
+    if (fg->nb_inputs != 1 || fg->nb_outputs != 1)
+        return 0;
+
+    // sub2video frames are generated by us and sent to the graph directly
+    ifp = ifp_from_ifilter(fg->inputs[0]);
+    if (ifp->type_src != fg->inputs[0]->type)
+        return 0;
+
+    /* anything else, including automatically inserted conversion filters,
+     * may modify the frames or their timing */
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        const char *name = graph->filters[i]->filter->name;
+        int found = 0;
+
+        for (int j = 0; j < FF_ARRAY_ELEMS(passthrough_filters); j++)
+            if (!strcmp(name, passthrough_filters[j])) {
+                found = 1;
+                break;
+            }
+        if (!found)
+            return 0;
+    }
+    return 1;
+}
+
 static int sub2video_frame(InputFilter *ifilter, AVFrame *frame, int buffer);
 
 static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
@@ -2162,7 +2229,7 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
     AVBufferRef *hw_device;
     AVFilterInOut *inputs, *outputs, *cur;
     int ret = AVERROR_BUG, i, simple = filtergraph_is_simple(fg);
-    int have_input_eof = 0;
+    int have_input_eof = 0, have_queued = 0;
     const char *graph_desc = fg->graph_desc;
 
     cleanup_filtergraph(fg, fgt);
@@ -2181,6 +2248,9 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
             ret = av_opt_set_int(fgt->graph, "threads", fgp->nb_threads, 0);
             if (ret < 0)
                 return ret;
+        } else {
+            fgt->graph->nb_threads = sch_get_thread_count(fgp->sch,
+                                                          SCH_FILTER_IN(fgp->sch_idx, 0));
         }
 
         if (av_dict_count(ofp->sws_opts)) {
@@ -2200,7 +2270,8 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
             av_free(args);
         }
     } else {
-        fgt->graph->nb_threads = filter_complex_nbthreads;
+        fgt->graph->nb_threads = filter_complex_nbthreads ? filter_complex_nbthreads :
+                                 sch_get_thread_count(fgp->sch, SCH_FILTER_IN(fgp->sch_idx, 0));
     }
 
     if (filter_buffered_frames) {
@@ -2300,6 +2371,7 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
                 ret = av_buffersrc_add_frame(ifilter->filter, tmp);
             }
             av_frame_free(&tmp);
+            have_queued = 1;
             if (ret < 0)
                 goto fail;
         }
@@ -2323,6 +2395,13 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
             goto fail;
     }
 
+    /* frames queued above are still inside the graph, bypassing it would
+     * reorder them with the following ones */
+    fgp->passthrough = !have_queued && !have_input_eof &&
+                       graph_is_passthrough(fg, fgt->graph);
+    if (fgp->passthrough)
+        av_log(fg, AV_LOG_VERBOSE, "Filtergraph is a no-op, passing frames through\n");
+
     return 0;
 fail:
     cleanup_filtergraph(fg, fgt);
@@ -2862,6 +2941,7 @@ static int fg_output_frame(OutputFilterPriv *ofp, FilterGraphThread *fgt,
 
             return ret == AVERROR_EOF ? 0 : ret;
         }
+        fgp->nb_frames_out++;
 
         if (type == AVMEDIA_TYPE_VIDEO) {
             ofp->fps.frame_number++;
@@ -2885,28 +2965,15 @@ static int fg_output_frame(OutputFilterPriv *ofp, FilterGraphThread *fgt,
     return 0;
 }
 
-static int fg_output_step(OutputFilterPriv *ofp, FilterGraphThread *fgt,
-                          AVFrame *frame)
+/* process a frame returned from the filtergraph output and send it on */
+static int fg_output_process(OutputFilterPriv *ofp, FilterGraphThread *fgt,
+                             AVFrame *frame)
 {
     FilterGraphPriv    *fgp = fgp_from_fg(ofp->ofilter.graph);
     AVFilterContext *filter = ofp->ofilter.filter;
     FrameData *fd;
     int ret;
 
-    ret = av_buffersink_get_frame_flags(filter, frame,
-                                        AV_BUFFERSINK_FLAG_NO_REQUEST);
-    if (ret == AVERROR_EOF && !fgt->eof_out[ofp->ofilter.index]) {
-        ret = fg_output_frame(ofp, fgt, NULL);
-        return (ret < 0) ? ret : 1;
-    } else if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-        return 1;
-    } else if (ret < 0) {
-        av_log(ofp, AV_LOG_WARNING,
-               "Error in retrieving a frame from the filtergraph: %s\n",
-               av_err2str(ret));
-        return ret;
-    }
-
     if (fgt->eof_out[ofp->ofilter.index]) {
         av_frame_unref(frame);
         return 0;
@@ -2970,6 +3037,34 @@ static int fg_output_step(OutputFilterPriv *ofp, FilterGraphThread *fgt,
     return 0;
 }
 
+static int fg_output_step(OutputFilterPriv *ofp, FilterGraphThread *fgt,
+                          AVFrame *frame)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(ofp->ofilter.graph);
+    AVFilterContext *filter = ofp->ofilter.filter;
+    int64_t t0;
+    int ret;
+
+    t0 = profile_pipeline_file ? av_gettime_relative() : 0;
+    ret = av_buffersink_get_frame_flags(filter, frame,
+                                        AV_BUFFERSINK_FLAG_NO_REQUEST);
+    if (profile_pipeline_file)
+        fgp->time += av_gettime_relative() - t0;
+    if (ret == AVERROR_EOF && !fgt->eof_out[ofp->ofilter.index]) {
+        ret = fg_output_frame(ofp, fgt, NULL);
+        return (ret < 0) ? ret : 1;
+    } else if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        return 1;
+    } else if (ret < 0) {
+        av_log(ofp, AV_LOG_WARNING,
+               "Error in retrieving a frame from the filtergraph: %s\n",
+               av_err2str(ret));
+        return ret;
+    }
+
+    return fg_output_process(ofp, fgt, frame);
+}
+
 /* retrieve all frames available at filtergraph outputs
  * and send them to consumers */
 static int read_frames(FilterGraph *fg, FilterGraphThread *fgt,
@@ -2995,6 +3090,7 @@ static int read_frames(FilterGraph *fg, FilterGraphThread *fgt,
     }
 
     if (fgp->nb_outputs_done < fg->nb_outputs) {
+        int64_t t0;
         int ret;
 
         /* Reap all buffers present in the buffer sinks */
@@ -3010,7 +3106,10 @@ static int read_frames(FilterGraph *fg, FilterGraphThread *fgt,
         }
 
 
+        t0 = profile_pipeline_file ? av_gettime_relative() : 0;
         ret = avfilter_graph_request_oldest(fgt->graph);
+        if (profile_pipeline_file)
+            fgp->time += av_gettime_relative() - t0;
         if (ret == AVERROR(EAGAIN)) {
             fgt->next_in = choose_input(fg, fgt);
             return 0;
@@ -3104,7 +3203,9 @@ static int sub2video_frame(InputFilter *ifilter, AVFrame *frame, int buffer)
 static int send_eof(FilterGraphThread *fgt, InputFilter *ifilter,
                     int64_t pts, AVRational tb)
 {
+    FilterGraphPriv *fgp = fgp_from_fg(ifilter->graph);
     InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
+    int64_t t0;
     int ret;
 
     if (fgt->eof_in[ifilter->index])
@@ -3116,7 +3217,10 @@ static int send_eof(FilterGraphThread *fgt, InputFilter *ifilter,
         pts = av_rescale_q_rnd(pts, tb, ifp->time_base,
                                AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
 
+        t0 = profile_pipeline_file ? av_gettime_relative() : 0;
         ret = av_buffersrc_close(ifilter->filter, pts, AV_BUFFERSRC_FLAG_PUSH);
+        if (profile_pipeline_file)
+            fgp->time += av_gettime_relative() - t0;
         if (ret < 0)
             return ret;
     } else {
@@ -3177,6 +3281,43 @@ static const char *unknown_if_null(const char *str)
     return str ? str : "unknown";
 }
 
+/* hand the frame directly to the graph output, doing what the buffer source
+ * would have done with it */
+static int send_frame_passthrough(FilterGraph *fg, FilterGraphThread *fgt,
+                                  AVFrame *frame)
+{
+    FilterGraphPriv  *fgp = fgp_from_fg(fg);
+    OutputFilterPriv *ofp = ofp_from_ofilter(fg->outputs[0]);
+    AVFilterContext *sink = ofp->ofilter.filter;
+    int ret;
+
+    switch (ofp->ofilter.type) {
+    case AVMEDIA_TYPE_VIDEO:
+        if (frame->colorspace == AVCOL_SPC_UNSPECIFIED)
+            frame->colorspace = av_buffersink_get_colorspace(sink);
+        if (frame->color_range == AVCOL_RANGE_UNSPECIFIED)
+            frame->color_range = av_buffersink_get_color_range(sink);
+        if (frame->alpha_mode == AVALPHA_MODE_UNSPECIFIED)
+            frame->alpha_mode = av_buffersink_get_alpha_mode(sink);
+        break;
+    case AVMEDIA_TYPE_AUDIO:
+        if (frame->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC &&
+            frame->ch_layout.nb_channels == av_buffersink_get_channels(sink)) {
+            av_channel_layout_uninit(&frame->ch_layout);
+            ret = av_buffersink_get_ch_layout(sink, &frame->ch_layout);
+            if (ret < 0) {
+                av_frame_unref(frame);
+                return ret;
+            }
+        }
+        break;
+    }
+
+    fgp->nb_frames_in++;
+
+    return fg_output_process(ofp, fgt, frame);
+}
+
 static int send_frame(FilterGraph *fg, FilterGraphThread *fgt,
                       InputFilter *ifilter, AVFrame *frame, int force_reinit)
 {
@@ -3184,6 +3325,7 @@ static int send_frame(FilterGraph *fg, FilterGraphThread *fgt,
     InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
     FrameData       *fd;
     AVFrameSideData *sd;
+    int64_t          t0;
     int need_reinit = 0, ret;
 
     /* determine if the parameters for this input changed */
@@ -3332,14 +3474,21 @@ static int send_frame(FilterGraph *fg, FilterGraphThread *fgt,
         return AVERROR(ENOMEM);
     fd->wallclock[LATENCY_PROBE_FILTER_PRE] = av_gettime_relative();
 
+    if (fgp->passthrough)
+        return send_frame_passthrough(fg, fgt, frame);
+
+    t0 = profile_pipeline_file ? av_gettime_relative() : 0;
     ret = av_buffersrc_add_frame_flags(ifilter->filter, frame,
                                        AV_BUFFERSRC_FLAG_PUSH);
+    if (profile_pipeline_file)
+        fgp->time += av_gettime_relative() - t0;
     if (ret < 0) {
         av_frame_unref(frame);
         if (ret != AVERROR_EOF)
             av_log(fg, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
         return ret;
     }
+    fgp->nb_frames_in++;
 
     return 0;
 }
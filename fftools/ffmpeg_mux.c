@@ -140,7 +140,7 @@ static int mux_fixup_ts(Muxer *mux, MuxStream *ms, AVPacket *pkt)
     OutputStream *ost = &ms->ost;
 
     // rescale timestamps to the stream timebase
-    if (ost->type == AVMEDIA_TYPE_AUDIO && !ost->enc) {
+    if (ost->type == AVMEDIA_TYPE_AUDIO && !ost->enc && !ost->enc_src) {
         // use av_rescale_delta() for streamcopying audio, to preserve
         // accuracy with coarse input timebases
         int duration = av_get_audio_frame_duration2(ost->st->codecpar, pkt->size);
@@ -228,7 +228,24 @@ static int write_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
     if (ms->stats.io)
         enc_stats_write(ost, &ms->stats, NULL, pkt, frame_num);
 
-    ret = av_interleaved_write_frame(s, pkt);
+    if (profile_pipeline_file) {
+        int64_t t0 = av_gettime_relative();
+
+        if (pkt->opaque_ref) {
+            const FrameData *fd = (FrameData*)pkt->opaque_ref->data;
+
+            for (int i = FF_ARRAY_ELEMS(fd->wallclock) - 1; i >= 0; i--) {
+                if (fd->wallclock[i] != INT64_MIN) {
+                    ms->interleave_wait += t0 - fd->wallclock[i];
+                    break;
+                }
+            }
+        }
+
+        ret = av_interleaved_write_frame(s, pkt);
+        ms->write_time += av_gettime_relative() - t0;
+    } else
+        ret = av_interleaved_write_frame(s, pkt);
     if (ret < 0) {
         av_log(ost, AV_LOG_ERROR,
                "Error submitting a packet to the muxer: %s\n",
@@ -287,7 +304,7 @@ static int mux_packet_filter(Muxer *mux, MuxThreadContext *mt,
     const char *err_msg;
     int ret;
 
-    if (pkt && !ost->enc) {
+    if (pkt && !ost->enc && !ost->enc_src) {
         ret = of_streamcopy(&mux->of, ost, pkt);
         if (ret == AVERROR(EAGAIN))
             return 0;
@@ -603,8 +620,9 @@ static int bsf_init(MuxStream *ms)
     return 0;
 }
 
-int of_stream_init(OutputFile *of, OutputStream *ost,
-                   const AVCodecContext *enc_ctx)
+static int stream_init(OutputFile *of, OutputStream *ost,
+                       const AVCodecContext *enc_ctx,
+                       const uint8_t *headers, int headers_size)
 {
     Muxer *mux = mux_from_of(of);
     MuxStream *ms = ms_from_ost(ost);
@@ -626,6 +644,14 @@ int of_stream_init(OutputFile *of, OutputStream *ost,
         }
     }
 
+    if (headers_size && !ms->par_in->extradata_size) {
+        ms->par_in->extradata = av_mallocz(headers_size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!ms->par_in->extradata)
+            return AVERROR(ENOMEM);
+        memcpy(ms->par_in->extradata, headers, headers_size);
+        ms->par_in->extradata_size = headers_size;
+    }
+
     /* initialize bitstream filters for the output stream
      * needs to be done here, because the codec id for streamcopy is not
      * known until now */
@@ -644,6 +670,71 @@ int of_stream_init(OutputFile *of, OutputStream *ost,
     return 0;
 }
 
+int of_stream_init(OutputFile *of, OutputStream *ost,
+                   const AVCodecContext *enc_ctx)
+{
+    return stream_init(of, ost, enc_ctx, NULL, 0);
+}
+
+/* Run the bitstream filter called name before the ones of the stream */
+static int bsf_prepend(MuxStream *ms, const char *name)
+{
+    const AVBitStreamFilter *filter = av_bsf_get_by_name(name);
+    AVBSFList *list;
+    AVBSFContext *ctx;
+    int ret;
+
+    if (!filter) {
+        av_log(ms, AV_LOG_ERROR, "The %s bitstream filter is needed, but "
+               "not available\n", name);
+        return AVERROR_BSF_NOT_FOUND;
+    }
+
+    list = av_bsf_list_alloc();
+    if (!list)
+        return AVERROR(ENOMEM);
+
+    ret = av_bsf_alloc(filter, &ctx);
+    if (ret < 0)
+        goto fail;
+    ret = av_bsf_list_append(list, ctx);
+    if (ret < 0) {
+        av_bsf_free(&ctx);
+        goto fail;
+    }
+
+    if (ms->bsf_ctx) {
+        ret = av_bsf_list_append(list, ms->bsf_ctx);
+        if (ret < 0)
+            goto fail;
+        ms->bsf_ctx = NULL;
+    }
+
+    return av_bsf_list_finalize(&list, &ms->bsf_ctx);
+fail:
+    av_bsf_list_free(&list);
+    return ret;
+}
+
+int of_stream_init_shared(OutputStream *ost, const AVCodecContext *enc_ctx,
+                          const uint8_t *headers, int headers_size)
+{
+    Muxer *mux = mux_from_of(ost->file);
+    MuxStream *ms = ms_from_ost(ost);
+    int ret;
+
+    // the headers a global-header encoder exports are not in its packets
+    if (enc_ctx->flags & AV_CODEC_FLAG_GLOBAL_HEADER && enc_ctx->extradata_size &&
+        !(mux->fc->oformat->flags & AVFMT_GLOBALHEADER) &&
+        ost->type == AVMEDIA_TYPE_VIDEO) {
+        ret = bsf_prepend(ms, "dump_extra");
+        if (ret < 0)
+            return ret;
+    }
+
+    return stream_init(ost->file, ost, enc_ctx, headers, headers_size);
+}
+
 static int check_written(OutputFile *of)
 {
     int64_t total_packets_written = 0;
@@ -749,6 +840,32 @@ static void mux_final_stats(Muxer *mux)
            overhead);
 }
 
+void of_print_profile(OutputFile *of, AVBPrint *bp)
+{
+    av_bprintf(bp, "  { \"index\": %d, \"url\": ", of->index);
+    bprint_json_string(bp, of->url);
+    av_bprintf(bp, ", \"streams\": [");
+
+    for (int i = 0; i < of->nb_streams; i++) {
+        OutputStream *ost = of->streams[i];
+        MuxStream     *ms = ms_from_ost(ost);
+        const AVCodecParameters *par = ost->st->codecpar;
+
+        av_bprintf(bp, "%s\n    { \"index\": %d, \"type\": \"%s\", \"codec\": \"%s\"",
+                   i ? "," : "", i, av_get_media_type_string(par->codec_type),
+                   avcodec_get_name(par->codec_id));
+        if (ost->enc)
+            av_bprintf(bp, ", \"frames_encoded\": %"PRIu64", \"encode_time_us\": %"PRId64,
+                       ost->enc->frames_encoded, (int64_t)atomic_load(&ost->enc->encode_time));
+        av_bprintf(bp, ", \"packets\": %"PRIu64", \"bytes\": %"PRIu64
+                   ", \"interleave_wait_us\": %"PRId64", \"write_time_us\": %"PRId64" }",
+                   atomic_load(&ost->packets_written), ms->data_size_mux,
+                   ms->interleave_wait, ms->write_time);
+    }
+
+    av_bprintf(bp, "\n  ] }");
+}
+
 int of_write_trailer(OutputFile *of)
 {
     Muxer *mux = mux_from_of(of);
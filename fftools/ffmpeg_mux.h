@@ -78,6 +78,13 @@ typedef struct MuxStream {
     // combined size of all the packets sent to the muxer
     uint64_t        data_size_mux;
 
+    // only measured when -profile_pipeline is used, in microseconds:
+    // time packets spent between leaving the previous stage (encoder or
+    // demuxer) and being submitted to the muxer
+    int64_t         interleave_wait;
+    // time spent in av_interleaved_write_frame()
+    int64_t         write_time;
+
     int             copy_initial_nonkeyframes;
     int             copy_prior_start;
     int             streamcopy_started;
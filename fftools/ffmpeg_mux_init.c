@@ -66,6 +66,23 @@ static int check_opt_bitexact(void *ctx, const AVDictionary *opts,
     return 0;
 }
 
+/* Check whether the mov muxer reserves space for the moov atom, which it
+ * estimates from the stream durations. */
+static int reserves_moov(const Muxer *mux)
+{
+    void *priv = mux->fc->priv_data;
+    const AVDictionaryEntry *e = av_dict_get(mux->opts, "movflags", NULL, 0);
+    const AVOption *o, *flag;
+    int val = 0;
+
+    if (!e || !priv ||
+        !(o    = av_opt_find(priv, "movflags", NULL, 0, 0)) ||
+        !(flag = av_opt_find(priv, "reserve_moov", "movflags", 0, 0)) ||
+        av_opt_eval_flags(priv, o, e->value, &val) < 0)
+        return 0;
+    return !!(val & flag->default_val.i64);
+}
+
 static int choose_encoder(const OptionsContext *o, AVFormatContext *s,
                           MuxStream *ms, const AVCodec **enc)
 {
@@ -593,6 +610,7 @@ static int new_stream_video(Muxer *mux, const OptionsContext *o,
         const char *intra_matrix = NULL, *inter_matrix = NULL;
         const char *chroma_intra_matrix = NULL;
         int do_pass = 0;
+        int enc_chunks = 0, enc_chunk_frames = 250;
         int i;
 
         opt_match_per_stream_str(ost, &o->frame_sizes, oc, st, &frame_size);
@@ -773,6 +791,26 @@ static int new_stream_video(Muxer *mux, const OptionsContext *o,
                 *vsync_method = VSYNC_VSCFR;
             }
         }
+
+        opt_match_per_stream_int(ost, &o->enc_chunks, oc, st, &enc_chunks);
+        opt_match_per_stream_int(ost, &o->enc_chunk_frames, oc, st, &enc_chunk_frames);
+        if (enc_chunks > 1) {
+            if (enc_chunk_frames <= 0) {
+                av_log(ost, AV_LOG_ERROR, "Invalid chunk length: %d\n",
+                       enc_chunk_frames);
+                return AVERROR(EINVAL);
+            }
+            if (do_pass || ost->enc_stats_post.io || vstats_filename ||
+                ost->enc->reinit_opts) {
+                av_log(ost, AV_LOG_ERROR, "Chunked encoding cannot be used with "
+                       "two-pass encoding, -stats_enc_post, -vstats or -reinit_opts\n");
+                return AVERROR(EINVAL);
+            }
+
+            ret = enc_chunks_init(ost->enc, enc_chunks, enc_chunk_frames);
+            if (ret < 0)
+                return ret;
+        }
     }
 
     return 0;
@@ -1384,6 +1422,11 @@ static int ost_add(Muxer *mux, const OptionsContext *o, enum AVMediaType type,
         // default to automatic thread count
         if (!threads_manual)
             ost->enc->enc_ctx->thread_count = 0;
+
+        sch_set_threadable(mux->sch, SCH_ENC(ms->sch_idx_enc), !threads_manual &&
+                           (enc->capabilities & (AV_CODEC_CAP_FRAME_THREADS |
+                                                 AV_CODEC_CAP_SLICE_THREADS |
+                                                 AV_CODEC_CAP_OTHER_THREADS)));
     } else {
         ret = filter_codec_opts(o->g->codec_opts, AV_CODEC_ID_NONE, oc, st,
                                 NULL, &encoder_opts,
@@ -1537,6 +1580,15 @@ static int ost_add(Muxer *mux, const OptionsContext *o, enum AVMediaType type,
     if (ost->ist && ost->ist->st->duration > 0) {
         ms->stream_duration    = ist->st->duration;
         ms->stream_duration_tb = ist->st->time_base;
+    } else if (ost->ist && ost->ist->file->ctx->duration > 0 && reserves_moov(mux)) {
+        ms->stream_duration    = ist->file->ctx->duration;
+        ms->stream_duration_tb = AV_TIME_BASE_Q;
+    }
+    // the space reserved for the moov is estimated from the hint
+    if (ms->stream_duration && mux->of.recording_time != INT64_MAX && reserves_moov(mux)) {
+        ms->stream_duration = FFMIN(ms->stream_duration,
+                                    av_rescale_q(mux->of.recording_time, AV_TIME_BASE_Q,
+                                                 ms->stream_duration_tb));
     }
 
     if (post)
@@ -1550,6 +1602,96 @@ fail:
     return ret;
 }
 
+static int ost_add_shared(Muxer *mux, const OptionsContext *o, OutputStream *src)
+{
+    AVFormatContext *oc = mux->fc;
+    MuxStream *ms_src = ms_from_ost(src);
+    MuxStream     *ms;
+    OutputStream *ost;
+    AVStream *st;
+    const char *bsfs = NULL;
+    int max_muxing_queue_size       = 128;
+    int muxing_queue_data_threshold = 50 * 1024 * 1024;
+    int ret;
+
+    st = avformat_new_stream(oc, NULL);
+    if (!st)
+        return AVERROR(ENOMEM);
+
+    ms  = mux_stream_alloc(mux, src->type);
+    if (!ms)
+        return AVERROR(ENOMEM);
+
+    ret = GROW_ARRAY(mux->sch_stream_idx, mux->nb_sch_stream_idx);
+    if (ret < 0)
+        return ret;
+
+    ret = sch_add_mux_stream(mux->sch, mux->sch_idx);
+    if (ret < 0)
+        return ret;
+
+    av_assert0(ret == mux->nb_sch_stream_idx - 1);
+    mux->sch_stream_idx[ret] = ms->ost.index;
+    ms->sch_idx              = ret;
+
+    ost = &ms->ost;
+
+    ms->par_in = avcodec_parameters_alloc();
+    ms->pkt    = av_packet_alloc();
+    if (!ms->par_in || !ms->pkt)
+        return AVERROR(ENOMEM);
+
+    ms->last_mux_dts = AV_NOPTS_VALUE;
+
+    ost->st         = st;
+    ost->enc_src    = src;
+    ost->bitexact   = src->bitexact;
+    ost->kf.ref_pts = AV_NOPTS_VALUE;
+    ms->par_in->codec_type   = src->type;
+    st->codecpar->codec_type = src->type;
+
+    av_strlcat(ms->log_name, "/shared", sizeof(ms->log_name));
+
+    av_log(ost, AV_LOG_VERBOSE, "Created %s stream from the encoder of "
+           "output stream %d:%d\n", av_get_media_type_string(src->type),
+           src->file->index, src->index);
+
+    // the source file is already set up, so its stream metadata is final
+    ret = av_dict_copy(&st->metadata, src->st->metadata, 0);
+    if (ret < 0)
+        return ret;
+
+    ms->max_frames = INT64_MAX;
+    opt_match_per_stream_int64(ost, &o->max_frames, oc, st, &ms->max_frames);
+
+    ms->copy_prior_start = -1;
+    opt_match_per_stream_str(ost, &o->bitstream_filters, oc, st, &bsfs);
+    if (bsfs && *bsfs) {
+        ret = av_bsf_list_parse_str(bsfs, &ms->bsf_ctx);
+        if (ret < 0) {
+            av_log(ost, AV_LOG_ERROR, "Error parsing bitstream filter sequence '%s': %s\n", bsfs, av_err2str(ret));
+            return ret;
+        }
+    }
+
+    opt_match_per_stream_int(ost, &o->max_muxing_queue_size, oc, st,
+                             &max_muxing_queue_size);
+    opt_match_per_stream_int(ost, &o->muxing_queue_data_threshold,
+                             oc, st, &muxing_queue_data_threshold);
+    sch_mux_stream_buffering(mux->sch, mux->sch_idx, ms->sch_idx,
+                             max_muxing_queue_size, muxing_queue_data_threshold);
+
+    ms->stream_duration    = ms_src->stream_duration;
+    ms->stream_duration_tb = ms_src->stream_duration_tb;
+
+    ret = enc_add_subscriber(src->enc, ost, oc->oformat->flags);
+    if (ret < 0)
+        return ret;
+
+    return sch_connect(mux->sch, SCH_ENC(ms_src->sch_idx_enc),
+                       SCH_MSTREAM(mux->sch_idx, ms->sch_idx));
+}
+
 static int map_auto_video(Muxer *mux, const OptionsContext *o)
 {
     AVFormatContext *oc = mux->fc;
@@ -1772,7 +1914,18 @@ static int map_manual(Muxer *mux, const OptionsContext *o, const StreamMap *map)
     if (map->disabled)
         return 0;
 
-    if (map->linklabel) {
+    if (map->enc_shared) {
+        OutputStream *src = output_files[map->file_index]->streams[map->stream_index];
+
+        if (!src->enc || ms_from_ost(src)->sch_idx_enc < 0) {
+            av_log(mux, AV_LOG_FATAL, "Output stream #%d:%d is not encoded, "
+                   "its encoder cannot be shared.\n",
+                   map->file_index, map->stream_index);
+            return AVERROR(EINVAL);
+        }
+
+        return ost_add_shared(mux, o, src);
+    } else if (map->linklabel) {
         FilterGraph *fg;
         OutputFilter *ofilter = NULL;
         int j, k;
@@ -3268,8 +3421,9 @@ static int set_dispositions(Muxer *mux, const OptionsContext *o)
 
         have_manual |= !!dispositions[i];
 
-        if (ost->ist) {
-            ost->st->disposition = ost->ist->st->disposition;
+        if (ost->ist || ost->enc_src) {
+            ost->st->disposition = ost->ist ? ost->ist->st->disposition :
+                                              ost->enc_src->st->disposition;
 
             if (ost->st->disposition & AV_DISPOSITION_DEFAULT)
                 have_default[ost->type + 1] = 1;
@@ -3560,6 +3714,12 @@ int of_open(const OptionsContext *o, const char *filename, Scheduler *sch)
     mux->sch     = sch;
     mux->sch_idx = err;
 
+    if (o->numa_node >= 0) {
+        err = sch_mux_set_numa_node(sch, mux->sch_idx, o->numa_node);
+        if (err < 0)
+            return err;
+    }
+
     /* create all output streams for this file */
     err = create_streams(mux, o);
     if (err < 0)
@@ -3649,7 +3809,7 @@ int of_open(const OptionsContext *o, const char *filename, Scheduler *sch)
     for (int i = 0; i < of->nb_streams; i++) {
         OutputStream *ost = of->streams[i];
 
-        if (!ost->enc) {
+        if (!ost->enc && !ost->enc_src) {
             err = of_stream_init(of, ost, NULL);
             if (err < 0)
                 return err;
@@ -77,12 +77,15 @@ int vstats_version = 2;
 int print_graphs = 0;
 char *print_graphs_file = NULL;
 char *print_graphs_format = NULL;
+char *sched_stats_file = NULL;
+char *profile_pipeline_file = NULL;
 int auto_conversion_filters = 1;
 int64_t stats_period = 500000;
 
 
 static int file_overwrite     = 0;
 static int no_file_overwrite  = 0;
+static int probe_nbthreads    = 1;
 int ignore_unknown_streams = 0;
 int copy_unknown_streams = 0;
 int recast_media = 0;
@@ -148,6 +151,7 @@ static void init_options(OptionsContext *o)
     o->input_sync_ref = -1;
     o->find_stream_info = 1;
     o->shortest_buf_duration = 10.f;
+    o->numa_node      = -1;
 }
 
 static int show_hwaccels(void *optctx, const char *opt, const char *arg)
@@ -621,7 +625,7 @@ static int opt_map(void *optctx, const char *opt, const char *arg)
             for (i = 0; i < o->nb_stream_maps; i++) {
                 m = &o->stream_maps[i];
                 if (file_idx == m->file_index &&
-                    !m->linklabel &&
+                    !m->linklabel && !m->enc_shared &&
                     m->stream_index >= 0 &&
                     m->stream_index < input_files[m->file_index]->nb_streams &&
                     stream_specifier_match(&ss,
@@ -676,6 +680,44 @@ fail:
     return ret;
 }
 
+static int opt_map_enc(void *optctx, const char *opt, const char *arg)
+{
+    OptionsContext *o = optctx;
+    StreamMap *m;
+    const OutputFile *of;
+    int file_idx, stream_idx, ret;
+    char *endptr;
+
+    file_idx = strtol(arg, &endptr, 0);
+    if (endptr == arg || *endptr != ':' ||
+        file_idx < 0 || file_idx >= nb_output_files) {
+        av_log(NULL, AV_LOG_FATAL, "Invalid output file index in '%s': "
+               "only the outputs preceding this one can be referenced.\n", arg);
+        return AVERROR(EINVAL);
+    }
+    of = output_files[file_idx];
+
+    arg = endptr + 1;
+    stream_idx = strtol(arg, &endptr, 0);
+    if (endptr == arg || *endptr || stream_idx < 0 || stream_idx >= of->nb_streams) {
+        av_log(NULL, AV_LOG_FATAL, "Invalid output stream index: %s.\n", arg);
+        return AVERROR(EINVAL);
+    }
+
+    ret = GROW_ARRAY(o->stream_maps, o->nb_stream_maps);
+    if (ret < 0)
+        return ret;
+
+    m = &o->stream_maps[o->nb_stream_maps - 1];
+
+    m->enc_shared   = 1;
+    m->file_index   = file_idx;
+    m->stream_index = stream_idx;
+    m->group_index  = -1;
+
+    return 0;
+}
+
 static int opt_attach(void *optctx, const char *opt, const char *arg)
 {
     OptionsContext *o = optctx;
@@ -696,6 +738,32 @@ static int opt_sdp_file(void *optctx, const char *opt, const char *arg)
     return sch_sdp_filename(go->sch, arg);
 }
 
+static int opt_sched_workers(void *optctx, const char *opt, const char *arg)
+{
+    GlobalOptionsContext *go = optctx;
+    double num;
+    int ret;
+
+    ret = parse_number(opt, arg, OPT_TYPE_INT, 0, INT_MAX, &num);
+    if (ret < 0)
+        return ret;
+
+    return sch_set_workers(go->sch, num);
+}
+
+static int opt_thread_budget(void *optctx, const char *opt, const char *arg)
+{
+    GlobalOptionsContext *go = optctx;
+    double num;
+    int ret;
+
+    ret = parse_number(opt, arg, OPT_TYPE_INT, 0, INT_MAX, &num);
+    if (ret < 0)
+        return ret;
+
+    return sch_set_thread_budget(go->sch, num);
+}
+
 #if CONFIG_VAAPI
 static int opt_vaapi_device(void *optctx, const char *opt, const char *arg)
 {
@@ -1421,6 +1489,44 @@ static int open_files(OptionGroupList *l, const char *inout, Scheduler *sch,
     return 0;
 }
 
+static int open_input_files(OptionGroupList *l, Scheduler *sch)
+{
+    OptionsContext *o;
+    int ret = 0;
+
+    if (probe_nbthreads <= 1 || l->nb_groups < 2)
+        return open_files(l, "input", sch, ifile_open);
+
+    /* all the option groups need to be parsed upfront, so that the inputs
+     * can be opened concurrently */
+    o = av_calloc(l->nb_groups, sizeof(*o));
+    if (!o)
+        return AVERROR(ENOMEM);
+
+    for (int i = 0; i < l->nb_groups; i++) {
+        init_options(&o[i]);
+        o[i].g = &l->groups[i];
+    }
+
+    for (int i = 0; i < l->nb_groups; i++) {
+        ret = parse_optgroup(&o[i], &l->groups[i], options);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Error parsing options for input file "
+                   "%s.\n", l->groups[i].arg);
+            goto finish;
+        }
+    }
+
+    ret = ifile_open_multi(o, l->nb_groups, sch, probe_nbthreads);
+
+finish:
+    for (int i = 0; i < l->nb_groups; i++)
+        uninit_options(&o[i]);
+    av_freep(&o);
+
+    return ret;
+}
+
 int ffmpeg_parse_options(int argc, char **argv, Scheduler *sch)
 {
     GlobalOptionsContext go = { .sch = sch };
@@ -1457,7 +1563,7 @@ int ffmpeg_parse_options(int argc, char **argv, Scheduler *sch)
     }
 
     /* open input files */
-    ret = open_files(&octx.groups[GROUP_INFILE], "input", sch, ifile_open);
+    ret = open_input_files(&octx.groups[GROUP_INFILE], sch);
     if (ret < 0) {
         errmsg = "opening input files";
         goto fail;
@@ -1586,6 +1692,10 @@ const OptionDef options[] = {
         { .func_arg = opt_map },
         "set input stream mapping",
         "[-]input_file_id[:stream_specifier][,sync_file_id[:stream_specifier]]" },
+    { "map_enc",                OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT | OPT_PERFILE | OPT_OUTPUT,
+        { .func_arg = opt_map_enc },
+        "share the encoder of an output stream of a preceding output file",
+        "output_file_id:stream_index" },
     { "map_metadata",           OPT_TYPE_STRING, OPT_SPEC | OPT_OUTPUT | OPT_EXPERT,
         { .off       = OFFSET(metadata_map) },
         "set metadata information of outfile from infile",
@@ -1699,6 +1809,9 @@ const OptionDef options[] = {
     { "shortest_buf_duration",  OPT_TYPE_FLOAT, OPT_EXPERT | OPT_OFFSET | OPT_OUTPUT,
         { .off = OFFSET(shortest_buf_duration) },
         "maximum buffering duration (in seconds) for the -shortest option" },
+    { "numa_node",              OPT_TYPE_INT, OPT_EXPERT | OPT_OFFSET | OPT_OUTPUT,
+        { .off = OFFSET(numa_node) },
+        "bind the processing chain of this output to a NUMA node", "node" },
     { "bitexact",               OPT_TYPE_BOOL, OPT_EXPERT | OPT_OFFSET | OPT_OUTPUT | OPT_INPUT,
         { .off = OFFSET(bitexact) },
         "bitexact mode" },
@@ -1761,6 +1874,15 @@ const OptionDef options[] = {
     { "filter_complex_threads", OPT_TYPE_INT, OPT_EXPERT,
         { &filter_complex_nbthreads },
         "number of threads for -filter_complex" },
+    { "probe_threads",       OPT_TYPE_INT, OPT_EXPERT,
+        { &probe_nbthreads },
+        "maximum number of input files opened and probed concurrently", "number" },
+    { "sched_workers",       OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_sched_workers },
+        "maximum number of simultaneously working decoders/filtergraphs/encoders", "number" },
+    { "thread_budget",       OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_thread_budget },
+        "total number of threads to split among decoders/filtergraphs/encoders", "number" },
     { "lavfi",               OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
         { .func_arg = opt_filter_complex },
         "create a complex filtergraph", "graph_description" },
@@ -1773,6 +1895,12 @@ const OptionDef options[] = {
     { "print_graphs_format", OPT_TYPE_STRING, 0,
         { &print_graphs_format },
       "set the output printing format (available formats are: default, compact, csv, flat, ini, json, xml, mermaid, mermaidhtml)", "format" },
+    { "sched_stats_file", OPT_TYPE_STRING, OPT_EXPERT,
+        { &sched_stats_file },
+        "write per-task scheduling statistics to the specified file as JSON", "filename" },
+    { "profile_pipeline", OPT_TYPE_STRING, OPT_EXPERT,
+        { &profile_pipeline_file },
+        "write per-stream and per-filter processing counters to the specified file as JSON", "filename" },
     { "auto_conversion_filters", OPT_TYPE_BOOL, OPT_EXPERT,
         { &auto_conversion_filters },
         "enable automatic conversion filters globally" },
@@ -1893,6 +2021,12 @@ const OptionDef options[] = {
     { "passlogfile",                OPT_TYPE_STRING, OPT_VIDEO | OPT_EXPERT | OPT_PERSTREAM | OPT_OUTPUT,
         { .off = OFFSET(passlogfiles) },
         "select two pass log file name prefix", "prefix" },
+    { "enc_chunks",                 OPT_TYPE_INT,    OPT_VIDEO | OPT_EXPERT | OPT_PERSTREAM | OPT_OUTPUT,
+        { .off = OFFSET(enc_chunks) },
+        "encode chunks of the stream concurrently with the given number of encoders", "number" },
+    { "enc_chunk_frames",           OPT_TYPE_INT,    OPT_VIDEO | OPT_EXPERT | OPT_PERSTREAM | OPT_OUTPUT,
+        { .off = OFFSET(enc_chunk_frames) },
+        "set the number of frames in a chunk for chunked encoding", "number" },
     { "vstats",                     OPT_TYPE_FUNC,   OPT_VIDEO | OPT_EXPERT,
         { .func_arg = opt_vstats },
         "dump video coding statistics to file" },
@@ -19,9 +19,22 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
+
+#if HAVE_PTHREAD_SETAFFINITY_NP
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+#include <sched.h>
+#endif
+
+#include <errno.h>
+#include <math.h>
 #include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 #include "cmdutils.h"
 #include "ffmpeg_sched.h"
@@ -32,6 +45,7 @@
 #include "libavcodec/packet.h"
 
 #include "libavutil/avassert.h"
+#include "libavutil/bprint.h"
 #include "libavutil/error.h"
 #include "libavutil/fifo.h"
 #include "libavutil/frame.h"
@@ -60,6 +74,39 @@ typedef struct SchWaiter {
     int                 choked_next;
 } SchWaiter;
 
+// number of bins in timing histograms
+#define SCH_HIST_BINS 32
+
+// SchTask.numa_node values other than a node index
+#define NUMA_NODE_NONE      -1
+// the task feeds outputs placed on different nodes
+#define NUMA_NODE_CONFLICT  -2
+
+enum SchTaskState {
+    SCH_TASK_STATE_WORK,
+    SCH_TASK_STATE_WAIT_INPUT,
+    SCH_TASK_STATE_WAIT_OUTPUT,
+    SCH_TASK_STATE_WAIT_WORKER,
+    // the task function returned, nothing more is recorded
+    SCH_TASK_STATE_NB,
+};
+
+static const char *const task_state_names[SCH_TASK_STATE_NB] = {
+    [SCH_TASK_STATE_WORK]           = "work",
+    [SCH_TASK_STATE_WAIT_INPUT]     = "wait_input",
+    [SCH_TASK_STATE_WAIT_OUTPUT]    = "wait_output",
+    [SCH_TASK_STATE_WAIT_WORKER]    = "wait_worker",
+};
+
+typedef struct SchHistogram {
+    // bin 0 counts durations under 1us, bin i>0 counts durations d
+    // with 2^(i-1)us <= d < 2^i us; the last bin also counts everything above
+    atomic_uint_least64_t bins[SCH_HIST_BINS];
+    atomic_uint_least64_t count;
+    atomic_uint_least64_t total;
+    atomic_uint_least64_t max;
+} SchHistogram;
+
 typedef struct SchTask {
     Scheduler          *parent;
     SchedulerNode       node;
@@ -69,6 +116,25 @@ typedef struct SchTask {
 
     pthread_t           thread;
     int                 thread_running;
+
+    // this task competes for a worker slot while running, see sch_set_workers()
+    int                 pooled;
+
+    // time spent in each state, only written by the task thread
+    // and only when Scheduler.stats_enabled is set
+    SchHistogram        hist[SCH_TASK_STATE_NB];
+    enum SchTaskState   state;
+    int64_t             state_start;
+
+    // this task takes part in splitting the thread budget,
+    // see sch_set_thread_budget()
+    int                 threadable;
+    // threads last assigned to the task from the budget,
+    // 0 if none yet, -1 once the task function returned
+    atomic_int          nb_threads;
+
+    // NUMA node the task thread is bound to, or one of NUMA_NODE_*
+    int                 numa_node;
 } SchTask;
 
 typedef struct SchDecOutput {
@@ -106,6 +172,43 @@ typedef struct SchSyncQueue {
     unsigned         nb_enc_idx;
 } SchSyncQueue;
 
+typedef struct SchEncChunkWorker {
+    unsigned            enc_idx;
+    // packets produced by the worker that cannot be sent downstream yet,
+    // a NULL entry marks the end of a chunk; protected by SchEncChunks.lock
+    AVFifo             *fifo;
+    // the worker task has finished; protected by SchEncChunks.lock
+    int                 finished;
+} SchEncChunkWorker;
+
+// state shared between an encoder and its chunk workers
+typedef struct SchEncChunks {
+    pthread_mutex_t     lock;
+    // signalled when packets are removed from the worker FIFOs or the
+    // sender changes
+    pthread_cond_t      cond;
+
+    SchEncChunkWorker  *workers;
+    unsigned         nb_workers;
+    unsigned            queue_size;
+
+    // worker receiving the current chunk, only accessed by the encoder task
+    unsigned            cur_in;
+    int                 started;
+    // empty frame sent to a worker to finish its chunk
+    AVFrame            *chunk_end;
+
+    // the following fields are protected by lock
+    // worker whose chunk is currently being sent downstream
+    unsigned            cur_out;
+    // a worker is forwarding packets downstream; enc_send() is called without
+    // holding the lock, so this keeps the packets in order
+    int                 sending;
+    // error returned by enc_send(), reported to all the workers
+    int                 err;
+    unsigned            nb_done;
+} SchEncChunks;
+
 typedef struct SchEnc {
     const AVClass      *class;
 
@@ -145,6 +248,13 @@ typedef struct SchEnc {
 
     // temporary storage used by sch_enc_send()
     AVPacket           *send_pkt;
+
+    // non-NULL for encoders with chunk workers
+    SchEncChunks       *chunks;
+    // for chunk workers, index of the encoder they work for and position of
+    // the worker in SchEncChunks.workers; chunk_leader is -1 otherwise
+    int                 chunk_leader;
+    unsigned            chunk_pos;
 } SchEnc;
 
 typedef struct SchDemuxStream {
@@ -309,6 +419,19 @@ struct Scheduler {
     pthread_mutex_t     schedule_lock;
 
     atomic_int_least64_t last_dts;
+
+    // maximum number of pooled tasks allowed to run simultaneously,
+    // 0 means no limit
+    unsigned            nb_workers;
+    unsigned            nb_workers_busy;
+    pthread_mutex_t     workers_lock;
+    pthread_cond_t      workers_cond;
+
+    int                 stats_enabled;
+
+    // total number of threads to split among decoders, filtergraphs and
+    // encoders, 0 if not limited
+    unsigned            thread_budget;
 };
 
 /**
@@ -369,8 +492,105 @@ static void waiter_uninit(SchWaiter *w)
     pthread_cond_destroy(&w->cond);
 }
 
+/**
+ * Wait until a worker slot is available for the task and claim it.
+ */
+static void worker_acquire(Scheduler *sch, SchTask *task)
+{
+    if (!sch->nb_workers || !task->pooled)
+        return;
+
+    pthread_mutex_lock(&sch->workers_lock);
+
+    while (sch->nb_workers_busy >= sch->nb_workers)
+        pthread_cond_wait(&sch->workers_cond, &sch->workers_lock);
+    sch->nb_workers_busy++;
+
+    pthread_mutex_unlock(&sch->workers_lock);
+}
+
+/**
+ * Give up the worker slot held by the task, e.g. before it may block waiting
+ * for its upstream or downstream.
+ */
+static void worker_release(Scheduler *sch, SchTask *task)
+{
+    if (!sch->nb_workers || !task->pooled)
+        return;
+
+    pthread_mutex_lock(&sch->workers_lock);
+
+    av_assert0(sch->nb_workers_busy > 0);
+    sch->nb_workers_busy--;
+    pthread_cond_signal(&sch->workers_cond);
+
+    pthread_mutex_unlock(&sch->workers_lock);
+}
+
+static void hist_add(SchHistogram *h, int64_t duration)
+{
+    uint64_t d   = FFMAX(duration, 0);
+    unsigned bin = d ? FFMIN(av_log2(FFMIN(d, UINT32_MAX)) + 1, SCH_HIST_BINS - 1) : 0;
+
+    // histograms only have a single writer, so a plain load+store is enough;
+    // atomics make reading them from another thread safe
+#define HIST_ADD(field, val)                                                   \
+    atomic_store_explicit(&(field), atomic_load_explicit(&(field),             \
+                          memory_order_relaxed) + (val), memory_order_relaxed)
+
+    HIST_ADD(h->bins[bin], 1);
+    HIST_ADD(h->count,     1);
+    HIST_ADD(h->total,     d);
+    if (d > atomic_load_explicit(&h->max, memory_order_relaxed))
+        atomic_store_explicit(&h->max, d, memory_order_relaxed);
+
+#undef HIST_ADD
+}
+
+static void task_state_set(Scheduler *sch, SchTask *task, enum SchTaskState state)
+{
+    int64_t now;
+
+    if (!sch->stats_enabled)
+        return;
+
+    now = av_gettime_relative();
+
+    if (task->state_start && task->state < SCH_TASK_STATE_NB)
+        hist_add(&task->hist[task->state], now - task->state_start);
+
+    task->state       = state;
+    task->state_start = now;
+}
+
+/**
+ * Called by a task before it enters a scheduler function that may block.
+ */
+static void task_sched_enter(Scheduler *sch, SchTask *task, enum SchTaskState wait)
+{
+    task_state_set(sch, task, wait);
+    worker_release(sch, task);
+}
+
+/**
+ * Called by a task when returning from a scheduler function back to its own
+ * processing.
+ */
+static void task_sched_leave(Scheduler *sch, SchTask *task)
+{
+    if (sch->nb_workers && task->pooled) {
+        task_state_set(sch, task, SCH_TASK_STATE_WAIT_WORKER);
+        worker_acquire(sch, task);
+    }
+    task_state_set(sch, task, SCH_TASK_STATE_WORK);
+}
+
+/**
+ * @param spsc the queue has a single producer and a single consumer, see
+ *             THREAD_QUEUE_ALLOC_SPSC
+ */
 static int queue_alloc(ThreadQueue **ptq, unsigned nb_streams, unsigned queue_size,
-                       enum QueueType type)
+                       enum QueueType type, int spsc)
 {
     ThreadQueue *tq;
 
@@ -391,7 +611,8 @@ static int queue_alloc(ThreadQueue **ptq, unsigned nb_streams, unsigned queue_si
     }
 
     tq = tq_alloc(nb_streams, queue_size,
-                  (type == QUEUE_PACKETS) ? THREAD_QUEUE_PACKETS : THREAD_QUEUE_FRAMES);
+                  (type == QUEUE_PACKETS) ? THREAD_QUEUE_PACKETS : THREAD_QUEUE_FRAMES,
+                  spsc ? THREAD_QUEUE_ALLOC_SPSC : 0);
     if (!tq)
         return AVERROR(ENOMEM);
 
@@ -433,6 +654,8 @@ static void task_init(Scheduler *sch, SchTask *task, enum SchedulerNodeType type
 
     task->func      = func;
     task->func_arg  = func_arg;
+
+    task->numa_node = NUMA_NODE_NONE;
 }
 
 static int64_t trailing_dts(const Scheduler *sch)
@@ -571,6 +794,27 @@ void sch_free(Scheduler **psch)
 
         av_freep(&enc->dst);
         av_freep(&enc->dst_finished);
+
+        if (enc->chunks) {
+            SchEncChunks *c = enc->chunks;
+
+            for (unsigned j = 0; j < c->nb_workers; j++) {
+                SchEncChunkWorker *cw = &c->workers[j];
+                AVPacket *pkt;
+
+                if (!cw->fifo)
+                    continue;
+
+                while (av_fifo_read(cw->fifo, &pkt, 1) >= 0)
+                    av_packet_free(&pkt);
+                av_fifo_freep2(&cw->fifo);
+            }
+            av_freep(&c->workers);
+            av_frame_free(&c->chunk_end);
+            pthread_cond_destroy(&c->cond);
+            pthread_mutex_destroy(&c->lock);
+            av_freep(&enc->chunks);
+        }
     }
     av_freep(&sch->enc);
 
@@ -604,6 +848,9 @@ void sch_free(Scheduler **psch)
     pthread_mutex_destroy(&sch->finish_lock);
     pthread_cond_destroy(&sch->finish_cond);
 
+    pthread_mutex_destroy(&sch->workers_lock);
+    pthread_cond_destroy(&sch->workers_cond);
+
     av_freep(psch);
 }
 
@@ -640,12 +887,142 @@ Scheduler *sch_alloc(void)
     if (ret)
         goto fail;
 
+    ret = pthread_mutex_init(&sch->workers_lock, NULL);
+    if (ret)
+        goto fail;
+
+    ret = pthread_cond_init(&sch->workers_cond, NULL);
+    if (ret)
+        goto fail;
+
     return sch;
 fail:
     sch_free(&sch);
     return NULL;
 }
 
+int sch_set_workers(Scheduler *sch, unsigned nb_workers)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+    sch->nb_workers = nb_workers;
+    return 0;
+}
+
+void sch_enable_stats(Scheduler *sch)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+    sch->stats_enabled = 1;
+}
+
+int sch_set_thread_budget(Scheduler *sch, unsigned nb_threads)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+    sch->thread_budget = nb_threads;
+    // the budget is split according to the measured load
+    if (nb_threads)
+        sch->stats_enabled = 1;
+    return 0;
+}
+
+static SchTask *task_from_node(Scheduler *sch, SchedulerNode node)
+{
+    switch (node.type) {
+    case SCH_NODE_TYPE_DEMUX:       return &sch->demux[node.idx].task;
+    case SCH_NODE_TYPE_MUX:         return &sch->mux[node.idx].task;
+    case SCH_NODE_TYPE_DEC:         return &sch->dec[node.idx].task;
+    case SCH_NODE_TYPE_ENC:         return &sch->enc[node.idx].task;
+    case SCH_NODE_TYPE_FILTER_IN:
+    case SCH_NODE_TYPE_FILTER_OUT:  return &sch->filters[node.idx].task;
+    default: av_unreachable("Invalid node type?");
+    }
+}
+
+void sch_set_threadable(Scheduler *sch, SchedulerNode node, int threadable)
+{
+    task_from_node(sch, node)->threadable = threadable;
+}
+
+// do not trust load measurements taken over less than this time
+#define THREAD_DEMAND_MIN_US 100000
+
+/**
+ * Estimate how many threads the task would keep busy, from its current thread
+ * count and the fraction of time it spent working rather than waiting for its
+ * neighbours.
+ *
+ * @return the estimate, or a negative value if nothing was measured yet
+ */
+static double task_thread_demand(const SchTask *task)
+{
+    const int nb_threads = atomic_load(&task->nb_threads);
+    uint64_t work, total = 0;
+
+    for (int i = 0; i < SCH_TASK_STATE_NB; i++)
+        total += atomic_load_explicit(&task->hist[i].total, memory_order_relaxed);
+    work = atomic_load_explicit(&task->hist[SCH_TASK_STATE_WORK].total,
+                                memory_order_relaxed);
+
+    if (nb_threads <= 0 || total < THREAD_DEMAND_MIN_US)
+        return -1.0;
+
+    return FFMAX((double)work / total, 0.05) * nb_threads;
+}
+
+static void thread_demand_add(const SchTask *task, double *demand_known,
+                              unsigned *nb_known, unsigned *nb_unknown)
+{
+    double demand;
+
+    // skip removed filtergraphs and tasks that are done
+    if (!task->parent || !task->threadable || atomic_load(&task->nb_threads) < 0)
+        return;
+
+    demand = task_thread_demand(task);
+    if (demand < 0.0) {
+        (*nb_unknown)++;
+    } else {
+        *demand_known += demand;
+        (*nb_known)++;
+    }
+}
+
+int sch_get_thread_count(Scheduler *sch, SchedulerNode node)
+{
+    SchTask *task = task_from_node(sch, node);
+    double demand_known = 0.0, demand_avg, demand;
+    unsigned nb_known = 0, nb_unknown = 0;
+    int nb_threads = 1;
+
+    if (!sch->thread_budget)
+        return 0;
+    if (!task->threadable)
+        goto finish;
+
+    for (unsigned i = 0; i < sch->nb_dec; i++)
+        thread_demand_add(&sch->dec[i].task, &demand_known, &nb_known, &nb_unknown);
+    for (unsigned i = 0; i < sch->nb_enc; i++)
+        thread_demand_add(&sch->enc[i].task, &demand_known, &nb_known, &nb_unknown);
+    for (unsigned i = 0; i < sch->nb_filters; i++)
+        thread_demand_add(&sch->filters[i].task, &demand_known, &nb_known, &nb_unknown);
+
+    // components that have not been measured yet are assumed to be as
+    // demanding as the average measured one
+    demand_avg = nb_known ? demand_known / nb_known : 1.0;
+    demand     = task_thread_demand(task);
+    if (demand < 0.0)
+        demand = demand_avg;
+
+    nb_threads = lrint(sch->thread_budget * demand /
+                       (demand_known + nb_unknown * demand_avg));
+    nb_threads = av_clip(nb_threads, 1, sch->thread_budget);
+
+finish:
+    av_log(task->func_arg, AV_LOG_VERBOSE,
+           "Using %d thread(s) out of a budget of %u\n", nb_threads, sch->thread_budget);
+    atomic_store(&task->nb_threads, nb_threads);
+    return nb_threads;
+}
+
 int sch_sdp_filename(Scheduler *sch, const char *sdp_filename)
 {
     av_freep(&sch->sdp_filename);
@@ -683,6 +1060,18 @@ int sch_add_mux(Scheduler *sch, SchThreadFunc func, int (*init)(void *),
     return idx;
 }
 
+int sch_mux_set_numa_node(Scheduler *sch, unsigned mux_idx, unsigned numa_node)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+    av_assert0(mux_idx < sch->nb_mux);
+
+    if (numa_node > INT_MAX)
+        return AVERROR(EINVAL);
+
+    sch->mux[mux_idx].task.numa_node = numa_node;
+    return 0;
+}
+
 int sch_add_mux_stream(Scheduler *sch, unsigned mux_idx)
 {
     SchMux       *mux;
@@ -789,6 +1178,8 @@ int sch_add_dec(Scheduler *sch, SchThreadFunc func, void *ctx, int send_end_ts)
     dec = &sch->dec[idx];
 
     task_init(sch, &dec->task, SCH_NODE_TYPE_DEC, idx, func, ctx);
+    dec->task.pooled = 1;
+    dec->task.threadable = 1;
 
     dec->class      = &sch_dec_class;
     dec->send_frame = av_frame_alloc();
@@ -799,10 +1190,6 @@ int sch_add_dec(Scheduler *sch, SchThreadFunc func, void *ctx, int send_end_ts)
     if (ret < 0)
         return ret;
 
-    ret = queue_alloc(&dec->queue, 1, 0, QUEUE_PACKETS);
-    if (ret < 0)
-        return ret;
-
     if (send_end_ts) {
         ret = av_thread_message_queue_alloc(&dec->queue_end_ts, 1, sizeof(Timestamp));
         if (ret < 0)
@@ -836,16 +1223,100 @@ int sch_add_enc(Scheduler *sch, SchThreadFunc func, void *ctx,
     enc->open_cb    = open_cb;
     enc->sq_idx[0]  = -1;
     enc->sq_idx[1]  = -1;
+    enc->chunk_leader = -1;
 
     task_init(sch, &enc->task, SCH_NODE_TYPE_ENC, idx, func, ctx);
+    enc->task.pooled = 1;
+    enc->task.threadable = 1;
 
     enc->send_pkt = av_packet_alloc();
     if (!enc->send_pkt)
         return AVERROR(ENOMEM);
 
-    ret = queue_alloc(&enc->queue, 1, 0, QUEUE_FRAMES);
+    return idx;
+}
+
+static int enc_chunks_alloc(SchEnc *enc, unsigned queue_size)
+{
+    SchEncChunks *c;
+    int ret;
+
+    c = av_mallocz(sizeof(*c));
+    if (!c)
+        return AVERROR(ENOMEM);
+
+    c->chunk_end = av_frame_alloc();
+    if (!c->chunk_end) {
+        av_freep(&c);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = pthread_mutex_init(&c->lock, NULL);
+    if (ret) {
+        av_frame_free(&c->chunk_end);
+        av_freep(&c);
+        return AVERROR(ret);
+    }
+
+    ret = pthread_cond_init(&c->cond, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&c->lock);
+        av_frame_free(&c->chunk_end);
+        av_freep(&c);
+        return AVERROR(ret);
+    }
+
+    c->queue_size = queue_size;
+    enc->chunks   = c;
+
+    return 0;
+}
+
+int sch_add_enc_chunk(Scheduler *sch, unsigned enc_idx, SchThreadFunc func,
+                      void *ctx, unsigned queue_size)
+{
+    SchEncChunkWorker *cw;
+    SchEncChunks *c;
+    SchEnc *enc, *w;
+    int ret, idx;
+
+    av_assert0(enc_idx < sch->nb_enc);
+    enc = &sch->enc[enc_idx];
+    av_assert0(enc->chunk_leader < 0 && queue_size > 0);
+
+    if (!enc->chunks) {
+        ret = enc_chunks_alloc(enc, queue_size);
+        if (ret < 0)
+            return ret;
+    }
+    c = enc->chunks;
+
+    ret = GROW_ARRAY(c->workers, c->nb_workers);
     if (ret < 0)
         return ret;
+    cw = &c->workers[c->nb_workers - 1];
+
+    cw->fifo = av_fifo_alloc2(8, sizeof(AVPacket*), AV_FIFO_FLAG_AUTO_GROW);
+    if (!cw->fifo)
+        return AVERROR(ENOMEM);
+
+    idx = sch_add_enc(sch, func, ctx, NULL);
+    if (idx < 0)
+        return idx;
+    // sch_add_enc() may have reallocated the array
+    enc = &sch->enc[enc_idx];
+    w   = &sch->enc[idx];
+
+    cw->enc_idx = idx;
+
+    w->chunk_leader = enc_idx;
+    w->chunk_pos    = c->nb_workers - 1;
+    // used when tracing the graph upstream
+    w->src          = SCH_ENC(enc_idx);
+
+    // the encoder task only splits the input, the workers do the encoding
+    w->task.threadable   = enc->task.threadable;
+    enc->task.threadable = 0;
 
     return idx;
 }
@@ -872,6 +1343,8 @@ int sch_add_filtergraph(Scheduler *sch, unsigned nb_inputs, unsigned nb_outputs,
     fg->class = &sch_fg_class;
 
     task_init(sch, &fg->task, SCH_NODE_TYPE_FILTER_IN, idx, func, ctx);
+    fg->task.pooled = 1;
+    fg->task.threadable = 1;
 
     if (nb_inputs) {
         fg->inputs = av_calloc(nb_inputs, sizeof(*fg->inputs));
@@ -891,7 +1364,7 @@ int sch_add_filtergraph(Scheduler *sch, unsigned nb_inputs, unsigned nb_outputs,
     if (ret < 0)
         return ret;
 
-    ret = queue_alloc(&fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES);
+    ret = queue_alloc(&fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES, 0);
     if (ret < 0)
         return ret;
 
@@ -1622,6 +2095,127 @@ fail:
     return ret;
 }
 
+static int dec_is_heartbeat_dst(const Scheduler *sch, unsigned dec_idx)
+{
+    for (unsigned i = 0; i < sch->nb_mux; i++) {
+        const SchMux *mux = &sch->mux[i];
+
+        for (unsigned j = 0; j < mux->nb_streams; j++) {
+            const SchMuxStream *ms = &mux->streams[j];
+
+            for (unsigned k = 0; k < ms->nb_sub_heartbeat_dst; k++)
+                if (ms->sub_heartbeat_dst[k] == dec_idx)
+                    return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Place the task producing src and everything upstream of it, up to the
+ * demuxers, on the given NUMA node.
+ */
+static void numa_node_propagate(Scheduler *sch, SchedulerNode src, int numa_node)
+{
+    SchTask *task;
+
+    if (src.type == SCH_NODE_TYPE_DEMUX)
+        return;
+
+    task = task_from_node(sch, src);
+    if (task->numa_node == numa_node || task->numa_node == NUMA_NODE_CONFLICT)
+        return;
+    task->numa_node = task->numa_node == NUMA_NODE_NONE ? numa_node :
+                                                          NUMA_NODE_CONFLICT;
+
+    switch (src.type) {
+    case SCH_NODE_TYPE_DEC:
+        numa_node_propagate(sch, sch->dec[src.idx].src, task->numa_node);
+        break;
+    case SCH_NODE_TYPE_ENC: {
+        SchEnc *enc = &sch->enc[src.idx];
+
+        numa_node_propagate(sch, enc->src, task->numa_node);
+
+        // the chunk workers do the actual encoding
+        for (unsigned i = 0; enc->chunks && i < enc->chunks->nb_workers; i++)
+            numa_node_propagate(sch, SCH_ENC(enc->chunks->workers[i].enc_idx),
+                                task->numa_node);
+        break;
+    }
+    case SCH_NODE_TYPE_FILTER_OUT: {
+        SchFilterGraph *fg = &sch->filters[src.idx];
+        for (unsigned i = 0; i < fg->nb_inputs; i++)
+            numa_node_propagate(sch, fg->inputs[i].src, task->numa_node);
+        break;
+    }
+    default:
+        av_unreachable("Invalid source node type?");
+    }
+}
+
+#if HAVE_PTHREAD_SETAFFINITY_NP && defined(CPU_SET)
+/**
+ * Read the set of CPUs belonging to a NUMA node from sysfs, where it is
+ * stored as a list of ranges, e.g. "0-15,32-47".
+ */
+static int numa_node_cpus(int numa_node, cpu_set_t *cpus)
+{
+    char path[64], list[1024];
+    const char *p = list;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", numa_node);
+    f = fopen(path, "r");
+    if (!f)
+        return AVERROR(errno);
+    p = fgets(list, sizeof(list), f);
+    fclose(f);
+    if (!p)
+        return AVERROR(EIO);
+
+    CPU_ZERO(cpus);
+    while (*p >= '0' && *p <= '9') {
+        char *end;
+        long first = strtol(p, &end, 10), last = first;
+
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, cpus);
+
+        p = end + (*end == ',');
+    }
+
+    return CPU_COUNT(cpus) ? 0 : AVERROR(EINVAL);
+}
+#endif
+
+static void task_bind_numa_node(SchTask *task)
+{
+#if HAVE_PTHREAD_SETAFFINITY_NP && defined(CPU_SET)
+    cpu_set_t cpus;
+    int ret;
+
+    ret = numa_node_cpus(task->numa_node, &cpus);
+    if (ret >= 0)
+        ret = AVERROR(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus));
+    if (ret < 0) {
+        av_log(task->func_arg, AV_LOG_WARNING,
+               "Could not bind thread to NUMA node %d: %s\n",
+               task->numa_node, av_err2str(ret));
+        return;
+    }
+
+    av_log(task->func_arg, AV_LOG_VERBOSE, "Bound to the %d CPUs of NUMA node %d\n",
+           CPU_COUNT(&cpus), task->numa_node);
+#else
+    av_log(task->func_arg, AV_LOG_WARNING,
+           "Binding threads to NUMA nodes is not supported on this system\n");
+#endif
+}
+
 static int start_prepare(Scheduler *sch)
 {
     int ret;
@@ -1666,11 +2260,32 @@ static int start_prepare(Scheduler *sch)
             if (!o->dst_finished)
                 return AVERROR(ENOMEM);
         }
+
+        // muxers sending subtitle heartbeats are additional producers
+        ret = queue_alloc(&dec->queue, 1, 0, QUEUE_PACKETS,
+                          !dec_is_heartbeat_dst(sch, i));
+        if (ret < 0)
+            return ret;
     }
 
     for (unsigned i = 0; i < sch->nb_enc; i++) {
         SchEnc *enc = &sch->enc[i];
 
+        // chunk workers are fed by and send their output through
+        // the encoder they work for
+        if (enc->chunk_leader >= 0) {
+            const SchEncChunks *c = sch->enc[enc->chunk_leader].chunks;
+
+            // a worker queue holds a whole chunk and the frame finishing it;
+            // this bypasses the queue size limit in queue_alloc(), which is
+            // fine since hardware frames are never sent to workers
+            enc->queue = tq_alloc(1, c->queue_size + 1, THREAD_QUEUE_FRAMES,
+                                  THREAD_QUEUE_ALLOC_SPSC);
+            if (!enc->queue)
+                return AVERROR(ENOMEM);
+            continue;
+        }
+
         if (!enc->src.type) {
             av_log(enc, AV_LOG_ERROR,
                    "Encoder not connected to a source\n");
@@ -1685,6 +2300,12 @@ static int start_prepare(Scheduler *sch)
         enc->dst_finished = av_calloc(enc->nb_dst, sizeof(*enc->dst_finished));
         if (!enc->dst_finished)
             return AVERROR(ENOMEM);
+
+        // encoders fed through a sync queue may receive frames from any
+        // thread sending to that sync queue
+        ret = queue_alloc(&enc->queue, 1, 0, QUEUE_FRAMES, enc->sq_idx[0] < 0);
+        if (ret < 0)
+            return ret;
     }
 
     for (unsigned i = 0; i < sch->nb_mux; i++) {
@@ -1700,8 +2321,12 @@ static int start_prepare(Scheduler *sch)
             }
         }
 
+        // packets for a single-stream muxer come from a single thread -
+        // the muxer's source, or the thread starting the muxer while
+        // holding mux_ready_lock, which the source must also take while
+        // the muxer is not started
         ret = queue_alloc(&mux->queue, mux->nb_streams, mux->queue_size,
-                          QUEUE_PACKETS);
+                          QUEUE_PACKETS, mux->nb_streams == 1);
         if (ret < 0)
             return ret;
     }
@@ -1735,6 +2360,16 @@ static int start_prepare(Scheduler *sch)
     if (ret < 0)
         return ret;
 
+    for (unsigned i = 0; i < sch->nb_mux; i++) {
+        SchMux *mux = &sch->mux[i];
+
+        if (mux->task.numa_node < 0)
+            continue;
+
+        for (unsigned j = 0; j < mux->nb_streams; j++)
+            numa_node_propagate(sch, mux->streams[j].src, mux->task.numa_node);
+    }
+
     return 0;
 }
 
@@ -2176,8 +2811,8 @@ static int demux_flush(Scheduler *sch, SchDemux *d, AVPacket *pkt)
     return 0;
 }
 
-int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
-                   unsigned flags)
+static int demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
+                      unsigned flags)
 {
     SchDemux *d;
     int terminate;
@@ -2198,6 +2833,22 @@ int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
     return demux_send_for_stream(sch, d, &d->streams[pkt->stream_index], pkt, flags);
 }
 
+int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
+                   unsigned flags)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(demux_idx < sch->nb_demux);
+    task = &sch->demux[demux_idx].task;
+
+    task_sched_enter(sch, task, SCH_TASK_STATE_WAIT_OUTPUT);
+    ret = demux_send(sch, demux_idx, pkt, flags);
+    task_sched_leave(sch, task);
+
+    return ret;
+}
+
 static int demux_done(Scheduler *sch, unsigned demux_idx)
 {
     SchDemux *d = &sch->demux[demux_idx];
@@ -2220,7 +2871,7 @@ static int demux_done(Scheduler *sch, unsigned demux_idx)
     return ret;
 }
 
-int sch_mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
+static int mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
 {
     SchMux *mux;
     int ret, stream_idx;
@@ -2233,6 +2884,21 @@ int sch_mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
     return ret;
 }
 
+int sch_mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(mux_idx < sch->nb_mux);
+    task = &sch->mux[mux_idx].task;
+
+    task_sched_enter(sch, task, SCH_TASK_STATE_WAIT_INPUT);
+    ret = mux_receive(sch, mux_idx, pkt);
+    task_sched_leave(sch, task);
+
+    return ret;
+}
+
 void sch_mux_receive_finish(Scheduler *sch, unsigned mux_idx, unsigned stream_idx)
 {
     SchMux *mux;
@@ -2251,8 +2917,8 @@ void sch_mux_receive_finish(Scheduler *sch, unsigned mux_idx, unsigned stream_id
     pthread_mutex_unlock(&sch->schedule_lock);
 }
 
-int sch_mux_sub_heartbeat(Scheduler *sch, unsigned mux_idx, unsigned stream_idx,
-                          const AVPacket *pkt)
+static int mux_sub_heartbeat(Scheduler *sch, unsigned mux_idx, unsigned stream_idx,
+                             const AVPacket *pkt)
 {
     SchMux       *mux;
     SchMuxStream *ms;
@@ -2277,6 +2943,22 @@ int sch_mux_sub_heartbeat(Scheduler *sch, unsigned mux_idx, unsigned stream_idx,
     return 0;
 }
 
+int sch_mux_sub_heartbeat(Scheduler *sch, unsigned mux_idx, unsigned stream_idx,
+                          const AVPacket *pkt)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(mux_idx < sch->nb_mux);
+    task = &sch->mux[mux_idx].task;
+
+    task_sched_enter(sch, task, SCH_TASK_STATE_WAIT_OUTPUT);
+    ret = mux_sub_heartbeat(sch, mux_idx, stream_idx, pkt);
+    task_sched_leave(sch, task);
+
+    return ret;
+}
+
 static int mux_done(Scheduler *sch, unsigned mux_idx)
 {
     SchMux *mux = &sch->mux[mux_idx];
@@ -2304,7 +2986,7 @@ static int mux_done(Scheduler *sch, unsigned mux_idx)
     return 0;
 }
 
-int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
+static int dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
 {
     SchDec *dec;
     int ret, dummy;
@@ -2333,6 +3015,21 @@ int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
     return ret;
 }
 
+int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(dec_idx < sch->nb_dec);
+    task = &sch->dec[dec_idx].task;
+
+    task_sched_enter(sch, task, SCH_TASK_STATE_WAIT_INPUT);
+    ret = dec_receive(sch, dec_idx, pkt);
+    task_sched_leave(sch, task);
+
+    return ret;
+}
+
 static int send_to_filter(Scheduler *sch, SchFilterGraph *fg,
                           unsigned in_idx, AVFrame *frame)
 {
@@ -2386,8 +3083,8 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_dec_send(Scheduler *sch, unsigned dec_idx,
-                 unsigned out_idx, AVFrame *frame)
+static int dec_send(Scheduler *sch, unsigned dec_idx,
+                    unsigned out_idx, AVFrame *frame)
 {
     SchDec *dec;
     SchDecOutput *o;
@@ -2430,6 +3127,22 @@ int sch_dec_send(Scheduler *sch, unsigned dec_idx,
     return (nb_done == o->nb_dst) ? AVERROR_EOF : 0;
 }
 
+int sch_dec_send(Scheduler *sch, unsigned dec_idx,
+                 unsigned out_idx, AVFrame *frame)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(dec_idx < sch->nb_dec);
+    task = &sch->dec[dec_idx].task;
+
+    task_sched_enter(sch, task, SCH_TASK_STATE_WAIT_OUTPUT);
+    ret = dec_send(sch, dec_idx, out_idx, frame);
+    task_sched_leave(sch, task);
+
+    return ret;
+}
+
 static int dec_done(Scheduler *sch, unsigned dec_idx)
 {
     SchDec *dec = &sch->dec[dec_idx];
@@ -2455,7 +3168,7 @@ static int dec_done(Scheduler *sch, unsigned dec_idx)
     return ret;
 }
 
-int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
+static int enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
 {
     SchEnc *enc;
     int ret, dummy;
@@ -2469,6 +3182,21 @@ int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
     return ret;
 }
 
+int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(enc_idx < sch->nb_enc);
+    task = &sch->enc[enc_idx].task;
+
+    task_sched_enter(sch, task, SCH_TASK_STATE_WAIT_INPUT);
+    ret = enc_receive(sch, enc_idx, frame);
+    task_sched_leave(sch, task);
+
+    return ret;
+}
+
 static int enc_send_to_dst(Scheduler *sch, const SchedulerNode dst,
                            uint8_t *dst_finished, AVPacket *pkt)
 {
@@ -2499,7 +3227,7 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+static int enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
 {
     SchEnc *enc;
     int ret;
@@ -2532,12 +3260,173 @@ int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
     return 0;
 }
 
-static int enc_done(Scheduler *sch, unsigned enc_idx)
+/**
+ * Send a packet produced by a chunk worker, or mark the end of its current
+ * chunk when pkt is NULL. Packets are forwarded downstream in chunk order,
+ * those of chunks that cannot be sent yet are buffered.
+ *
+ * Only one worker at a time forwards packets, without holding the lock, so
+ * that the other workers can keep buffering theirs while the muxer applies
+ * backpressure. A worker blocks once it has buffered a whole chunk worth of
+ * packets.
+ */
+static int enc_chunk_send(Scheduler *sch, SchEnc *w, AVPacket *pkt)
 {
-    SchEnc *enc = &sch->enc[enc_idx];
+    SchEncChunks      *c = sch->enc[w->chunk_leader].chunks;
+    SchEncChunkWorker *cw = &c->workers[w->chunk_pos];
+    AVPacket *tmp = NULL;
     int ret = 0;
 
-    tq_receive_finish(enc->queue, 0);
+    pthread_mutex_lock(&c->lock);
+
+    // the worker owning the chunk being output never waits when it can
+    // forward the packets itself
+    while (!c->err && av_fifo_can_read(cw->fifo) > c->queue_size &&
+           (c->cur_out != w->chunk_pos || c->sending)) {
+        const SchEncChunkWorker *out = &c->workers[c->cur_out];
+
+        // the chunk being output will never be finished
+        if (out->finished && !av_fifo_can_read(out->fifo)) {
+            ret = AVERROR_EOF;
+            goto finish;
+        }
+
+        pthread_cond_wait(&c->cond, &c->lock);
+    }
+    if (c->err) {
+        ret = c->err;
+        goto finish;
+    }
+
+    if (pkt && c->cur_out == w->chunk_pos && !c->sending &&
+        !av_fifo_can_read(cw->fifo)) {
+        // packets of the chunk currently being output are sent directly
+        c->sending = 1;
+        pthread_mutex_unlock(&c->lock);
+
+        ret = enc_send(sch, w->chunk_leader, pkt);
+
+        pthread_mutex_lock(&c->lock);
+    } else {
+        if (pkt) {
+            tmp = av_packet_alloc();
+            if (!tmp) {
+                ret = AVERROR(ENOMEM);
+                goto finish;
+            }
+            av_packet_move_ref(tmp, pkt);
+        }
+
+        ret = av_fifo_write(cw->fifo, &tmp, 1);
+        if (ret < 0) {
+            if (tmp)
+                av_packet_move_ref(pkt, tmp);
+            av_packet_free(&tmp);
+            goto finish;
+        }
+
+        // the worker currently sending will forward the packet when its turn
+        // comes
+        if (c->sending)
+            goto finish;
+        c->sending = 1;
+    }
+
+    // send everything that is ready now
+    while (ret >= 0 && av_fifo_read(c->workers[c->cur_out].fifo, &tmp, 1) >= 0) {
+        pthread_cond_broadcast(&c->cond);
+
+        if (!tmp) {
+            c->cur_out = (c->cur_out + 1) % c->nb_workers;
+            continue;
+        }
+
+        pthread_mutex_unlock(&c->lock);
+
+        ret = enc_send(sch, w->chunk_leader, tmp);
+        av_packet_free(&tmp);
+
+        pthread_mutex_lock(&c->lock);
+    }
+
+    if (ret < 0)
+        c->err = ret;
+    c->sending = 0;
+    pthread_cond_broadcast(&c->cond);
+
+finish:
+    pthread_mutex_unlock(&c->lock);
+
+    return ret;
+}
+
+int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+{
+    SchEnc *enc;
+    int ret;
+
+    av_assert0(enc_idx < sch->nb_enc);
+    enc = &sch->enc[enc_idx];
+
+    task_sched_enter(sch, &enc->task, SCH_TASK_STATE_WAIT_OUTPUT);
+    ret = enc->chunk_leader >= 0 ? enc_chunk_send(sch, enc, pkt) :
+                                   enc_send(sch, enc_idx, pkt);
+    task_sched_leave(sch, &enc->task);
+
+    return ret;
+}
+
+int sch_enc_chunk_send(Scheduler *sch, unsigned enc_idx, AVFrame *frame,
+                       int new_chunk)
+{
+    SchEncChunks *c;
+    SchEnc *enc;
+    int ret = 0;
+
+    av_assert0(enc_idx < sch->nb_enc);
+    enc = &sch->enc[enc_idx];
+    c   = enc->chunks;
+    av_assert0(c && frame);
+
+    task_sched_enter(sch, &enc->task, SCH_TASK_STATE_WAIT_OUTPUT);
+
+    if (new_chunk && c->started) {
+        ret = tq_send(sch->enc[c->workers[c->cur_in].enc_idx].queue, 0,
+                      c->chunk_end);
+        if (ret < 0)
+            goto finish;
+
+        c->cur_in = (c->cur_in + 1) % c->nb_workers;
+    }
+    c->started = 1;
+
+    ret = tq_send(sch->enc[c->workers[c->cur_in].enc_idx].queue, 0, frame);
+
+finish:
+    task_sched_leave(sch, &enc->task);
+
+    return ret;
+}
+
+int sch_enc_chunk_end(Scheduler *sch, unsigned enc_idx)
+{
+    SchEnc *w;
+    int ret;
+
+    av_assert0(enc_idx < sch->nb_enc);
+    w = &sch->enc[enc_idx];
+    av_assert0(w->chunk_leader >= 0);
+
+    task_sched_enter(sch, &w->task, SCH_TASK_STATE_WAIT_OUTPUT);
+    ret = enc_chunk_send(sch, w, NULL);
+    task_sched_leave(sch, &w->task);
+
+    return ret;
+}
+
+static int enc_done_outputs(Scheduler *sch, SchEnc *enc)
+{
+    int ret = 0;
 
     for (unsigned i = 0; i < enc->nb_dst; i++) {
         int err = enc_send_to_dst(sch, enc->dst[i], &enc->dst_finished[i], NULL);
@@ -2548,8 +3437,39 @@ static int enc_done(Scheduler *sch, unsigned enc_idx)
     return ret;
 }
 
-int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
-                       unsigned *in_idx, AVFrame *frame)
+static int enc_done(Scheduler *sch, unsigned enc_idx)
+{
+    SchEnc *enc = &sch->enc[enc_idx];
+    int ret = 0;
+
+    tq_receive_finish(enc->queue, 0);
+
+    // the workers finish the current chunks and close the outputs
+    // once all of them are done
+    if (enc->chunks) {
+        for (unsigned i = 0; i < enc->chunks->nb_workers; i++)
+            tq_send_finish(sch->enc[enc->chunks->workers[i].enc_idx].queue, 0);
+        return 0;
+    }
+
+    if (enc->chunk_leader >= 0) {
+        SchEncChunks *c = sch->enc[enc->chunk_leader].chunks;
+
+        pthread_mutex_lock(&c->lock);
+        c->workers[enc->chunk_pos].finished = 1;
+        pthread_cond_broadcast(&c->cond);
+        if (++c->nb_done == c->nb_workers)
+            ret = enc_done_outputs(sch, &sch->enc[enc->chunk_leader]);
+        pthread_mutex_unlock(&c->lock);
+
+        return ret;
+    }
+
+    return enc_done_outputs(sch, enc);
+}
+
+static int filter_receive(Scheduler *sch, unsigned fg_idx,
+                          unsigned *in_idx, AVFrame *frame)
 {
     SchFilterGraph *fg;
     int ret, idx;
@@ -2599,6 +3519,22 @@ int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
     }
 }
 
+int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
+                       unsigned *in_idx, AVFrame *frame)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(fg_idx < sch->nb_filters);
+    task = &sch->filters[fg_idx].task;
+
+    task_sched_enter(sch, task, SCH_TASK_STATE_WAIT_INPUT);
+    ret = filter_receive(sch, fg_idx, in_idx, frame);
+    task_sched_leave(sch, task);
+
+    return ret;
+}
+
 void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
 {
     SchFilterGraph *fg;
@@ -2626,7 +3562,7 @@ void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
     pthread_mutex_unlock(&sch->schedule_lock);
 }
 
-int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *frame)
+static int filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *frame)
 {
     SchFilterGraph *fg;
     SchedulerNode  dst;
@@ -2650,6 +3586,21 @@ int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *
     return ret;
 }
 
+int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *frame)
+{
+    SchTask *task;
+    int ret;
+
+    av_assert0(fg_idx < sch->nb_filters);
+    task = &sch->filters[fg_idx].task;
+
+    task_sched_enter(sch, task, SCH_TASK_STATE_WAIT_OUTPUT);
+    ret = filter_send(sch, fg_idx, out_idx, frame);
+    task_sched_leave(sch, task);
+
+    return ret;
+}
+
 static int filter_done(Scheduler *sch, unsigned fg_idx)
 {
     SchFilterGraph *fg = &sch->filters[fg_idx];
@@ -2720,7 +3671,13 @@ static void *task_wrapper(void *arg)
     int ret;
     int err = 0;
 
+    if (task->numa_node >= 0)
+        task_bind_numa_node(task);
+
+    task_sched_leave(sch, task);
     ret = task->func(task->func_arg);
+    task_sched_enter(sch, task, SCH_TASK_STATE_NB);
+    atomic_store(&task->nb_threads, -1);
     if (ret < 0)
         av_log(task->func_arg, AV_LOG_ERROR,
                "Task finished with error: %s\n", av_err2str(ret));
@@ -2832,3 +3789,93 @@ int sch_stop(Scheduler *sch, int64_t *finish_ts)
 
     return ret;
 }
+
+static void print_task_stats(AVBPrint *bp, const SchTask *task,
+                             const char *type, unsigned idx, ThreadQueue *queue,
+                             int last)
+{
+    const AVClass *cls = *(const AVClass**)task->func_arg;
+
+    av_bprintf(bp, "    {\n      \"type\": \"%s\",\n      \"index\": %u,\n"
+               "      \"name\": ", type, idx);
+    bprint_json_string(bp, cls->item_name(task->func_arg));
+    av_bprintf(bp, ",\n      \"time_us\": {\n");
+
+    for (int i = 0; i < SCH_TASK_STATE_NB; i++) {
+        const SchHistogram *h = &task->hist[i];
+        int first = 1;
+
+        av_bprintf(bp, "        \"%s\": { \"count\": %"PRIu64", \"total\": %"PRIu64
+                   ", \"max\": %"PRIu64", \"histogram\": [",
+                   task_state_names[i],
+                   (uint64_t)atomic_load(&h->count),
+                   (uint64_t)atomic_load(&h->total),
+                   (uint64_t)atomic_load(&h->max));
+
+        // [upper bound of the bin, count] pairs for non-empty bins
+        for (int j = 0; j < SCH_HIST_BINS; j++) {
+            uint64_t count = atomic_load(&h->bins[j]);
+            if (!count)
+                continue;
+            av_bprintf(bp, "%s[%"PRIu64", %"PRIu64"]", first ? "" : ", ",
+                       j == SCH_HIST_BINS - 1 ? UINT64_MAX : UINT64_C(1) << j,
+                       count);
+            first = 0;
+        }
+
+        av_bprintf(bp, "] }%s\n", i < SCH_TASK_STATE_NB - 1 ? "," : "");
+    }
+    av_bprintf(bp, "      }");
+
+    if (queue) {
+        ThreadQueueStats qs;
+
+        tq_stats(queue, &qs);
+        av_bprintf(bp, ",\n      \"input_queue\": { \"capacity\": %zu, \"sent\": %"PRIu64
+                   ", \"send_blocked\": %"PRIu64", \"occupancy_avg\": %.3f"
+                   ", \"occupancy_max\": %zu }",
+                   qs.capacity, qs.nb_sent, qs.nb_send_blocked,
+                   qs.nb_sent ? (double)qs.occupancy_sum / qs.nb_sent : 0.0,
+                   qs.occupancy_max);
+    }
+
+    av_bprintf(bp, "\n    }%s\n", last ? "" : ",");
+}
+
+void sch_print_stats(Scheduler *sch, AVBPrint *bp)
+{
+    unsigned nb_tasks = 0, nb_printed = 0;
+
+    for (unsigned i = 0; i < sch->nb_demux; i++)
+        nb_tasks += !!sch->demux[i].nb_streams;
+    for (unsigned i = 0; i < sch->nb_filters; i++)
+        nb_tasks += !!sch->filters[i].task.parent;
+    nb_tasks += sch->nb_dec + sch->nb_enc + sch->nb_mux;
+
+    av_bprintf(bp, "{\n  \"nodes\": [\n");
+
+    for (unsigned i = 0; i < sch->nb_demux; i++) {
+        if (!sch->demux[i].nb_streams)
+            continue;
+        print_task_stats(bp, &sch->demux[i].task, "demux", i, NULL,
+                         ++nb_printed == nb_tasks);
+    }
+    for (unsigned i = 0; i < sch->nb_dec; i++)
+        print_task_stats(bp, &sch->dec[i].task, "dec", i, sch->dec[i].queue,
+                         ++nb_printed == nb_tasks);
+    for (unsigned i = 0; i < sch->nb_filters; i++) {
+        // removed filtergraphs have their task cleared
+        if (!sch->filters[i].task.parent)
+            continue;
+        print_task_stats(bp, &sch->filters[i].task, "filter", i,
+                         sch->filters[i].queue, ++nb_printed == nb_tasks);
+    }
+    for (unsigned i = 0; i < sch->nb_enc; i++)
+        print_task_stats(bp, &sch->enc[i].task, "enc", i, sch->enc[i].queue,
+                         ++nb_printed == nb_tasks);
+    for (unsigned i = 0; i < sch->nb_mux; i++)
+        print_task_stats(bp, &sch->mux[i].task, "mux", i, sch->mux[i].queue,
+                         ++nb_printed == nb_tasks);
+
+    av_bprintf(bp, "  ]\n}\n");
+}
@@ -85,6 +85,7 @@
  * knowledge about the whole transcoding pipeline.
  */
 
+struct AVBPrint;
 struct AVFrame;
 struct AVPacket;
 
@@ -261,6 +262,23 @@ int sch_add_mux(Scheduler *sch, SchThreadFunc func, int (*init)(void *),
  */
 #define DEFAULT_FRAME_THREAD_QUEUE_SIZE 2
 
+/**
+ * Bind the muxer and all the encoders, filtergraphs and decoders feeding it
+ * to the CPUs of the given NUMA node. Since their buffer pools are allocated
+ * from these threads, the frames passed along the chain then also stay in
+ * node-local memory.
+ *
+ * Components that feed several muxers placed on different nodes are not
+ * bound. Demuxers are never bound. Binding is only supported on Linux, on
+ * other systems a warning is printed.
+ *
+ * Must be called before sch_start().
+ *
+ * @param mux_idx index previously returned by sch_add_mux()
+ * @param numa_node index of the NUMA node
+ */
+int sch_mux_set_numa_node(Scheduler *sch, unsigned mux_idx, unsigned numa_node);
+
 /**
  * Add a muxed stream for a previously added muxer.
  *
@@ -300,6 +318,77 @@ int sch_mux_stream_ready(Scheduler *sch, unsigned mux_idx, unsigned stream_idx);
  */
 int sch_sdp_filename(Scheduler *sch, const char *sdp_filename);
 
+/**
+ * Limit the number of decoder, filtergraph and encoder tasks that may be
+ * actively processing data at the same time.
+ *
+ * Every such task still runs in its own thread, but it must hold one of
+ * nb_workers worker slots while doing work. The slot is given up whenever the
+ * task enters the scheduler to receive input or send output (i.e. whenever it
+ * may block), so that a task waiting on its neighbours never prevents another
+ * task from running. Demuxers and muxers are mostly I/O-bound and are not
+ * subject to this limit.
+ *
+ * Must be called before sch_start().
+ *
+ * @param nb_workers maximum number of simultaneously working tasks, 0 means
+ *                   no limit (the default)
+ */
+int sch_set_workers(Scheduler *sch, unsigned nb_workers);
+
+/**
+ * Set the total number of threads to be split among all decoders,
+ * filtergraphs and encoders.
+ *
+ * Each of these components requests its share with sch_get_thread_count()
+ * whenever it (re)initializes its codec or filtergraph. The budget is split in
+ * proportion to the load measured so far, estimated from the time each
+ * component spent working rather than waiting for its neighbours; components
+ * without measurements are assumed to carry an average load. Components which
+ * are opened later during processing, such as encoders or reconfigured
+ * filtergraphs, thus take the actual throughput of the pipeline into account.
+ *
+ * Must be called before sch_start().
+ *
+ * @param nb_threads total number of threads, 0 means no budget (the default)
+ */
+int sch_set_thread_budget(Scheduler *sch, unsigned nb_threads);
+
+/**
+ * Declare whether a decoder, encoder or filtergraph can make use of more than
+ * one thread. Components that cannot are always assigned a single thread and
+ * do not reduce the share of the others. All components are assumed to be
+ * threadable by default.
+ */
+void sch_set_threadable(Scheduler *sch, SchedulerNode node, int threadable);
+
+/**
+ * Get the number of threads a decoder, encoder or filtergraph should use,
+ * see sch_set_thread_budget(). May be called from any thread.
+ *
+ * @return number of threads, or 0 if no thread budget is set and the
+ *         component should use its default
+ */
+int sch_get_thread_count(Scheduler *sch, SchedulerNode node);
+
+/**
+ * Enable collecting per-task statistics, which can be retrieved with
+ * sch_print_stats(). Must be called before sch_start().
+ */
+void sch_enable_stats(Scheduler *sch);
+
+/**
+ * Print the statistics collected for every task as a JSON document.
+ *
+ * For each demuxer, decoder, filtergraph, encoder and muxer this contains
+ * histograms of the time spent processing data, waiting for input, waiting
+ * for space in downstream queues and waiting for a worker slot (see
+ * sch_set_workers()), plus the occupancy of the task's input queue.
+ *
+ * May be called at any time, including while transcoding is running.
+ */
+void sch_print_stats(Scheduler *sch, struct AVBPrint *bp);
+
 /**
  * Add an encoder to the scheduler.
  *
@@ -317,6 +406,36 @@ int sch_sdp_filename(Scheduler *sch, const char *sdp_filename);
 int sch_add_enc(Scheduler *sch, SchThreadFunc func, void *ctx,
                 int (*open_cb)(void *func_arg, const struct AVFrame *frame));
 
+/**
+ * Add a chunk worker to an encoder, enabling chunked encoding for it.
+ *
+ * The input of an encoder with chunk workers is split into chunks by the
+ * encoder task, which passes every chunk to one of the workers with
+ * sch_enc_chunk_send(), in a round-robin fashion. The workers encode their
+ * chunks concurrently, each chunk with a newly opened encoder, and send the
+ * packets with sch_enc_send(). The scheduler forwards these packets to the
+ * encoder's destinations in chunk order.
+ *
+ * A worker inherits the threadable flag of the encoder (see
+ * sch_set_threadable()), which is then cleared for the encoder itself.
+ *
+ * @param enc_idx    Index of the encoder previously returned by sch_add_enc().
+ * @param func       Function executed as the worker task.
+ * @param ctx        Worker state; will be passed to func and used for logging.
+ * @param queue_size Number of frames in a chunk. The worker input queue holds
+ *                   a whole chunk, so that the encoder task does not have to
+ *                   wait for the worker to consume it, and at most as many
+ *                   packets are buffered by a worker whose chunk cannot be
+ *                   sent downstream yet, before sch_enc_send() blocks.
+ *                   Hardware frames must not be sent to workers.
+ *
+ * @retval ">=0" Encoder index of the newly-created worker, to be used with
+ *               sch_enc_receive(), sch_enc_send() and sch_enc_chunk_end().
+ * @retval "<0"  Error code.
+ */
+int sch_add_enc_chunk(Scheduler *sch, unsigned enc_idx, SchThreadFunc func,
+                      void *ctx, unsigned queue_size);
+
 /**
  * Add an pre-encoding sync queue to the scheduler.
  *
@@ -479,6 +598,38 @@ int sch_enc_receive(Scheduler *sch, unsigned enc_idx, struct AVFrame *frame);
  */
 int sch_enc_send   (Scheduler *sch, unsigned enc_idx, struct AVPacket *pkt);
 
+/**
+ * Called by tasks of encoders with chunk workers to send a frame to the
+ * worker encoding the current chunk.
+ *
+ * @param enc_idx   Encoder index previously returned by sch_add_enc().
+ * @param frame     The frame to send; it will be consumed and cleared by this
+ *                  function on success.
+ * @param new_chunk When nonzero, the current chunk is finished and the frame
+ *                  starts a new chunk, sent to the next worker.
+ *
+ * @retval 0           success
+ * @retval AVERROR_EOF the worker will not accept more frames
+ * @retval "another negative error code" other failure
+ */
+int sch_enc_chunk_send(Scheduler *sch, unsigned enc_idx, struct AVFrame *frame,
+                       int new_chunk);
+
+/**
+ * Called by chunk worker tasks after they have sent all the packets of a
+ * chunk with sch_enc_send().
+ *
+ * Chunk workers receive an empty frame (with no data buffers) from
+ * sch_enc_receive() when their current chunk is finished. A chunk may also be
+ * finished by sch_enc_receive() returning AVERROR_EOF.
+ *
+ * @param enc_idx Worker index previously returned by sch_add_enc_chunk().
+ *
+ * @retval 0     success
+ * @retval "<0"  Error code.
+ */
+int sch_enc_chunk_end(Scheduler *sch, unsigned enc_idx);
+
 /**
  * Called by muxer tasks to obtain packets for muxing. Will wait for a packet
  * for any muxed stream to become available and return it in pkt.
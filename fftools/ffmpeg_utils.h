@@ -21,6 +21,7 @@
 
 #include <stdint.h>
 
+#include "libavutil/bprint.h"
 #include "libavutil/common.h"
 #include "libavutil/frame.h"
 #include "libavutil/rational.h"
@@ -60,4 +61,21 @@ static inline int clone_side_data(AVFrameSideData ***dst, int *nb_dst,
     return 0;
 }
 
+/**
+ * Print str to bp as a quoted and escaped JSON string.
+ */
+static inline void bprint_json_string(AVBPrint *bp, const char *str)
+{
+    av_bprint_chars(bp, '"', 1);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            av_bprintf(bp, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            av_bprintf(bp, "\\u%04x", *str);
+        else
+            av_bprint_chars(bp, *str, 1);
+    }
+    av_bprint_chars(bp, '"', 1);
+}
+
 #endif // FFTOOLS_FFMPEG_UTILS_H
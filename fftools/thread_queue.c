@@ -16,6 +16,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -25,6 +26,7 @@
 #include "libavutil/fifo.h"
 #include "libavutil/frame.h"
 #include "libavutil/intreadwrite.h"
+#include "libavutil/macros.h"
 #include "libavutil/mem.h"
 #include "libavutil/thread.h"
 
@@ -38,7 +40,7 @@ enum {
 };
 
 struct ThreadQueue {
-    int             choked;
+    atomic_int      choked;
     int              *finished;
     unsigned int    nb_streams;
 
@@ -47,6 +49,28 @@ struct ThreadQueue {
     AVContainerFifo *fifo;
     AVFifo          *fifo_stream_index;
 
+    /* Lock-free ring buffer used instead of the fifos for
+     * THREAD_QUEUE_ALLOC_SPSC queues. The item at ring_head is the next one
+     * to be read, written only by the receiving side; the item at ring_tail
+     * is the next one to be written, written only by the sending side.
+     * Both indices increase monotonically and are taken modulo ring_size
+     * when accessing the ring. */
+    void            **ring;
+    size_t            ring_size;
+    atomic_size_t     ring_head;
+    atomic_size_t     ring_tail;
+    // replaces finished[0] for THREAD_QUEUE_ALLOC_SPSC queues
+    atomic_int        ring_finished;
+    // the receiving/sending side is waiting on cond for data/space
+    atomic_int        recv_waiting;
+    atomic_int        send_waiting;
+
+    size_t                capacity;
+    atomic_uint_least64_t nb_sent;
+    atomic_uint_least64_t nb_send_blocked;
+    atomic_uint_least64_t occupancy_sum;
+    atomic_size_t         occupancy_max;
+
     pthread_mutex_t lock;
     pthread_cond_t  cond;
 };
@@ -61,6 +85,14 @@ void tq_free(ThreadQueue **ptq)
     av_container_fifo_free(&tq->fifo);
     av_fifo_freep2(&tq->fifo_stream_index);
 
+    for (size_t i = 0; tq->ring && i < tq->ring_size; i++) {
+        if (tq->type == THREAD_QUEUE_FRAMES)
+            av_frame_free((AVFrame**)&tq->ring[i]);
+        else
+            av_packet_free((AVPacket**)&tq->ring[i]);
+    }
+    av_freep(&tq->ring);
+
     av_freep(&tq->finished);
 
     pthread_cond_destroy(&tq->cond);
@@ -70,7 +102,7 @@ void tq_free(ThreadQueue **ptq)
 }
 
 ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
-                      enum ThreadQueueType type)
+                      enum ThreadQueueType type, unsigned flags)
 {
     ThreadQueue *tq;
     int ret;
@@ -97,7 +129,37 @@ ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
         goto fail;
     tq->nb_streams = nb_streams;
 
-    tq->type = type;
+    tq->type     = type;
+    tq->capacity = queue_size;
+
+    atomic_init(&tq->choked,          0);
+    atomic_init(&tq->ring_head,       0);
+    atomic_init(&tq->ring_tail,       0);
+    atomic_init(&tq->ring_finished,   0);
+    atomic_init(&tq->recv_waiting,    0);
+    atomic_init(&tq->send_waiting,    0);
+    atomic_init(&tq->nb_sent,         0);
+    atomic_init(&tq->nb_send_blocked, 0);
+    atomic_init(&tq->occupancy_sum,   0);
+    atomic_init(&tq->occupancy_max,   0);
+
+    if (flags & THREAD_QUEUE_ALLOC_SPSC) {
+        av_assert0(nb_streams == 1);
+
+        tq->ring = av_calloc(queue_size, sizeof(*tq->ring));
+        if (!tq->ring)
+            goto fail;
+        tq->ring_size = queue_size;
+
+        for (size_t i = 0; i < queue_size; i++) {
+            tq->ring[i] = (type == THREAD_QUEUE_FRAMES) ?
+                          (void*)av_frame_alloc() : (void*)av_packet_alloc();
+            if (!tq->ring[i])
+                goto fail;
+        }
+
+        return tq;
+    }
 
     tq->fifo = (type == THREAD_QUEUE_FRAMES) ?
                av_container_fifo_alloc_avframe(0) : av_container_fifo_alloc_avpacket(0);
@@ -114,12 +176,182 @@ fail:
     return NULL;
 }
 
+// callers must make sure this is not called concurrently for the same queue
+static void stats_add_sent(ThreadQueue *tq, size_t occupancy)
+{
+    uint64_t nb_sent = atomic_load_explicit(&tq->nb_sent,       memory_order_relaxed);
+    uint64_t occ_sum = atomic_load_explicit(&tq->occupancy_sum, memory_order_relaxed);
+
+    atomic_store_explicit(&tq->nb_sent,       nb_sent + 1,         memory_order_relaxed);
+    atomic_store_explicit(&tq->occupancy_sum, occ_sum + occupancy, memory_order_relaxed);
+    if (occupancy > atomic_load_explicit(&tq->occupancy_max, memory_order_relaxed))
+        atomic_store_explicit(&tq->occupancy_max, occupancy, memory_order_relaxed);
+}
+
+static void stats_add_blocked(ThreadQueue *tq)
+{
+    uint64_t nb = atomic_load_explicit(&tq->nb_send_blocked, memory_order_relaxed);
+    atomic_store_explicit(&tq->nb_send_blocked, nb + 1, memory_order_relaxed);
+}
+
+static void move_item(const ThreadQueue *tq, void *dst, void *src)
+{
+    if (tq->type == THREAD_QUEUE_FRAMES)
+        av_frame_move_ref(dst, src);
+    else
+        av_packet_move_ref(dst, src);
+}
+
+static void unref_item(const ThreadQueue *tq, void *data)
+{
+    if (tq->type == THREAD_QUEUE_FRAMES)
+        av_frame_unref(data);
+    else
+        av_packet_unref(data);
+}
+
+/* Wake up the other side if it is waiting. The waiting side sets its flag
+ * with the lock held and then re-checks the queue state before waiting, so
+ * with sequentially consistent accesses to the ring indices and the flags
+ * either it sees our update or we see its flag. */
+static void ring_wake(ThreadQueue *tq, atomic_int *waiting)
+{
+    if (!atomic_load(waiting))
+        return;
+
+    pthread_mutex_lock(&tq->lock);
+    pthread_cond_broadcast(&tq->cond);
+    pthread_mutex_unlock(&tq->lock);
+}
+
+// update the state flags of a THREAD_QUEUE_ALLOC_SPSC queue
+static void ring_set_finished(ThreadQueue *tq, int flag)
+{
+    pthread_mutex_lock(&tq->lock);
+    atomic_fetch_or(&tq->ring_finished, flag);
+    pthread_cond_broadcast(&tq->cond);
+    pthread_mutex_unlock(&tq->lock);
+}
+
+static int ring_send(ThreadQueue *tq, void *data)
+{
+    size_t tail = atomic_load_explicit(&tq->ring_tail, memory_order_relaxed);
+    int finished;
+
+    finished = atomic_load(&tq->ring_finished);
+    if (finished & FINISHED_SEND)
+        return AVERROR(EINVAL);
+
+    if (!(finished & FINISHED_RECV) &&
+        tail - atomic_load(&tq->ring_head) >= tq->ring_size) {
+        stats_add_blocked(tq);
+
+        pthread_mutex_lock(&tq->lock);
+
+        atomic_store(&tq->send_waiting, 1);
+        while (!(atomic_load(&tq->ring_finished) & FINISHED_RECV) &&
+               tail - atomic_load(&tq->ring_head) >= tq->ring_size)
+            pthread_cond_wait(&tq->cond, &tq->lock);
+        atomic_store(&tq->send_waiting, 0);
+
+        pthread_mutex_unlock(&tq->lock);
+
+        finished = atomic_load(&tq->ring_finished);
+    }
+
+    if (finished & FINISHED_RECV) {
+        atomic_fetch_or(&tq->ring_finished, FINISHED_SEND);
+        return AVERROR_EOF;
+    }
+
+    move_item(tq, tq->ring[tail % tq->ring_size], data);
+    atomic_store(&tq->ring_tail, tail + 1);
+
+    stats_add_sent(tq, tail + 1 - atomic_load(&tq->ring_head));
+
+    ring_wake(tq, &tq->recv_waiting);
+
+    return 0;
+}
+
+static int ring_receive_nonblock(ThreadQueue *tq, int *stream_idx, void *data,
+                                 int *consumed)
+{
+    size_t head = atomic_load_explicit(&tq->ring_head, memory_order_relaxed);
+    int finished;
+
+    if (atomic_load(&tq->choked))
+        return AVERROR(EAGAIN);
+
+    while (1) {
+        while (head != atomic_load(&tq->ring_tail)) {
+            move_item(tq, data, tq->ring[head % tq->ring_size]);
+            atomic_store(&tq->ring_head, ++head);
+            *consumed = 1;
+
+            if (atomic_load(&tq->ring_finished) & FINISHED_RECV) {
+                unref_item(tq, data);
+                continue;
+            }
+
+            *stream_idx = 0;
+            return 0;
+        }
+
+        finished = atomic_load(&tq->ring_finished);
+        if (!finished)
+            return AVERROR(EAGAIN);
+
+        // the sender may have written more items before finishing
+        if (head != atomic_load(&tq->ring_tail))
+            continue;
+
+        break;
+    }
+
+    /* return EOF to the consumer at most once */
+    if (!(finished & FINISHED_RECV)) {
+        atomic_fetch_or(&tq->ring_finished, FINISHED_RECV);
+        *stream_idx = 0;
+    }
+
+    return AVERROR_EOF;
+}
+
+static int ring_receive(ThreadQueue *tq, int *stream_idx, void *data, int flags)
+{
+    int consumed = 0;
+    int ret;
+
+    ret = ring_receive_nonblock(tq, stream_idx, data, &consumed);
+    if (ret == AVERROR(EAGAIN) && !(flags & THREAD_QUEUE_FLAG_NO_BLOCK)) {
+        pthread_mutex_lock(&tq->lock);
+
+        atomic_store(&tq->recv_waiting, 1);
+        while ((ret = ring_receive_nonblock(tq, stream_idx, data, &consumed)) ==
+               AVERROR(EAGAIN))
+            pthread_cond_wait(&tq->cond, &tq->lock);
+        atomic_store(&tq->recv_waiting, 0);
+
+        pthread_mutex_unlock(&tq->lock);
+    }
+
+    if (consumed)
+        ring_wake(tq, &tq->send_waiting);
+
+    return ret;
+}
+
 int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
 {
     int *finished;
     int ret;
 
     av_assert0(stream_idx < tq->nb_streams);
+
+    if (tq->ring)
+        return ring_send(tq, data);
+
     finished = &tq->finished[stream_idx];
 
     pthread_mutex_lock(&tq->lock);
@@ -129,6 +361,9 @@ int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
         goto finish;
     }
 
+    if (!(*finished & FINISHED_RECV) && !av_fifo_can_write(tq->fifo_stream_index))
+        stats_add_blocked(tq);
+
     while (!(*finished & FINISHED_RECV) && !av_fifo_can_write(tq->fifo_stream_index))
         pthread_cond_wait(&tq->cond, &tq->lock);
 
@@ -144,6 +379,8 @@ int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
         if (ret < 0)
             goto finish;
 
+        stats_add_sent(tq, av_fifo_can_read(tq->fifo_stream_index));
+
         pthread_cond_broadcast(&tq->cond);
     }
 
@@ -158,7 +395,7 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
 {
     unsigned int nb_finished = 0;
 
-    if (tq->choked)
+    if (atomic_load(&tq->choked))
         return AVERROR(EAGAIN);
 
     while (av_container_fifo_read(tq->fifo, data, 0) >= 0) {
@@ -168,8 +405,7 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
         ret = av_fifo_read(tq->fifo_stream_index, &idx, 1);
         av_assert0(ret >= 0);
         if (tq->finished[idx] & FINISHED_RECV) {
-            (tq->type == THREAD_QUEUE_FRAMES) ?
-            av_frame_unref(data) : av_packet_unref(data);
+            unref_item(tq, data);
             continue;
         }
 
@@ -200,6 +436,9 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data, int flags)
 
     *stream_idx = -1;
 
+    if (tq->ring)
+        return ring_receive(tq, stream_idx, data, flags);
+
     pthread_mutex_lock(&tq->lock);
 
     while (1) {
@@ -228,13 +467,19 @@ void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
 
+    if (tq->ring) {
+        atomic_store(&tq->choked, 0);
+        ring_set_finished(tq, FINISHED_SEND);
+        return;
+    }
+
     pthread_mutex_lock(&tq->lock);
 
     /* mark the stream as send-finished;
      * next time the consumer thread tries to read this stream it will get
      * an EOF and recv-finished flag will be set */
     tq->finished[stream_idx] |= FINISHED_SEND;
-    tq->choked = 0;
+    atomic_store(&tq->choked, 0);
     pthread_cond_broadcast(&tq->cond);
 
     pthread_mutex_unlock(&tq->lock);
@@ -244,6 +489,11 @@ void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
 
+    if (tq->ring) {
+        ring_set_finished(tq, FINISHED_RECV);
+        return;
+    }
+
     pthread_mutex_lock(&tq->lock);
 
     /* mark the stream as recv-finished;
@@ -259,10 +509,18 @@ void tq_choke(ThreadQueue *tq, int choked)
 {
     pthread_mutex_lock(&tq->lock);
 
-    int prev_choked = tq->choked;
-    tq->choked = choked;
+    int prev_choked = atomic_exchange(&tq->choked, choked);
     if (choked != prev_choked)
         pthread_cond_broadcast(&tq->cond);
 
     pthread_mutex_unlock(&tq->lock);
 }
+
+void tq_stats(ThreadQueue *tq, ThreadQueueStats *stats)
+{
+    stats->capacity        = tq->capacity;
+    stats->nb_sent         = atomic_load(&tq->nb_sent);
+    stats->nb_send_blocked = atomic_load(&tq->nb_send_blocked);
+    stats->occupancy_sum   = atomic_load(&tq->occupancy_sum);
+    stats->occupancy_max   = atomic_load(&tq->occupancy_max);
+}
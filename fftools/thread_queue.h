@@ -19,6 +19,7 @@
 #ifndef FFTOOLS_THREAD_QUEUE_H
 #define FFTOOLS_THREAD_QUEUE_H
 
+#include <stdint.h>
 #include <string.h>
 
 enum ThreadQueueType {
@@ -32,8 +33,39 @@ enum ThreadQueueFlags {
     THREAD_QUEUE_FLAG_NO_BLOCK = (1 << 0),
 };
 
+enum ThreadQueueAllocFlags {
+    /* The queue has exactly one stream, which is only ever sent to by one
+     * thread at a time and received from by one thread at a time (calls from
+     * different threads on the same side must be serialized externally).
+     * Such queues are implemented as a lock-free ring buffer, a lock is only
+     * taken when the receiving side has to wait for data or the sending side
+     * has to wait for space. */
+    THREAD_QUEUE_ALLOC_SPSC = (1 << 0),
+};
+
 typedef struct ThreadQueue ThreadQueue;
 
+typedef struct ThreadQueueStats {
+    /**
+     * Number of items the queue can hold without blocking.
+     */
+    size_t      capacity;
+    /**
+     * Total number of items sent to the queue.
+     */
+    uint64_t    nb_sent;
+    /**
+     * Number of tq_send() calls that had to wait for space in the queue.
+     */
+    uint64_t    nb_send_blocked;
+    /**
+     * Sum and maximum of the number of queued items, sampled after each
+     * successful tq_send().
+     */
+    uint64_t    occupancy_sum;
+    size_t      occupancy_max;
+} ThreadQueueStats;
+
 /**
  * Allocate a queue for sending data between threads.
  *
@@ -41,9 +73,10 @@ typedef struct ThreadQueue ThreadQueue;
  *                   maintained
  * @param queue_size number of items that can be stored in the queue without
  *                   blocking
+ * @param flags      combination of THREAD_QUEUE_ALLOC_*
  */
 ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
-                      enum ThreadQueueType type);
+                      enum ThreadQueueType type, unsigned flags);
 void         tq_free(ThreadQueue **tq);
 
 /**
@@ -96,4 +129,9 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data, int flags);
  */
 void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx);
 
+/**
+ * Get a snapshot of the queue usage statistics.
+ */
+void tq_stats(ThreadQueue *tq, ThreadQueueStats *stats);
+
 #endif // FFTOOLS_THREAD_QUEUE_H
@@ -440,6 +440,8 @@ extern const FFOutputFormat ff_segment_muxer;
 extern const FFOutputFormat ff_stream_segment_muxer;
 extern const FFInputFormat  ff_ser_demuxer;
 extern const FFInputFormat  ff_sga_demuxer;
+extern const FFInputFormat  ff_shmframe_demuxer;
+extern const FFOutputFormat ff_shmframe_muxer;
 extern const FFInputFormat  ff_shorten_demuxer;
 extern const FFInputFormat  ff_siff_demuxer;
 extern const FFInputFormat  ff_simbiosis_imx_demuxer;
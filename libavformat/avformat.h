@@ -1504,6 +1504,13 @@ typedef struct AVFormatContext {
 #define AVFMT_FLAG_SORT_DTS    0x10000 ///< try to interleave outputted packets by dts (using this flag can slow demuxing down)
 #define AVFMT_FLAG_FAST_SEEK   0x80000 ///< Enable fast, but inaccurate seeks for some formats
 #define AVFMT_FLAG_AUTO_BSF   0x200000 ///< Add bitstream filters as requested by the muxer
+/**
+ * Make avformat_find_stream_info() stop as soon as the codec parameters of
+ * the streams that are not discarded (AVStream.discard < AVDISCARD_ALL) are
+ * known, without analyzing frame rates and timestamps further, and without
+ * decoding packets of discarded streams.
+ */
+#define AVFMT_FLAG_MIN_PROBE  0x800000
 
 #if FF_API_OLD_ID3V2_COMMENT
 /**
@@ -1987,6 +1994,16 @@ typedef struct AVFormatContext {
      * - demuxing: Set by user
      */
     int recursion_limit;
+
+    /**
+     * Path of a file to store the stream information found by
+     * avformat_find_stream_info() to. When it was written for the same
+     * input (format, size and streams found by the header), the stream
+     * information is loaded from it instead, and the streams are not probed.
+     *
+     * - demuxing: Set by user
+     */
+    char *stream_info_file;
 } AVFormatContext;
 
 /**
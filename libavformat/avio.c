@@ -886,6 +886,13 @@ int ffurl_get_file_handle(URLContext *h)
     return h->prot->url_get_file_handle(h);
 }
 
+const AVBufferRef *ffurl_get_mapping(URLContext *h)
+{
+    if (!h || !h->prot || !h->prot->url_get_mapping)
+        return NULL;
+    return h->prot->url_get_mapping(h);
+}
+
 int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles)
 {
     if (!h || !h->prot)
@@ -21,6 +21,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/log.h"
 
 typedef struct AVFormatContext AVFormatContext;
@@ -224,6 +225,24 @@ int ffio_open_dyn_packet_buf(AVIOContext **s, int max_packet_size);
  */
 struct URLContext *ffio_geturlcontext(AVIOContext *s);
 
+/**
+ * Read size bytes without copying them, if the underlying resource is mapped
+ * to memory (see ffurl_get_mapping()).
+ *
+ * @param any_padding if 0, the data is only read this way when the
+ *                    AV_INPUT_BUFFER_PADDING_SIZE bytes following it in the
+ *                    resource are zero; otherwise the padding may hold any
+ *                    bytes, which is only safe for data that is never parsed
+ *                    beyond its size, like raw video or PCM samples
+ * @param buf set to a new read-only reference to the data read; its size
+ *            includes AV_INPUT_BUFFER_PADDING_SIZE bytes following the data
+ * @return size on success, AVERROR(ENOSYS) if the data cannot be read this
+ *         way (nothing is consumed then), another negative error code on
+ *         failure
+ */
+int ffio_read_mapped(AVIOContext *s, int size, int any_padding,
+                     AVBufferRef **buf);
+
 /**
  * Create and initialize a AVIOContext for accessing the
  * resource referenced by the URLContext h.
@@ -31,6 +31,7 @@
 #include "avio.h"
 #include "avio_internal.h"
 #include "internal.h"
+#include "url.h"
 #include <stdarg.h>
 
 #define IO_BUFFER_SIZE 32768
@@ -684,6 +685,66 @@ int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsig
     }
 }
 
+int ffio_read_mapped(AVIOContext *s, int size, int any_padding,
+                     AVBufferRef **buf)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    const AVBufferRef *map;
+    AVBufferRef *ref;
+    int64_t pos, end;
+
+    if (size <= 0 || s->write_flag || s->update_checksum || !s->seek ||
+        !(s->seekable & AVIO_SEEKABLE_NORMAL))
+        return AVERROR(ENOSYS);
+
+    map = ffurl_get_mapping(ffio_geturlcontext(s));
+    if (!map)
+        return AVERROR(ENOSYS);
+
+    pos = avio_tell(s);
+    end = pos + size;
+    if (pos < 0 || end > (int64_t)map->size - AV_INPUT_BUFFER_PADDING_SIZE)
+        return AVERROR(ENOSYS);
+
+    if (!any_padding) {
+        const uint8_t *padding = map->data + end;
+        uint64_t nonzero = 0;
+
+        for (int i = 0; i < AV_INPUT_BUFFER_PADDING_SIZE; i += 8)
+            nonzero |= AV_RN64(padding + i);
+        if (nonzero)
+            return AVERROR(ENOSYS);
+    }
+
+    ref = av_buffer_ref(map);
+    if (!ref)
+        return AVERROR(ENOMEM);
+
+    /* skip the data, seeking the underlying resource if it is not buffered,
+     * rather than reading it into the buffer */
+    if (s->buf_end - s->buf_ptr >= size) {
+        s->buf_ptr += size;
+    } else {
+        int64_t ret = s->seek(s->opaque, end, SEEK_SET);
+        if (ret < 0) {
+            av_buffer_unref(&ref);
+            return ret;
+        }
+        s->buf_end = s->checksum_ptr = s->buf_ptr = s->buf_ptr_max = s->buffer;
+        s->pos         = end;
+        s->eof_reached = 0;
+
+        ctx->bytes_read += size;
+        s->bytes_read    = ctx->bytes_read;
+    }
+
+    ref->data += pos;
+    ref->size  = size + AV_INPUT_BUFFER_PADDING_SIZE;
+    *buf = ref;
+
+    return size;
+}
+
 int avio_read_partial(AVIOContext *s, unsigned char *buf, int size)
 {
     int len;
@@ -23,11 +23,13 @@
 
 /**
  * @TODO
- *      support keeping files
  *      support filling with a background thread
  */
 
+#include "config.h"
+
 #include <inttypes.h>
+#include <stdio.h>
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
@@ -35,6 +37,10 @@
 #include "libavutil/file_open.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavutil/random_seed.h"
+#include "libavutil/sha.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
 #include "libavutil/tree.h"
 #include "avio.h"
 #include <fcntl.h>
@@ -45,9 +51,21 @@
 #include <unistd.h>
 #endif
 #include <sys/stat.h>
+#include "internal.h"
 #include "os_support.h"
 #include "url.h"
 
+/* sha1 of the url, in hex */
+#define CACHE_KEY_SIZE 40
+
+typedef struct CacheIndexEntry {
+    char key[CACHE_KEY_SIZE + 1];
+    /* changes whenever the data file is recreated */
+    uint64_t id;
+    int64_t size;
+    int64_t last_access;
+} CacheIndexEntry;
+
 typedef struct CacheEntry {
     int64_t logical_pos;
     int64_t physical_pos;
@@ -67,13 +85,660 @@ typedef struct CacheContext {
     URLContext *inner;
     int64_t cache_hit, cache_miss;
     int read_ahead_limit;
+    char *cache_dir;
+    int64_t max_size;
+    int64_t max_age;
+
+    /* persistent cache state, the inner protocol is opened on demand */
+    char key[CACHE_KEY_SIZE + 1];
+    uint64_t id;
+    char *inner_url;
+    int inner_flags;
+    AVDictionary *inner_opts;
+
+    /* validators of the resource the cached data belongs to, see
+     * cache_validate() */
+    char *etag;
+    char *last_modified;
+    int64_t remote_size;
+    int64_t checked;
+    /* the resource changed after some cached data was read */
+    int stale;
 } CacheContext;
 
+/* fcntl() locks do not exclude threads of the same process */
+static AVMutex index_mutex = AV_MUTEX_INITIALIZER;
+
 static int cmp(const void *key, const void *node)
 {
     return FFDIFFSIGN(*(const int64_t *)key, ((const CacheEntry *) node)->logical_pos);
 }
 
+static int enu_free(void *opaque, void *elem)
+{
+    av_free(elem);
+    return 0;
+}
+
+#if HAVE_FCNTL
+/* Add a cached range of the persistent data file, which is stored at its
+ * logical position */
+static int insert_extent(CacheContext *c, int64_t pos, int64_t size)
+{
+    while (size > 0) {
+        CacheEntry *entry, *next[2] = { NULL, NULL };
+        int len = FFMIN(size, INT_MAX / 2);
+
+        entry = av_tree_find(c->root, &pos, cmp, (void **)next);
+        if (entry) {
+            entry->size = FFMAX(entry->size, len);
+        } else {
+            struct AVTreeNode *node = av_tree_node_alloc();
+            entry = av_malloc(sizeof(*entry));
+            if (!entry || !node) {
+                av_free(entry);
+                av_free(node);
+                return AVERROR(ENOMEM);
+            }
+            entry->logical_pos  = pos;
+            entry->physical_pos = pos;
+            entry->size         = len;
+            av_tree_insert(&c->root, entry, cmp, &node);
+        }
+        c->end = FFMAX(c->end, pos + len);
+        pos  += len;
+        size -= len;
+    }
+    return 0;
+}
+
+static int index_lock(URLContext *h)
+{
+    CacheContext *c = h->priv_data;
+    struct flock fl = { .l_type = F_WRLCK, .l_whence = SEEK_SET };
+    char *path = av_asprintf("%s/lock", c->cache_dir);
+    int fd, ret;
+
+    if (!path)
+        return AVERROR(ENOMEM);
+
+    ff_mutex_lock(&index_mutex);
+    fd = avpriv_open(path, O_RDWR | O_CREAT, 0644);
+    av_free(path);
+    if (fd < 0) {
+        ret = AVERROR(errno);
+        goto fail;
+    }
+    while (fcntl(fd, F_SETLKW, &fl) < 0) {
+        if (errno != EINTR) {
+            ret = AVERROR(errno);
+            close(fd);
+            goto fail;
+        }
+    }
+    return fd;
+
+fail:
+    ff_mutex_unlock(&index_mutex);
+    av_log(h, AV_LOG_ERROR, "Could not lock the cache index: %s\n", av_err2str(ret));
+    return ret;
+}
+
+static void index_unlock(int fd)
+{
+    /* closing the descriptor releases the lock */
+    close(fd);
+    ff_mutex_unlock(&index_mutex);
+}
+
+static int index_read(URLContext *h, CacheIndexEntry **entries, int *nb_entries)
+{
+    CacheContext *c = h->priv_data;
+    char *path = av_asprintf("%s/index", c->cache_dir);
+    CacheIndexEntry e;
+    char line[256];
+    FILE *f;
+
+    *entries   = NULL;
+    *nb_entries = 0;
+    if (!path)
+        return AVERROR(ENOMEM);
+    f = avpriv_fopen_utf8(path, "r");
+    av_free(path);
+    if (!f)
+        return errno == ENOENT ? 0 : AVERROR(errno);
+
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%40s %"SCNx64" %"SCNd64" %"SCNd64, e.key, &e.id,
+                   &e.size, &e.last_access) != 4 ||
+            strlen(e.key) != CACHE_KEY_SIZE)
+            continue;
+        if (!av_dynarray2_add((void **)entries, nb_entries, sizeof(e),
+                              (const uint8_t *)&e)) {
+            fclose(f);
+            return AVERROR(ENOMEM);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static int index_write(URLContext *h, const CacheIndexEntry *entries, int nb_entries)
+{
+    CacheContext *c = h->priv_data;
+    char *path = av_asprintf("%s/index", c->cache_dir);
+    char *tmp  = av_asprintf("%s/index.tmp", c->cache_dir);
+    FILE *f = NULL;
+    int ret = 0;
+
+    if (!path || !tmp) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    /* replace the index atomically, so that a crash cannot corrupt it */
+    f = avpriv_fopen_utf8(tmp, "w");
+    if (!f) {
+        ret = AVERROR(errno);
+        goto end;
+    }
+    for (int i = 0; i < nb_entries; i++)
+        fprintf(f, "%s %016"PRIx64" %"PRId64" %"PRId64"\n", entries[i].key,
+                entries[i].id, entries[i].size, entries[i].last_access);
+    if (fclose(f) || rename(tmp, path) < 0)
+        ret = AVERROR(errno);
+
+end:
+    if (ret < 0)
+        av_log(h, AV_LOG_ERROR, "Could not write the cache index: %s\n", av_err2str(ret));
+    av_free(path);
+    av_free(tmp);
+    return ret;
+}
+
+static char *object_path(CacheContext *c, const char *key, const char *ext)
+{
+    return av_asprintf("%s/%s.%s", c->cache_dir, key, ext);
+}
+
+/* Load the cached ranges of the object, called with the index locked */
+static int map_read(URLContext *h)
+{
+    CacheContext *c = h->priv_data;
+    char *path = object_path(c, c->key, "map");
+    char line[1024];
+    const char *p;
+    int64_t pos, size;
+    FILE *f;
+    int ret = 0;
+
+    if (!path)
+        return AVERROR(ENOMEM);
+    f = avpriv_fopen_utf8(path, "r");
+    av_free(path);
+    if (!f)
+        return errno == ENOENT ? 0 : AVERROR(errno);
+
+    while (fgets(line, sizeof(line), f) && ret >= 0) {
+        line[strcspn(line, "\r\n")] = 0;
+
+        /* the validators already known are the most recent ones */
+        if (av_strstart(line, "etag ", &p)) {
+            if (!c->etag && !(c->etag = av_strdup(p)))
+                ret = AVERROR(ENOMEM);
+        } else if (av_strstart(line, "modified ", &p)) {
+            if (!c->last_modified && !(c->last_modified = av_strdup(p)))
+                ret = AVERROR(ENOMEM);
+        } else if (sscanf(line, "size %"SCNd64, &size) == 1 && size >= 0) {
+            if (c->remote_size < 0)
+                c->remote_size = size;
+        } else if (sscanf(line, "checked %"SCNd64, &pos) == 1) {
+            c->checked = FFMAX(c->checked, pos);
+        } else if (sscanf(line, "eof %"SCNd64, &pos) == 1 && pos >= 0) {
+            c->end         = FFMAX(c->end, pos);
+            c->is_true_eof = 1;
+        } else if (sscanf(line, "%"SCNd64" %"SCNd64, &pos, &size) == 2 &&
+                   pos >= 0 && size > 0) {
+            ret = insert_extent(c, pos, size);
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+typedef struct MapWriter {
+    FILE *f;
+    int64_t start, end;
+    int64_t size;
+} MapWriter;
+
+static void map_flush(MapWriter *w)
+{
+    if (w->end > w->start) {
+        fprintf(w->f, "%"PRId64" %"PRId64"\n", w->start, w->end - w->start);
+        w->size += w->end - w->start;
+    }
+}
+
+static int map_write_entry(void *opaque, void *elem)
+{
+    MapWriter *w = opaque;
+    CacheEntry *entry = elem;
+
+    if (w->end > w->start && entry->logical_pos <= w->end) {
+        w->end = FFMAX(w->end, entry->logical_pos + entry->size);
+        return 0;
+    }
+    map_flush(w);
+    w->start = entry->logical_pos;
+    w->end   = entry->logical_pos + entry->size;
+    return 0;
+}
+
+/* Store the union of the ranges cached by every user of the object, called
+ * with the index locked */
+static int map_write(URLContext *h, int64_t *size)
+{
+    CacheContext *c = h->priv_data;
+    MapWriter w = { 0 };
+    char *path, *tmp;
+    int ret;
+
+    if ((ret = map_read(h)) < 0)
+        return ret;
+
+    path = object_path(c, c->key, "map");
+    tmp  = object_path(c, c->key, "map.tmp");
+    if (!path || !tmp) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    w.f = avpriv_fopen_utf8(tmp, "w");
+    if (!w.f) {
+        ret = AVERROR(errno);
+        goto end;
+    }
+    if (c->etag)
+        fprintf(w.f, "etag %s\n", c->etag);
+    if (c->last_modified)
+        fprintf(w.f, "modified %s\n", c->last_modified);
+    if (c->remote_size >= 0)
+        fprintf(w.f, "size %"PRId64"\n", c->remote_size);
+    fprintf(w.f, "checked %"PRId64"\n", c->checked);
+    if (c->is_true_eof)
+        fprintf(w.f, "eof %"PRId64"\n", c->end);
+    av_tree_enumerate(c->root, &w, NULL, map_write_entry);
+    map_flush(&w);
+    if (fclose(w.f) || rename(tmp, path) < 0)
+        ret = AVERROR(errno);
+    *size = w.size;
+
+end:
+    av_free(path);
+    av_free(tmp);
+    return ret;
+}
+
+static void object_remove(URLContext *h, const char *key)
+{
+    CacheContext *c = h->priv_data;
+    char *data = object_path(c, key, "data");
+    char *map  = object_path(c, key, "map");
+
+    if (map)
+        unlink(map);
+    if (data)
+        unlink(data);
+    av_free(data);
+    av_free(map);
+}
+
+static int cache_store(URLContext *h)
+{
+    CacheContext *c = h->priv_data;
+    CacheIndexEntry *entries;
+    int64_t total = 0;
+    int nb_entries, lock_fd, ret;
+
+    lock_fd = index_lock(h);
+    if (lock_fd < 0)
+        return lock_fd;
+    ret = index_read(h, &entries, &nb_entries);
+    if (ret < 0)
+        goto end;
+
+    for (int i = 0; i < nb_entries; i++) {
+        CacheIndexEntry *e = &entries[i];
+        /* skip the ranges if the object was evicted in the meantime */
+        if (!strcmp(e->key, c->key) && e->id == c->id) {
+            int64_t size;
+            if ((ret = map_write(h, &size)) < 0)
+                goto end;
+            e->size        = size;
+            e->last_access = av_gettime();
+        }
+        total += e->size;
+    }
+
+    /* evict the least recently used objects, but never the current one */
+    while (c->max_size && total > c->max_size) {
+        int lru = -1;
+        for (int i = 0; i < nb_entries; i++) {
+            if (strcmp(entries[i].key, c->key) &&
+                (lru < 0 || entries[i].last_access < entries[lru].last_access))
+                lru = i;
+        }
+        if (lru < 0)
+            break;
+        av_log(h, AV_LOG_VERBOSE, "Evicting %s (%"PRId64" bytes) from the cache\n",
+               entries[lru].key, entries[lru].size);
+        object_remove(h, entries[lru].key);
+        total -= entries[lru].size;
+        entries[lru] = entries[--nb_entries];
+    }
+
+    ret = index_write(h, entries, nb_entries);
+
+end:
+    index_unlock(lock_fd);
+    av_free(entries);
+    return ret;
+}
+
+/* Remove the object from the cache, unless it was already replaced */
+static int object_drop(URLContext *h)
+{
+    CacheContext *c = h->priv_data;
+    CacheIndexEntry *entries;
+    int nb_entries, lock_fd, ret;
+
+    lock_fd = index_lock(h);
+    if (lock_fd < 0)
+        return lock_fd;
+    ret = index_read(h, &entries, &nb_entries);
+    if (ret < 0)
+        goto end;
+
+    for (int i = 0; i < nb_entries; i++) {
+        if (!strcmp(entries[i].key, c->key) && entries[i].id == c->id) {
+            object_remove(h, c->key);
+            entries[i] = entries[--nb_entries];
+            ret = index_write(h, entries, nb_entries);
+            break;
+        }
+    }
+
+end:
+    index_unlock(lock_fd);
+    av_free(entries);
+    return ret;
+}
+
+static int object_open(URLContext *h, const char *arg)
+{
+    CacheContext *c = h->priv_data;
+    CacheIndexEntry *entries = NULL, *entry = NULL;
+    uint8_t digest[20];
+    struct AVSHA *sha;
+    char *path;
+    int nb_entries, lock_fd, ret, is_new = 0;
+
+    if (ff_mkdir_p(c->cache_dir) < 0 && errno != EEXIST) {
+        ret = AVERROR(errno);
+        av_log(h, AV_LOG_ERROR, "Could not create the cache directory %s: %s\n",
+               c->cache_dir, av_err2str(ret));
+        return ret;
+    }
+
+    sha = av_sha_alloc();
+    if (!sha)
+        return AVERROR(ENOMEM);
+    av_sha_init(sha, 160);
+    av_sha_update(sha, arg, strlen(arg));
+    av_sha_final(sha, digest);
+    av_free(sha);
+    ff_data_to_hex(c->key, digest, sizeof(digest), 1);
+
+    lock_fd = index_lock(h);
+    if (lock_fd < 0)
+        return lock_fd;
+    ret = index_read(h, &entries, &nb_entries);
+    if (ret < 0)
+        goto end;
+
+    for (int i = 0; i < nb_entries && !entry; i++)
+        if (!strcmp(entries[i].key, c->key))
+            entry = &entries[i];
+
+    if (entry) {
+        c->id = entry->id;
+        ret = map_read(h);
+        if (ret < 0)
+            goto end;
+    } else {
+        entry = av_dynarray2_add((void **)&entries, &nb_entries, sizeof(*entry), NULL);
+        if (!entry) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        memcpy(entry->key, c->key, sizeof(entry->key));
+        entry->id   = (uint64_t)av_get_random_seed() << 32 | av_get_random_seed();
+        entry->size = 0;
+        c->id       = entry->id;
+        is_new      = 1;
+    }
+    entry->last_access = av_gettime();
+
+    path = object_path(c, c->key, "data");
+    if (!path) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    /* a data file without index entry is left over from an evicted object */
+    c->fd = avpriv_open(path, O_RDWR | O_CREAT | (is_new ? O_TRUNC : 0), 0644);
+    av_free(path);
+    if (c->fd < 0) {
+        ret = AVERROR(errno);
+        av_log(h, AV_LOG_ERROR, "Failed to open the cache file: %s\n", av_err2str(ret));
+        goto end;
+    }
+
+    ret = index_write(h, entries, nb_entries);
+
+end:
+    index_unlock(lock_fd);
+    av_free(entries);
+    return ret;
+}
+
+static void object_free_ranges(CacheContext *c)
+{
+    av_tree_enumerate(c->root, NULL, NULL, enu_free);
+    av_tree_destroy(c->root);
+    c->root        = NULL;
+    c->end         = 0;
+    c->is_true_eof = 0;
+}
+
+/* Replace the cached copy of the object, which is stale, by an empty one */
+static int object_reset(URLContext *h, const char *arg)
+{
+    CacheContext *c = h->priv_data;
+    int ret;
+
+    close(c->fd);
+    c->fd = -1;
+    object_free_ranges(c);
+
+    ret = object_drop(h);
+    if (ret < 0)
+        return ret;
+    return object_open(h, arg);
+}
+
+/**
+ * Record the validators of the resource opened by the inner protocol: its
+ * ETag and last modification date, if it is an http resource, and its size.
+ *
+ * @return 1 if they show that the resource changed since it was cached,
+ *         0 otherwise
+ */
+static int cache_validate(URLContext *h)
+{
+    CacheContext *c = h->priv_data;
+    char *etag = NULL, *modified = NULL;
+    int64_t size;
+    int changed;
+
+    av_opt_get(c->inner, "etag", AV_OPT_SEARCH_CHILDREN | AV_OPT_ALLOW_NULL,
+               (uint8_t **)&etag);
+    av_opt_get(c->inner, "last_modified", AV_OPT_SEARCH_CHILDREN | AV_OPT_ALLOW_NULL,
+               (uint8_t **)&modified);
+    size = ffurl_seek(c->inner, 0, AVSEEK_SIZE);
+
+    changed = (etag     && c->etag          && strcmp(etag, c->etag)) ||
+              (modified && c->last_modified && strcmp(modified, c->last_modified)) ||
+              (size >= 0 && c->remote_size >= 0 && size != c->remote_size) ||
+              (size >= 0 && c->is_true_eof && size != c->end);
+    if (!etag && !modified && size < 0 && c->root)
+        av_log(h, AV_LOG_VERBOSE, "Cannot check whether the cached data of %s is up to date\n",
+               c->key);
+
+    if (etag) {
+        av_free(c->etag);
+        c->etag = etag;
+    }
+    if (modified) {
+        av_free(c->last_modified);
+        c->last_modified = modified;
+    }
+    if (size >= 0)
+        c->remote_size = size;
+    c->checked = av_gettime();
+
+    return changed;
+}
+
+/* Remove the options the inner protocol would take from options, so that
+ * only the ones nothing uses are left in it */
+static int inner_take_options(URLContext *h, const char *arg, int flags,
+                              AVDictionary **options)
+{
+    const AVDictionaryEntry *e = NULL;
+    AVDictionary *unused = NULL;
+    URLContext *uc;
+    int ret;
+
+    ret = ffurl_alloc(&uc, arg, flags, &h->interrupt_callback);
+    if (ret < 0)
+        return ret;
+
+    while ((e = av_dict_iterate(*options, e))) {
+        if (av_opt_find(uc, e->key, NULL, 0, AV_OPT_SEARCH_CHILDREN))
+            continue;
+        ret = av_dict_set(&unused, e->key, e->value, 0);
+        if (ret < 0)
+            break;
+    }
+    ffurl_closep(&uc);
+
+    if (ret < 0) {
+        av_dict_free(&unused);
+        return ret;
+    }
+    av_dict_free(options);
+    *options = unused;
+    return 0;
+}
+
+static int cache_open_persistent(URLContext *h, const char *arg, int flags,
+                                 AVDictionary **options)
+{
+    CacheContext *c = h->priv_data;
+    int ret;
+
+    c->fd          = -1;
+    c->remote_size = -1;
+    ret = object_open(h, arg);
+    if (ret < 0)
+        goto fail;
+
+    /* cached data validated less than max_age ago is used without
+     * connecting, until some data is missing */
+    if (c->root && c->max_age && av_gettime() - c->checked < c->max_age) {
+        c->inner_url   = av_strdup(arg);
+        c->inner_flags = flags;
+        if (!c->inner_url) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        if (options) {
+            ret = av_dict_copy(&c->inner_opts, *options, 0);
+            if (ret < 0)
+                goto fail;
+            /* the options are applied to the inner protocol later; options
+             * of nested protocols cannot be told from unknown ones here */
+            ret = inner_take_options(h, arg, flags, options);
+            if (ret < 0)
+                goto fail;
+        }
+        return 0;
+    }
+
+    ret = ffurl_open_whitelist(&c->inner, arg, flags, &h->interrupt_callback,
+                               options, h->protocol_whitelist, h->protocol_blacklist, h);
+    if (ret < 0)
+        goto fail;
+
+    if (cache_validate(h) && c->root) {
+        av_log(h, AV_LOG_INFO, "Cached data of %s is outdated, fetching it again\n",
+               c->key);
+        ret = object_reset(h, arg);
+        if (ret < 0)
+            goto fail;
+    }
+    return 0;
+
+fail:
+    if (c->fd >= 0)
+        close(c->fd);
+    ffurl_closep(&c->inner);
+    av_freep(&c->inner_url);
+    av_dict_free(&c->inner_opts);
+    av_freep(&c->etag);
+    av_freep(&c->last_modified);
+    object_free_ranges(c);
+    return ret;
+}
+#endif /* HAVE_FCNTL */
+
+static int open_inner(URLContext *h)
+{
+    CacheContext *c = h->priv_data;
+    int ret;
+
+    if (c->stale)
+        return AVERROR(EIO);
+    if (c->inner)
+        return 0;
+    ret = ffurl_open_whitelist(&c->inner, c->inner_url, c->inner_flags,
+                               &h->interrupt_callback, &c->inner_opts,
+                               h->protocol_whitelist, h->protocol_blacklist, h);
+    if (ret < 0)
+        return ret;
+
+#if HAVE_FCNTL
+    /* the data read from the cache so far may be outdated, so it cannot be
+     * completed with the current one */
+    if (cache_validate(h)) {
+        av_log(h, AV_LOG_ERROR, "%s changed since it was cached, dropping the cached data\n",
+               c->key);
+        c->stale = 1;
+        return AVERROR(EIO);
+    }
+#endif
+    return 0;
+}
+
 static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     CacheContext *c = h->priv_data;
@@ -82,6 +747,15 @@ static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **
 
     av_strstart(arg, "cache:", &arg);
 
+    if (c->cache_dir) {
+#if HAVE_FCNTL
+        return cache_open_persistent(h, arg, flags, options);
+#else
+        av_log(h, AV_LOG_ERROR, "Persistent caching is not supported on this platform\n");
+        return AVERROR(ENOSYS);
+#endif
+    }
+
     c->fd = avpriv_tempfile("ffcache", &buffername, 0, h);
     if (c->fd < 0){
         av_log(h, AV_LOG_ERROR, "Failed to create tempfile\n");
@@ -109,7 +783,10 @@ static int add_entry(URLContext *h, const unsigned char *buf, int size)
     struct AVTreeNode *node = NULL;
 
     //FIXME avoid lseek
-    pos = lseek(c->fd, 0, SEEK_END);
+    if (c->cache_dir)
+        pos = lseek(c->fd, c->logical_pos, SEEK_SET);
+    else
+        pos = lseek(c->fd, 0, SEEK_END);
     if (pos < 0) {
         ret = AVERROR(errno);
         av_log(h, AV_LOG_ERROR, "seek in cache failed\n");
@@ -200,6 +877,13 @@ static int cache_read(URLContext *h, unsigned char *buf, int size)
 
     // Cache miss or some kind of fault with the cache
 
+    if (c->cache_dir && c->is_true_eof && c->logical_pos >= c->end)
+        return AVERROR_EOF;
+
+    r = open_inner(h);
+    if (r < 0)
+        return r;
+
     if (c->logical_pos != c->inner_pos) {
         r = ffurl_seek(c->inner, c->logical_pos, SEEK_SET);
         if (r<0) {
@@ -233,6 +917,11 @@ static int64_t cache_seek(URLContext *h, int64_t pos, int whence)
     int64_t ret;
 
     if (whence == AVSEEK_SIZE) {
+        if (c->cache_dir && c->is_true_eof)
+            return c->end;
+        ret = open_inner(h);
+        if (ret < 0)
+            return ret;
         pos= ffurl_seek(c->inner, pos, whence);
         if(pos <= 0){
             pos= ffurl_seek(c->inner, -1, SEEK_END);
@@ -261,6 +950,9 @@ resolve_eof:
     }
 
     //cache miss
+    ret = open_inner(h);
+    if (ret < 0)
+        return ret;
     ret= ffurl_seek(c->inner, pos, whence);
     if ((whence == SEEK_SET && pos >= c->logical_pos ||
          whence == SEEK_END && pos <= 0) && ret < 0) {
@@ -292,12 +984,6 @@ resolve_eof:
     return ret;
 }
 
-static int enu_free(void *opaque, void *elem)
-{
-    av_free(elem);
-    return 0;
-}
-
 static int cache_close(URLContext *h)
 {
     CacheContext *c = h->priv_data;
@@ -306,6 +992,13 @@ static int cache_close(URLContext *h)
     av_log(h, AV_LOG_INFO, "Statistics, cache hits:%"PRId64" cache misses:%"PRId64"\n",
            c->cache_hit, c->cache_miss);
 
+#if HAVE_FCNTL
+    if (c->cache_dir && c->stale)
+        object_drop(h);
+    else if (c->cache_dir && cache_store(h) < 0)
+        av_log(h, AV_LOG_WARNING, "Could not store the cached ranges of %s\n", c->key);
+#endif
+
     close(c->fd);
     if (c->filename) {
         ret = unlink(c->filename);
@@ -314,6 +1007,10 @@ static int cache_close(URLContext *h)
         av_freep(&c->filename);
     }
     ffurl_closep(&c->inner);
+    av_freep(&c->inner_url);
+    av_dict_free(&c->inner_opts);
+    av_freep(&c->etag);
+    av_freep(&c->last_modified);
     av_tree_enumerate(c->root, NULL, NULL, enu_free);
     av_tree_destroy(c->root);
 
@@ -325,6 +1022,9 @@ static int cache_close(URLContext *h)
 
 static const AVOption options[] = {
     { "read_ahead_limit", "Amount in bytes that may be read ahead when seeking isn't supported, -1 for unlimited", OFFSET(read_ahead_limit), AV_OPT_TYPE_INT, { .i64 = 65536 }, -1, INT_MAX, D },
+    { "cache_dir", "Directory of a persistent cache shared between processes", OFFSET(cache_dir), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
+    { "cache_max_size", "Size in bytes above which the least recently used objects are evicted from the persistent cache, 0 for unlimited", OFFSET(max_size), AV_OPT_TYPE_INT64, { .i64 = 1LL << 30 }, 0, INT64_MAX, D },
+    { "cache_max_age", "Time during which data of the persistent cache is used without checking that the resource did not change, 0 to always check it", OFFSET(max_age), AV_OPT_TYPE_DURATION, { .i64 = 0 }, 0, INT64_MAX, D },
     {NULL},
 };
 
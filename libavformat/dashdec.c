@@ -31,6 +31,7 @@
 #include "avio_internal.h"
 #include "dash.h"
 #include "demux.h"
+#include "prefetch.h"
 #include "url.h"
 
 #define INITIAL_BUFFER_SIZE 32768
@@ -81,6 +82,8 @@ struct representation {
     char *url_template;
     FFIOContext pb;
     AVIOContext *input;
+    FFPrefetch *prefetch;
+    int prefetch_open; /* current fragment is read from prefetch */
     AVFormatContext *parent;
     AVFormatContext *ctx;
     int stream_index;
@@ -161,6 +164,11 @@ typedef struct DASHContext {
     int max_reload;
     char *cenc_decryption_key;
     char *cenc_decryption_keys;
+    int prefetch_segments;
+    FFPrefetchStats prefetch_stats;
+    int async_reload;
+    FFRefresh *refresh;
+    int64_t refresh_interval;
 
     /* Flags for init section*/
     int is_init_section_common_video;
@@ -365,6 +373,7 @@ static void free_representation(struct representation *pls)
     av_freep(&pls->init_sec_buf);
     av_freep(&pls->pb.pub.buffer);
     ff_format_io_close(pls->parent, &pls->input);
+    ff_prefetch_free(&pls->prefetch);
     if (pls->ctx) {
         pls->ctx->pb = NULL;
         avformat_close_input(&pls->ctx);
@@ -1300,7 +1309,8 @@ static int parse_manifest(AVFormatContext *s, const char *url, AVIOContext *in)
             return ret;
     }
 
-    if (av_opt_get(in, "location", AV_OPT_SEARCH_CHILDREN, (uint8_t**)&c->base_url) < 0)
+    if (!c->base_url &&
+        av_opt_get(in, "location", AV_OPT_SEARCH_CHILDREN, (uint8_t**)&c->base_url) < 0)
         c->base_url = av_strdup(url);
 
     av_bprint_init(&buf, 0, INT_MAX); // xmlReadMemory uses integer bufsize
@@ -1552,10 +1562,18 @@ static void move_segments(struct representation *rep_src, struct representation
 }
 
 
-static int refresh_manifest(AVFormatContext *s)
+/* With async_reload, parse the manifest last downloaded by the refresh thread,
+ * if it was not parsed yet. If wait is set, request a new download and wait
+ * for it instead. */
+static int refresh_manifest(AVFormatContext *s, int wait)
 {
     int ret = 0, i;
     DASHContext *c = s->priv_data;
+    FFIOContext pb;
+    char *data = NULL;
+    char *location = NULL;
+    int size = 0;
+
     // save current context
     int n_videos = c->n_videos;
     struct representation **videos = c->videos;
@@ -1565,14 +1583,25 @@ static int refresh_manifest(AVFormatContext *s)
     struct representation **subtitles = c->subtitles;
     char *base_url = c->base_url;
 
-    c->base_url = NULL;
+    if (c->refresh) {
+        ret = ff_refresh_get(c->refresh, wait, &data, &size, &location);
+        /* without an update period, download once per fragment like
+         * the synchronous reload, but one fragment ahead */
+        if (!wait && !c->refresh_interval)
+            ff_refresh_request(c->refresh);
+        if (ret <= 0)
+            return ret;
+        ffio_init_read_context(&pb, (const uint8_t *)data, size);
+    }
+
+    c->base_url = location;
     c->n_videos = 0;
     c->videos = NULL;
     c->n_audios = 0;
     c->audios = NULL;
     c->n_subtitles = 0;
     c->subtitles = NULL;
-    ret = parse_manifest(s, s->url, NULL);
+    ret = parse_manifest(s, s->url, data ? &pb.pub : NULL);
     if (ret)
         goto finish;
 
@@ -1580,19 +1609,22 @@ static int refresh_manifest(AVFormatContext *s)
         av_log(c, AV_LOG_ERROR,
                "new manifest has mismatched no. of video representations, %d -> %d\n",
                n_videos, c->n_videos);
-        return AVERROR_INVALIDDATA;
+        ret = AVERROR_INVALIDDATA;
+        goto finish;
     }
     if (c->n_audios != n_audios) {
         av_log(c, AV_LOG_ERROR,
                "new manifest has mismatched no. of audio representations, %d -> %d\n",
                n_audios, c->n_audios);
-        return AVERROR_INVALIDDATA;
+        ret = AVERROR_INVALIDDATA;
+        goto finish;
     }
     if (c->n_subtitles != n_subtitles) {
         av_log(c, AV_LOG_ERROR,
                "new manifest has mismatched no. of subtitles representations, %d -> %d\n",
                n_subtitles, c->n_subtitles);
-        return AVERROR_INVALIDDATA;
+        ret = AVERROR_INVALIDDATA;
+        goto finish;
     }
 
     for (i = 0; i < n_videos; i++) {
@@ -1648,9 +1680,35 @@ finish:
     c->audios = audios;
     c->n_videos = n_videos;
     c->videos = videos;
+    av_free(data);
     return ret;
 }
 
+static char *get_template_url(struct representation *pls, int64_t seq_no)
+{
+    DASHContext *c = pls->parent->priv_data;
+    char *tmpfilename;
+    char *url;
+
+    if (!pls->url_template) {
+        av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
+        return NULL;
+    }
+    tmpfilename = av_mallocz(c->max_url_size);
+    if (!tmpfilename)
+        return NULL;
+    ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, seq_no, 0, get_segment_start_time_based_on_timeline(pls, seq_no));
+    url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
+    if (!url) {
+        av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
+        url = av_strdup(pls->url_template);
+        if (!url)
+            av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
+    }
+    av_free(tmpfilename);
+    return url;
+}
+
 static struct fragment *get_current_fragment(struct representation *pls)
 {
     int64_t min_seq_no = 0;
@@ -1682,7 +1740,7 @@ static struct fragment *get_current_fragment(struct representation *pls)
                        c->max_reload, pls->cur_seq_no);
                 return NULL;
             }
-            refresh_manifest(pls->parent);
+            refresh_manifest(pls->parent, 1);
         } else {
             break;
         }
@@ -1692,7 +1750,7 @@ static struct fragment *get_current_fragment(struct representation *pls)
         max_seq_no = calc_max_seg_no(pls, c);
 
         if (pls->timelines || pls->fragments) {
-            refresh_manifest(pls->parent);
+            refresh_manifest(pls->parent, 0);
         }
         if (pls->cur_seq_no <= min_seq_no) {
             av_log(pls->parent, AV_LOG_VERBOSE, "old fragment: cur[%"PRId64"] min[%"PRId64"] max[%"PRId64"]\n", (int64_t)pls->cur_seq_no, min_seq_no, max_seq_no);
@@ -1711,30 +1769,11 @@ static struct fragment *get_current_fragment(struct representation *pls)
         }
     }
     if (seg) {
-        char *tmpfilename;
-        if (!pls->url_template) {
-            av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
-            av_free(seg);
-            return NULL;
-        }
-        tmpfilename = av_mallocz(c->max_url_size);
-        if (!tmpfilename) {
+        seg->url = get_template_url(pls, pls->cur_seq_no);
+        if (!seg->url) {
             av_free(seg);
             return NULL;
         }
-        ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, pls->cur_seq_no, 0, get_segment_start_time_based_on_timeline(pls, pls->cur_seq_no));
-        seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
-        if (!seg->url) {
-            av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
-            seg->url = av_strdup(pls->url_template);
-            if (!seg->url) {
-                av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
-                av_free(tmpfilename);
-                av_free(seg);
-                return NULL;
-            }
-        }
-        av_free(tmpfilename);
         seg->size = -1;
     }
 
@@ -1750,7 +1789,10 @@ static int read_from_url(struct representation *pls, struct fragment *seg,
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, pls->cur_seg_size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->prefetch_open)
+        ret = ff_prefetch_read(pls->prefetch, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1789,6 +1831,84 @@ cleanup:
     return ret;
 }
 
+/* Start reading seg from the prefetch buffers, if it was downloaded ahead */
+static int open_prefetched(DASHContext *c, struct representation *pls, struct fragment *seg)
+{
+    char *url = av_malloc(c->max_url_size);
+    int found;
+
+    if (!url)
+        return 0;
+    ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+    found = ff_prefetch_open(pls->prefetch, pls->cur_seq_no, url);
+    av_free(url);
+
+    if (found) {
+        pls->prefetch_open = 1;
+        pls->cur_seg_offset = 0;
+        pls->cur_seg_size = seg->size;
+    }
+    return found;
+}
+
+/* Queue the fragments following the current one for prefetching */
+static void prefetch_next_fragments(DASHContext *c, struct representation *pls)
+{
+    int64_t last = pls->cur_seq_no + c->prefetch_segments;
+    char *url;
+
+    ff_prefetch_retain(pls->prefetch, pls->cur_seq_no + 1, last);
+
+    if (pls->n_fragments)
+        last = FFMIN(last, pls->n_fragments - 1);
+    else if (!pls->url_template)
+        return;
+    else if (c->is_live)
+        last = FFMIN(last, calc_max_seg_no(pls, c));
+    else
+        last = FFMIN(last, pls->last_seq_no);
+
+    url = av_malloc(c->max_url_size);
+    if (!url)
+        return;
+
+    for (int64_t seq_no = pls->cur_seq_no + 1; seq_no <= last; seq_no++) {
+        AVDictionary *opts = NULL;
+        int64_t url_offset = 0, size = -1;
+        char *seg_url;
+        int is_http, ret;
+
+        if (pls->n_fragments) {
+            struct fragment *seg = pls->fragments[seq_no];
+            seg_url    = seg->url;
+            url_offset = seg->url_offset;
+            size       = seg->size;
+        } else {
+            seg_url = get_template_url(pls, seq_no);
+            if (!seg_url)
+                break;
+        }
+        ff_make_absolute_url(url, c->max_url_size, c->base_url, seg_url);
+        if (!pls->n_fragments)
+            av_free(seg_url);
+        is_http = ishttp(url);
+
+        /* over http, only request the byte range; otherwise seek to it */
+        ret = av_dict_copy(&opts, c->avio_opts, 0);
+        if (ret >= 0 && is_http && size >= 0) {
+            av_dict_set_int(&opts, "offset", url_offset, 0);
+            av_dict_set_int(&opts, "end_offset", url_offset + size, 0);
+        }
+        if (ret >= 0)
+            ret = ff_prefetch_queue(pls->prefetch, seq_no, url,
+                                    is_http ? 0 : url_offset, size, opts);
+        av_dict_free(&opts);
+        if (ret < 0)
+            break;
+    }
+    av_free(url);
+}
+
 static int update_init_section(struct representation *pls)
 {
     static const int max_init_section_size = 1024 * 1024;
@@ -1838,7 +1958,7 @@ static int update_init_section(struct representation *pls)
 static int64_t seek_data(void *opaque, int64_t offset, int whence)
 {
     struct representation *v = opaque;
-    if (v->n_fragments && !v->init_sec_data_len) {
+    if (v->n_fragments && !v->init_sec_data_len && !v->prefetch_open) {
         return avio_seek(v->input, offset, whence);
     }
 
@@ -1851,8 +1971,19 @@ static int read_data(void *opaque, uint8_t *buf, int buf_size)
     struct representation *v = opaque;
     DASHContext *c = v->parent->priv_data;
 
+    if (c->prefetch_segments && !v->prefetch) {
+        ret = ff_prefetch_alloc(&v->prefetch, v->parent, c->prefetch_segments,
+                                &c->prefetch_stats);
+        if (ret < 0) {
+            av_log(v->parent, AV_LOG_WARNING, "Could not start prefetching "
+                   "fragments: %s\n", av_err2str(ret));
+            c->prefetch_segments = 0;
+        }
+        ret = 0;
+    }
+
 restart:
-    if (!v->input) {
+    if (!v->input && !v->prefetch_open) {
         free_fragment(&v->cur_seg);
         v->cur_seg = get_current_fragment(v);
         if (!v->cur_seg) {
@@ -1865,7 +1996,10 @@ restart:
         if (ret)
             goto end;
 
-        ret = open_input(c, v, v->cur_seg);
+        if (v->prefetch && open_prefetched(c, v, v->cur_seg))
+            ret = 0;
+        else
+            ret = open_input(c, v, v->cur_seg);
         if (ret < 0) {
             if (ff_check_interrupt(c->interrupt_callback)) {
                 ret = AVERROR_EXIT;
@@ -1883,6 +2017,8 @@ restart:
             goto restart;
         }
         v->n_open_failures = 0;
+        if (v->prefetch)
+            prefetch_next_fragments(c, v);
     }
 
     if (v->init_sec_buf_read_offset < v->init_sec_data_len) {
@@ -1906,6 +2042,14 @@ restart:
     if (ret > 0)
         goto end;
 
+    if (v->prefetch_open && ret < 0 && ret != AVERROR_EXIT && ret != AVERROR_EOF &&
+        !v->cur_seg_offset) {
+        /* Nothing was returned from the fragment yet, open it directly */
+        ff_prefetch_close(v->prefetch);
+        v->prefetch_open = 0;
+        goto restart;
+    }
+
     if (c->is_live || v->cur_seq_no < v->last_seq_no) {
         if (!v->is_restart_needed)
             v->cur_seq_no++;
@@ -2164,6 +2308,31 @@ static int dash_read_header(AVFormatContext *s)
         av_dict_set(&c->avio_opts, "seekable", "0", 0);
     }
 
+    /* Prefetching and the refresh thread open the urls themselves,
+     * bypassing io_open. */
+    if (!ffio_geturlcontext(s->pb)) {
+        if (c->prefetch_segments) {
+            av_log(s, AV_LOG_WARNING, "Disabling prefetch_segments due to custom io_open.\n");
+            c->prefetch_segments = 0;
+        }
+        if (c->async_reload) {
+            av_log(s, AV_LOG_WARNING, "Disabling async_reload due to custom io_open.\n");
+            c->async_reload = 0;
+        }
+    }
+
+    if (c->is_live && c->async_reload) {
+        c->refresh_interval = c->minimum_update_period * 1000000;
+        ret = ff_refresh_alloc(&c->refresh, s, s->url, c->avio_opts,
+                               c->refresh_interval);
+        if (ret < 0)
+            av_log(s, AV_LOG_WARNING, "Could not start reloading the manifest "
+                   "in the background: %s\n", av_err2str(ret));
+        else if (!c->refresh_interval)
+            ff_refresh_request(c->refresh);
+        ret = 0;
+    }
+
     if(c->n_videos)
         c->is_init_section_common_video = is_common_init_section_exist(c->videos, c->n_videos);
 
@@ -2336,6 +2505,8 @@ static void recheck_discard_flags(AVFormatContext *s, struct representation **p,
         } else if (!needed && pls->ctx) {
             close_demux_for_component(pls);
             ff_format_io_close(pls->parent, &pls->input);
+            ff_prefetch_free(&pls->prefetch);
+            pls->prefetch_open = 0;
             av_log(s, AV_LOG_INFO, "No longer receiving stream_index %d\n", pls->stream_index);
         }
     }
@@ -2398,10 +2569,14 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
             cur->init_sec_buf_read_offset = 0;
             cur->is_restart_needed = 0;
             ff_format_io_close(cur->parent, &cur->input);
+            ff_prefetch_close(cur->prefetch);
+            cur->prefetch_open = 0;
             ret = reopen_demux_for_component(s, cur);
         } else if (ret == AVERROR_EOF) {
             close_demux_for_component(cur);
             ff_format_io_close(cur->parent, &cur->input);
+            ff_prefetch_close(cur->prefetch);
+            cur->prefetch_open = 0;
             av_log(s, AV_LOG_DEBUG, "EOF on stream_index %d\n", cur->stream_index);
             // prevent recheck_discard_flags() from re-enabling the component
             for (int i = 0; i < cur->nb_assoc_stream; i++)
@@ -2415,6 +2590,19 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
 static int dash_close(AVFormatContext *s)
 {
     DASHContext *c = s->priv_data;
+
+    ff_refresh_free(&c->refresh);
+
+    if (c->prefetch_stats.nb_segments) {
+        const FFPrefetchStats *st = &c->prefetch_stats;
+        av_log(s, AV_LOG_VERBOSE, "Read %"PRId64" prefetched fragments, "
+               "%"PRId64" bytes downloaded at %.0f kbit/s per connection, "
+               "%"PRId64" stalls lasting %.3f s in total\n",
+               st->nb_segments, st->bytes,
+               st->download_time ? st->bytes * 8000.0 / st->download_time : 0.0,
+               st->nb_stalls, st->stall_time / 1000000.0);
+    }
+
     free_audio_list(c);
     free_video_list(c);
     free_subtitle_list(c);
@@ -2444,6 +2632,8 @@ static int dash_seek(AVFormatContext *s, struct representation *pls, int64_t see
     }
 
     ff_format_io_close(pls->parent, &pls->input);
+    ff_prefetch_close(pls->prefetch);
+    pls->prefetch_open = 0;
 
     // find the nearest fragment
     if (pls->n_timelines > 0 && pls->fragment_timescale > 0) {
@@ -2545,6 +2735,25 @@ static const AVOption dash_options[] = {
     { "cenc_decryption_keys", "Media decryption keys by KID (hex)", OFFSET(cenc_decryption_keys), AV_OPT_TYPE_STRING, {.str = NULL}, INT_MIN, INT_MAX, .flags = FLAGS },
     { "max_reload", "Maximum number of manifest reloads in get_current_fragment() before giving up",
         OFFSET(max_reload), AV_OPT_TYPE_INT, { .i64 = 100 }, 0, INT_MAX, FLAGS },
+    { "async_reload", "Reload the manifest of live streams in a background thread",
+        OFFSET(async_reload), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, FLAGS },
+    { "prefetch_segments", "Number of fragments to download ahead in background threads",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, FLAGS },
+    { "prefetch_nb_segments", "Number of fragments read from prefetch buffers",
+        OFFSET(prefetch_stats.nb_segments), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX,
+        AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "prefetch_bytes", "Size of the fragments read from prefetch buffers",
+        OFFSET(prefetch_stats.bytes), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX,
+        AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "prefetch_download_time", "Time spent downloading prefetched fragments, in microseconds",
+        OFFSET(prefetch_stats.download_time), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX,
+        AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "prefetch_stalls", "Number of times reading waited for a prefetched fragment",
+        OFFSET(prefetch_stats.nb_stalls), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX,
+        AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "prefetch_stall_time", "Time spent waiting for prefetched fragments, in microseconds",
+        OFFSET(prefetch_stats.stall_time), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX,
+        AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     {NULL}
 };
 
@@ -51,6 +51,7 @@
 #include "internal.h"
 #include "mux.h"
 #include "os_support.h"
+#include "upload.h"
 #include "url.h"
 #include "dash.h"
 
@@ -204,14 +205,42 @@ typedef struct DASHContext {
     int64_t update_period;
     int64_t availability_start_time_ms;
     int64_t suggested_presentation_delay;
+    int upload_threads;
+    int upload_queue_size;
+    int upload_retries;
+    FFUploadQueue *upload;
 } DASHContext;
 
+/* local files are written synchronously, so that they can be renamed */
+static int use_upload(DASHContext *c, const char *filename)
+{
+    const char *proto;
+
+    if (!c->upload || !filename)
+        return 0;
+    proto = avio_find_protocol_name(filename);
+    return !proto || strcmp(proto, "file");
+}
+
+static void dashenc_io_free(AVFormatContext *s, AVIOContext **pb)
+{
+    DASHContext *c = s->priv_data;
+
+    if (c->upload && ff_upload_is_open(c->upload, *pb))
+        ff_upload_discard(c->upload, pb);
+    else
+        ff_format_io_close(s, pb);
+}
+
 static int dashenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
                            AVDictionary **options) {
     DASHContext *c = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
     int err = AVERROR_MUXER_NOT_FOUND;
-    if (!*pb || !http_base_proto || !c->http_persistent) {
+    if (use_upload(c, filename)) {
+        dashenc_io_free(s, pb);
+        err = ff_upload_open(c->upload, pb, filename, *options);
+    } else if (!*pb || !http_base_proto || !c->http_persistent) {
         err = s->io_open(s, pb, filename, AVIO_FLAG_WRITE, options);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -232,7 +261,9 @@ static void dashenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filenam
     if (!*pb)
         return;
 
-    if (!http_base_proto || !c->http_persistent) {
+    if (c->upload && ff_upload_is_open(c->upload, *pb)) {
+        ff_upload_close(c->upload, pb, 0);
+    } else if (!http_base_proto || !c->http_persistent) {
         ff_format_io_close(s, pb);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -244,6 +275,17 @@ static void dashenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filenam
     }
 }
 
+/* manifests are only published once the segments they reference are uploaded */
+static void dashenc_manifest_close(AVFormatContext *s, AVIOContext **pb, char *filename)
+{
+    DASHContext *c = s->priv_data;
+
+    if (c->upload && ff_upload_is_open(c->upload, *pb))
+        ff_upload_close(c->upload, pb, FF_UPLOAD_ORDERED);
+    else
+        dashenc_io_close(s, pb, filename);
+}
+
 static const char *get_format_str(SegmentType segment_type)
 {
     switch (segment_type) {
@@ -448,7 +490,7 @@ static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
     if (final)
         ff_hls_write_end_list(c->m3u8_out);
 
-    dashenc_io_close(s, &c->m3u8_out, temp_filename_hls);
+    dashenc_manifest_close(s, &c->m3u8_out, temp_filename_hls);
 
     if (use_rename)
         ff_rename(temp_filename_hls, filename_hls, os->ctx);
@@ -496,7 +538,7 @@ static void dash_free(AVFormatContext *s)
             else
                 ff_format_io_close(s, &os->ctx->pb);
         }
-        ff_format_io_close(s, &os->out);
+        dashenc_io_free(s, &os->out);
         avformat_free_context(os->ctx);
         avcodec_free_context(&os->parser_avctx);
         av_parser_close(os->parser);
@@ -509,9 +551,10 @@ static void dash_free(AVFormatContext *s)
     }
     av_freep(&c->streams);
 
-    ff_format_io_close(s, &c->mpd_out);
-    ff_format_io_close(s, &c->m3u8_out);
-    ff_format_io_close(s, &c->http_delete);
+    dashenc_io_free(s, &c->mpd_out);
+    dashenc_io_free(s, &c->m3u8_out);
+    dashenc_io_free(s, &c->http_delete);
+    ff_upload_free(&c->upload);
 }
 
 static void output_segment_list(OutputStream *os, AVIOContext *out, AVFormatContext *s,
@@ -1118,7 +1161,7 @@ static int write_manifest(AVFormatContext *s, int final)
 
     avio_printf(out, "</MPD>\n");
     avio_flush(out);
-    dashenc_io_close(s, &c->mpd_out, temp_filename);
+    dashenc_manifest_close(s, &c->mpd_out, temp_filename);
 
     if (use_rename) {
         if ((ret = ff_rename(temp_filename, s->url, s)) < 0)
@@ -1235,7 +1278,7 @@ static int write_manifest(AVFormatContext *s, int final)
             }
         }
 
-        dashenc_io_close(s, &c->m3u8_out, temp_filename);
+        dashenc_manifest_close(s, &c->m3u8_out, temp_filename);
         if (use_rename)
             if ((ret = ff_rename(temp_filename, filename_hls, s)) < 0)
                 return ret;
@@ -1358,6 +1401,24 @@ static int dash_init(AVFormatContext *s)
     if (!c->streams)
         return AVERROR(ENOMEM);
 
+    if (c->upload_threads) {
+        if (c->single_file || c->streaming) {
+            av_log(s, AV_LOG_WARNING, "Background uploads are not supported "
+                   "with single_file or streaming, uploading synchronously\n");
+        } else if (!ff_format_io_is_default(s)) {
+            av_log(s, AV_LOG_WARNING, "Background uploads are not supported "
+                   "with custom io_open, uploading synchronously\n");
+        } else {
+            ret = ff_upload_alloc(&c->upload, s, c->upload_threads,
+                                  c->upload_queue_size, c->upload_retries);
+            if (ret == AVERROR(ENOSYS))
+                av_log(s, AV_LOG_WARNING, "Background uploads are not "
+                       "supported in this build, uploading synchronously\n");
+            else if (ret < 0)
+                return ret;
+        }
+    }
+
     if ((ret = parse_adaptation_sets(s)) < 0)
         return ret;
 
@@ -1467,7 +1528,7 @@ static int dash_init(AVFormatContext *s)
                 av_dict_free(&opts);
                 return ret;
             }
-            ret = s->io_open(s, &os->out, filename, AVIO_FLAG_WRITE, &opts);
+            ret = dashenc_io_open(s, &os->out, filename, &opts);
         } else {
             ctx->url = av_strdup(filename);
             ret = s->io_open(s, &ctx->pb, filename, AVIO_FLAG_WRITE, &opts);
@@ -2218,6 +2279,12 @@ static int dash_write_trailer(AVFormatContext *s)
         }
     }
 
+    if (c->upload) {
+        int ret = ff_upload_flush(c->upload);
+        if (ret < 0 && !c->ignore_io_errors)
+            return ret;
+    }
+
     return 0;
 }
 
@@ -2287,6 +2354,9 @@ static const AVOption options[] = {
     { "target_latency", "Set desired target latency for Low-latency dash", OFFSET(target_latency), AV_OPT_TYPE_DURATION, { .i64 = 0 }, 0, INT_MAX, E },
     { "timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
     { "update_period", "Set the mpd update interval", OFFSET(update_period), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E},
+    { "upload_queue_size", "maximum number of files waiting for a background upload", OFFSET(upload_queue_size), AV_OPT_TYPE_INT, {.i64 = 16}, 1, INT_MAX, E },
+    { "upload_retries", "number of times a failed background upload is retried", OFFSET(upload_retries), AV_OPT_TYPE_INT, {.i64 = 2}, 0, INT_MAX, E },
+    { "upload_threads", "number of concurrent background uploads to network outputs, 0 to upload synchronously", OFFSET(upload_threads), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, E },
     { "use_template", "Use SegmentTemplate instead of SegmentList", OFFSET(use_template), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, E },
     { "use_timeline", "Use SegmentTimeline in SegmentTemplate", OFFSET(use_timeline), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, E },
     { "utc_timing_url", "URL of the page that will return the UTC timestamp in ISO format", OFFSET(utc_timing_url), AV_OPT_TYPE_STRING, { 0 }, 0, 0, E },
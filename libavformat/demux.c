@@ -48,6 +48,7 @@
 #include "demux.h"
 #include "id3v2.h"
 #include "internal.h"
+#include "streaminfo.h"
 #include "url.h"
 
 static int64_t wrap_timestamp(const AVStream *st, int64_t timestamp)
@@ -2618,6 +2619,26 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     int64_t max_subtitle_analyze_duration;
     int64_t probesize = ic->probesize;
     int eof_reached = 0;
+    int min_probe = ic->flags & AVFMT_FLAG_MIN_PROBE;
+    char *stream_info_key = NULL;
+    int stream_info_loaded = 0;
+    int missing_parameters = 0;
+
+    if (ic->stream_info_file) {
+        ret = ff_stream_info_key(ic, &stream_info_key);
+        if (ret < 0)
+            return ret;
+        ret = ff_stream_info_read(ic, ic->stream_info_file, stream_info_key);
+        if (ret < 0) {
+            av_free(stream_info_key);
+            return ret;
+        }
+        /* skip the probing, but not what follows it */
+        stream_info_loaded = ret;
+        ret = 0;
+        if (stream_info_loaded)
+            goto probing_done;
+    }
 
     flush_codecs = probesize > 0;
 
@@ -2725,8 +2746,18 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             int fps_analyze_framecount = 20;
             int count;
 
+            /* only the streams that will be read need to be complete */
+            if (min_probe && st->discard >= AVDISCARD_ALL)
+                continue;
             if (!has_codec_parameters(st, NULL))
                 break;
+            if (min_probe) {
+                if (!sti->avctx->extradata &&
+                    (!sti->extract_extradata.inited || sti->extract_extradata.bsf) &&
+                    extract_extradata_check(st))
+                    break;
+                continue;
+            }
             /* If the timebase is coarse (like the usual millisecond precision
              * of mkv), we need to analyze more frames to reliably arrive at
              * the correct fps. */
@@ -2766,8 +2797,9 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         if (i == ic->nb_streams && !si->missing_streams) {
             analyzed_all_streams = 1;
             /* NOTE: If the format has no header, then we need to read some
-             * packets to get most of the streams, so we cannot stop here. */
-            if (!(ic->ctx_flags & AVFMTCTX_NOHEADER)) {
+             * packets to get most of the streams, so we cannot stop here,
+             * unless only the streams found so far are wanted. */
+            if (!(ic->ctx_flags & AVFMTCTX_NOHEADER) || min_probe && ic->nb_streams) {
                 /* If we found the info for all the codecs, we can stop. */
                 ret = count;
                 av_log(ic, AV_LOG_DEBUG, "All info found\n");
@@ -2822,6 +2854,12 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         if (!(st->disposition & AV_DISPOSITION_ATTACHED_PIC))
             read_size += pkt->size;
 
+        if (min_probe && st->discard >= AVDISCARD_ALL) {
+            if (ic->flags & AVFMT_FLAG_NOBUFFER)
+                av_packet_unref(pkt1);
+            continue;
+        }
+
         avctx = sti->avctx;
         if (!sti->avctx_inited) {
             ret = avcodec_parameters_to_context(avctx, st->codecpar);
@@ -3094,6 +3132,8 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 
     av_opt_set_int(ic, "skip_clear", 0, AV_OPT_SEARCH_CHILDREN);
 
+probing_done:
+
     if (ret >= 0 && ic->nb_streams)
         /* We could not have all the codec parameters before EOF. */
         ret = -1;
@@ -3111,8 +3151,13 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             if (ret < 0)
                 goto find_stream_info_err;
         }
-        if (!has_codec_parameters(st, &errmsg)) {
+        /* the stored parameters were complete, but some checks rely on
+         * the decoding done while probing */
+        if (!stream_info_loaded && !has_codec_parameters(st, &errmsg)) {
             char buf[256];
+            missing_parameters = 1;
+            if (min_probe && st->discard >= AVDISCARD_ALL)
+                continue;
             avcodec_string(buf, sizeof(buf), sti->avctx, 0);
             av_log(ic, AV_LOG_WARNING,
                    "Could not find codec parameters for stream %d (%s): %s\n"
@@ -3181,6 +3226,11 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         lcevc->height = st->codecpar->height;
     }
 
+    /* streams created while probing would not exist when it is skipped */
+    if (stream_info_key && !stream_info_loaded && ret >= 0 && !missing_parameters &&
+        ic->nb_streams == orig_nb_streams)
+        ff_stream_info_write(ic, ic->stream_info_file, stream_info_key);
+
 find_stream_info_err:
     for (unsigned i = 0; i < ic->nb_streams; i++) {
         AVStream *const st  = ic->streams[i];
@@ -3205,6 +3255,7 @@ find_stream_info_err:
         av_log(ic, AV_LOG_DEBUG, "After avformat_find_stream_info() pos: %"PRId64" bytes read:%"PRId64" seeks:%d frames:%d\n",
                avio_tell(ic->pb), ctx->bytes_read, ctx->seek_count, count);
     }
+    av_free(stream_info_key);
     return ret;
 
 unref_then_goto_end:
@@ -29,6 +29,7 @@
 #include "libavutil/internal.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "avio.h"
 #if HAVE_DIRENT_H
 #include <dirent.h>
@@ -41,6 +42,9 @@
 #include <unistd.h>
 #endif
 #include <sys/stat.h>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <stdlib.h>
 #include "os_support.h"
 #include "url.h"
@@ -90,6 +94,10 @@
 #  endif
 #endif
 
+#define FILE_READAHEAD (CONFIG_FILE_PROTOCOL && HAVE_PREAD && HAVE_THREADS)
+
+#define READAHEAD_MAX_THREADS 8
+
 /* standard file protocol */
 
 typedef struct FileContext {
@@ -100,17 +108,68 @@ typedef struct FileContext {
     int pkt_size;
     int follow;
     int seekable;
+    int readahead;
+    int readahead_size;
+    struct Readahead *ra;
+    int use_mmap;
+    AVBufferRef *map;
+    int64_t map_pos;
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
 } FileContext;
 
+#if FILE_READAHEAD
+enum ReadaheadState {
+    RA_FREE,
+    RA_QUEUED,
+    RA_READING,
+    RA_DONE,
+};
+
+typedef struct ReadaheadBlock {
+    uint8_t *data;
+    int64_t  pos;   ///< file offset of the first byte of the block
+    int      size;  ///< bytes read, less than the block size only at EOF
+    int      err;   ///< error code if the read failed
+    enum ReadaheadState state;
+    int      stale; ///< set when a block being read is not needed anymore
+} ReadaheadBlock;
+
+/**
+ * Blocks following the current read position are read by a pool of worker
+ * threads with pread(), so that several reads are in flight while the caller
+ * is consuming data. The number of blocks kept ahead starts at one and
+ * doubles with every block consumed sequentially, up to the configured
+ * maximum; seeking out of the read-ahead window resets it.
+ */
+typedef struct Readahead {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    pthread_t       threads[READAHEAD_MAX_THREADS];
+    int          nb_threads;
+    int             exit;
+
+    int             fd;
+    ReadaheadBlock *blocks;
+    int          nb_blocks;
+    int             block_size;
+    int             depth;
+
+    int64_t         pos;      ///< current logical read position
+    int64_t         next_pos; ///< file offset of the next block to queue
+} Readahead;
+#endif
+
 static const AVOption file_options[] = {
     { "truncate", "truncate existing files on write", offsetof(FileContext, trunc), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, AV_OPT_FLAG_ENCODING_PARAM },
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
     { "pkt_size", "Maximum packet size", offsetof(FileContext, pkt_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "readahead", "Number of blocks to read ahead in background threads", offsetof(FileContext, readahead), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, AV_OPT_FLAG_DECODING_PARAM },
+    { "readahead_size", "Size of a read-ahead block", offsetof(FileContext, readahead_size), AV_OPT_TYPE_INT, { .i64 = 1 << 20 }, 4096, INT_MAX / 2, AV_OPT_FLAG_DECODING_PARAM },
+    { "mmap", "Map the file to memory and let demuxers reference it without copying", offsetof(FileContext, use_mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -141,11 +200,307 @@ static const AVClass fd_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+#if FILE_READAHEAD
+static void ra_release(ReadaheadBlock *b)
+{
+    if (b->state == RA_READING)
+        b->stale = 1;
+    else
+        b->state = RA_FREE;
+}
+
+/* restart the read-ahead window at the read position */
+static void ra_reset(Readahead *ra)
+{
+    for (int i = 0; i < ra->nb_blocks; i++)
+        if (ra->blocks[i].state != RA_FREE)
+            ra_release(&ra->blocks[i]);
+    ra->next_pos = ra->pos;
+    ra->depth    = 1;
+}
+
+/* drop the blocks before the read position and queue the ones following it,
+ * must be called with the lock held */
+static void ra_schedule(Readahead *ra)
+{
+    int64_t start = INT64_MAX;
+    int active = 0, queued = 0;
+
+    for (int i = 0; i < ra->nb_blocks; i++) {
+        ReadaheadBlock *b = &ra->blocks[i];
+
+        if (b->state == RA_FREE || b->stale)
+            continue;
+        if (b->pos + ra->block_size <= ra->pos) {
+            ra_release(b);
+            continue;
+        }
+        start = FFMIN(start, b->pos);
+        active++;
+    }
+
+    // seeked out of the read-ahead window
+    if ((active && ra->pos < start) || ra->pos > ra->next_pos) {
+        ra_reset(ra);
+        active = 0;
+    }
+
+    for (int i = 0; i < ra->nb_blocks && active < ra->depth; i++) {
+        ReadaheadBlock *b = &ra->blocks[i];
+
+        if (b->state != RA_FREE)
+            continue;
+
+        b->pos   = ra->next_pos;
+        b->size  = 0;
+        b->err   = 0;
+        b->stale = 0;
+        b->state = RA_QUEUED;
+
+        ra->next_pos += ra->block_size;
+        active++;
+        queued++;
+    }
+
+    if (queued)
+        pthread_cond_broadcast(&ra->cond);
+}
+
+static void *ra_worker(void *arg)
+{
+    Readahead *ra = arg;
+
+    pthread_mutex_lock(&ra->lock);
+    while (!ra->exit) {
+        ReadaheadBlock *b = NULL;
+        int size = 0, err = 0;
+
+        // read the queued block closest to the read position first
+        for (int i = 0; i < ra->nb_blocks; i++)
+            if (ra->blocks[i].state == RA_QUEUED &&
+                (!b || ra->blocks[i].pos < b->pos))
+                b = &ra->blocks[i];
+        if (!b) {
+            pthread_cond_wait(&ra->cond, &ra->lock);
+            continue;
+        }
+        b->state = RA_READING;
+        pthread_mutex_unlock(&ra->lock);
+
+        while (size < ra->block_size) {
+            ssize_t ret = pread(ra->fd, b->data + size, ra->block_size - size,
+                                b->pos + size);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret < 0)
+                err = AVERROR(errno);
+            if (ret <= 0)
+                break;
+            size += ret;
+        }
+
+        pthread_mutex_lock(&ra->lock);
+        if (b->stale) {
+            b->stale = 0;
+            b->state = RA_FREE;
+        } else {
+            b->size  = size;
+            b->err   = err;
+            b->state = RA_DONE;
+        }
+        pthread_cond_broadcast(&ra->cond);
+    }
+    pthread_mutex_unlock(&ra->lock);
+
+    return NULL;
+}
+
+static int ra_read(Readahead *ra, unsigned char *buf, int size)
+{
+    int ret;
+
+    pthread_mutex_lock(&ra->lock);
+    while (1) {
+        ReadaheadBlock *b = NULL;
+
+        ra_schedule(ra);
+
+        for (int i = 0; i < ra->nb_blocks; i++) {
+            ReadaheadBlock *cur = &ra->blocks[i];
+            if (cur->state != RA_FREE && !cur->stale &&
+                cur->pos <= ra->pos && ra->pos < cur->pos + ra->block_size) {
+                b = cur;
+                break;
+            }
+        }
+        if (!b || b->state != RA_DONE) {
+            pthread_cond_wait(&ra->cond, &ra->lock);
+            continue;
+        }
+
+        if (b->err) {
+            // let the read be retried on the next call
+            ret = b->err;
+            ra_reset(ra);
+            break;
+        }
+        if (ra->pos >= b->pos + b->size) {
+            ret = AVERROR_EOF;
+            break;
+        }
+
+        ret = FFMIN(size, b->pos + b->size - ra->pos);
+        memcpy(buf, b->data + (ra->pos - b->pos), ret);
+        ra->pos += ret;
+
+        // sequential access, read further ahead
+        if (ra->pos == b->pos + ra->block_size) {
+            ra->depth = FFMIN(ra->depth * 2, ra->nb_blocks);
+            ra_schedule(ra);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&ra->lock);
+
+    return ret;
+}
+
+static int64_t ra_seek(Readahead *ra, int64_t pos, int whence)
+{
+    struct stat st;
+
+    switch (whence) {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        pos += ra->pos;
+        break;
+    case SEEK_END:
+        if (fstat(ra->fd, &st) < 0)
+            return AVERROR(errno);
+        pos += st.st_size;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    pthread_mutex_lock(&ra->lock);
+    ra->pos = pos;
+    ra_schedule(ra);
+    pthread_mutex_unlock(&ra->lock);
+
+    return pos;
+}
+
+static void ra_free(Readahead **pra)
+{
+    Readahead *ra = *pra;
+
+    if (!ra)
+        return;
+
+    pthread_mutex_lock(&ra->lock);
+    ra->exit = 1;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+
+    for (int i = 0; i < ra->nb_threads; i++)
+        pthread_join(ra->threads[i], NULL);
+
+    if (ra->blocks) {
+        for (int i = 0; i < ra->nb_blocks; i++)
+            av_freep(&ra->blocks[i].data);
+        av_freep(&ra->blocks);
+    }
+    pthread_cond_destroy(&ra->cond);
+    pthread_mutex_destroy(&ra->lock);
+    av_freep(pra);
+}
+
+static int ra_init(URLContext *h, FileContext *c)
+{
+    Readahead *ra;
+    int ret;
+
+    ra = av_mallocz(sizeof(*ra));
+    if (!ra)
+        return AVERROR(ENOMEM);
+
+    ret = pthread_mutex_init(&ra->lock, NULL);
+    if (ret) {
+        av_free(ra);
+        return AVERROR(ret);
+    }
+    ret = pthread_cond_init(&ra->cond, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&ra->lock);
+        av_free(ra);
+        return AVERROR(ret);
+    }
+    c->ra = ra;
+
+    ra->fd         = c->fd;
+    ra->block_size = c->readahead_size;
+    ra->depth      = 1;
+
+    ra->blocks = av_calloc(c->readahead, sizeof(*ra->blocks));
+    if (!ra->blocks)
+        return AVERROR(ENOMEM);
+    for (; ra->nb_blocks < c->readahead; ra->nb_blocks++) {
+        ra->blocks[ra->nb_blocks].data = av_malloc(ra->block_size);
+        if (!ra->blocks[ra->nb_blocks].data)
+            return AVERROR(ENOMEM);
+    }
+
+    for (; ra->nb_threads < FFMIN(c->readahead, READAHEAD_MAX_THREADS); ra->nb_threads++) {
+        ret = pthread_create(&ra->threads[ra->nb_threads], NULL, ra_worker, ra);
+        if (ret)
+            return AVERROR(ret);
+    }
+
+    av_log(h, AV_LOG_DEBUG, "Reading ahead up to %d blocks of %d bytes using %d threads\n",
+           ra->nb_blocks, ra->block_size, ra->nb_threads);
+
+    return 0;
+}
+#endif
+
+/* Accessing a mapping beyond the end of the file raises SIGBUS, so stop
+ * using it once the file has been truncated. Packets still referencing it
+ * are not protected. */
+static void file_map_check(URLContext *h, FileContext *c)
+{
+    struct stat st;
+
+    if (!c->map || (!fstat(c->fd, &st) && st.st_size >= c->map->size))
+        return;
+
+    av_log(h, AV_LOG_WARNING, "File truncated while mapped, reading it instead\n");
+    if (lseek(c->fd, c->map_pos, SEEK_SET) < 0)
+        av_log(h, AV_LOG_ERROR, "Could not seek: %s\n", av_err2str(AVERROR(errno)));
+    av_buffer_unref(&c->map);
+}
+
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+    file_map_check(h, c);
+    if (c->map) {
+        if (c->map_pos >= c->map->size)
+            return AVERROR_EOF;
+        size = FFMIN(size, c->map->size - c->map_pos);
+        memcpy(buf, c->map->data + c->map_pos, size);
+        c->map_pos += size;
+        return size;
+    }
+#if FILE_READAHEAD
+    if (c->ra)
+        return ra_read(c->ra, buf, size);
+#endif
     ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
@@ -226,7 +581,12 @@ static int fd_dup(URLContext *h, int oldfd)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
-    int ret = close(c->fd);
+    int ret;
+#if FILE_READAHEAD
+    ra_free(&c->ra);
+#endif
+    av_buffer_unref(&c->map);
+    ret = close(c->fd);
     return (ret == -1) ? AVERROR(errno) : 0;
 }
 
@@ -245,6 +605,23 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
         return ret < 0 ? AVERROR(errno) : (S_ISFIFO(st.st_mode) ? 0 : st.st_size);
     }
 
+    if (c->map) {
+        if (whence == SEEK_CUR)
+            pos += c->map_pos;
+        else if (whence == SEEK_END)
+            pos += c->map->size;
+        else if (whence != SEEK_SET)
+            return AVERROR(EINVAL);
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        return c->map_pos = pos;
+    }
+
+#if FILE_READAHEAD
+    if (c->ra)
+        return ra_seek(c->ra, pos, whence);
+#endif
+
     ret = lseek(c->fd, pos, whence);
 
     return ret < 0 ? AVERROR(errno) : ret;
@@ -288,6 +665,52 @@ static int file_move(URLContext *h_src, URLContext *h_dst)
     return 0;
 }
 
+#if HAVE_MMAP
+static void file_unmap(void *opaque, uint8_t *data)
+{
+    munmap(data, (size_t)(uintptr_t)opaque);
+}
+#endif
+
+static int file_map(URLContext *h, FileContext *c)
+{
+#if HAVE_MMAP
+    struct stat st;
+    void *map;
+
+    if (fstat(c->fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+        st.st_size > SIZE_MAX) {
+        av_log(h, AV_LOG_VERBOSE, "Not a regular non-empty file, not mapping it\n");
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, c->fd, 0);
+    if (map == MAP_FAILED) {
+        av_log(h, AV_LOG_WARNING, "Could not map the file: %s\n", av_err2str(AVERROR(errno)));
+        return 0;
+    }
+
+    c->map = av_buffer_create(map, st.st_size, file_unmap,
+                              (void *)(uintptr_t)st.st_size, AV_BUFFER_FLAG_READONLY);
+    if (!c->map) {
+        munmap(map, st.st_size);
+        return AVERROR(ENOMEM);
+    }
+
+    return 0;
+#else
+    av_log(h, AV_LOG_WARNING, "Memory mapping is not supported in this build\n");
+    return 0;
+#endif
+}
+
+static const AVBufferRef *file_get_mapping(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    file_map_check(h, c);
+    return c->map;
+}
+
 static int file_open(URLContext *h, const char *filename, int flags)
 {
     FileContext *c = h->priv_data;
@@ -334,6 +757,33 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (c->seekable >= 0)
         h->is_streamed = !c->seekable;
 
+    if (c->use_mmap && !(flags & AVIO_FLAG_WRITE) && !c->follow) {
+        int ret = file_map(h, c);
+        if (ret < 0) {
+            close(c->fd);
+            return ret;
+        }
+    }
+
+    if (c->readahead && !c->map) {
+#if FILE_READAHEAD
+        if (flags & AVIO_FLAG_WRITE || c->follow ||
+            fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+            av_log(h, AV_LOG_WARNING, "Read-ahead is only supported when "
+                   "reading regular files, disabling it\n");
+        } else {
+            int ret = ra_init(h, c);
+            if (ret < 0) {
+                ra_free(&c->ra);
+                close(c->fd);
+                return ret;
+            }
+        }
+#else
+        av_log(h, AV_LOG_WARNING, "Read-ahead is not supported in this build\n");
+#endif
+    }
+
     return 0;
 }
 
@@ -429,6 +879,7 @@ const URLProtocol ff_file_protocol = {
     .url_seek            = file_seek,
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
+    .url_get_mapping     = file_get_mapping,
     .url_check           = file_check,
     .url_delete          = file_delete,
     .url_move            = file_move,
@@ -44,6 +44,7 @@
 #include "internal.h"
 #include "avio_internal.h"
 #include "id3v2.h"
+#include "prefetch.h"
 #include "url.h"
 
 #include "hls_sample_encryption.h"
@@ -108,6 +109,8 @@ struct playlist {
     int input_reuse;
     AVIOContext *input_next;
     int input_next_requested;
+    FFPrefetch *prefetch;
+    int prefetch_open; /* current segment is read from prefetch */
     AVFormatContext *parent;
     int index;
     AVFormatContext *ctx;
@@ -246,6 +249,8 @@ typedef struct HLSContext {
     int http_multiple;
     int http_seekable;
     int seg_max_retry;
+    int prefetch_segments;
+    FFPrefetchStats prefetch_stats;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
 } HLSContext;
@@ -300,6 +305,7 @@ static void free_playlist_list(HLSContext *c)
         pls->input_reuse = 0;
         ff_format_io_close(c->ctx, &pls->input_next);
         pls->input_next_requested = 0;
+        ff_prefetch_free(&pls->prefetch);
         if (pls->ctx) {
             pls->ctx->pb = NULL;
             avformat_close_input(&pls->ctx);
@@ -692,13 +698,12 @@ static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
 #endif
 }
 
-static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+/* Check that url is a http(s), data or file url, the latter only with an
+ * allowed extension. */
+static int check_url(AVFormatContext *s, const char *url, int *is_http_out)
 {
     HLSContext *c = s->priv_data;
-    AVDictionary *tmp = NULL;
     const char *proto_name = NULL;
-    int ret;
     int is_http = 0;
 
     if (av_strstart(url, "crypto", NULL)) {
@@ -740,6 +745,22 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     else if (strcmp(proto_name, "file") || !strncmp(url, "file,", 5))
         return AVERROR_INVALIDDATA;
 
+    *is_http_out = is_http;
+    return 0;
+}
+
+static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
+                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+{
+    HLSContext *c = s->priv_data;
+    AVDictionary *tmp = NULL;
+    int ret;
+    int is_http;
+
+    ret = check_url(s, url, &is_http);
+    if (ret < 0)
+        return ret;
+
     av_dict_copy(&tmp, *opts, 0);
     av_dict_copy(&tmp, opts2, 0);
 
@@ -1225,7 +1246,10 @@ static int read_from_url(struct playlist *pls, struct segment *seg,
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->prefetch_open)
+        ret = ff_prefetch_read(pls->prefetch, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1691,7 +1715,8 @@ static int reload_playlist(struct playlist *v, HLSContext *c)
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if ((!v->input && !v->prefetch_open) ||
+        (c->http_persistent && v->input_read_done)) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1758,6 +1783,42 @@ reload:
     return ret;
 }
 
+/* Queue the segments following the current one for prefetching. Encrypted
+ * segments are not prefetched. */
+static void prefetch_next_segments(HLSContext *c, struct playlist *pls)
+{
+    int64_t last = pls->cur_seq_no + c->prefetch_segments;
+
+    ff_prefetch_retain(pls->prefetch, pls->cur_seq_no + 1, last);
+
+    for (int64_t seq_no = pls->cur_seq_no + 1; seq_no <= last; seq_no++) {
+        int64_t n = seq_no - pls->start_seq_no;
+        AVDictionary *opts = NULL;
+        struct segment *seg;
+        int is_http, ret;
+
+        if (n >= pls->n_segments)
+            break;
+        seg = pls->segments[n];
+        if (seg->key_type != KEY_NONE ||
+            check_url(pls->parent, seg->url, &is_http) < 0)
+            continue;
+
+        /* over http, only request the byte range; otherwise seek to it */
+        ret = av_dict_copy(&opts, c->avio_opts, 0);
+        if (ret >= 0 && is_http && seg->size >= 0) {
+            av_dict_set_int(&opts, "offset", seg->url_offset, 0);
+            av_dict_set_int(&opts, "end_offset", seg->url_offset + seg->size, 0);
+        }
+        if (ret >= 0)
+            ret = ff_prefetch_queue(pls->prefetch, seq_no, seg->url,
+                                    is_http ? 0 : seg->url_offset, seg->size, opts);
+        av_dict_free(&opts);
+        if (ret < 0)
+            break;
+    }
+}
+
 static int read_data_continuous(void *opaque, uint8_t *buf, int buf_size)
 {
     struct playlist *v = opaque;
@@ -1776,6 +1837,16 @@ static int read_data_continuous(void *opaque, uint8_t *buf, int buf_size)
 
     v->input_read_done = 0;
 
+    if (c->prefetch_segments && !v->prefetch) {
+        ret = ff_prefetch_alloc(&v->prefetch, v->parent, c->prefetch_segments,
+                                &c->prefetch_stats);
+        if (ret < 0) {
+            av_log(v->parent, AV_LOG_WARNING, "Could not start prefetching "
+                   "segments: %s\n", av_err2str(ret));
+            c->prefetch_segments = 0;
+        }
+    }
+
 restart:
     ret = reload_playlist(v, c);
     if (ret < 0)
@@ -1783,13 +1854,21 @@ restart:
 
     seg = current_segment(v);
 
-    if (!v->input || v->input_read_done) {
+    if ((!v->input && !v->prefetch_open) || v->input_read_done) {
         /* load/update Media Initialization Section, if any */
         ret = update_init_section(v, seg);
         if (ret)
             return ret;
 
-        if (c->http_multiple == 1 && v->input_next_requested) {
+        if (v->prefetch && ff_prefetch_open(v->prefetch, v->cur_seq_no, seg->url)) {
+            /* a connection kept open for reuse is not needed anymore */
+            ff_format_io_close(v->parent, &v->input);
+            v->input_read_done = 0;
+            v->input_reuse = 0;
+            v->prefetch_open = 1;
+            v->cur_seg_offset = 0;
+            ret = 0;
+        } else if (c->http_multiple == 1 && v->input_next_requested) {
             FFSWAP(AVIOContext *, v->input, v->input_next);
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
@@ -1818,9 +1897,11 @@ restart:
         just_opened = 1;
         if (v->first_read_seq_no < 0)
             v->first_read_seq_no = v->cur_seq_no;
+        if (v->prefetch)
+            prefetch_next_segments(c, v);
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1830,7 +1911,7 @@ restart:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !v->input_next_requested && !v->prefetch &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL) &&
         !segment_reusable(v->input, current_segment(v), seg)) {
         ret = open_input(c, v, seg, &v->input_next);
@@ -1864,7 +1945,15 @@ restart:
 
         return ret;
     }
-    if (ret == 0 && segment_reusable(v->input, seg, next_segment(v))) {
+    if (v->prefetch_open) {
+        ff_prefetch_close(v->prefetch);
+        v->prefetch_open = 0;
+        if (ret == AVERROR_EXIT)
+            return ret;
+        /* Nothing was returned from the segment yet, open it directly */
+        if (ret < 0 && ret != AVERROR_EOF && !v->cur_seg_offset)
+            goto restart;
+    } else if (ret == 0 && segment_reusable(v->input, seg, next_segment(v))) {
         /* Clean boundary, and the next segment continues this resource. Keep
          * the connection open and read it as a whole. Note that splitting
          * segments in these cases is useful for dynamic variant/quality
@@ -2284,6 +2373,16 @@ static int hls_close(AVFormatContext *s)
     if (c->crypto_ctx.aes_ctx)
         av_free(c->crypto_ctx.aes_ctx);
 
+    if (c->prefetch_stats.nb_segments) {
+        const FFPrefetchStats *st = &c->prefetch_stats;
+        av_log(s, AV_LOG_VERBOSE, "Read %"PRId64" prefetched segments, "
+               "%"PRId64" bytes downloaded at %.0f kbit/s per connection, "
+               "%"PRId64" stalls lasting %.3f s in total\n",
+               st->nb_segments, st->bytes,
+               st->download_time ? st->bytes * 8000.0 / st->download_time : 0.0,
+               st->nb_stalls, st->stall_time / 1000000.0);
+    }
+
     av_dict_free(&c->avio_opts);
     ff_format_io_close(c->ctx, &c->playlist_pb);
 
@@ -2322,6 +2421,11 @@ static int hls_read_header(AVFormatContext *s)
             av_log(s, AV_LOG_WARNING, "Disabling http_multiple due to custom io_open.\n");
             c->http_multiple = 0;
         }
+        /* Prefetching opens the segments itself, bypassing io_open. */
+        if (c->prefetch_segments) {
+            av_log(s, AV_LOG_WARNING, "Disabling prefetch_segments due to custom io_open.\n");
+            c->prefetch_segments = 0;
+        }
     }
 
     /* XXX: Some HLS servers don't like being sent the range header,
@@ -2474,6 +2578,8 @@ static int hls_read_header(AVFormatContext *s)
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next = NULL;
             pls->input_next_requested = 0;
+            ff_prefetch_close(pls->prefetch);
+            pls->prefetch_open = 0;
             pls->cur_seg_offset = 0;
             pls->cur_init_section = NULL;
             /* Reset EOF flag */
@@ -2646,6 +2752,8 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             pls->input_reuse = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
+            ff_prefetch_free(&pls->prefetch);
+            pls->prefetch_open = 0;
             if (pls->is_subtitle)
                 avformat_close_input(&pls->ctx);
             pls->needed = 0;
@@ -3033,6 +3141,8 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         pls->input_reuse = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        ff_prefetch_close(pls->prefetch);
+        pls->prefetch_open = 0;
         av_packet_unref(pls->pkt);
         pb->eof_reached = 0;
         /* Clear any buffered data */
@@ -3165,6 +3275,23 @@ static const AVOption hls_options[] = {
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {"seg_max_retry", "Maximum number of times to reload a segment on error.",
      OFFSET(seg_max_retry), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_segments", "Number of segments to download ahead in background threads",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_nb_segments", "Number of segments read from prefetch buffers",
+        OFFSET(prefetch_stats.nb_segments), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX,
+        AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"prefetch_bytes", "Size of the segments read from prefetch buffers",
+        OFFSET(prefetch_stats.bytes), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX,
+        AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"prefetch_download_time", "Time spent downloading prefetched segments, in microseconds",
+        OFFSET(prefetch_stats.download_time), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX,
+        AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"prefetch_stalls", "Number of times reading waited for a prefetched segment",
+        OFFSET(prefetch_stats.nb_stalls), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX,
+        AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"prefetch_stall_time", "Time spent waiting for prefetched segments, in microseconds",
+        OFFSET(prefetch_stats.stall_time), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX,
+        AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
     {NULL}
 };
 
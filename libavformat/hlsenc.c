@@ -57,6 +57,7 @@
 #include "movenc.h"
 #endif
 #include "os_support.h"
+#include "upload.h"
 #include "url.h"
 
 typedef enum {
@@ -96,6 +97,16 @@ typedef struct HLSSegment {
     char buf[]; /* for filename, sub_filename and key_uri */
 } HLSSegment;
 
+typedef struct HLSPart {
+    double duration; /* in seconds */
+    int independent;
+    int64_t sequence; /* media sequence number of the segment */
+
+    struct HLSPart *next;
+
+    char filename[];
+} HLSPart;
+
 typedef enum HLSFlags {
     // Generate a single media file and use byte ranges in the playlist.
     HLS_SINGLE_FILE = (1 << 0),
@@ -161,6 +172,13 @@ typedef struct VariantStream {
     HLSSegment *last_segment;
     HLSSegment *old_segments;
 
+    HLSPart *parts;       /* partial segments of the last segments */
+    HLSPart *last_part;
+    int64_t part_start;   /* start of the current partial segment, in AV_TIME_BASE */
+    int part_number;      /* index of the current partial segment in its segment */
+    int part_offset;      /* offset of the current partial segment in the segment buffer */
+    int part_independent;
+
     char *basename_tmp;
     char *basename;
     char *vtt_basename;
@@ -206,6 +224,8 @@ typedef struct HLSContext {
     uint32_t start_sequence_source_type;  // enum StartSequenceSourceType
 
     int64_t time;          // Set by a private option.
+    int64_t part_time;     // Set by a private option.
+    int can_block_reload;  // Set by a private option.
     int64_t init_time;     // Set by a private option.
     int max_nb_segments;   // Set by a private option.
     int hls_delete_threshold; // Set by a private option.
@@ -265,6 +285,11 @@ typedef struct HLSContext {
     char *headers;
     int has_default_key; /* has DEFAULT field of var_stream_map */
     int has_video_m3u8; /* has video stream m3u8 list */
+
+    int upload_threads;
+    int upload_queue_size;
+    int upload_retries;
+    FFUploadQueue *upload;
 } HLSContext;
 
 static int strftime_expand(const char *fmt, char **dest)
@@ -290,13 +315,38 @@ static int strftime_expand(const char *fmt, char **dest)
     return r;
 }
 
+/* local files are written synchronously, so that they can be renamed */
+static int use_upload(HLSContext *hls, const char *filename)
+{
+    const char *proto;
+
+    if (!hls->upload || !filename)
+        return 0;
+    av_strstart(filename, "crypto:", &filename);
+    proto = avio_find_protocol_name(filename);
+    return !proto || strcmp(proto, "file");
+}
+
+static void hlsenc_io_free(AVFormatContext *s, AVIOContext **pb)
+{
+    HLSContext *hls = s->priv_data;
+
+    if (hls->upload && ff_upload_is_open(hls->upload, *pb))
+        ff_upload_discard(hls->upload, pb);
+    else
+        ff_format_io_close(s, pb);
+}
+
 static int hlsenc_io_open(AVFormatContext *s, AVIOContext **pb, const char *filename,
                           AVDictionary **options)
 {
     HLSContext *hls = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
     int err = AVERROR_MUXER_NOT_FOUND;
-    if (!*pb || !http_base_proto || !hls->http_persistent) {
+    if (use_upload(hls, filename)) {
+        hlsenc_io_free(s, pb);
+        err = ff_upload_open(hls->upload, pb, filename, *options);
+    } else if (!*pb || !http_base_proto || !hls->http_persistent) {
         err = s->io_open(s, pb, filename, AVIO_FLAG_WRITE, options);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -318,7 +368,9 @@ static int hlsenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename)
     int ret = 0;
     if (!*pb)
         return ret;
-    if (!http_base_proto || !hls->http_persistent || hls->key_info_file || hls->encrypt) {
+    if (hls->upload && ff_upload_is_open(hls->upload, *pb)) {
+        ret = ff_upload_close(hls->upload, pb, 0);
+    } else if (!http_base_proto || !hls->http_persistent || hls->key_info_file || hls->encrypt) {
         ff_format_io_close(s, pb);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -331,6 +383,16 @@ static int hlsenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename)
     return ret;
 }
 
+/* playlists are only published once the files they reference are uploaded */
+static int hlsenc_playlist_close(AVFormatContext *s, AVIOContext **pb, char *filename)
+{
+    HLSContext *hls = s->priv_data;
+
+    if (hls->upload && ff_upload_is_open(hls->upload, *pb))
+        return ff_upload_close(hls->upload, pb, FF_UPLOAD_ORDERED);
+    return hlsenc_io_close(s, pb, filename);
+}
+
 static void set_http_options(AVFormatContext *s, AVDictionary **options, HLSContext *c)
 {
     int http_base_proto = ff_is_http_proto(s->url);
@@ -505,6 +567,30 @@ static void reflush_dynbuf(VariantStream *vs, int *range_length)
     avio_write(vs->out, vs->temp_buffer, *range_length);
 }
 
+/* the first fragment flush of the fmp4 muxer only writes the init section */
+static int flush_init_file(AVFormatContext *s, VariantStream *vs)
+{
+    HLSContext *hls = s->priv_data;
+    AVFormatContext *oc = vs->avf;
+    int byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
+    int range_length;
+
+    range_length = avio_close_dyn_buf(oc->pb, &vs->init_buffer);
+    if (range_length <= 0)
+        return AVERROR(EINVAL);
+    avio_write(vs->out, vs->init_buffer, range_length);
+    if (!hls->resend_init_file)
+        av_freep(&vs->init_buffer);
+    vs->init_range_length = range_length;
+    avio_open_dyn_buf(&oc->pb);
+    vs->packets_written = 0;
+    vs->start_pos = range_length;
+    if (!byterange_mode) {
+        hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
+    }
+    return 0;
+}
+
 static int hls_delete_file(HLSContext *hls, AVFormatContext *avf,
                            char *path, const char *proto)
 {
@@ -1312,6 +1398,144 @@ static void hls_free_segments(HLSSegment *p)
     }
 }
 
+static void hls_free_parts(HLSPart *p)
+{
+    HLSPart *part;
+
+    while (p) {
+        part = p;
+        p = p->next;
+        av_freep(&part);
+    }
+}
+
+/* partial segments are named after their segment, e.g. seg3.0.m4s, seg3.1.m4s */
+static char *part_filename(HLSContext *hls, const char *url, int number)
+{
+    size_t len = strlen(url), ext;
+
+    /* they are written directly under their final name */
+    if ((hls->flags & HLS_TEMP_FILE) && len > 4 && !strcmp(url + len - 4, ".tmp"))
+        len -= 4;
+    for (ext = len; ext > 0 && url[ext - 1] != '.' && url[ext - 1] != '/'; ext--)
+        ;
+    if (!ext || url[ext - 1] != '.')
+        ext = len + 1;
+
+    return av_asprintf("%.*s.%d%.*s", (int)(ext - 1), url, number,
+                       (int)(len + 1 - ext), url + ext - 1);
+}
+
+static const char *part_uri(HLSContext *hls, const char *filename)
+{
+    return hls->use_localtime_mkdir ? filename : av_basename(filename);
+}
+
+/* Write the data muxed since the previous partial segment to its own file */
+static int hls_flush_part(AVFormatContext *s, VariantStream *vs, double duration)
+{
+    HLSContext *hls = s->priv_data;
+    AVFormatContext *oc = vs->avf;
+    AVDictionary *options = NULL;
+    HLSPart *part;
+    uint8_t *buf;
+    char *filename;
+    int size, offset, ret;
+
+    av_write_frame(oc, NULL);
+    if (!vs->init_range_length) {
+        ret = flush_init_file(s, vs);
+        if (ret < 0)
+            return ret;
+        av_write_frame(oc, NULL);
+    }
+    size = avio_get_dyn_buf(oc->pb, &buf);
+    if (size <= vs->part_offset)
+        return 0;
+
+    filename = part_filename(hls, oc->url, vs->part_number);
+    if (!filename)
+        return AVERROR(ENOMEM);
+    offset = vs->part_offset;
+    vs->part_offset = size;
+    vs->part_number++;
+
+    set_http_options(s, &options, hls);
+    ret = hlsenc_io_open(s, &vs->out, filename, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
+               "Failed to open file '%s'\n", filename);
+        av_freep(&filename);
+        return hls->ignore_io_errors ? 0 : ret;
+    }
+    avio_write(vs->out, buf + offset, size - offset);
+    ret = hlsenc_io_close(s, &vs->out, filename);
+    if (ret < 0 && !hls->ignore_io_errors) {
+        av_log(s, AV_LOG_ERROR, "Failed to upload file '%s'\n", filename);
+        av_freep(&filename);
+        return ret;
+    }
+
+    part = av_malloc(sizeof(*part) + strlen(filename) + 1);
+    if (!part) {
+        av_freep(&filename);
+        return AVERROR(ENOMEM);
+    }
+    part->duration    = duration;
+    part->independent = vs->part_independent;
+    part->sequence    = vs->sequence;
+    part->next        = NULL;
+    strcpy(part->filename, filename);
+    av_freep(&filename);
+
+    if (vs->last_part)
+        vs->last_part->next = part;
+    else
+        vs->parts = part;
+    vs->last_part = part;
+
+    return 0;
+}
+
+/* Only the partial segments of the last two segments stay in the playlist */
+static int hls_trim_parts(AVFormatContext *s, VariantStream *vs)
+{
+    HLSContext *hls = s->priv_data;
+    HLSPart *part;
+    int ret = 0;
+
+    while ((part = vs->parts) && part->sequence < vs->sequence - 2) {
+        vs->parts = part->next;
+        if (!vs->parts)
+            vs->last_part = NULL;
+        if (hls->flags & HLS_DELETE_SEGMENTS)
+            ret = hls_delete_file(hls, s, part->filename,
+                                  avio_find_protocol_name(s->url));
+        av_freep(&part);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+/* Returns whether the discontinuity of the segment is still to be written */
+static int hls_write_parts(HLSContext *hls, VariantStream *vs, AVIOContext *out,
+                           int64_t sequence, int discont)
+{
+    for (HLSPart *part = vs->parts; part; part = part->next) {
+        if (part->sequence != sequence)
+            continue;
+        if (discont) {
+            avio_printf(out, "#EXT-X-DISCONTINUITY\n");
+            discont = 0;
+        }
+        ff_hls_write_part(out, part->duration, hls->baseurl,
+                          part_uri(hls, part->filename), part->independent);
+    }
+    return discont;
+}
+
 static int hls_rename_temp_file(AVFormatContext *s, AVFormatContext *oc)
 {
     size_t len = strlen(oc->url);
@@ -1537,7 +1761,7 @@ static int create_master_playlist(AVFormatContext *s,
 fail:
     if (ret >=0)
         hls->master_m3u8_created = 1;
-    hlsenc_io_close(s, &hls->m3u8_out, temp_filename);
+    hlsenc_playlist_close(s, &hls->m3u8_out, temp_filename);
     if (use_temp_file)
         ff_rename(temp_filename, hls->master_m3u8_url, s);
 
@@ -1563,6 +1787,9 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
     double prog_date_time = vs->initial_prog_date_time;
     double *prog_date_time_p = (hls->flags & HLS_PROGRAM_DATE_TIME) ? &prog_date_time : NULL;
     int byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
+    int part_mode = hls->part_time > 0 && !last;
+    int64_t en_sequence = sequence;
+    char *next_part = NULL;
 
     hls->version = 2;
     if (!(hls->flags & HLS_ROUND_DURATIONS)) {
@@ -1589,6 +1816,12 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
     if (!is_file_proto && (hls->flags & HLS_TEMP_FILE) && !warned_non_file++)
         av_log(s, AV_LOG_ERROR, "Cannot use rename on non file protocol, this may lead to races and temporary partial files\n");
 
+    if (part_mode) {
+        next_part = part_filename(hls, vs->avf->url, vs->part_number);
+        if (!next_part)
+            return AVERROR(ENOMEM);
+    }
+
     set_http_options(s, &options, hls);
     snprintf(temp_filename, sizeof(temp_filename), use_temp_file ? "%s.tmp" : "%s", vs->m3u8_name);
     ret = hlsenc_io_open(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename, &options);
@@ -1601,10 +1834,16 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
         if (target_duration <= en->duration)
             target_duration = lrint(en->duration);
     }
+    /* partial segments are listed before their segment is complete */
+    if (part_mode)
+        target_duration = FFMAX(target_duration, lrint(hls->time / (double)AV_TIME_BASE));
 
     vs->discontinuity_set = 0;
     ff_hls_write_playlist_header(byterange_mode ? hls->m3u8_out : vs->out, hls->version, hls->allowcache,
                                  target_duration, sequence, hls->pl_type, hls->flags & HLS_I_FRAMES_ONLY);
+    if (part_mode)
+        ff_hls_write_part_inf(vs->out, hls->part_time / (double)AV_TIME_BASE,
+                              hls->can_block_reload);
 
     if ((hls->flags & HLS_DISCONT_START) && sequence==hls->start_sequence && vs->discontinuity_set==0) {
         avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "#EXT-X-DISCONTINUITY\n");
@@ -1614,6 +1853,8 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
         avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "#EXT-X-INDEPENDENT-SEGMENTS\n");
     }
     for (en = vs->segments; en; en = en->next) {
+        int discont = en->discont;
+
         if ((hls->encrypt || hls->key_info_file) && (!key_uri || strcmp(en->key_uri, key_uri) ||
                                     av_strcasecmp(en->iv_string, iv_string))) {
             avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"", en->key_uri);
@@ -1629,7 +1870,10 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
                                    hls->flags & HLS_SINGLE_FILE, vs->init_range_length, 0);
         }
 
-        ret = ff_hls_write_file_entry(byterange_mode ? hls->m3u8_out : vs->out, en->discont, byterange_mode,
+        if (part_mode)
+            discont = hls_write_parts(hls, vs, vs->out, en_sequence++, discont);
+
+        ret = ff_hls_write_file_entry(byterange_mode ? hls->m3u8_out : vs->out, discont, byterange_mode,
                                       en->duration, hls->flags & HLS_ROUND_DURATIONS,
                                       en->size, en->pos, hls->baseurl,
                                       en->filename,
@@ -1642,6 +1886,14 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
         }
     }
 
+    if (part_mode) {
+        if (!vs->segments)
+            ff_hls_write_init_file(vs->out, vs->fmp4_init_filename, 0,
+                                   vs->init_range_length, 0);
+        hls_write_parts(hls, vs, vs->out, vs->sequence, vs->discontinuity);
+        ff_hls_write_preload_hint(vs->out, hls->baseurl, part_uri(hls, next_part));
+    }
+
     if (last && (hls->flags & HLS_OMIT_ENDLIST)==0)
         ff_hls_write_end_list(byterange_mode ? hls->m3u8_out : vs->out);
 
@@ -1671,11 +1923,12 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
 
 fail:
     av_dict_free(&options);
-    ret = hlsenc_io_close(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename);
+    av_freep(&next_part);
+    ret = hlsenc_playlist_close(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename);
     if (ret < 0) {
         return ret;
     }
-    hlsenc_io_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name);
+    hlsenc_playlist_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name);
     if (use_temp_file) {
         ff_rename(temp_filename, vs->m3u8_name, s);
         if (vs->vtt_m3u8_name)
@@ -2528,26 +2781,24 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
             pkt->dts != AV_NOPTS_VALUE)
             ff_mov_set_fragment_end_hint(oc, stream_index, pkt, st->time_base);
 #endif
+        if (hls->part_time > 0 && vs->part_start != AV_NOPTS_VALUE) {
+            int64_t pts = av_rescale_q(pkt->pts, st->time_base, AV_TIME_BASE_Q);
+
+            ret = hls_flush_part(s, vs, (pts - vs->part_start) / (double)AV_TIME_BASE);
+            if (ret < 0)
+                return ret;
+            vs->part_start  = AV_NOPTS_VALUE;
+            vs->part_number = 0;
+            vs->part_offset = 0;
+        }
         av_write_frame(oc, NULL); /* Flush any buffered data */
         new_start_pos = avio_tell(oc->pb);
         vs->size = new_start_pos - vs->start_pos;
         avio_flush(oc->pb);
-        if (hls->segment_type == SEGMENT_TYPE_FMP4) {
-            if (!vs->init_range_length) {
-                range_length = avio_close_dyn_buf(oc->pb, &vs->init_buffer);
-                if (range_length <= 0)
-                    return AVERROR(EINVAL);
-                avio_write(vs->out, vs->init_buffer, range_length);
-                if (!hls->resend_init_file)
-                    av_freep(&vs->init_buffer);
-                vs->init_range_length = range_length;
-                avio_open_dyn_buf(&oc->pb);
-                vs->packets_written = 0;
-                vs->start_pos = range_length;
-                if (!byterange_mode) {
-                    hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
-                }
-            }
+        if (hls->segment_type == SEGMENT_TYPE_FMP4 && !vs->init_range_length) {
+            ret = flush_init_file(s, vs);
+            if (ret < 0)
+                return ret;
         }
         if (!byterange_mode) {
             if (vs->vtt_avf) {
@@ -2648,7 +2899,8 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
         }
 
         // if we're building a VOD playlist, skip writing the manifest multiple times, and just wait until the end
-        if (hls->pl_type != PLAYLIST_TYPE_VOD) {
+        // with partial segments, it is written once the next segment is started, see below
+        if (hls->pl_type != PLAYLIST_TYPE_VOD && !hls->part_time) {
             if ((ret = hls_window(s, 0, vs)) < 0) {
                 av_log(s, AV_LOG_WARNING, "upload playlist failed, will retry with a new http session.\n");
                 ff_format_io_close(s, &vs->out);
@@ -2696,6 +2948,37 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
         if (ret < 0) {
             return ret;
         }
+
+        /* announce the first partial segment of the new segment */
+        if (hls->part_time > 0) {
+            if ((ret = hls_trim_parts(s, vs)) < 0 ||
+                (ret = hls_window(s, 0, vs)) < 0)
+                return ret;
+        }
+    }
+
+    if (hls->part_time > 0 && is_ref_pkt) {
+        int64_t pts = av_rescale_q(pkt->pts, st->time_base, AV_TIME_BASE_Q);
+        int64_t end = av_rescale_q(pkt->pts + pkt->duration, st->time_base, AV_TIME_BASE_Q);
+
+        /* end the partial segment before it exceeds its target duration */
+        if (vs->part_start != AV_NOPTS_VALUE && pts > vs->part_start &&
+            end - vs->part_start > hls->part_time) {
+#if CONFIG_MP4_MUXER
+            if (pkt->dts != AV_NOPTS_VALUE)
+                ff_mov_set_fragment_end_hint(oc, stream_index, pkt, st->time_base);
+#endif
+            ret = hls_flush_part(s, vs, (pts - vs->part_start) / (double)AV_TIME_BASE);
+            if (ret < 0)
+                return ret;
+            vs->part_start = AV_NOPTS_VALUE;
+            if ((ret = hls_window(s, 0, vs)) < 0)
+                return ret;
+        }
+        if (vs->part_start == AV_NOPTS_VALUE) {
+            vs->part_start       = pts;
+            vs->part_independent = !vs->has_video || (pkt->flags & AV_PKT_FLAG_KEY);
+        }
     }
 
     vs->packets_written++;
@@ -2729,13 +3012,15 @@ static void hls_deinit(AVFormatContext *s)
             av_freep(&vs->init_buffer);
         hls_free_segments(vs->segments);
         hls_free_segments(vs->old_segments);
+        hls_free_parts(vs->parts);
         av_freep(&vs->m3u8_name);
         av_freep(&vs->streams);
     }
 
-    ff_format_io_close(s, &hls->m3u8_out);
-    ff_format_io_close(s, &hls->sub_m3u8_out);
-    ff_format_io_close(s, &hls->http_delete);
+    hlsenc_io_free(s, &hls->m3u8_out);
+    hlsenc_io_free(s, &hls->sub_m3u8_out);
+    hlsenc_io_free(s, &hls->http_delete);
+    ff_upload_free(&hls->upload);
     av_freep(&hls->key_basename);
     av_freep(&hls->var_streams);
     av_freep(&hls->cc_streams);
@@ -2794,8 +3079,8 @@ static int hls_write_trailer(struct AVFormatContext *s)
                 vs->start_pos = init_range_length;
                 byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
                 if (!byterange_mode) {
-                    ff_format_io_close(s, &vs->out);
                     hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
+                    ff_format_io_close(s, &vs->out);
                 }
             }
         }
@@ -2864,6 +3149,7 @@ failed:
             if (vtt_oc->pb)
                 av_write_trailer(vtt_oc);
             vs->size = avio_tell(vs->vtt_avf->pb) - vs->start_pos;
+            hlsenc_io_close(s, &vtt_oc->pb, vtt_oc->url);
             ff_format_io_close(s, &vtt_oc->pb);
         }
         ret = hls_window(s, 1, vs);
@@ -2877,6 +3163,12 @@ failed:
         av_free(old_filename);
     }
 
+    if (hls->upload) {
+        ret = ff_upload_flush(hls->upload);
+        if (ret < 0 && !hls->ignore_io_errors)
+            return ret;
+    }
+
     return 0;
 }
 
@@ -2915,6 +3207,24 @@ static int hls_init(AVFormatContext *s)
         av_log(hls, AV_LOG_WARNING, "No HTTP method set, hls muxer defaulting to method PUT.\n");
     }
 
+    if (hls->upload_threads) {
+        if ((hls->flags & HLS_SINGLE_FILE) || hls->max_seg_size > 0) {
+            av_log(s, AV_LOG_WARNING, "Background uploads are not supported "
+                   "in byterange mode, uploading synchronously\n");
+        } else if (!ff_format_io_is_default(s)) {
+            av_log(s, AV_LOG_WARNING, "Background uploads are not supported "
+                   "with custom io_open, uploading synchronously\n");
+        } else {
+            ret = ff_upload_alloc(&hls->upload, s, hls->upload_threads,
+                                  hls->upload_queue_size, hls->upload_retries);
+            if (ret == AVERROR(ENOSYS))
+                av_log(s, AV_LOG_WARNING, "Background uploads are not "
+                       "supported in this build, uploading synchronously\n");
+            else if (ret < 0)
+                return ret;
+        }
+    }
+
     ret = validate_name(hls->nb_varstreams, s->url);
     if (ret < 0)
         return ret;
@@ -2968,6 +3278,25 @@ static int hls_init(AVFormatContext *s)
 
     hls->recording_time = hls->init_time && hls->max_nb_segments > 0 ? hls->init_time : hls->time;
 
+    if (hls->part_time > 0) {
+        if (hls->segment_type != SEGMENT_TYPE_FMP4 || (hls->flags & HLS_SINGLE_FILE) ||
+            hls->max_seg_size > 0 || hls->pl_type == PLAYLIST_TYPE_VOD) {
+            av_log(s, AV_LOG_ERROR, "Partial segments require fmp4 segments "
+                   "in separate files and a live playlist\n");
+            return AVERROR(EINVAL);
+        }
+        if (hls->part_time >= hls->time) {
+            av_log(s, AV_LOG_ERROR, "hls_part_time must be shorter than hls_time\n");
+            return AVERROR(EINVAL);
+        }
+        /* the parts are written as they are muxed, unlike the encrypted
+         * segments */
+        if (hls->encrypt || hls->key_info_file) {
+            av_log(s, AV_LOG_ERROR, "Partial segments cannot be encrypted\n");
+            return AVERROR_PATCHWELCOME;
+        }
+    }
+
     if (hls->flags & HLS_SPLIT_BY_TIME && hls->flags & HLS_INDEPENDENT_SEGMENTS) {
         // Independent segments cannot be guaranteed when splitting by time
         hls->flags &= ~HLS_INDEPENDENT_SEGMENTS;
@@ -2986,6 +3315,7 @@ static int hls_init(AVFormatContext *s)
         vs->sequence  = hls->start_sequence;
         vs->start_pts = AV_NOPTS_VALUE;
         vs->end_pts   = AV_NOPTS_VALUE;
+        vs->part_start = AV_NOPTS_VALUE;
         vs->current_segment_final_filename_fmt[0] = '\0';
         vs->initial_prog_date_time = initial_program_date_time;
 
@@ -3140,6 +3470,8 @@ static const AVOption options[] = {
     {"start_number",  "set first number in the sequence",        OFFSET(start_sequence),AV_OPT_TYPE_INT64,  {.i64 = 0},     0, INT64_MAX, E},
     {"hls_time",      "set segment length",                      OFFSET(time),          AV_OPT_TYPE_DURATION, {.i64 = 2000000}, 0, INT64_MAX, E},
     {"hls_init_time", "set segment length at init list",         OFFSET(init_time),     AV_OPT_TYPE_DURATION, {.i64 = 0},       0, INT64_MAX, E},
+    {"hls_part_time", "set partial segment length for low latency HLS", OFFSET(part_time), AV_OPT_TYPE_DURATION, {.i64 = 0},       0, INT64_MAX, E},
+    {"hls_can_block_reload", "announce that the server supports blocking playlist reloads", OFFSET(can_block_reload), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, E},
     {"hls_list_size", "set maximum number of playlist entries",  OFFSET(max_nb_segments),    AV_OPT_TYPE_INT,    {.i64 = 5},     0, INT_MAX, E},
     {"hls_delete_threshold", "set number of unreferenced segments to keep before deleting",  OFFSET(hls_delete_threshold),    AV_OPT_TYPE_INT,    {.i64 = 1},     1, INT_MAX, E},
     {"hls_vtt_options","set hls vtt list of options for the container format used for hls", OFFSET(vtt_format_options_str), AV_OPT_TYPE_STRING, {.str = NULL},  0, 0,    E},
@@ -3195,6 +3527,9 @@ static const AVOption options[] = {
     {"timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
     {"ignore_io_errors", "Ignore IO errors for stable long-duration runs with network output", OFFSET(ignore_io_errors), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     {"headers", "set custom HTTP headers, can override built in default headers", OFFSET(headers), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
+    {"upload_threads", "number of concurrent background uploads to network outputs, 0 to upload synchronously", OFFSET(upload_threads), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, E},
+    {"upload_queue_size", "maximum number of files waiting for a background upload", OFFSET(upload_queue_size), AV_OPT_TYPE_INT, {.i64 = 16}, 1, INT_MAX, E},
+    {"upload_retries", "number of times a failed background upload is retried", OFFSET(upload_retries), AV_OPT_TYPE_INT, {.i64 = 2}, 0, INT_MAX, E},
     { NULL },
 };
 
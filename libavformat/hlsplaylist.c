@@ -196,6 +196,38 @@ int ff_hls_write_file_entry(AVIOContext *out, int insert_discont,
     return 0;
 }
 
+void ff_hls_write_part_inf(AVIOContext *out, double part_target,
+                           int can_block_reload)
+{
+    if (!out)
+        return;
+    /* clients should stay at least three partial segments behind the edge */
+    avio_printf(out, "#EXT-X-SERVER-CONTROL:%sPART-HOLD-BACK=%f\n",
+                can_block_reload ? "CAN-BLOCK-RELOAD=YES," : "", 3 * part_target);
+    avio_printf(out, "#EXT-X-PART-INF:PART-TARGET=%f\n", part_target);
+}
+
+void ff_hls_write_part(AVIOContext *out, double duration,
+                       const char *baseurl /* Ignored if NULL */,
+                       const char *filename, int independent)
+{
+    if (!out || !filename)
+        return;
+    avio_printf(out, "#EXT-X-PART:DURATION=%f,URI=\"%s%s\"%s\n", duration,
+                baseurl ? baseurl : "", filename,
+                independent ? ",INDEPENDENT=YES" : "");
+}
+
+void ff_hls_write_preload_hint(AVIOContext *out,
+                               const char *baseurl /* Ignored if NULL */,
+                               const char *filename)
+{
+    if (!out || !filename)
+        return;
+    avio_printf(out, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s%s\"\n",
+                baseurl ? baseurl : "", filename);
+}
+
 void ff_hls_write_end_list(AVIOContext *out)
 {
     if (!out)
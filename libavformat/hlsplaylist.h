@@ -59,6 +59,14 @@ int ff_hls_write_file_entry(AVIOContext *out, int insert_discont,
                             const char *baseurl /* Ignored if NULL */,
                             const char *filename, double *prog_date_time,
                             int iframe_mode);
+void ff_hls_write_part_inf(AVIOContext *out, double part_target,
+                           int can_block_reload);
+void ff_hls_write_part(AVIOContext *out, double duration,
+                       const char *baseurl /* Ignored if NULL */,
+                       const char *filename, int independent);
+void ff_hls_write_preload_hint(AVIOContext *out,
+                               const char *baseurl /* Ignored if NULL */,
+                               const char *filename);
 void ff_hls_write_end_list (AVIOContext *out);
 
 #endif /* AVFORMAT_HLSPLAYLIST_H_ */
@@ -24,6 +24,7 @@
 #include "config.h"
 #include "config_components.h"
 
+#include <stdatomic.h>
 #include <string.h>
 #include <time.h>
 #if CONFIG_ZLIB
@@ -37,6 +38,7 @@
 #include "libavutil/macros.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/parseutils.h"
 
@@ -62,6 +64,7 @@
 #define HTTP_MUTLI    2
 #define MAX_DATE_LEN  19
 #define WHITESPACES " \n\t\r"
+#define PARALLEL_READ_SIZE 65536
 typedef enum {
     LOWER_PROTO,
     READ_HEADERS,
@@ -69,6 +72,8 @@ typedef enum {
     FINISH
 }HandshakeState;
 
+typedef struct HTTPParallel HTTPParallel;
+
 typedef struct HTTPContext {
     const AVClass *class;
     unsigned char buffer[BUFFER_SIZE], *buf_ptr, *buf_end;
@@ -81,6 +86,8 @@ typedef struct HTTPContext {
     char *http_proxy;
     char *headers;
     char *mime_type;
+    char *etag;
+    char *last_modified;
     char *http_version;
     char *user_agent;
     char *referer;
@@ -114,6 +121,8 @@ typedef struct HTTPContext {
     int respect_retry_after;
     uint64_t request_size;
     uint64_t initial_request_size;
+    int parallel_connections;
+    int parallel_range_size;
 
     /**********************
      * Context-wide state *
@@ -127,6 +136,8 @@ typedef struct HTTPContext {
     AVDictionary *cookie_dict;
     AVDictionary *chained_options;
     AVDictionary *redirect_cache;
+    /* Set while byte ranges are downloaded in parallel */
+    HTTPParallel *parallel;
 
     /* Connection statistics */
     int nb_connections;
@@ -199,6 +210,8 @@ static const AVOption http_options[] = {
     { "initial_request_size", "size (in bytes) of initial requests made during probing / header parsing", OFFSET(initial_request_size), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D },
     { "post_data", "set custom HTTP post data", OFFSET(post_data), AV_OPT_TYPE_BINARY, .flags = D | E },
     { "mime_type", "export the MIME type", OFFSET(mime_type), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "etag", "export the ETag of the resource", OFFSET(etag), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "last_modified", "export the last modification date of the resource", OFFSET(last_modified), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "http_version", "export the http response version", OFFSET(http_version), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "cookies", "set cookies to be sent in applicable future requests, use newline delimited Set-Cookie HTTP field value syntax", OFFSET(cookies), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
     { "icy", "request ICY metadata", OFFSET(icy), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, D },
@@ -227,6 +240,8 @@ static const AVOption http_options[] = {
     { "reply_code", "The http status code to return to a client", OFFSET(reply_code), AV_OPT_TYPE_INT, { .i64 = 200}, INT_MIN, 599, E},
     { "short_seek_size", "Threshold to favor readahead over seek.", OFFSET(short_seek_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, D },
     { "max_redirects", "Maximum number of redirects", OFFSET(max_redirects), AV_OPT_TYPE_INT, { .i64 = MAX_REDIRECTS }, 0, INT_MAX, D },
+    { "parallel_connections", "number of connections to download byte ranges on in parallel", OFFSET(parallel_connections), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, D },
+    { "parallel_range_size", "size (in bytes) of the byte ranges downloaded in parallel", OFFSET(parallel_range_size), AV_OPT_TYPE_INT, { .i64 = 1 << 20 }, PARALLEL_READ_SIZE, 1 << 28, D },
     { NULL }
 };
 
@@ -235,6 +250,9 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
                         const char *proxyauth);
 static int http_read_header(URLContext *h);
 static int http_shutdown(URLContext *h, int flags);
+#if HAVE_THREADS
+static void parallel_free(URLContext *h);
+#endif
 
 void ff_http_init_auth_state(URLContext *dest, const URLContext *src)
 {
@@ -578,6 +596,10 @@ int ff_http_do_new_request2(URLContext *h, const char *uri, AVDictionary **opts)
         return AVERROR(EINVAL);
     }
 
+#if HAVE_THREADS
+    parallel_free(h);
+#endif
+
     if (!s->end_chunked_post) {
         ret = http_shutdown(h, h->flags);
         if (ret < 0)
@@ -1311,6 +1333,12 @@ static int process_line(URLContext *h, char *line, int line_count, int *parsed_h
         } else if (!av_strcasecmp(tag, "Content-Type")) {
             av_free(s->mime_type);
             s->mime_type = av_get_token((const char **)&p, ";");
+        } else if (!av_strcasecmp(tag, "ETag")) {
+            av_free(s->etag);
+            s->etag = av_strdup(p);
+        } else if (!av_strcasecmp(tag, "Last-Modified")) {
+            av_free(s->last_modified);
+            s->last_modified = av_strdup(p);
         } else if (!av_strcasecmp(tag, "Set-Cookie")) {
             if (parse_cookie(s, p, &s->cookie_dict))
                 av_log(h, AV_LOG_WARNING, "Unable to parse '%s'\n", p);
@@ -1458,8 +1486,9 @@ static int http_read_header(URLContext *h)
         int parsed_http_code = 0;
 
         if ((err = http_get_line(s, line, sizeof(line))) < 0) {
-            av_log(h, AV_LOG_ERROR, "Error reading HTTP response: %s\n",
-                   av_err2str(err));
+            /* not an error if the request was aborted on purpose */
+            av_log(h, err == AVERROR_EXIT ? AV_LOG_DEBUG : AV_LOG_ERROR,
+                   "Error reading HTTP response: %s\n", av_err2str(err));
             return err;
         }
 
@@ -2006,10 +2035,415 @@ static int store_icy(URLContext *h, int size)
     return FFMIN(size, remaining);
 }
 
+#if HAVE_THREADS
+enum HTTPRangeState {
+    RANGE_FREE,
+    RANGE_LOADING,
+    RANGE_DONE,
+};
+
+typedef struct HTTPRange {
+    enum HTTPRangeState state;
+    /* set to abort the download, the range is freed by its thread */
+    int drop;
+    uint64_t start;
+    int size;
+    int filled;
+    int error;
+    uint8_t *data;
+} HTTPRange;
+
+struct HTTPParallel {
+    URLContext *h;
+    char *url;
+    AVDictionary *opts;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cond;
+    pthread_cond_t  data_cond;
+    pthread_t *threads;
+    int nb_threads;
+    atomic_int exit;
+
+    HTTPRange *ranges;
+    int nb_ranges;
+    int range_size;
+    /* the main connection serves the data up to here */
+    uint64_t start;
+    /* start of the next range to hand out to a connection */
+    uint64_t next_off;
+    uint64_t end;
+
+    /* statistics */
+    int nb_fetched;
+    int nb_stalls;
+    int64_t stall_time;
+};
+
+static int parallel_interrupt_cb(void *opaque)
+{
+    HTTPParallel *p = opaque;
+    return atomic_load(&p->exit) ||
+           ff_check_interrupt(&p->h->interrupt_callback);
+}
+
+static int parallel_fetch(HTTPParallel *p, URLContext **hd, HTTPRange *r)
+{
+    const AVIOInterruptCB int_cb = { parallel_interrupt_cb, p };
+    URLContext *h = p->h;
+    int64_t ret;
+
+    if (!*hd) {
+        AVDictionary *opts = NULL;
+        if ((ret = av_dict_copy(&opts, p->opts, 0)) < 0 ||
+            (ret = av_dict_set_int(&opts, "offset", r->start, 0)) < 0 ||
+            (ret = av_dict_set_int(&opts, "end_offset", r->start + r->size, 0)) < 0) {
+            av_dict_free(&opts);
+            return ret;
+        }
+        ret = ffurl_open_whitelist(hd, p->url, AVIO_FLAG_READ, &int_cb, &opts,
+                                   h->protocol_whitelist, h->protocol_blacklist, h);
+        av_dict_free(&opts);
+        if (ret < 0)
+            return ret;
+    } else {
+        /* the seek reuses the persistent connection once the previous
+         * range has been read completely */
+        HTTPContext *c = (*hd)->priv_data;
+        c->end_off = r->start + r->size;
+        ret = ffurl_seek(*hd, r->start, SEEK_SET);
+        if (ret < 0)
+            return ret;
+    }
+
+    while (r->filled < r->size) {
+        int drop;
+
+        ret = ffurl_read(*hd, r->data + r->filled,
+                         FFMIN(r->size - r->filled, PARALLEL_READ_SIZE));
+        if (!ret || ret == AVERROR_EOF)
+            ret = AVERROR(EIO);
+        if (ret < 0)
+            return ret;
+
+        pthread_mutex_lock(&p->lock);
+        r->filled += ret;
+        drop = r->drop;
+        pthread_cond_broadcast(&p->data_cond);
+        pthread_mutex_unlock(&p->lock);
+        if (drop)
+            break;
+    }
+    return 0;
+}
+
+static void *parallel_worker(void *arg)
+{
+    HTTPParallel *p = arg;
+    URLContext *hd = NULL;
+
+    ff_thread_setname("http-range");
+
+    pthread_mutex_lock(&p->lock);
+    while (!atomic_load(&p->exit)) {
+        HTTPRange *r = NULL;
+        int ret;
+
+        if (p->next_off < p->end) {
+            for (int i = 0; i < p->nb_ranges && !r; i++)
+                if (p->ranges[i].state == RANGE_FREE)
+                    r = &p->ranges[i];
+        }
+        if (!r) {
+            pthread_cond_wait(&p->work_cond, &p->lock);
+            continue;
+        }
+
+        r->state  = RANGE_LOADING;
+        r->drop   = 0;
+        r->start  = p->next_off;
+        r->size   = FFMIN(p->range_size, p->end - p->next_off);
+        r->filled = 0;
+        r->error  = 0;
+        p->next_off += r->size;
+        pthread_mutex_unlock(&p->lock);
+
+        ret = parallel_fetch(p, &hd, r);
+        if (ret < 0)
+            ffurl_closep(&hd);
+
+        pthread_mutex_lock(&p->lock);
+        if (r->drop) {
+            /* dropped by a seek, or read completely before the end */
+            if (!ret && r->filled == r->size)
+                p->nb_fetched++;
+            r->state = RANGE_FREE;
+            pthread_cond_signal(&p->work_cond);
+        } else {
+            r->state = RANGE_DONE;
+            r->error = ret;
+            if (ret < 0 && ret != AVERROR_EXIT)
+                av_log(p->h, AV_LOG_WARNING, "Downloading bytes %"PRIu64"-%"PRIu64
+                       " failed: %s\n", r->start, r->start + r->size - 1,
+                       av_err2str(ret));
+            else if (!ret)
+                p->nb_fetched++;
+        }
+        pthread_cond_broadcast(&p->data_cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    ffurl_closep(&hd);
+    return NULL;
+}
+
+static void parallel_free(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    HTTPParallel *p = s->parallel;
+
+    if (!p)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    atomic_store(&p->exit, 1);
+    pthread_cond_broadcast(&p->work_cond);
+    pthread_mutex_unlock(&p->lock);
+
+    for (int i = 0; i < p->nb_threads; i++)
+        pthread_join(p->threads[i], NULL);
+
+    av_log(h, AV_LOG_DEBUG, "Parallel download: %d range%s, %d stall%s, "
+           "%.2f s stalled\n",
+           p->nb_fetched, p->nb_fetched == 1 ? "" : "s",
+           p->nb_stalls,  p->nb_stalls  == 1 ? "" : "s",
+           1e-6 * p->stall_time);
+
+    pthread_cond_destroy(&p->data_cond);
+    pthread_cond_destroy(&p->work_cond);
+    pthread_mutex_destroy(&p->lock);
+    for (int i = 0; i < p->nb_ranges; i++)
+        av_free(p->ranges[i].data);
+    av_free(p->ranges);
+    av_free(p->threads);
+    av_dict_free(&p->opts);
+    av_free(p->url);
+    av_freep(&s->parallel);
+}
+
+static int parallel_start(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    HTTPParallel *p;
+    int ret;
+
+    p = av_mallocz(sizeof(*p));
+    if (!p)
+        return AVERROR(ENOMEM);
+    s->parallel = p;
+    p->h          = h;
+    p->range_size = s->parallel_range_size;
+    p->end        = s->end_off ? FFMIN(s->end_off, s->filesize) : s->filesize;
+    /* the main connection keeps serving the first range */
+    p->start      = s->off + p->range_size;
+    p->next_off   = p->start;
+    atomic_init(&p->exit, 0);
+
+    /* the location is taken after redirects, so that the range requests
+     * go to the server directly */
+    p->url = av_strdup(s->location);
+    if (!p->url)
+        goto fail;
+    if (av_dict_copy(&p->opts, s->chained_options, 0) < 0 ||
+        av_dict_set(&p->opts, "parallel_connections", "0", 0) < 0 ||
+        av_dict_set(&p->opts, "seekable", "1", 0) < 0 ||
+        av_dict_set(&p->opts, "multiple_requests", "1", 0) < 0 ||
+        av_dict_set(&p->opts, "icy", "0", 0) < 0 ||
+        av_dict_set(&p->opts, "request_size", "0", 0) < 0 ||
+        av_dict_set(&p->opts, "initial_request_size", "0", 0) < 0 ||
+        av_dict_set_int(&p->opts, "short_seek_size", p->range_size, 0) < 0)
+        goto fail;
+
+    /* every connection can work on a range while as many are buffered */
+    p->nb_ranges = 2 * s->parallel_connections;
+    p->ranges    = av_calloc(p->nb_ranges, sizeof(*p->ranges));
+    p->threads   = av_calloc(s->parallel_connections, sizeof(*p->threads));
+    if (!p->ranges || !p->threads)
+        goto fail;
+    for (int i = 0; i < p->nb_ranges; i++) {
+        p->ranges[i].data = av_malloc(p->range_size);
+        if (!p->ranges[i].data)
+            goto fail;
+    }
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work_cond, NULL);
+    pthread_cond_init(&p->data_cond, NULL);
+
+    for (; p->nb_threads < s->parallel_connections; p->nb_threads++) {
+        ret = pthread_create(&p->threads[p->nb_threads], NULL, parallel_worker, p);
+        if (ret) {
+            parallel_free(h);
+            return AVERROR(ret);
+        }
+    }
+
+    av_log(h, AV_LOG_VERBOSE, "Downloading %d byte ranges in parallel on "
+           "%d connections\n", p->nb_ranges, p->nb_threads);
+    return 0;
+
+fail:
+    if (p->ranges)
+        for (int i = 0; i < p->nb_ranges; i++)
+            av_free(p->ranges[i].data);
+    av_free(p->ranges);
+    av_free(p->threads);
+    av_dict_free(&p->opts);
+    av_free(p->url);
+    av_freep(&s->parallel);
+    return AVERROR(ENOMEM);
+}
+
+/* Whether the rest of the resource can be downloaded as byte ranges */
+static int parallel_possible(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    uint64_t end = s->end_off ? FFMIN(s->end_off, s->filesize) : s->filesize;
+
+    if (s->parallel_connections < 2 || h->is_streamed || !s->hd ||
+        (h->flags & AVIO_FLAG_WRITE) || s->filesize == UINT64_MAX ||
+        s->icy_metaint || s->chunksize != UINT64_MAX)
+        return 0;
+#if CONFIG_ZLIB
+    if (s->compressed)
+        return 0;
+#endif
+    /* not worth it when the main connection serves everything */
+    return s->off < end && end - s->off > 2 * (uint64_t)s->parallel_range_size;
+}
+
+static int parallel_read(URLContext *h, uint8_t *buf, int size)
+{
+    HTTPContext *s = h->priv_data;
+    HTTPParallel *p = s->parallel;
+    HTTPRange *r;
+    int64_t stall_start = 0;
+    int pos, ret;
+
+    /* the main connection has served its range */
+    if (s->hd)
+        ffurl_closep(&s->hd);
+
+    if (s->off >= p->end)
+        return AVERROR_EOF;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        r = NULL;
+        for (int i = 0; i < p->nb_ranges; i++) {
+            HTTPRange *cur = &p->ranges[i];
+            if (cur->state != RANGE_FREE && !cur->drop &&
+                cur->start <= s->off && s->off < cur->start + cur->size) {
+                r = cur;
+                break;
+            }
+        }
+        if (r && (r->filled > s->off - r->start || r->state == RANGE_DONE))
+            break;
+        if (!stall_start) {
+            stall_start = av_gettime_relative();
+            p->nb_stalls++;
+        }
+        pthread_cond_wait(&p->data_cond, &p->lock);
+    }
+    if (stall_start)
+        p->stall_time += av_gettime_relative() - stall_start;
+
+    pos = s->off - r->start;
+    if (pos == r->filled) {
+        ret = r->error < 0 ? r->error : AVERROR(EIO);
+        pthread_mutex_unlock(&p->lock);
+        return ret;
+    }
+    size = FFMIN(size, r->filled - pos);
+    pthread_mutex_unlock(&p->lock);
+
+    /* the filled part of the range is only freed by this thread */
+    memcpy(buf, r->data + pos, size);
+    s->off += size;
+
+    if (pos + size == r->size) {
+        pthread_mutex_lock(&p->lock);
+        /* the thread may not have reached the end of the range yet */
+        if (r->state == RANGE_LOADING) {
+            r->drop = 1;
+        } else {
+            r->state = RANGE_FREE;
+            pthread_cond_signal(&p->work_cond);
+        }
+        pthread_mutex_unlock(&p->lock);
+    }
+    return size;
+}
+
+static int64_t parallel_seek(URLContext *h, uint64_t off)
+{
+    HTTPContext *s = h->priv_data;
+    HTTPParallel *p = s->parallel;
+    HTTPRange *target = NULL;
+
+    pthread_mutex_lock(&p->lock);
+    if (off >= p->start) {
+        for (int i = 0; i < p->nb_ranges; i++) {
+            HTTPRange *r = &p->ranges[i];
+            if (r->state != RANGE_FREE && !r->drop &&
+                r->start <= off && off < r->start + r->size)
+                target = r;
+        }
+    }
+
+    /* keep the ranges from the target on, when it has been requested
+     * already, otherwise restart from the new position */
+    for (int i = 0; i < p->nb_ranges; i++) {
+        HTTPRange *r = &p->ranges[i];
+        if (r->state == RANGE_FREE || (target && r->start >= target->start))
+            continue;
+        if (r->state == RANGE_LOADING)
+            r->drop = 1;
+        else
+            r->state = RANGE_FREE;
+    }
+    if (!target) {
+        p->start    = FFMIN(off, p->end);
+        p->next_off = p->start;
+    }
+    pthread_cond_broadcast(&p->work_cond);
+    pthread_mutex_unlock(&p->lock);
+
+    if (s->hd)
+        ffurl_closep(&s->hd);
+    s->off = off;
+    return off;
+}
+#endif /* HAVE_THREADS */
+
 static int http_read(URLContext *h, uint8_t *buf, int size)
 {
     HTTPContext *s = h->priv_data;
 
+#if HAVE_THREADS
+    if (!s->parallel && parallel_possible(h)) {
+        int ret = parallel_start(h);
+        if (ret < 0)
+            return ret;
+    }
+    if (s->parallel) {
+        if (s->off >= s->parallel->start)
+            return parallel_read(h, buf, size);
+        size = FFMIN(size, s->parallel->start - s->off);
+    }
+#endif
+
     if (s->icy_metaint > 0) {
         size = store_icy(h, size);
         if (size < 0)
@@ -2083,6 +2517,9 @@ static int http_close(URLContext *h)
     int ret = 0;
     HTTPContext *s = h->priv_data;
 
+#if HAVE_THREADS
+    parallel_free(h);
+#endif
 #if CONFIG_ZLIB
     inflateEnd(&s->inflate_stream);
     av_freep(&s->inflate_buffer);
@@ -2138,6 +2575,10 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
         return AVERROR(EINVAL);
     if (off < 0)
         return AVERROR(EINVAL);
+#if HAVE_THREADS
+    if (s->parallel && !force_reconnect)
+        return parallel_seek(h, off);
+#endif
     if (!force_reconnect && off == s->off)
         return s->off;
     s->off = off;
@@ -597,6 +597,32 @@ int ff_rename(const char *url_src, const char *url_dst, void *logctx);
  */
 int ff_alloc_extradata(AVCodecParameters *par, int size);
 
+/**
+ * Return nonzero if packets of the given codec are never parsed beyond their
+ * size, so that their padding does not need to be zeroed.
+ */
+int ff_codec_ignores_padding(enum AVCodecID codec_id);
+
+#define FF_INPUT_HASH_SIZE 20
+
+/**
+ * Compute a SHA-1 of the first and last 64 KiB of a seekable input of the
+ * given size, which identifies a file rewritten with the same size without
+ * reading all of it. The position of pb is restored.
+ */
+int ff_hash_input_ends(AVIOContext *pb, int64_t size, uint8_t *hash);
+
+/**
+ * Like av_get_packet(), but when the input is mapped to memory, the packet
+ * may reference the mapping instead of a copy of the data. This is done only
+ * when the bytes following the data in the mapping are zero, or when the
+ * codec of st ignores them (see ff_codec_ignores_padding()).
+ * The packet is then not writable, so this must only be used by demuxers that
+ * do not modify the packet data in place.
+ */
+int ff_get_packet_mapped(AVIOContext *s, const AVStream *st,
+                         AVPacket *pkt, int size);
+
 /**
  * Copies the whilelists from one context to the other
  */
@@ -612,6 +638,12 @@ int ff_copy_whiteblacklists(AVFormatContext *dst, const AVFormatContext *src);
  */
 int ff_format_io_close(AVFormatContext *s, AVIOContext **pb);
 
+/**
+ * Check whether the I/O callbacks of s are the default ones, which unlike
+ * the callbacks of API users may be called from any thread.
+ */
+int ff_format_io_is_default(const AVFormatContext *s);
+
 /**
  * Release a libcurl event loop and set *loop to NULL.
  * No-op when @p loop or *loop is NULL.
@@ -361,6 +361,9 @@ typedef struct MOVContext {
     int has_looked_for_mfra;
     int use_tfdt;
     MOVFragmentIndex frag_index;
+    char *index_file;
+    int index_file_loaded;  ///< the fragment index was completed from index_file
+    struct FFSeekIndex *index_file_idx; ///< identity of the input when moov was read
     int atom_depth;
     unsigned int aax_mode;  ///< 'aax' file has been detected
     uint8_t file_key[20];
@@ -70,6 +70,7 @@
 /* For ff_codec_get_id(). */
 #include "riff.h"
 #include "rmsipr.h"
+#include "seekindex.h"
 
 #if CONFIG_BZLIB
 #include <bzlib.h>
@@ -439,6 +440,15 @@ typedef struct MatroskaDemuxContext {
 
     /* Bandwidth value for WebM DASH Manifest */
     int bandwidth;
+
+    /* Seek index sidecar file */
+    char *index_file;
+    FFSeekIndex *index_file_idx; ///< identity of the input when the header was read
+    int64_t index_file_entries;
+
+    /* The padding of blocks read from a mapped input may hold any bytes,
+     * since none of the tracks parse their packets beyond their size. */
+    int blocks_any_padding;
 } MatroskaDemuxContext;
 
 #define CHILD_OF(parent) { .def = { .n = parent } }
@@ -1085,10 +1095,30 @@ static int ebml_read_ascii(AVIOContext *pb, int size,
  * 0 is success, < 0 or NEEDS_CHECKING is failure.
  */
 static int ebml_read_binary(AVIOContext *pb, int length,
-                            int64_t pos, EbmlBin *bin)
+                            int64_t pos, EbmlBin *bin, int mapped,
+                            int any_padding)
 {
     int ret;
 
+    /* Blocks are only ever read from, so they can reference the input
+     * directly if it is mapped to memory. */
+    if (mapped) {
+        AVBufferRef *buf;
+
+        ret = ffio_read_mapped(pb, length, any_padding, &buf);
+        if (ret >= 0) {
+            av_buffer_unref(&bin->buf);
+            bin->buf  = buf;
+            bin->data = buf->data;
+            bin->size = length;
+            bin->pos  = pos;
+            return 0;
+        } else if (ret != AVERROR(ENOSYS))
+            return ret;
+        // do not copy a previous mapped block in av_buffer_realloc()
+        av_buffer_unref(&bin->buf);
+    }
+
     ret = av_buffer_realloc(&bin->buf, length + AV_INPUT_BUFFER_PADDING_SIZE);
     if (ret < 0)
         return ret;
@@ -1493,7 +1523,10 @@ static int ebml_parse(MatroskaDemuxContext *matroska,
         res = ebml_read_ascii(pb, length, syntax->def.s, data);
         break;
     case EBML_BIN:
-        res = ebml_read_binary(pb, length, pos_alt, data);
+        res = ebml_read_binary(pb, length, pos_alt, data,
+                               syntax->id == MATROSKA_ID_BLOCK ||
+                               syntax->id == MATROSKA_ID_SIMPLEBLOCK,
+                               matroska->blocks_any_padding);
         break;
     case EBML_LEVEL1:
     case EBML_NEST:
@@ -3417,6 +3450,72 @@ static int matroska_parse_dovi_streams(AVFormatContext *s)
     return 0;
 }
 
+static int64_t count_index_entries(AVFormatContext *s)
+{
+    int64_t nb_entries = 0;
+    for (int i = 0; i < s->nb_streams; i++)
+        nb_entries += ffstream(s->streams[i])->nb_index_entries;
+    return nb_entries;
+}
+
+/* Add the index entries found by a previous run without Cues */
+static int matroska_load_index_file(MatroskaDemuxContext *matroska)
+{
+    AVFormatContext *s = matroska->ctx;
+    FFSeekIndex *idx;
+    int ret;
+
+    if (!matroska->index_file || s->flags & AVFMT_FLAG_IGNIDX)
+        return 0;
+
+    ret = ff_seek_index_alloc(s, &matroska->index_file_idx);
+    if (ret < 0)
+        return ret == AVERROR(ENOSYS) ? 0 : ret;
+    idx = matroska->index_file_idx;
+
+    ret = ff_seek_index_read(s, matroska->index_file, idx);
+    if (ret < 0)
+        return ret;
+    if (ret > 0) {
+        for (int i = 0; i < idx->nb_streams; i++) {
+            for (int j = 0; j < idx->nb_entries[i]; j++) {
+                const AVIndexEntry *e = &idx->entries[i][j];
+                av_add_index_entry(s->streams[i], e->pos, e->timestamp,
+                                   e->size, e->min_distance, e->flags);
+            }
+        }
+        ff_seek_index_clear(idx);
+    }
+
+    matroska->index_file_entries = count_index_entries(s);
+    return 0;
+}
+
+static void matroska_save_index_file(MatroskaDemuxContext *matroska)
+{
+    AVFormatContext *s = matroska->ctx;
+    FFSeekIndex *idx = matroska->index_file_idx;
+
+    if (!idx || idx->nb_streams != s->nb_streams ||
+        count_index_entries(s) <= matroska->index_file_entries)
+        return;
+    /* the Cues are a better index */
+    for (int i = 0; i < matroska->num_level1_elems; i++)
+        if (matroska->level1_elems[i].id == MATROSKA_ID_CUES)
+            return;
+
+    idx->complete = matroska->done;
+    for (int i = 0; i < s->nb_streams; i++) {
+        FFStream *const sti = ffstream(s->streams[i]);
+        for (int j = 0; j < sti->nb_index_entries; j++)
+            if (ff_seek_index_add(idx, i, &sti->index_entries[j]) < 0)
+                goto end;
+    }
+    ff_seek_index_write(s, matroska->index_file, idx);
+end:
+    ff_seek_index_clear(idx);
+}
+
 static int matroska_read_header(AVFormatContext *s)
 {
     FFFormatContext *const si = ffformatcontext(s);
@@ -3425,6 +3524,7 @@ static int matroska_read_header(AVFormatContext *s)
     EbmlList *chapters_list    = &matroska->chapters;
     MatroskaAttachment *attachments;
     MatroskaChapter *chapters;
+    MatroskaTrack *tracks;
     uint64_t max_start = 0;
     int64_t pos;
     Ebml ebml = { 0 };
@@ -3505,6 +3605,13 @@ static int matroska_read_header(AVFormatContext *s)
     if (res < 0)
         return res;
 
+    tracks = matroska->tracks.elem;
+    matroska->blocks_any_padding = matroska->tracks.nb_elem > 0;
+    for (i = 0; i < matroska->tracks.nb_elem; i++)
+        if (tracks[i].stream &&
+            !ff_codec_ignores_padding(tracks[i].stream->codecpar->codec_id))
+            matroska->blocks_any_padding = 0;
+
     attachments = attachments_list->elem;
     for (j = 0; j < attachments_list->nb_elem; j++) {
         if (!(attachments[j].filename && attachments[j].mime &&
@@ -3563,6 +3670,9 @@ static int matroska_read_header(AVFormatContext *s)
         }
 
     matroska_add_index_entries(matroska);
+    res = matroska_load_index_file(matroska);
+    if (res < 0)
+        return res;
 
     matroska_convert_tags(s);
 
@@ -4572,6 +4682,8 @@ static int matroska_read_close(AVFormatContext *s)
     MatroskaTrack *tracks = matroska->tracks.elem;
     int n;
 
+    matroska_save_index_file(matroska);
+    ff_seek_index_free(&matroska->index_file_idx);
     matroska_clear_queue(matroska);
 
     for (n = 0; n < matroska->tracks.nb_elem; n++)
@@ -5035,11 +5147,25 @@ const FFInputFormat ff_webm_dash_manifest_demuxer = {
 };
 #endif
 
+static const AVOption matroska_options[] = {
+    { "index_file", "file to load the seek index from and to store it to, for files without Cues",
+        offsetof(MatroskaDemuxContext, index_file), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM },
+    { NULL },
+};
+
+static const AVClass matroska_class = {
+    .class_name = "matroska,webm demuxer",
+    .item_name  = av_default_item_name,
+    .option     = matroska_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 const FFInputFormat ff_matroska_demuxer = {
     .p.name         = "matroska,webm",
     .p.long_name    = NULL_IF_CONFIG_SMALL("Matroska / WebM"),
     .p.extensions   = "mkv,mk3d,mka,mks,webm",
     .p.mime_type    = "audio/webm,audio/x-matroska,video/webm,video/x-matroska",
+    .p.priv_class   = &matroska_class,
     .priv_data_size = sizeof(MatroskaDemuxContext),
     .flags_internal = FF_INFMT_FLAG_INIT_CLEANUP,
     .read_probe     = matroska_probe,
@@ -72,6 +72,7 @@
 #include "id3v1.h"
 #include "mov_chan.h"
 #include "replaygain.h"
+#include "seekindex.h"
 
 #if CONFIG_ZLIB
 #include <zlib.h>
@@ -88,6 +89,7 @@ typedef struct MOVParseTableEntry {
 
 static int mov_read_default(MOVContext *c, AVIOContext *pb, MOVAtom atom);
 static int mov_read_mfra(MOVContext *c, AVIOContext *f);
+static int mov_load_index_file(MOVContext *c);
 static void mov_free_stream_context(AVFormatContext *s, AVStream *st);
 
 static int mov_metadata_track_or_disc_number(MOVContext *c, AVIOContext *pb,
@@ -1708,6 +1710,9 @@ static int mov_read_moov(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     /* we parsed the 'moov' atom, we can terminate the parsing as soon as we find the 'mdat' */
     /* so we don't parse the whole file if over a network */
     c->found_moov=1;
+    /* a complete fragment index also avoids scanning all the fragments */
+    if ((ret = mov_load_index_file(c)) < 0)
+        return ret;
     return 0; /* now go for mdat */
 }
 
@@ -1928,6 +1933,96 @@ static int update_frag_index(MOVContext *c, int64_t offset)
     return index;
 }
 
+/* Fill the fragment index from the one saved by a previous scan of the
+ * fragments, which then does not need to be done again. The index is checked
+ * against the input and its streams as they are after the moov atom, and is
+ * written with that same identity by mov_save_index_file(). */
+static int mov_load_index_file(MOVContext *c)
+{
+    AVFormatContext *s = c->fc;
+    FFSeekIndex *idx;
+    int ret;
+
+    if (!c->index_file || c->frag_index.complete ||
+        s->flags & AVFMT_FLAG_IGNIDX || !(s->pb->seekable & AVIO_SEEKABLE_NORMAL))
+        return 0;
+
+    ret = ff_seek_index_alloc(s, &c->index_file_idx);
+    if (ret < 0)
+        return ret == AVERROR(ENOSYS) ? 0 : ret;
+    idx = c->index_file_idx;
+
+    ret = ff_seek_index_read(s, c->index_file, idx);
+    if (ret <= 0)
+        return ret;
+    ret = 0;
+    if (!idx->complete)
+        goto end;
+
+    for (int i = 0; i < idx->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        MOVStreamContext *sc = st->priv_data;
+
+        for (int j = 0; j < idx->nb_entries[i]; j++) {
+            const AVIndexEntry *e = &idx->entries[i][j];
+            MOVFragmentStreamInfo *frag_stream_info;
+            int index = update_frag_index(c, e->pos);
+
+            if (index < 0) {
+                ret = index == -1 ? AVERROR(ENOMEM) : index;
+                goto end;
+            }
+            frag_stream_info = get_frag_stream_info(&c->frag_index, index, sc->id);
+            if (frag_stream_info && frag_stream_info->tfdt_dts == AV_NOPTS_VALUE)
+                frag_stream_info->tfdt_dts = e->timestamp;
+        }
+        if (idx->durations[i] > 0 &&
+            (st->duration == AV_NOPTS_VALUE || st->duration < idx->durations[i]))
+            st->duration = idx->durations[i];
+    }
+    c->frag_index.complete = 1;
+    c->index_file_loaded   = 1;
+
+end:
+    ff_seek_index_clear(idx);
+    return ret;
+}
+
+/* Store the fragment index built by reading all the fragments of a file
+ * without sidx or mfra. */
+static void mov_save_index_file(MOVContext *c)
+{
+    AVFormatContext *s = c->fc;
+    FFSeekIndex *idx = c->index_file_idx;
+
+    if (!idx || c->index_file_loaded || c->frag_index.complete ||
+        !c->frag_index.nb_items || idx->nb_streams != s->nb_streams)
+        return;
+    for (int i = 0; i < c->frag_index.nb_items; i++)
+        if (!c->frag_index.item[i].headers_read)
+            return;
+
+    idx->complete = 1;
+    for (int i = 0; i < s->nb_streams; i++) {
+        MOVStreamContext *sc = s->streams[i]->priv_data;
+
+        for (int j = 0; j < c->frag_index.nb_items; j++) {
+            MOVFragmentStreamInfo *frag_stream_info =
+                get_frag_stream_info(&c->frag_index, j, sc->id);
+            AVIndexEntry e = {
+                .pos       = c->frag_index.item[j].moof_offset,
+                .timestamp = frag_stream_info ? frag_stream_info->tfdt_dts
+                                              : AV_NOPTS_VALUE,
+            };
+            if (ff_seek_index_add(idx, i, &e) < 0)
+                goto end;
+        }
+    }
+    ff_seek_index_write(s, c->index_file, idx);
+end:
+    ff_seek_index_clear(idx);
+}
+
 static void fix_frag_index_entries(MOVFragmentIndex *frag_index, int index,
                                    int id, int entries)
 {
@@ -8968,6 +9063,9 @@ static int cenc_filter(MOVContext *mov, AVStream* st, MOVStreamContext *sc, AVPa
         }
 
         if (mov->decryption_keys || mov->decryption_default_key) {
+            ret = av_packet_make_writable(pkt);
+            if (ret < 0)
+                return ret;
             return cenc_decrypt(mov, sc, encrypted_sample, pkt->data, pkt->size);
         } else {
             size_t size;
@@ -10617,6 +10715,7 @@ static int mov_read_close(AVFormatContext *s)
     av_freep(&mov->dv_demux);
     avformat_free_context(mov->dv_fctx);
     mov->dv_fctx = NULL;
+    ff_seek_index_free(&mov->index_file_idx);
 
     if (mov->meta_keys) {
         for (i = 1; i < mov->meta_keys_count; i++) {
@@ -11806,6 +11905,8 @@ static int mov_read_header(AVFormatContext *s)
         if (mov->frag_index.item[i].moof_offset <= mov->fragment.moof_offset)
             mov->frag_index.item[i].headers_read = 1;
 
+    mov_save_index_file(mov);
+
     return 0;
 }
 
@@ -12187,7 +12288,7 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
             }
             ret = av_get_packet(sc->pb, pkt, au_size);
         } else
-            ret = av_get_packet(sc->pb, pkt, sample->size);
+            ret = ff_get_packet_mapped(sc->pb, st, pkt, sample->size);
         if (ret < 0) {
             if (should_retry(sc->pb, ret)) {
                 mov_current_sample_dec(sc);
@@ -12229,8 +12330,12 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
     if (st->discard == AVDISCARD_ALL)
         goto retry;
 
-    if (mov->aax_mode)
+    if (mov->aax_mode) {
+        ret = av_packet_make_writable(pkt);
+        if (ret < 0)
+            return ret;
         aax_filter(pkt->data, pkt->size, mov);
+    }
 
     ret = cenc_filter(mov, st, sc, pkt, current_index);
     if (ret < 0) {
@@ -12482,6 +12587,8 @@ static const AVOption mov_options[] = {
         FLAGS, .unit = "use_mfra_for" },
     {"use_tfdt", "use tfdt for fragment timestamps", OFFSET(use_tfdt), AV_OPT_TYPE_BOOL, {.i64 = 1},
         0, 1, FLAGS},
+    {"index_file", "file to load the fragment index from and to store it to, for fragmented files without sidx or mfra",
+        OFFSET(index_file), AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, FLAGS},
     { "export_all", "Export unrecognized metadata entries", OFFSET(export_all),
         AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, .flags = FLAGS },
     { "export_xmp", "Export full XMP metadata", OFFSET(export_xmp),
@@ -106,6 +106,7 @@ static const AVOption options[] = {
       { "negative_cts_offsets", "Use negative CTS offsets (reducing the need for edit lists)", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_NEGATIVE_CTS_OFFSETS}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "omit_tfhd_offset", "Omit the base data offset in tfhd atoms", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_OMIT_TFHD_OFFSET}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "prefer_icc", "If writing colr atom prioritise usage of ICC profile if it exists in stream packet side data", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_PREFER_ICC}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
+      { "reserve_moov", "With faststart, reserve space for the moov atom estimated from the stream durations instead of running a second pass", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_RESERVE_MOOV}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "rtphint", "Add RTP hint tracks", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_RTP_HINT}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "separate_moof", "Write separate moof/mdat atoms for each track", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_SEPARATE_MOOF}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "skip_sidx", "Skip writing of sidx atom", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_SKIP_SIDX}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
@@ -8204,6 +8205,54 @@ static int mov_init_iamf_track(AVFormatContext *s)
 }
 #endif
 
+/*
+ * Estimate the size of the moov atom from the stream durations set by the
+ * caller as hints, erring on the large side: every sample is assumed to get
+ * its own stts, ctts and chunk entries. Returns 0 if a duration or a sample
+ * rate is unknown.
+ */
+static int estimate_moov_size(AVFormatContext *s)
+{
+    /* mvhd, udta, metadata, and the tmcd or chapter tracks */
+    double size = 8192 + s->nb_chapters * 64;
+
+    for (int i = 0; i < s->nb_streams; i++) {
+        const AVStream *st = s->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+        double duration, rate;
+        /* stsz, stts and a stsc and co64 entry */
+        int sample_size = 4 + 8 + 12 + 8;
+
+        if (st->duration <= 0 || st->time_base.num <= 0 || st->time_base.den <= 0)
+            return 0;
+        duration = st->duration * av_q2d(st->time_base);
+
+        switch (par->codec_type) {
+        case AVMEDIA_TYPE_VIDEO:
+            rate = av_q2d(st->avg_frame_rate);
+            if (rate <= 0)
+                rate = av_q2d(par->framerate);
+            if (rate <= 0)
+                return 0;
+            /* ctts and stss */
+            sample_size += 8 + 4;
+            break;
+        case AVMEDIA_TYPE_AUDIO:
+            if (par->sample_rate <= 0)
+                return 0;
+            rate = par->sample_rate / (double)(par->frame_size > 0 ? par->frame_size : 1024);
+            break;
+        default:
+            rate = 1;
+            break;
+        }
+        size += 2048 + par->extradata_size + duration * rate * sample_size;
+    }
+    size *= 1.0625;
+
+    return size < INT_MAX ? (int)size : 0;
+}
+
 static int mov_init(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -8274,6 +8323,15 @@ static int mov_init(AVFormatContext *s)
 
     if (mov->flags & FF_MOV_FLAG_FASTSTART) {
         mov->reserved_moov_size = -1;
+        /* the durations are in the time base set by the caller, which the
+         * tracks override below */
+        if (mov->flags & FF_MOV_FLAG_RESERVE_MOOV &&
+            !(mov->flags & FF_MOV_FLAG_FRAGMENT) && mov->mode != MODE_AVIF) {
+            mov->estimated_moov_size = estimate_moov_size(s);
+            if (!mov->estimated_moov_size)
+                av_log(s, AV_LOG_WARNING, "Stream durations or rates unknown, "
+                       "cannot reserve space for the moov atom\n");
+        }
     }
 
     if (mov->use_editlist < 0) {
@@ -8917,8 +8975,14 @@ static int mov_write_header(AVFormatContext *s)
             update_size(pb, mov->mdat_pos);
         }
     } else if (mov->mode != MODE_AVIF) {
-        if (mov->flags & FF_MOV_FLAG_FASTSTART)
+        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
             mov->reserved_header_pos = avio_tell(pb);
+            if (mov->estimated_moov_size) {
+                avio_wb32(pb, mov->estimated_moov_size);
+                ffio_wfourcc(pb, "free");
+                ffio_fill(pb, 0, mov->estimated_moov_size - 8);
+            }
+        }
         mov_write_mdat_tag(pb, mov);
     }
 
@@ -9051,6 +9115,39 @@ static int compute_sidx_size(AVFormatContext *s)
     return sidx_size;
 }
 
+/*
+ * Write the moov atom into the space reserved before the mdat, followed by a
+ * free atom for the remaining space. Returns 0 if it does not fit.
+ */
+static int write_reserved_moov(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    AVIOContext *pb = s->pb;
+    int64_t end = avio_tell(pb);
+    int moov_size, free_size;
+    int ret;
+
+    moov_size = get_moov_size(s);
+    if (moov_size < 0)
+        return moov_size;
+    free_size = mov->estimated_moov_size - moov_size;
+    if (free_size < 0 || free_size > 0 && free_size < 8) {
+        av_log(s, AV_LOG_WARNING, "The moov atom needs %d bytes, %d were reserved\n",
+               moov_size, mov->estimated_moov_size);
+        return 0;
+    }
+
+    avio_seek(pb, mov->reserved_header_pos, SEEK_SET);
+    if ((ret = mov_write_moov_tag(pb, mov, s)) < 0)
+        return ret;
+    if (free_size) {
+        avio_wb32(pb, free_size);
+        ffio_wfourcc(pb, "free");
+    }
+    avio_seek(pb, end, SEEK_SET);
+    return 1;
+}
+
 static int shift_data(AVFormatContext *s)
 {
     int moov_size;
@@ -9170,7 +9267,14 @@ static int mov_write_trailer(AVFormatContext *s)
 
         avio_seek(pb, mov->reserved_moov_size > 0 ? mov->reserved_header_pos : moov_pos, SEEK_SET);
 
-        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+        if (mov->flags & FF_MOV_FLAG_FASTSTART &&
+            mov->estimated_moov_size &&
+            (res = write_reserved_moov(s)) != 0) {
+            if (res < 0)
+                return res;
+        } else if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+            /* without reserved space, or if the moov did not fit in it; the
+             * reserved space is then left as a free atom after the moov */
             av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
             res = shift_data(s);
             if (res < 0)
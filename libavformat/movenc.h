@@ -240,6 +240,7 @@ typedef struct MOVMuxContext {
 
     int reserved_moov_size; ///< 0 for disabled, -1 for automatic, size otherwise
     int64_t reserved_header_pos;
+    int estimated_moov_size; ///< space reserved for the moov with faststart, 0 if none
 
     char *major_brand;
 
@@ -300,6 +301,7 @@ typedef struct MOVMuxContext {
 #define FF_MOV_FLAG_CMAF                  (1 << 22)
 #define FF_MOV_FLAG_PREFER_ICC            (1 << 23)
 #define FF_MOV_FLAG_HYBRID_FRAGMENTED     (1 << 24)
+#define FF_MOV_FLAG_RESERVE_MOOV          (1 << 25)
 
 int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt);
 
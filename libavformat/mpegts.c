@@ -3345,6 +3345,19 @@ static int mpegts_resync(AVFormatContext *s, int seekback, const uint8_t *curren
     avio_seek(pb, -back, SEEK_CUR);
 
     for (i = 0; i < ts->resync_size; i++) {
+        int len = FFMIN(pb->buf_end - pb->buf_ptr, ts->resync_size - i);
+        /* look for the sync byte in the buffered data in one go */
+        if (len > 1) {
+            const uint8_t *sync = memchr(pb->buf_ptr, SYNC_BYTE, len);
+            if (!sync) {
+                avio_skip(pb, len);
+                i += len - 1;
+                continue;
+            }
+            len = sync - pb->buf_ptr;
+            avio_skip(pb, len);
+            i += len;
+        }
         c = avio_r8(pb);
         if (avio_feof(pb))
             return AVERROR_EOF;
@@ -3414,6 +3427,51 @@ static void finished_reading_packet(AVFormatContext *s, int raw_packet_size)
         avio_skip(pb, skip);
 }
 
+/**
+ * Handle the packets that are complete in the I/O buffer in one run, right
+ * from the buffer, stopping at the first one that is out of sync.
+ *
+ * @return number of packets handled, or a negative error code
+ */
+static int handle_buffered_packets(MpegTSContext *ts, int max_packets)
+{
+    AVIOContext *pb = ts->stream->pb;
+    const int raw_packet_size = ts->raw_packet_size;
+    /* see read_packet() for the layout of the raw packets */
+    const int skip = raw_packet_size == TS_DVHS_PACKET_SIZE ? 4 : 0;
+    const uint8_t *buf = pb->buf_ptr;
+    int64_t pos = avio_tell(pb) + skip + TS_PACKET_SIZE;
+    int nb_packets, i, ret = 0;
+
+    if (pb->write_flag || raw_packet_size < TS_PACKET_SIZE + skip)
+        return 0;
+
+    nb_packets = FFMIN((pb->buf_end - buf) / raw_packet_size, max_packets);
+    for (i = 0; i < nb_packets; i++)
+        if (buf[i * raw_packet_size + skip] != SYNC_BYTE)
+            break;
+    nb_packets = i;
+
+    for (i = 0; i < nb_packets && !ts->stop_parse; i++) {
+        const uint8_t *packet = buf + i * raw_packet_size + skip;
+        MpegTSFilter *tss = ts->pids[AV_RB16(packet + 1) & 0x1fff];
+        int is_start = packet[1] & 0x40;
+
+        /* drop the packets that handle_packet() would ignore early */
+        if (tss ? tss->discard && !is_start : !(ts->auto_guess && is_start))
+            continue;
+
+        ret = handle_packet(ts, packet, pos + (int64_t)i * raw_packet_size);
+        if (ret < 0) {
+            i++;
+            break;
+        }
+    }
+
+    avio_skip(pb, (int64_t)i * raw_packet_size);
+    return ret < 0 ? ret : i;
+}
+
 static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
 {
     AVFormatContext *s = ts->stream;
@@ -3455,6 +3513,14 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
         if (ts->stop_parse > 0)
             break;
 
+        ret = handle_buffered_packets(ts, nb_packets ? FFMIN(nb_packets - packet_num, INT_MAX) : INT_MAX);
+        if (ret < 0)
+            break;
+        if (ret > 0) {
+            packet_num += ret - 1;
+            continue;
+        }
+
         ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             break;
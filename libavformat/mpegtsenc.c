@@ -80,6 +80,10 @@ enum {
     MPEGTS_SERVICE_TYPE_ADVANCED_CODEC_DIGITAL_HDTV  = 0x19,
     MPEGTS_SERVICE_TYPE_HEVC_DIGITAL_HDTV            = 0x1F,
 };
+
+/* number of TS packets continuing a PES packet built before they are written */
+#define PES_RUN_PACKETS 32
+
 typedef struct MpegTSWrite {
     const AVClass *av_class;
     MpegTSSection pat; /* MPEG-2 PAT table */
@@ -136,6 +140,8 @@ typedef struct MpegTSWrite {
     int pcr_pid;            ///< user-specified separate PCR PID (-1 = use video PID)
     int64_t pcr_stream_pcr_period; ///< PCR period for the dedicated stream
     int64_t pcr_stream_last_pcr;   ///< last PCR sent on the dedicated PID
+
+    uint8_t pes_run[PES_RUN_PACKETS * TS_PACKET_SIZE];
 } MpegTSWrite;
 
 /* a PES packet header is generated every DEFAULT_PES_HEADER_FREQ packets */
@@ -1506,6 +1512,73 @@ static int get_pes_stream_id(AVFormatContext *s, AVStream *st, int stream_id, in
     }
 }
 
+/*
+ * The TS packets continuing a PES packet carry neither PCR nor adaptation
+ * field, and no other packet is inserted between them, until the PCR reaches
+ * the time a table or a PCR is due. Return that PCR value, INT64_MIN if the
+ * next packet must be written by the regular code in mpegts_write_pes().
+ */
+static int64_t pes_run_pcr_limit(AVFormatContext *s, int64_t dts, int64_t delay)
+{
+    MpegTSWrite *ts = s->priv_data;
+    int64_t pcr, limit;
+
+    if (ts->mux_rate > 1)
+        pcr = get_pcr(ts);
+    else if (dts != AV_NOPTS_VALUE)
+        pcr = (dts - delay) * SYSTEM_CLOCK_FREQUENCY_DIVISOR;
+    else
+        return INT64_MAX;
+
+    if (ts->last_pat_ts == AV_NOPTS_VALUE || ts->last_sdt_ts == AV_NOPTS_VALUE ||
+        ts->last_nit_ts == AV_NOPTS_VALUE)
+        return INT64_MIN;
+    limit = FFMIN3(av_sat_add64(ts->last_pat_ts, ts->pat_period),
+                   av_sat_add64(ts->last_sdt_ts, ts->sdt_period),
+                   av_sat_add64(ts->last_nit_ts, ts->nit_period));
+
+    if (ts->mux_rate > 1) {
+        if (ts->pcr_pid >= FIRST_OTHER_PID)
+            limit = FFMIN(limit, av_sat_add64(ts->pcr_stream_last_pcr,
+                                              ts->pcr_stream_pcr_period));
+        else
+            limit = FFMIN(limit, ts->next_pcr);
+        /* null packets are inserted while the PES packet is early; the PCR
+         * only grows, so this stays false once it is */
+        if (dts != AV_NOPTS_VALUE && (dts - pcr / SYSTEM_CLOCK_FREQUENCY_DIVISOR) > delay)
+            return INT64_MIN;
+    }
+
+    return pcr < limit ? limit : INT64_MIN;
+}
+
+/*
+ * Write the full TS packets continuing a PES packet at once, the last one
+ * which may need stuffing excepted. Return the size of the payload written.
+ */
+static int mpegts_write_pes_run(AVFormatContext *s, MpegTSWriteStream *ts_st,
+                                const uint8_t *payload, int payload_size,
+                                int64_t pcr_limit)
+{
+    MpegTSWrite *ts = s->priv_data;
+    uint32_t header = SYNC_BYTE << 24 | ts_st->pid << 8 | 0x10; // payload indicator
+    uint8_t *q = ts->pes_run, *end = ts->pes_run + sizeof(ts->pes_run);
+    int written = 0;
+
+    while (payload_size - written > TS_PACKET_SIZE - 4 && q < end &&
+           (ts->mux_rate <= 1 || get_pcr(ts) < pcr_limit)) {
+        ts_st->cc = (ts_st->cc + 1) & 0xf;
+        AV_WB32(q, header | ts_st->cc);
+        memcpy(q + 4, payload + written, TS_PACKET_SIZE - 4);
+        q       += TS_PACKET_SIZE;
+        written += TS_PACKET_SIZE - 4;
+        ts->total_size += TS_PACKET_SIZE;
+    }
+    avio_write(s->pb, ts->pes_run, q - ts->pes_run);
+
+    return written;
+}
+
 /* Add a PES header to the front of the payload, and segment into an integer
  * number of TS packets. The final TS packet is padded using an oversized
  * adaptation header to exactly fill the last TS packet.
@@ -1542,6 +1615,19 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
     is_start = 1;
     while (payload_size > 0) {
         int64_t pcr = AV_NOPTS_VALUE;
+
+        if (!is_start && !ts->m2ts_mode && !ts_st->discontinuity &&
+            payload_size > TS_PACKET_SIZE - 4) {
+            int64_t pcr_limit = pes_run_pcr_limit(s, dts, delay);
+            if (pcr_limit != INT64_MIN) {
+                len = mpegts_write_pes_run(s, ts_st, payload, payload_size, pcr_limit);
+                payload      += len;
+                payload_size -= len;
+                if (len)
+                    continue;
+            }
+        }
+
         if (ts->mux_rate > 1)
             pcr = get_pcr(ts);
         else if (dts != AV_NOPTS_VALUE)
@@ -0,0 +1,769 @@
+/*
+ * Segment prefetching for segmented stream demuxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include "libavutil/avassert.h"
+#include "libavutil/bprint.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "avio_internal.h"
+#include "prefetch.h"
+#include "url.h"
+
+#if HAVE_THREADS
+
+#define PREFETCH_CHUNK_SIZE 65536
+/* maximum amount of data buffered per segment and not read yet */
+#define PREFETCH_MAX_BUFFERED (32 << 20)
+
+enum PrefetchState {
+    PREFETCH_FREE,
+    PREFETCH_QUEUED,
+    PREFETCH_LOADING,
+    PREFETCH_DONE,
+};
+
+typedef struct PrefetchSlot {
+    FFPrefetch *p;
+    enum PrefetchState state;
+    /* set to abort the download, the slot is freed by its thread */
+    atomic_int cancel;
+
+    int64_t seq_no;
+    char *url;
+    AVDictionary *opts;
+    int64_t offset;
+    int64_t size;
+
+    /* kept across segments, so that the buffers form a pool; the data
+     * already read is discarded when the buffer is full */
+    uint8_t *buf;
+    unsigned int buf_size;
+    unsigned int data_len;
+    unsigned int read_pos;
+    int64_t downloaded;
+    int error;
+
+    int64_t start_time;
+    int64_t end_time;
+} PrefetchSlot;
+
+struct FFPrefetch {
+    AVFormatContext *s;
+    FFPrefetchStats *stats;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cond;
+    pthread_cond_t  data_cond;
+    pthread_cond_t  space_cond;
+    pthread_t *threads;
+    int nb_threads;
+    int exit;
+
+    PrefetchSlot *slots;
+    int nb_slots;
+    PrefetchSlot *cur;
+};
+
+static void slot_reset(PrefetchSlot *slot)
+{
+    av_freep(&slot->url);
+    av_dict_free(&slot->opts);
+    slot->data_len   = 0;
+    slot->read_pos   = 0;
+    slot->downloaded = 0;
+    slot->error      = 0;
+    slot->state    = PREFETCH_FREE;
+    atomic_store(&slot->cancel, 0);
+}
+
+/* Drop a slot not being read; called with the lock held */
+static void slot_drop(PrefetchSlot *slot)
+{
+    if (slot->state == PREFETCH_LOADING) {
+        atomic_store(&slot->cancel, 1);
+        pthread_cond_broadcast(&slot->p->space_cond);
+    } else if (slot->state != PREFETCH_FREE)
+        slot_reset(slot);
+}
+
+static int prefetch_interrupt_cb(void *opaque)
+{
+    PrefetchSlot *slot = opaque;
+    return atomic_load(&slot->cancel) ||
+           ff_check_interrupt(&slot->p->s->interrupt_callback);
+}
+
+static int prefetch_download(PrefetchSlot *slot, uint8_t *chunk)
+{
+    FFPrefetch *p = slot->p;
+    const AVIOInterruptCB int_cb = { prefetch_interrupt_cb, slot };
+    AVIOContext *pb = NULL;
+    int64_t done = 0;
+    int ret;
+
+    ret = ffio_open_whitelist(&pb, slot->url, AVIO_FLAG_READ, &int_cb, &slot->opts,
+                              p->s->protocol_whitelist, p->s->protocol_blacklist);
+    if (ret < 0)
+        return ret;
+
+    if (slot->offset) {
+        int64_t pos = avio_seek(pb, slot->offset, SEEK_SET);
+        if (pos < 0) {
+            ret = pos;
+            goto end;
+        }
+    }
+
+    while (slot->size < 0 || done < slot->size) {
+        int size = PREFETCH_CHUNK_SIZE;
+        uint8_t *buf;
+
+        if (slot->size >= 0)
+            size = FFMIN(size, slot->size - done);
+
+        ret = avio_read(pb, chunk, size);
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret < 0)
+            goto end;
+
+        pthread_mutex_lock(&p->lock);
+        /* wait for the segment to be read rather than buffering all of it */
+        while (slot->read_pos < slot->data_len &&
+               slot->data_len - slot->read_pos + ret > PREFETCH_MAX_BUFFERED &&
+               !atomic_load(&slot->cancel))
+            pthread_cond_wait(&p->space_cond, &p->lock);
+        if (atomic_load(&slot->cancel)) {
+            pthread_mutex_unlock(&p->lock);
+            ret = AVERROR_EXIT;
+            goto end;
+        }
+        if (slot->read_pos && slot->data_len + ret > slot->buf_size) {
+            memmove(slot->buf, slot->buf + slot->read_pos,
+                    slot->data_len - slot->read_pos);
+            slot->data_len -= slot->read_pos;
+            slot->read_pos  = 0;
+        }
+        if (slot->data_len + ret > slot->buf_size) {
+            unsigned int new_size = FFMAX(slot->data_len + ret,
+                                          FFMIN(2LL * slot->buf_size, INT_MAX));
+            buf = av_realloc(slot->buf, new_size);
+            if (!buf) {
+                pthread_mutex_unlock(&p->lock);
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+            slot->buf      = buf;
+            slot->buf_size = new_size;
+        }
+        memcpy(slot->buf + slot->data_len, chunk, ret);
+        slot->data_len   += ret;
+        slot->downloaded += ret;
+        pthread_cond_signal(&p->data_cond);
+        pthread_mutex_unlock(&p->lock);
+
+        done += ret;
+    }
+    ret = 0;
+
+end:
+    avio_closep(&pb);
+    return ret;
+}
+
+static void *prefetch_worker(void *arg)
+{
+    FFPrefetch *p = arg;
+    uint8_t *chunk = av_malloc(PREFETCH_CHUNK_SIZE);
+
+    ff_thread_setname("prefetch");
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->exit) {
+        PrefetchSlot *slot = NULL;
+        int ret;
+
+        /* download the nearest segment first */
+        for (int i = 0; i < p->nb_slots; i++) {
+            PrefetchSlot *s = &p->slots[i];
+            if (s->state == PREFETCH_QUEUED && (!slot || s->seq_no < slot->seq_no))
+                slot = s;
+        }
+        if (!slot) {
+            pthread_cond_wait(&p->work_cond, &p->lock);
+            continue;
+        }
+
+        slot->state      = PREFETCH_LOADING;
+        slot->start_time = av_gettime_relative();
+        pthread_mutex_unlock(&p->lock);
+
+        ret = chunk ? prefetch_download(slot, chunk) : AVERROR(ENOMEM);
+
+        pthread_mutex_lock(&p->lock);
+        if (atomic_load(&slot->cancel)) {
+            slot_reset(slot);
+        } else {
+            slot->state    = PREFETCH_DONE;
+            slot->error    = ret;
+            slot->end_time = av_gettime_relative();
+            if (ret < 0 && ret != AVERROR_EXIT)
+                av_log(p->s, AV_LOG_WARNING, "Prefetching segment %"PRId64" "
+                       "from '%s' failed: %s\n", slot->seq_no, slot->url,
+                       av_err2str(ret));
+        }
+        pthread_cond_broadcast(&p->data_cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    av_free(chunk);
+    return NULL;
+}
+
+int ff_prefetch_alloc(FFPrefetch **pp, AVFormatContext *s, int nb_segments,
+                      FFPrefetchStats *stats)
+{
+    FFPrefetch *p;
+    int ret;
+
+    av_assert0(nb_segments > 0);
+
+    p = av_mallocz(sizeof(*p));
+    if (!p)
+        return AVERROR(ENOMEM);
+    p->s     = s;
+    p->stats = stats;
+
+    /* the segment being read plus the ones ahead of it */
+    p->nb_slots = nb_segments + 1;
+    p->slots    = av_calloc(p->nb_slots, sizeof(*p->slots));
+    p->threads  = av_calloc(p->nb_slots, sizeof(*p->threads));
+    if (!p->slots || !p->threads) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int i = 0; i < p->nb_slots; i++) {
+        p->slots[i].p = p;
+        atomic_init(&p->slots[i].cancel, 0);
+    }
+
+    ret = pthread_mutex_init(&p->lock, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        av_log(s, AV_LOG_ERROR, "pthread_mutex_init failed: %s\n", av_err2str(ret));
+        goto fail;
+    }
+    ret = pthread_cond_init(&p->work_cond, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        av_log(s, AV_LOG_ERROR, "pthread_cond_init failed: %s\n", av_err2str(ret));
+        goto work_cond_fail;
+    }
+    ret = pthread_cond_init(&p->data_cond, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        av_log(s, AV_LOG_ERROR, "pthread_cond_init failed: %s\n", av_err2str(ret));
+        goto data_cond_fail;
+    }
+    ret = pthread_cond_init(&p->space_cond, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        av_log(s, AV_LOG_ERROR, "pthread_cond_init failed: %s\n", av_err2str(ret));
+        goto space_cond_fail;
+    }
+
+    /* one thread per slot, so that every queued segment gets downloaded even
+     * while aborted downloads are still winding down */
+    for (; p->nb_threads < p->nb_slots; p->nb_threads++) {
+        ret = pthread_create(&p->threads[p->nb_threads], NULL, prefetch_worker, p);
+        if (ret) {
+            ret = AVERROR(ret);
+            ff_prefetch_free(&p);
+            return ret;
+        }
+    }
+
+    *pp = p;
+    return 0;
+
+space_cond_fail:
+    pthread_cond_destroy(&p->data_cond);
+data_cond_fail:
+    pthread_cond_destroy(&p->work_cond);
+work_cond_fail:
+    pthread_mutex_destroy(&p->lock);
+fail:
+    av_freep(&p->slots);
+    av_freep(&p->threads);
+    av_freep(&p);
+    return ret;
+}
+
+int ff_prefetch_queue(FFPrefetch *p, int64_t seq_no, const char *url,
+                      int64_t offset, int64_t size, const AVDictionary *opts)
+{
+    PrefetchSlot *slot = NULL;
+    int ret = 0;
+
+    pthread_mutex_lock(&p->lock);
+
+    for (int i = 0; i < p->nb_slots; i++) {
+        PrefetchSlot *s = &p->slots[i];
+        if (s->state == PREFETCH_FREE) {
+            if (!slot)
+                slot = s;
+        } else if (s->seq_no == seq_no && !atomic_load(&s->cancel)) {
+            if (s == p->cur || !strcmp(s->url, url))
+                goto end;
+            /* the playlist changed, the queued segment is stale */
+            slot_drop(s);
+            if (s->state == PREFETCH_FREE && !slot)
+                slot = s;
+        }
+    }
+    if (!slot) {
+        ret = AVERROR(EAGAIN);
+        goto end;
+    }
+
+    slot->url = av_strdup(url);
+    if (!slot->url || (ret = av_dict_copy(&slot->opts, opts, 0)) < 0) {
+        slot_reset(slot);
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    slot->seq_no = seq_no;
+    slot->offset = offset;
+    slot->size   = size;
+    slot->state  = PREFETCH_QUEUED;
+    pthread_cond_signal(&p->work_cond);
+
+end:
+    pthread_mutex_unlock(&p->lock);
+    return ret;
+}
+
+void ff_prefetch_retain(FFPrefetch *p, int64_t first, int64_t last)
+{
+    pthread_mutex_lock(&p->lock);
+    for (int i = 0; i < p->nb_slots; i++) {
+        PrefetchSlot *slot = &p->slots[i];
+        if (slot != p->cur && (slot->seq_no < first || slot->seq_no > last))
+            slot_drop(slot);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+int ff_prefetch_open(FFPrefetch *p, int64_t seq_no, const char *url)
+{
+    int found = 0;
+
+    av_assert0(!p->cur);
+
+    pthread_mutex_lock(&p->lock);
+    for (int i = 0; i < p->nb_slots; i++) {
+        PrefetchSlot *slot = &p->slots[i];
+        if (slot->state == PREFETCH_FREE || slot->seq_no != seq_no ||
+            atomic_load(&slot->cancel))
+            continue;
+        /* the playlist may have changed since the segment was queued */
+        if (strcmp(slot->url, url)) {
+            slot_drop(slot);
+            continue;
+        }
+        p->cur = slot;
+        found  = 1;
+        break;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return found;
+}
+
+int ff_prefetch_read(FFPrefetch *p, uint8_t *buf, int size)
+{
+    PrefetchSlot *slot = p->cur;
+    int64_t stall_start = 0;
+    int ret;
+
+    av_assert0(slot);
+
+    pthread_mutex_lock(&p->lock);
+    while (slot->read_pos == slot->data_len && slot->state != PREFETCH_DONE) {
+        if (!stall_start) {
+            stall_start = av_gettime_relative();
+            p->stats->nb_stalls++;
+        }
+        pthread_cond_wait(&p->data_cond, &p->lock);
+    }
+    if (stall_start)
+        p->stats->stall_time += av_gettime_relative() - stall_start;
+
+    if (slot->read_pos < slot->data_len) {
+        ret = FFMIN(size, slot->data_len - slot->read_pos);
+        memcpy(buf, slot->buf + slot->read_pos, ret);
+        slot->read_pos += ret;
+        pthread_cond_broadcast(&p->space_cond);
+    } else {
+        ret = slot->error < 0 ? slot->error : AVERROR_EOF;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return ret;
+}
+
+void ff_prefetch_close(FFPrefetch *p)
+{
+    PrefetchSlot *slot = p ? p->cur : NULL;
+
+    if (!slot)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    if (slot->state == PREFETCH_DONE && !slot->error) {
+        p->stats->nb_segments++;
+        p->stats->bytes         += slot->downloaded;
+        p->stats->download_time += slot->end_time - slot->start_time;
+    }
+    slot_drop(slot);
+    p->cur = NULL;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void ff_prefetch_free(FFPrefetch **pp)
+{
+    FFPrefetch *p = *pp;
+
+    if (!p)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    p->exit = 1;
+    for (int i = 0; i < p->nb_slots; i++)
+        atomic_store(&p->slots[i].cancel, 1);
+    pthread_cond_broadcast(&p->work_cond);
+    pthread_cond_broadcast(&p->space_cond);
+    pthread_mutex_unlock(&p->lock);
+
+    for (int i = 0; i < p->nb_threads; i++)
+        pthread_join(p->threads[i], NULL);
+
+    for (int i = 0; i < p->nb_slots; i++) {
+        slot_reset(&p->slots[i]);
+        av_freep(&p->slots[i].buf);
+    }
+
+    pthread_cond_destroy(&p->space_cond);
+    pthread_cond_destroy(&p->data_cond);
+    pthread_cond_destroy(&p->work_cond);
+    pthread_mutex_destroy(&p->lock);
+    av_freep(&p->threads);
+    av_freep(&p->slots);
+    av_freep(pp);
+}
+
+struct FFRefresh {
+    AVFormatContext *s;
+    char *url;
+    AVDictionary *opts;
+    int64_t interval;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    atomic_int exit;
+    int requested;
+    int busy;
+
+    /* result of the latest download */
+    unsigned gen;
+    unsigned gen_returned;
+    char *buf;
+    int size;
+    char *location;
+    int error;
+};
+
+static int refresh_interrupt_cb(void *opaque)
+{
+    FFRefresh *r = opaque;
+    return atomic_load(&r->exit) || ff_check_interrupt(&r->s->interrupt_callback);
+}
+
+static int refresh_download(FFRefresh *r, char **buf, int *size, char **location)
+{
+    const AVIOInterruptCB int_cb = { refresh_interrupt_cb, r };
+    AVDictionary *opts = NULL;
+    AVIOContext *pb = NULL;
+    AVBPrint bp;
+    int ret;
+
+    ret = av_dict_copy(&opts, r->opts, 0);
+    if (ret >= 0)
+        ret = ffio_open_whitelist(&pb, r->url, AVIO_FLAG_READ, &int_cb, &opts,
+                                  r->s->protocol_whitelist, r->s->protocol_blacklist);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    if (av_opt_get(pb, "location", AV_OPT_SEARCH_CHILDREN, (uint8_t **)location) < 0)
+        *location = NULL;
+
+    av_bprint_init(&bp, 0, INT_MAX);
+    ret = avio_read_to_bprint(pb, &bp, SIZE_MAX);
+    if (ret >= 0 && !avio_feof(pb))
+        ret = AVERROR_INVALIDDATA;
+    avio_closep(&pb);
+
+    if (ret >= 0) {
+        *size = bp.len;
+        ret = av_bprint_finalize(&bp, buf);
+    } else {
+        av_bprint_finalize(&bp, NULL);
+    }
+    if (ret < 0)
+        av_freep(location);
+    return ret;
+}
+
+static void *refresh_worker(void *arg)
+{
+    FFRefresh *r = arg;
+    int64_t next = av_gettime() + r->interval;
+
+    ff_thread_setname("refresh");
+
+    pthread_mutex_lock(&r->lock);
+    while (!atomic_load(&r->exit)) {
+        char *buf = NULL, *location = NULL;
+        int size = 0, ret;
+
+        if (!r->requested) {
+            if (r->interval > 0) {
+                struct timespec ts = { .tv_sec  =  next / 1000000,
+                                       .tv_nsec = (next % 1000000) * 1000 };
+                if (pthread_cond_timedwait(&r->cond, &r->lock, &ts) != ETIMEDOUT)
+                    continue;
+            } else {
+                pthread_cond_wait(&r->cond, &r->lock);
+                continue;
+            }
+        }
+        r->requested = 0;
+        r->busy      = 1;
+        pthread_mutex_unlock(&r->lock);
+
+        ret = refresh_download(r, &buf, &size, &location);
+        if (ret < 0 && ret != AVERROR_EXIT)
+            av_log(r->s, AV_LOG_WARNING, "Failed to reload '%s': %s\n",
+                   r->url, av_err2str(ret));
+        next = av_gettime() + r->interval;
+
+        pthread_mutex_lock(&r->lock);
+        av_free(r->buf);
+        av_free(r->location);
+        r->buf      = buf;
+        r->size     = size;
+        r->location = location;
+        r->error    = FFMIN(ret, 0);
+        r->busy     = 0;
+        r->gen++;
+        pthread_cond_broadcast(&r->cond);
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    return NULL;
+}
+
+int ff_refresh_alloc(FFRefresh **pr, AVFormatContext *s, const char *url,
+                     const AVDictionary *opts, int64_t interval)
+{
+    FFRefresh *r = av_mallocz(sizeof(*r));
+    int ret;
+
+    if (!r)
+        return AVERROR(ENOMEM);
+    r->s        = s;
+    r->interval = interval;
+    r->url      = av_strdup(url);
+    if (!r->url || av_dict_copy(&r->opts, opts, 0) < 0) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    atomic_init(&r->exit, 0);
+
+    ret = pthread_mutex_init(&r->lock, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        av_log(s, AV_LOG_ERROR, "pthread_mutex_init failed: %s\n", av_err2str(ret));
+        goto fail;
+    }
+    ret = pthread_cond_init(&r->cond, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        av_log(s, AV_LOG_ERROR, "pthread_cond_init failed: %s\n", av_err2str(ret));
+        goto cond_fail;
+    }
+    ret = pthread_create(&r->thread, NULL, refresh_worker, r);
+    if (ret) {
+        ret = AVERROR(ret);
+        av_log(s, AV_LOG_ERROR, "pthread_create failed: %s\n", av_err2str(ret));
+        goto thread_fail;
+    }
+
+    *pr = r;
+    return 0;
+
+thread_fail:
+    pthread_cond_destroy(&r->cond);
+cond_fail:
+    pthread_mutex_destroy(&r->lock);
+fail:
+    av_dict_free(&r->opts);
+    av_freep(&r->url);
+    av_freep(&r);
+    return ret;
+}
+
+void ff_refresh_request(FFRefresh *r)
+{
+    pthread_mutex_lock(&r->lock);
+    r->requested = 1;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+int ff_refresh_get(FFRefresh *r, int wait, char **buf, int *size, char **location)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&r->lock);
+    if (wait) {
+        /* a download already in progress may have started too early */
+        unsigned gen = r->gen + 1 + r->busy;
+        r->requested = 1;
+        pthread_cond_broadcast(&r->cond);
+        while (r->gen != gen)
+            pthread_cond_wait(&r->cond, &r->lock);
+    }
+    if (r->gen != r->gen_returned) {
+        r->gen_returned = r->gen;
+        if (r->error < 0) {
+            ret = r->error;
+        } else {
+            *buf      = r->buf;
+            *size     = r->size;
+            *location = r->location;
+            r->buf      = NULL;
+            r->location = NULL;
+            ret = 1;
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    return ret;
+}
+
+void ff_refresh_free(FFRefresh **pr)
+{
+    FFRefresh *r = *pr;
+
+    if (!r)
+        return;
+
+    pthread_mutex_lock(&r->lock);
+    atomic_store(&r->exit, 1);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    av_free(r->buf);
+    av_free(r->location);
+    av_dict_free(&r->opts);
+    av_freep(&r->url);
+    av_freep(pr);
+}
+
+#else
+
+int ff_prefetch_alloc(FFPrefetch **p, AVFormatContext *s, int nb_segments,
+                      FFPrefetchStats *stats)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_prefetch_queue(FFPrefetch *p, int64_t seq_no, const char *url,
+                      int64_t offset, int64_t size, const AVDictionary *opts)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_prefetch_retain(FFPrefetch *p, int64_t first, int64_t last)
+{
+}
+
+int ff_prefetch_open(FFPrefetch *p, int64_t seq_no, const char *url)
+{
+    return 0;
+}
+
+int ff_prefetch_read(FFPrefetch *p, uint8_t *buf, int size)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_prefetch_close(FFPrefetch *p)
+{
+}
+
+void ff_prefetch_free(FFPrefetch **p)
+{
+}
+
+int ff_refresh_alloc(FFRefresh **r, AVFormatContext *s, const char *url,
+                     const AVDictionary *opts, int64_t interval)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_refresh_request(FFRefresh *r)
+{
+}
+
+int ff_refresh_get(FFRefresh *r, int wait, char **buf, int *size, char **location)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_refresh_free(FFRefresh **r)
+{
+}
+
+#endif /* HAVE_THREADS */
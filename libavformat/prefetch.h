@@ -0,0 +1,159 @@
+/*
+ * Segment prefetching for segmented stream demuxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_PREFETCH_H
+#define AVFORMAT_PREFETCH_H
+
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+#include "avformat.h"
+
+/**
+ * @file
+ * Background downloads for segmented stream demuxers (HLS, DASH).
+ *
+ * FFPrefetch downloads upcoming segments in background threads into memory,
+ * so that the per-segment request latency overlaps with reading the current
+ * segment. Segments are identified by their sequence number. The demuxer
+ * queues the segments it is going to need, opens a segment when it gets to
+ * it and reads it like from an AVIOContext, waiting for data still being
+ * downloaded. At most 32 MiB of a segment are buffered before it is read;
+ * the download then waits for the reader.
+ *
+ * FFRefresh downloads a manifest in a background thread.
+ *
+ * All functions must be called from the demuxer thread.
+ */
+
+typedef struct FFPrefetchStats {
+    int64_t nb_segments;   ///< segments read from prefetch buffers
+    int64_t bytes;         ///< size of these segments
+    int64_t download_time; ///< time spent downloading them, in microseconds
+    int64_t nb_stalls;     ///< number of times reading had to wait for data
+    int64_t stall_time;    ///< time spent waiting, in microseconds
+} FFPrefetchStats;
+
+typedef struct FFPrefetch FFPrefetch;
+
+/**
+ * Allocate a prefetcher holding up to nb_segments segments ahead of the one
+ * being read, each downloaded by its own thread.
+ *
+ * @param s     context providing the interrupt callback and the protocol
+ *              white- and blacklists used for the downloads
+ * @param stats statistics updated while reading, may be shared between
+ *              several prefetchers; must outlive the prefetcher
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_prefetch_alloc(FFPrefetch **p, AVFormatContext *s, int nb_segments,
+                      FFPrefetchStats *stats);
+
+/**
+ * Queue a segment for download, if it is not queued already. A segment
+ * queued earlier with the same sequence number but a different url is
+ * dropped.
+ *
+ * @param offset byte offset to seek to after opening the url, 0 to not seek
+ * @param size   number of bytes to download, -1 to download until EOF
+ * @param opts   options for opening the url, copied
+ * @return 0 on success, AVERROR(EAGAIN) if all slots are in use,
+ *         another negative AVERROR code on failure
+ */
+int ff_prefetch_queue(FFPrefetch *p, int64_t seq_no, const char *url,
+                      int64_t offset, int64_t size, const AVDictionary *opts);
+
+/**
+ * Drop all segments outside of [first, last] except the one being read,
+ * aborting their downloads.
+ */
+void ff_prefetch_retain(FFPrefetch *p, int64_t first, int64_t last);
+
+/**
+ * Start reading the given segment.
+ *
+ * @return 1 if the segment was queued for the same url and reading from it
+ *         can start, 0 if it is not available
+ */
+int ff_prefetch_open(FFPrefetch *p, int64_t seq_no, const char *url);
+
+/**
+ * Read from the segment opened with ff_prefetch_open(), waiting until data
+ * is available.
+ *
+ * @return number of bytes read, AVERROR_EOF at the end of the segment,
+ *         another negative AVERROR code if downloading it failed
+ */
+int ff_prefetch_read(FFPrefetch *p, uint8_t *buf, int size);
+
+/**
+ * Stop reading the segment opened with ff_prefetch_open(), if any, and
+ * release it. p may be NULL.
+ */
+void ff_prefetch_close(FFPrefetch *p);
+
+/**
+ * Abort all downloads, join the threads and free the prefetcher.
+ */
+void ff_prefetch_free(FFPrefetch **p);
+
+/**
+ * Download a resource which changes over time, such as a live manifest,
+ * periodically or on request in a background thread.
+ */
+typedef struct FFRefresh FFRefresh;
+
+/**
+ * Start a refresh thread.
+ *
+ * @param url      resource to download
+ * @param opts     options for opening the url, copied
+ * @param interval time between downloads in microseconds; if 0, only
+ *                 download on request
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_refresh_alloc(FFRefresh **r, AVFormatContext *s, const char *url,
+                     const AVDictionary *opts, int64_t interval);
+
+/**
+ * Request a new download without waiting for it.
+ */
+void ff_refresh_request(FFRefresh *r);
+
+/**
+ * Get the result of the latest download not returned yet.
+ *
+ * @param wait     if set, request a new download and wait for it
+ * @param buf      set to the downloaded data, zero-terminated, which must be
+ *                 freed with av_free()
+ * @param size     set to the size of the downloaded data
+ * @param location set to the url the data was downloaded from after
+ *                 redirects, if known, else NULL; must be freed with av_free()
+ * @return 1 if data was returned, 0 if there was no new download, a negative
+ *         AVERROR code if the latest download failed
+ */
+int ff_refresh_get(FFRefresh *r, int wait, char **buf, int *size, char **location);
+
+/**
+ * Abort the download in progress, join the thread and free the context.
+ */
+void ff_refresh_free(FFRefresh **r);
+
+#endif /* AVFORMAT_PREFETCH_H */
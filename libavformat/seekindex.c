@@ -0,0 +1,248 @@
+/*
+ * Seek index sidecar files
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/avstring.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
+
+#include "avio_internal.h"
+#include "internal.h"
+#include "seekindex.h"
+
+#define SEEK_INDEX_TAG     MKBETAG('F', 'F', 'S', 'I')
+#define SEEK_INDEX_VERSION 2
+/* pos, timestamp, size, flags, min_distance */
+#define SEEK_INDEX_ENTRY_SIZE 28
+int ff_seek_index_alloc(AVFormatContext *s, FFSeekIndex **pidx)
+{
+    FFSeekIndex *idx;
+    int ret;
+
+    *pidx = NULL;
+    if (!(s->pb->seekable & AVIO_SEEKABLE_NORMAL) || avio_size(s->pb) <= 0)
+        return AVERROR(ENOSYS);
+
+    idx = av_mallocz(sizeof(*idx));
+    if (!idx)
+        return AVERROR(ENOMEM);
+    idx->nb_streams = s->nb_streams;
+    idx->entries    = av_calloc(s->nb_streams, sizeof(*idx->entries));
+    idx->nb_entries = av_calloc(s->nb_streams, sizeof(*idx->nb_entries));
+    idx->durations  = av_calloc(s->nb_streams, sizeof(*idx->durations));
+    idx->streams    = av_calloc(s->nb_streams, sizeof(*idx->streams));
+    if (s->nb_streams && (!idx->entries || !idx->nb_entries ||
+                          !idx->durations || !idx->streams)) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int i = 0; i < s->nb_streams; i++) {
+        const AVStream *st = s->streams[i];
+        idx->streams[i].codec_type = st->codecpar->codec_type;
+        idx->streams[i].codec_id   = st->codecpar->codec_id;
+        idx->streams[i].time_base  = st->time_base;
+    }
+
+    idx->input_size = avio_size(s->pb);
+    ret = ff_hash_input_ends(s->pb, idx->input_size, idx->input_hash);
+    if (ret < 0)
+        goto fail;
+
+    *pidx = idx;
+    return 0;
+fail:
+    ff_seek_index_free(&idx);
+    return ret;
+}
+
+int ff_seek_index_add(FFSeekIndex *idx, int stream_index, const AVIndexEntry *e)
+{
+    if (stream_index < 0 || stream_index >= idx->nb_streams)
+        return AVERROR(EINVAL);
+    if (!av_dynarray2_add((void **)&idx->entries[stream_index],
+                          &idx->nb_entries[stream_index], sizeof(*e),
+                          (const uint8_t *)e))
+        return AVERROR(ENOMEM);
+    return 0;
+}
+
+void ff_seek_index_clear(FFSeekIndex *idx)
+{
+    for (int i = 0; i < idx->nb_streams; i++) {
+        av_freep(&idx->entries[i]);
+        idx->nb_entries[i] = 0;
+        idx->durations[i]  = 0;
+    }
+    idx->complete = 0;
+}
+
+void ff_seek_index_free(FFSeekIndex **pidx)
+{
+    FFSeekIndex *idx = *pidx;
+
+    if (!idx)
+        return;
+    for (int i = 0; i < idx->nb_streams && idx->entries; i++)
+        av_free(idx->entries[i]);
+    av_free(idx->entries);
+    av_free(idx->nb_entries);
+    av_free(idx->durations);
+    av_free(idx->streams);
+    av_freep(pidx);
+}
+
+int ff_seek_index_read(AVFormatContext *s, const char *url, FFSeekIndex *idx)
+{
+    AVIOContext *pb = NULL;
+    uint8_t hash[FF_INPUT_HASH_SIZE];
+    int64_t size;
+    int ret, version, complete;
+
+    ret = s->io_open(s, &pb, url, AVIO_FLAG_READ, NULL);
+    if (ret < 0) {
+        av_log(s, AV_LOG_DEBUG, "No seek index loaded from %s: %s\n",
+               url, av_err2str(ret));
+        return 0;
+    }
+    size = avio_size(pb);
+
+    if (avio_rb32(pb) != SEEK_INDEX_TAG)
+        goto invalid;
+    version = avio_r8(pb);
+    if (version != SEEK_INDEX_VERSION) {
+        av_log(s, AV_LOG_VERBOSE, "Ignoring the seek index %s of version %d\n",
+               url, version);
+        ret = 0;
+        goto end;
+    }
+    complete = avio_r8(pb);
+    avio_rb16(pb);
+    if (avio_rb64(pb) != idx->input_size ||
+        avio_read(pb, hash, sizeof(hash)) != sizeof(hash) ||
+        memcmp(hash, idx->input_hash, sizeof(hash)) ||
+        avio_rb32(pb) != idx->nb_streams)
+        goto mismatch;
+
+    for (int i = 0; i < idx->nb_streams; i++) {
+        const FFSeekIndexStream *st = &idx->streams[i];
+        unsigned nb_entries;
+
+        if (avio_rb32(pb) != st->codec_type    ||
+            avio_rb32(pb) != st->codec_id      ||
+            avio_rb32(pb) != st->time_base.num ||
+            avio_rb32(pb) != st->time_base.den)
+            goto mismatch;
+        idx->durations[i] = avio_rb64(pb);
+        nb_entries = avio_rb32(pb);
+        if (size >= 0 && nb_entries > (size - avio_tell(pb)) / SEEK_INDEX_ENTRY_SIZE)
+            goto invalid;
+
+        for (unsigned j = 0; j < nb_entries; j++) {
+            AVIndexEntry e;
+            e.pos          = avio_rb64(pb);
+            e.timestamp    = avio_rb64(pb);
+            e.size         = avio_rb32(pb) & 0x3FFFFFFF;
+            e.flags        = avio_rb32(pb) & 3;
+            e.min_distance = avio_rb32(pb);
+            if ((ret = ff_seek_index_add(idx, i, &e)) < 0)
+                goto end;
+        }
+    }
+    if (pb->error || avio_feof(pb))
+        goto invalid;
+
+    av_log(s, AV_LOG_VERBOSE, "Loaded the %sseek index %s\n",
+           complete ? "complete " : "", url);
+    idx->complete = complete;
+    ret = 1;
+    goto end;
+
+mismatch:
+    av_log(s, AV_LOG_VERBOSE, "Ignoring the seek index %s of another input\n", url);
+    ret = 0;
+    goto end;
+invalid:
+    av_log(s, AV_LOG_WARNING, "Ignoring the invalid seek index %s\n", url);
+    ret = 0;
+end:
+    if (ret <= 0)
+        ff_seek_index_clear(idx);
+    ff_format_io_close(s, &pb);
+    return ret;
+}
+
+int ff_seek_index_write(AVFormatContext *s, const char *url, const FFSeekIndex *idx)
+{
+    AVIOContext *pb = NULL;
+    char *tmp;
+    int ret;
+
+    if (idx->nb_streams != s->nb_streams)
+        return AVERROR(EINVAL);
+
+    /* written next to it and renamed, so that readers never see a partial
+     * index */
+    tmp = av_asprintf("%s.tmp", url);
+    if (!tmp)
+        return AVERROR(ENOMEM);
+    ret = s->io_open(s, &pb, tmp, AVIO_FLAG_WRITE, NULL);
+    if (ret < 0)
+        goto fail;
+
+    avio_wb32(pb, SEEK_INDEX_TAG);
+    avio_w8(pb, SEEK_INDEX_VERSION);
+    avio_w8(pb, !!idx->complete);
+    avio_wb16(pb, 0);
+    avio_wb64(pb, idx->input_size);
+    avio_write(pb, idx->input_hash, sizeof(idx->input_hash));
+    avio_wb32(pb, idx->nb_streams);
+    for (int i = 0; i < idx->nb_streams; i++) {
+        const FFSeekIndexStream *st = &idx->streams[i];
+
+        avio_wb32(pb, st->codec_type);
+        avio_wb32(pb, st->codec_id);
+        avio_wb32(pb, st->time_base.num);
+        avio_wb32(pb, st->time_base.den);
+        avio_wb64(pb, s->streams[i]->duration);
+        avio_wb32(pb, idx->nb_entries[i]);
+        for (int j = 0; j < idx->nb_entries[i]; j++) {
+            const AVIndexEntry *e = &idx->entries[i][j];
+            avio_wb64(pb, e->pos);
+            avio_wb64(pb, e->timestamp);
+            avio_wb32(pb, e->size);
+            avio_wb32(pb, e->flags);
+            avio_wb32(pb, e->min_distance);
+        }
+    }
+    ret = ff_format_io_close(s, &pb);
+    if (ret < 0)
+        goto fail;
+
+    ret = ff_rename(tmp, url, s);
+    if (ret >= 0)
+        av_log(s, AV_LOG_VERBOSE, "Wrote the seek index %s\n", url);
+    av_free(tmp);
+    return ret;
+
+fail:
+    av_log(s, AV_LOG_ERROR, "Could not write the seek index %s: %s\n",
+           url, av_err2str(ret));
+    av_free(tmp);
+    return ret;
+}
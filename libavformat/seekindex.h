@@ -0,0 +1,113 @@
+/*
+ * Seek index sidecar files
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_SEEKINDEX_H
+#define AVFORMAT_SEEKINDEX_H
+
+#include "avformat.h"
+#include "internal.h"
+
+/**
+ * @file
+ * Seek index sidecar files.
+ *
+ * Demuxers that build their seek index while reading (Matroska without
+ * Cues, fragmented MP4 without sidx/mfra) can store it in a file next to the
+ * input, and load it when the input is opened again, instead of scanning it
+ * again. The meaning of the entries is up to the demuxer. An index file is
+ * only loaded for an input of the same size, with the same first and last
+ * bytes and the same streams.
+ */
+
+typedef struct FFSeekIndexStream {
+    enum AVMediaType codec_type;
+    enum AVCodecID codec_id;
+    AVRational time_base;
+} FFSeekIndexStream;
+
+typedef struct FFSeekIndex {
+    /**
+     * Set by the demuxer if the entries cover the whole input.
+     */
+    int complete;
+    int nb_streams;
+    /**
+     * Per stream entry tables, nb_streams of each.
+     */
+    AVIndexEntry **entries;
+    int *nb_entries;
+    /**
+     * Stream durations at the time the index was written, in stream time
+     * base. Only set by ff_seek_index_read().
+     */
+    int64_t *durations;
+
+    /**
+     * Identity of the input, captured by ff_seek_index_alloc(): its size,
+     * a hash of its first and last bytes and the parameters of its streams.
+     */
+    int64_t input_size;
+    uint8_t input_hash[FF_INPUT_HASH_SIZE];
+    FFSeekIndexStream *streams;
+} FFSeekIndex;
+
+/**
+ * Allocate an empty index for the input of s and its streams as they are
+ * now. Demuxers which change the stream parameters later while reading the
+ * header must use the same index for reading and writing the index file, so
+ * that both compare the same state.
+ *
+ * The position of s->pb is restored.
+ *
+ * @return 0 on success, AVERROR(ENOSYS) if the input is not seekable,
+ *         another negative error code on failure
+ */
+int ff_seek_index_alloc(AVFormatContext *s, FFSeekIndex **idx);
+
+/**
+ * Append an entry to the table of a stream.
+ */
+int ff_seek_index_add(FFSeekIndex *idx, int stream_index, const AVIndexEntry *e);
+
+/**
+ * Remove all the entries.
+ */
+void ff_seek_index_clear(FFSeekIndex *idx);
+
+void ff_seek_index_free(FFSeekIndex **idx);
+
+/**
+ * Load the entries of the index file at url into idx if the file belongs
+ * to the input idx was allocated for.
+ *
+ * @param idx an index without entries, from ff_seek_index_alloc()
+ * @return 1 if an index was loaded, 0 if there is no usable index file,
+ *         a negative error code on failure; idx is left without entries
+ *         unless 1 is returned
+ */
+int ff_seek_index_read(AVFormatContext *s, const char *url, FFSeekIndex *idx);
+
+/**
+ * Write idx to url, with the identity of the input it was allocated for and
+ * the current stream durations.
+ */
+int ff_seek_index_write(AVFormatContext *s, const char *url, const FFSeekIndex *idx);
+
+#endif /* AVFORMAT_SEEKINDEX_H */
@@ -0,0 +1,128 @@
+/*
+ * Shared memory frame ring
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_SHMFRAME_H
+#define AVFORMAT_SHMFRAME_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "libavutil/macros.h"
+
+/**
+ * Layout of the file shared between one shmframe muxer and any number of
+ * shmframe demuxers. The file is mapped by all processes; it starts with a
+ * ShmFrameHeader, followed by the concatenated extradata of all streams, and
+ * then (at data_offset) by nb_slots slots of slot_stride bytes each.
+ *
+ * Packets are numbered by a monotonically increasing sequence number; packet
+ * N lives in slot N % nb_slots. The writer sets the sequence number of a slot
+ * to SHMFRAME_SEQ_INVALID while filling it, publishes the packet by storing
+ * its sequence number in the slot and then advances write_seq. Every reader
+ * owns one ShmFrameReader entry and advertises the first sequence number it
+ * has not yet consumed in it; the writer never overwrites a slot still needed
+ * by an active reader.
+ *
+ * The atomics live in the mapping and thus must be lock-free, which configure
+ * checks.
+ */
+
+#define SHMFRAME_MAGIC       MKTAG(u'\xFF', 'S', 'h', 'F')
+#define SHMFRAME_VERSION     1
+#define SHMFRAME_MAX_STREAMS 16
+#define SHMFRAME_MAX_READERS 32
+#define SHMFRAME_SLOT_ALIGN  64
+#define SHMFRAME_DATA_ALIGN  4096
+
+/* Sequence number of a slot while the writer fills it */
+#define SHMFRAME_SEQ_INVALID UINT64_MAX
+
+typedef struct ShmFrameStream {
+    int32_t  codec_type;
+    int32_t  codec_id;
+    uint32_t codec_tag;
+    int32_t  format;
+    int64_t  bit_rate;
+    int32_t  bits_per_coded_sample;
+    int32_t  bits_per_raw_sample;
+    int32_t  profile, level;
+    int32_t  width, height;
+    int32_t  sar_num, sar_den;
+    int32_t  framerate_num, framerate_den;
+    int32_t  field_order;
+    int32_t  color_range, color_primaries, color_trc, color_space;
+    int32_t  chroma_location;
+    int32_t  ch_order, nb_channels;
+    uint64_t ch_mask;
+    int32_t  sample_rate;
+    int32_t  block_align;
+    int32_t  frame_size;
+    int32_t  time_base_num, time_base_den;
+    uint32_t extradata_offset; ///< relative to the start of the file
+    uint32_t extradata_size;
+} ShmFrameStream;
+
+typedef struct ShmFrameReader {
+    atomic_uint   token;    ///< nonzero while the entry is owned by a reader
+    atomic_ullong released; ///< first sequence number not yet consumed
+} ShmFrameReader;
+
+typedef struct ShmFrameHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nb_slots;
+    uint32_t slot_size;    ///< maximum payload size of a slot
+    uint64_t slot_stride;  ///< distance in bytes between two slots
+    uint64_t data_offset;  ///< offset of the first slot
+    uint32_t nb_streams;
+    ShmFrameStream streams[SHMFRAME_MAX_STREAMS];
+
+    atomic_uint   ready;     ///< set once all of the above is valid
+    atomic_uint   eof;       ///< set once the writer will not publish more
+    atomic_ullong write_seq; ///< number of packets published so far
+    ShmFrameReader readers[SHMFRAME_MAX_READERS];
+} ShmFrameHeader;
+
+typedef struct ShmFrameSlot {
+    atomic_ullong seq; ///< sequence number of the packet in this slot
+    int64_t  pts;
+    int64_t  dts;
+    int64_t  duration;
+    uint32_t size;
+    uint32_t flags;
+    uint32_t stream_index;
+} ShmFrameSlot;
+
+/* Size of the slot header; the payload follows it */
+#define SHMFRAME_SLOT_HEADER_SIZE FFALIGN(sizeof(ShmFrameSlot), SHMFRAME_SLOT_ALIGN)
+
+static inline ShmFrameSlot *ff_shmframe_slot(const ShmFrameHeader *hdr,
+                                             uint64_t seq)
+{
+    uint8_t *base = (uint8_t *) hdr + hdr->data_offset;
+    return (ShmFrameSlot *) (base + (seq % hdr->nb_slots) * hdr->slot_stride);
+}
+
+static inline uint8_t *ff_shmframe_slot_data(ShmFrameSlot *slot)
+{
+    return (uint8_t *) slot + SHMFRAME_SLOT_HEADER_SIZE;
+}
+
+#endif /* AVFORMAT_SHMFRAME_H */
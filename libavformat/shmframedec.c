@@ -0,0 +1,364 @@
+/*
+ * Shared memory frame ring demuxer
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libavutil/file_open.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/random_seed.h"
+#include "libavutil/time.h"
+
+#include "avformat.h"
+#include "demux.h"
+#include "internal.h"
+#include "shmframe.h"
+#include "url.h"
+
+typedef struct ShmFrameDemuxContext {
+    const AVClass *class;
+    int64_t timeout;
+
+    int fd;
+    ShmFrameHeader *hdr;
+    size_t map_size;
+    ShmFrameReader *reader;
+    unsigned token;
+    uint64_t seq;
+} ShmFrameDemuxContext;
+
+/**
+ * Sleep for a short, growing amount of time. Returns AVERROR_EXIT if
+ * interrupted and AVERROR(ETIMEDOUT) once the timeout since start expired.
+ */
+static int shmframe_backoff(AVFormatContext *s, int64_t start, int *sleep_us)
+{
+    ShmFrameDemuxContext *c = s->priv_data;
+
+    if (ff_check_interrupt(&s->interrupt_callback))
+        return AVERROR_EXIT;
+    if (c->timeout >= 0 && av_gettime_relative() - start > c->timeout)
+        return AVERROR(ETIMEDOUT);
+
+    av_usleep(*sleep_us);
+    *sleep_us = FFMIN(*sleep_us * 2, 1000);
+    return 0;
+}
+
+static int shmframe_map(AVFormatContext *s)
+{
+    ShmFrameDemuxContext *c = s->priv_data;
+    const int64_t start = av_gettime_relative();
+    int sleep_us = 100, ret;
+    struct stat st;
+
+    /* Wait for the writer to create the ring and publish its header */
+    for (;;) {
+        c->fd = avpriv_open(s->url, O_RDWR);
+        if (c->fd >= 0) {
+            if (fstat(c->fd, &st) < 0)
+                return AVERROR(errno);
+            if (st.st_size >= sizeof(ShmFrameHeader))
+                break;
+            close(c->fd);
+            c->fd = -1;
+        } else if (errno != ENOENT) {
+            return AVERROR(errno);
+        }
+
+        ret = shmframe_backoff(s, start, &sleep_us);
+        if (ret < 0)
+            return ret;
+    }
+
+    c->map_size = st.st_size;
+    c->hdr = mmap(NULL, c->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (c->hdr == MAP_FAILED) {
+        c->hdr = NULL;
+        return AVERROR(errno);
+    }
+
+    while (!atomic_load(&c->hdr->ready)) {
+        if (atomic_load(&c->hdr->eof))
+            return AVERROR_EOF;
+        ret = shmframe_backoff(s, start, &sleep_us);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (c->hdr->magic != SHMFRAME_MAGIC || c->hdr->version != SHMFRAME_VERSION) {
+        av_log(s, AV_LOG_ERROR, "Shared frame ring header mismatch: expected "
+               "magic 0x%X version %d, got magic 0x%X version %d\n",
+               SHMFRAME_MAGIC, SHMFRAME_VERSION, c->hdr->magic, c->hdr->version);
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (!c->hdr->nb_slots || c->hdr->nb_streams > SHMFRAME_MAX_STREAMS ||
+        c->hdr->data_offset > c->map_size ||
+        c->hdr->slot_stride < SHMFRAME_SLOT_HEADER_SIZE + c->hdr->slot_size ||
+        c->hdr->slot_stride > (c->map_size - c->hdr->data_offset) / c->hdr->nb_slots)
+        return AVERROR_INVALIDDATA;
+
+    return 0;
+}
+
+static int shmframe_attach(AVFormatContext *s)
+{
+    ShmFrameDemuxContext *c = s->priv_data;
+    ShmFrameHeader *hdr = c->hdr;
+
+    c->token = av_get_random_seed() | 1;
+
+    for (int i = 0; i < SHMFRAME_MAX_READERS; i++) {
+        ShmFrameReader *r = &hdr->readers[i];
+        unsigned expected = 0;
+
+        /* Publish a conservative position before claiming the entry, then
+         * refresh it; the writer never runs ahead of either value by more
+         * than the ring size. */
+        if (atomic_load(&r->token))
+            continue;
+        atomic_store(&r->released, atomic_load(&hdr->write_seq));
+        if (!atomic_compare_exchange_strong(&r->token, &expected, c->token))
+            continue;
+
+        c->seq = atomic_load(&hdr->write_seq);
+        atomic_store(&r->released, c->seq);
+        c->reader = r;
+        av_log(s, AV_LOG_VERBOSE, "Attached as reader %d at packet %"PRIu64"\n",
+               i, c->seq);
+        return 0;
+    }
+
+    av_log(s, AV_LOG_ERROR, "All %d reader entries are in use\n",
+           SHMFRAME_MAX_READERS);
+    return AVERROR(EBUSY);
+}
+
+static int shmframe_read_close(AVFormatContext *s)
+{
+    ShmFrameDemuxContext *c = s->priv_data;
+
+    if (c->reader) {
+        unsigned token = c->token;
+        atomic_compare_exchange_strong(&c->reader->token, &token, 0);
+        c->reader = NULL;
+    }
+
+    if (c->hdr) {
+        munmap(c->hdr, c->map_size);
+        c->hdr = NULL;
+    }
+
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+
+    return 0;
+}
+
+static int shmframe_read_header(AVFormatContext *s)
+{
+    ShmFrameDemuxContext *c = s->priv_data;
+    ShmFrameHeader *hdr;
+    int ret;
+
+    c->fd = -1;
+
+    ret = shmframe_map(s);
+    if (ret < 0) {
+        av_log(s, AV_LOG_ERROR, "Failed to open shared frame ring '%s': %s\n",
+               s->url, av_err2str(ret));
+        return ret;
+    }
+    hdr = c->hdr;
+
+    for (int i = 0; i < hdr->nb_streams; i++) {
+        const ShmFrameStream *ss = &hdr->streams[i];
+        AVStream *st = avformat_new_stream(s, NULL);
+        AVCodecParameters *par;
+        if (!st)
+            return AVERROR(ENOMEM);
+        par = st->codecpar;
+
+        par->codec_type            = ss->codec_type;
+        par->codec_id              = ss->codec_id;
+        par->codec_tag             = ss->codec_tag;
+        par->format                = ss->format;
+        par->bit_rate              = ss->bit_rate;
+        par->bits_per_coded_sample = ss->bits_per_coded_sample;
+        par->bits_per_raw_sample   = ss->bits_per_raw_sample;
+        par->profile               = ss->profile;
+        par->level                 = ss->level;
+        par->width                 = ss->width;
+        par->height                = ss->height;
+        par->sample_aspect_ratio   = (AVRational) { ss->sar_num, ss->sar_den };
+        par->framerate             = (AVRational) { ss->framerate_num, ss->framerate_den };
+        par->field_order           = ss->field_order;
+        par->color_range           = ss->color_range;
+        par->color_primaries       = ss->color_primaries;
+        par->color_trc             = ss->color_trc;
+        par->color_space           = ss->color_space;
+        par->chroma_location       = ss->chroma_location;
+        par->sample_rate           = ss->sample_rate;
+        par->block_align           = ss->block_align;
+        par->frame_size            = ss->frame_size;
+
+        if (ss->ch_order == AV_CHANNEL_ORDER_NATIVE && ss->ch_mask) {
+            ret = av_channel_layout_from_mask(&par->ch_layout, ss->ch_mask);
+            if (ret < 0)
+                return ret;
+        } else if (ss->nb_channels > 0) {
+            par->ch_layout.order       = AV_CHANNEL_ORDER_UNSPEC;
+            par->ch_layout.nb_channels = ss->nb_channels;
+        }
+
+        if (ss->extradata_size) {
+            if (ss->extradata_offset < sizeof(ShmFrameHeader) ||
+                ss->extradata_offset + (uint64_t) ss->extradata_size > hdr->data_offset)
+                return AVERROR_INVALIDDATA;
+            ret = ff_alloc_extradata(par, ss->extradata_size);
+            if (ret < 0)
+                return ret;
+            memcpy(par->extradata, (uint8_t *) hdr + ss->extradata_offset,
+                   ss->extradata_size);
+        }
+
+        if (ss->time_base_num > 0 && ss->time_base_den > 0)
+            avpriv_set_pts_info(st, 64, ss->time_base_num, ss->time_base_den);
+    }
+
+    return shmframe_attach(s);
+}
+
+static int shmframe_overwritten(AVFormatContext *s)
+{
+    ShmFrameDemuxContext *c = s->priv_data;
+    av_log(s, AV_LOG_ERROR, "Packet %"PRIu64" was overwritten by the writer\n",
+           c->seq);
+    return AVERROR(EIO);
+}
+
+static int shmframe_read_packet(AVFormatContext *s, AVPacket *pkt)
+{
+    ShmFrameDemuxContext *c = s->priv_data;
+    ShmFrameHeader *hdr = c->hdr;
+    const int64_t start = av_gettime_relative();
+    int sleep_us = 10, ret;
+    ShmFrameSlot *slot;
+    uint32_t size;
+
+    for (;;) {
+        if (!c->reader || atomic_load(&c->reader->token) != c->token) {
+            av_log(s, AV_LOG_ERROR, "Evicted by the writer after stalling\n");
+            c->reader = NULL;
+            return AVERROR(EIO);
+        }
+
+        if (atomic_load(&hdr->write_seq) > c->seq)
+            break;
+
+        /* Check write_seq once more, the last packet may have been published
+         * right before EOF was signalled. */
+        if (atomic_load(&hdr->eof)) {
+            if (atomic_load(&hdr->write_seq) > c->seq)
+                continue;
+            return AVERROR_EOF;
+        }
+
+        if (s->flags & AVFMT_FLAG_NONBLOCK)
+            return AVERROR(EAGAIN);
+
+        ret = shmframe_backoff(s, start, &sleep_us);
+        if (ret < 0)
+            return ret;
+    }
+
+    slot = ff_shmframe_slot(hdr, c->seq);
+    if (atomic_load(&slot->seq) != c->seq)
+        return shmframe_overwritten(s);
+    size = slot->size;
+    if (size > hdr->slot_size)
+        size = 0;
+
+    /* Copy out rather than referencing the mapping, so that the ring does
+     * not stall while the packet is queued further downstream. */
+    ret = av_new_packet(pkt, size);
+    if (ret < 0)
+        return ret;
+    memcpy(pkt->data, ff_shmframe_slot_data(slot), size);
+
+    pkt->pts          = slot->pts;
+    pkt->dts          = slot->dts;
+    pkt->duration     = slot->duration;
+    pkt->flags        = slot->flags;
+    pkt->stream_index = slot->stream_index;
+
+    /* The writer may have reused the slot while it was copied, if this
+     * reader was evicted or lagged behind. */
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load(&slot->seq) != c->seq ||
+        atomic_load(&c->reader->token) != c->token) {
+        av_packet_unref(pkt);
+        return shmframe_overwritten(s);
+    }
+    if (slot->size > hdr->slot_size ||
+        (unsigned) pkt->stream_index >= s->nb_streams) {
+        av_packet_unref(pkt);
+        return AVERROR_INVALIDDATA;
+    }
+
+    atomic_store(&c->reader->released, ++c->seq);
+    return 0;
+}
+
+#define OFFSET(x) offsetof(ShmFrameDemuxContext, x)
+#define D AV_OPT_FLAG_DECODING_PARAM
+static const AVOption options[] = {
+    { "timeout", "how long to wait for the writer (-1 = forever)", OFFSET(timeout),
+        AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT64_MAX, D },
+    { NULL },
+};
+
+static const AVClass shmframe_demuxer_class = {
+    .class_name = "shmframe demuxer",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
+const FFInputFormat ff_shmframe_demuxer = {
+    .p.name         = "shmframe",
+    .p.long_name    = NULL_IF_CONFIG_SMALL("Shared memory frame ring"),
+    .p.priv_class   = &shmframe_demuxer_class,
+    .p.flags        = AVFMT_NOFILE | AVFMT_NOGENSEARCH | AVFMT_NOBINSEARCH | AVFMT_NO_BYTE_SEEK,
+    .priv_data_size = sizeof(ShmFrameDemuxContext),
+    .flags_internal = FF_INFMT_FLAG_INIT_CLEANUP,
+    .read_header    = shmframe_read_header,
+    .read_packet    = shmframe_read_packet,
+    .read_close     = shmframe_read_close,
+};
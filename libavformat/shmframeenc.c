@@ -0,0 +1,389 @@
+/*
+ * Shared memory frame ring muxer
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "libavutil/file_open.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
+
+#include "avformat.h"
+#include "internal.h"
+#include "mux.h"
+#include "shmframe.h"
+#include "url.h"
+
+#define DEFAULT_SLOT_SIZE (1 << 20)
+
+typedef struct ShmFrameMuxContext {
+    const AVClass *class;
+    int nb_slots;
+    int slot_size;
+    int min_readers;
+    int64_t reader_timeout;
+    int unlink_file;
+
+    int fd;
+    ShmFrameHeader *hdr;
+    size_t map_size;
+    uint64_t seq;
+
+    /* Last observed progress of every reader, used to detect stalls */
+    unsigned reader_token[SHMFRAME_MAX_READERS];
+    uint64_t reader_released[SHMFRAME_MAX_READERS];
+    int64_t  reader_progress[SHMFRAME_MAX_READERS];
+} ShmFrameMuxContext;
+
+static int shmframe_slot_size(AVFormatContext *s)
+{
+    ShmFrameMuxContext *c = s->priv_data;
+    int size = 0;
+
+    if (c->slot_size)
+        return c->slot_size;
+
+    for (int i = 0; i < s->nb_streams; i++) {
+        const AVCodecParameters *par = s->streams[i]->codecpar;
+        if (par->codec_id == AV_CODEC_ID_RAWVIDEO) {
+            int ret = av_image_get_buffer_size(par->format, par->width,
+                                               par->height, 1);
+            if (ret < 0)
+                return ret;
+            size = FFMAX(size, ret);
+        }
+    }
+
+    return size ? size : DEFAULT_SLOT_SIZE;
+}
+
+static int shmframe_init(AVFormatContext *s)
+{
+    ShmFrameMuxContext *c = s->priv_data;
+    size_t extradata_size = 0, data_offset, slot_stride;
+    int slot_size, ret;
+
+    c->fd = -1;
+
+    if (s->nb_streams > SHMFRAME_MAX_STREAMS) {
+        av_log(s, AV_LOG_ERROR, "At most %d streams are supported\n",
+               SHMFRAME_MAX_STREAMS);
+        return AVERROR(EINVAL);
+    }
+
+    for (int i = 0; i < s->nb_streams; i++) {
+        const AVCodecParameters *par = s->streams[i]->codecpar;
+        if (par->codec_id == AV_CODEC_ID_WRAPPED_AVFRAME) {
+            av_log(s, AV_LOG_ERROR, "Stream %d: wrapped_avframe packets "
+                   "cannot be shared between processes, use rawvideo or "
+                   "a PCM codec instead\n", i);
+            return AVERROR(EINVAL);
+        }
+        extradata_size += par->extradata_size;
+    }
+
+    slot_size = shmframe_slot_size(s);
+    if (slot_size < 0)
+        return slot_size;
+
+    data_offset = FFALIGN(sizeof(ShmFrameHeader) + extradata_size,
+                          SHMFRAME_DATA_ALIGN);
+    slot_stride = FFALIGN(SHMFRAME_SLOT_HEADER_SIZE + (size_t) slot_size +
+                          AV_INPUT_BUFFER_PADDING_SIZE, SHMFRAME_SLOT_ALIGN);
+    if (extradata_size > UINT32_MAX ||
+        slot_stride > (SIZE_MAX - data_offset) / c->nb_slots)
+        return AVERROR(EINVAL);
+    c->map_size = data_offset + slot_stride * c->nb_slots;
+
+    /* Never attach to a stale ring; readers of a previous instance keep
+     * their own mapping of the unlinked file. */
+    if (unlink(s->url) < 0 && errno != ENOENT) {
+        ret = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Failed to remove stale '%s': %s\n",
+               s->url, av_err2str(ret));
+        return ret;
+    }
+
+    c->fd = avpriv_open(s->url, O_RDWR | O_CREAT | O_EXCL, 0660);
+    if (c->fd < 0) {
+        ret = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Failed to create '%s': %s\n",
+               s->url, av_err2str(ret));
+        return ret;
+    }
+
+    if (ftruncate(c->fd, c->map_size) < 0) {
+        ret = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Failed to resize '%s': %s\n",
+               s->url, av_err2str(ret));
+        return ret;
+    }
+
+    c->hdr = mmap(NULL, c->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (c->hdr == MAP_FAILED) {
+        c->hdr = NULL;
+        ret = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Failed to map '%s': %s\n",
+               s->url, av_err2str(ret));
+        return ret;
+    }
+
+    c->hdr->magic       = SHMFRAME_MAGIC;
+    c->hdr->version     = SHMFRAME_VERSION;
+    c->hdr->nb_slots    = c->nb_slots;
+    c->hdr->slot_size   = slot_size;
+    c->hdr->slot_stride = slot_stride;
+    c->hdr->data_offset = data_offset;
+
+    av_log(s, AV_LOG_VERBOSE, "Mapped %d slots of %d bytes (%zu bytes total)\n",
+           c->nb_slots, slot_size, c->map_size);
+    return 0;
+}
+
+static int shmframe_write_header(AVFormatContext *s)
+{
+    ShmFrameMuxContext *c = s->priv_data;
+    ShmFrameHeader *hdr = c->hdr;
+    uint32_t extradata_offset = sizeof(ShmFrameHeader);
+
+    hdr->nb_streams = s->nb_streams;
+    for (int i = 0; i < s->nb_streams; i++) {
+        const AVStream *st = s->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+        ShmFrameStream *ss = &hdr->streams[i];
+
+        ss->codec_type            = par->codec_type;
+        ss->codec_id              = par->codec_id;
+        ss->codec_tag             = par->codec_tag;
+        ss->format                = par->format;
+        ss->bit_rate              = par->bit_rate;
+        ss->bits_per_coded_sample = par->bits_per_coded_sample;
+        ss->bits_per_raw_sample   = par->bits_per_raw_sample;
+        ss->profile               = par->profile;
+        ss->level                 = par->level;
+        ss->width                 = par->width;
+        ss->height                = par->height;
+        ss->sar_num               = par->sample_aspect_ratio.num;
+        ss->sar_den               = par->sample_aspect_ratio.den;
+        ss->framerate_num         = par->framerate.num;
+        ss->framerate_den         = par->framerate.den;
+        ss->field_order           = par->field_order;
+        ss->color_range           = par->color_range;
+        ss->color_primaries       = par->color_primaries;
+        ss->color_trc             = par->color_trc;
+        ss->color_space           = par->color_space;
+        ss->chroma_location       = par->chroma_location;
+        ss->ch_order              = par->ch_layout.order;
+        ss->nb_channels           = par->ch_layout.nb_channels;
+        ss->ch_mask               = par->ch_layout.order == AV_CHANNEL_ORDER_NATIVE ?
+                                    par->ch_layout.u.mask : 0;
+        ss->sample_rate           = par->sample_rate;
+        ss->block_align           = par->block_align;
+        ss->frame_size            = par->frame_size;
+        ss->time_base_num         = st->time_base.num;
+        ss->time_base_den         = st->time_base.den;
+        ss->extradata_offset      = extradata_offset;
+        ss->extradata_size        = par->extradata_size;
+
+        if (par->extradata_size)
+            memcpy((uint8_t *) hdr + extradata_offset, par->extradata,
+                   par->extradata_size);
+        extradata_offset += par->extradata_size;
+    }
+
+    atomic_store(&hdr->ready, 1);
+    return 0;
+}
+
+static int count_readers(const ShmFrameHeader *hdr)
+{
+    int nb_readers = 0;
+    for (int i = 0; i < SHMFRAME_MAX_READERS; i++)
+        nb_readers += !!atomic_load(&hdr->readers[i].token);
+    return nb_readers;
+}
+
+/**
+ * Check whether any reader still needs the slot that packet seq is about to
+ * overwrite. Readers which made no progress for longer than reader_timeout
+ * are evicted.
+ */
+static int readers_blocking(AVFormatContext *s, uint64_t seq)
+{
+    ShmFrameMuxContext *c = s->priv_data;
+    ShmFrameHeader *hdr = c->hdr;
+    const int64_t now = av_gettime_relative();
+    int blocking = 0;
+
+    for (int i = 0; i < SHMFRAME_MAX_READERS; i++) {
+        ShmFrameReader *r = &hdr->readers[i];
+        unsigned token = atomic_load(&r->token);
+        uint64_t released;
+        if (!token)
+            continue;
+
+        released = atomic_load(&r->released);
+        if (released + c->nb_slots > seq)
+            continue;
+
+        if (token != c->reader_token[i] || released != c->reader_released[i]) {
+            c->reader_token[i]    = token;
+            c->reader_released[i] = released;
+            c->reader_progress[i] = now;
+        } else if (c->reader_timeout > 0 &&
+                   now - c->reader_progress[i] > c->reader_timeout) {
+            if (atomic_compare_exchange_strong(&r->token, &token, 0)) {
+                av_log(s, AV_LOG_WARNING, "Evicting reader %d stalled at "
+                       "packet %"PRIu64"\n", i, released);
+            }
+            continue;
+        }
+
+        blocking = 1;
+    }
+
+    return blocking;
+}
+
+static int shmframe_wait(AVFormatContext *s, uint64_t seq)
+{
+    ShmFrameMuxContext *c = s->priv_data;
+    int sleep_us = 10;
+
+    for (;;) {
+        if (seq || count_readers(c->hdr) >= c->min_readers) {
+            if (!readers_blocking(s, seq))
+                return 0;
+        }
+
+        if (ff_check_interrupt(&s->interrupt_callback))
+            return AVERROR_EXIT;
+
+        av_usleep(sleep_us);
+        sleep_us = FFMIN(sleep_us * 2, 1000);
+    }
+}
+
+static int shmframe_write_packet(AVFormatContext *s, AVPacket *pkt)
+{
+    ShmFrameMuxContext *c = s->priv_data;
+    ShmFrameHeader *hdr = c->hdr;
+    ShmFrameSlot *slot;
+    int ret;
+
+    if (pkt->size > hdr->slot_size) {
+        av_log(s, AV_LOG_ERROR, "Packet of %d bytes does not fit into a "
+               "slot of %u bytes, increase slot_size\n", pkt->size,
+               hdr->slot_size);
+        return AVERROR(EINVAL);
+    }
+
+    ret = shmframe_wait(s, c->seq);
+    if (ret < 0)
+        return ret;
+
+    /* Readers still copying the previous packet of the slot see that it
+     * changed when checking its sequence number again. */
+    slot = ff_shmframe_slot(hdr, c->seq);
+    atomic_store(&slot->seq, SHMFRAME_SEQ_INVALID);
+    atomic_thread_fence(memory_order_release);
+    slot->pts          = pkt->pts;
+    slot->dts          = pkt->dts;
+    slot->duration     = pkt->duration;
+    slot->size         = pkt->size;
+    slot->flags        = pkt->flags;
+    slot->stream_index = pkt->stream_index;
+    memcpy(ff_shmframe_slot_data(slot), pkt->data, pkt->size);
+    memset(ff_shmframe_slot_data(slot) + pkt->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    atomic_store(&slot->seq, c->seq);
+
+    atomic_store(&hdr->write_seq, ++c->seq);
+    return 0;
+}
+
+static int shmframe_write_trailer(AVFormatContext *s)
+{
+    ShmFrameMuxContext *c = s->priv_data;
+    atomic_store(&c->hdr->eof, 1);
+    return 0;
+}
+
+static void shmframe_deinit(AVFormatContext *s)
+{
+    ShmFrameMuxContext *c = s->priv_data;
+
+    if (c->hdr) {
+        /* Also signal EOF on failure, so that readers do not hang */
+        atomic_store(&c->hdr->eof, 1);
+        munmap(c->hdr, c->map_size);
+        c->hdr = NULL;
+    }
+
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+        if (c->unlink_file)
+            unlink(s->url);
+    }
+}
+
+#define OFFSET(x) offsetof(ShmFrameMuxContext, x)
+#define E AV_OPT_FLAG_ENCODING_PARAM
+static const AVOption options[] = {
+    { "nb_slots", "number of packets the ring can hold", OFFSET(nb_slots),
+        AV_OPT_TYPE_INT, { .i64 = 8 }, 2, 4096, E },
+    { "slot_size", "maximum packet size in bytes (0 = auto)", OFFSET(slot_size),
+        AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX - 4096, E },
+    { "min_readers", "number of readers to wait for before writing the first packet",
+        OFFSET(min_readers), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, SHMFRAME_MAX_READERS, E },
+    { "reader_timeout", "evict readers that made no progress for this long (0 = never)",
+        OFFSET(reader_timeout), AV_OPT_TYPE_DURATION, { .i64 = 0 }, 0, INT64_MAX, E },
+    { "unlink", "remove the shared file when done", OFFSET(unlink_file),
+        AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
+    { NULL },
+};
+
+static const AVClass shmframe_muxer_class = {
+    .class_name = "shmframe muxer",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
+const FFOutputFormat ff_shmframe_muxer = {
+    .p.name         = "shmframe",
+    .p.long_name    = NULL_IF_CONFIG_SMALL("Shared memory frame ring"),
+    .p.priv_class   = &shmframe_muxer_class,
+    .p.audio_codec  = AV_CODEC_ID_PCM_S16LE,
+    .p.video_codec  = AV_CODEC_ID_RAWVIDEO,
+    .p.flags        = AVFMT_NOFILE | AVFMT_TS_NONSTRICT | AVFMT_TS_NEGATIVE,
+    .priv_data_size = sizeof(ShmFrameMuxContext),
+    .init           = shmframe_init,
+    .write_header   = shmframe_write_header,
+    .write_packet   = shmframe_write_packet,
+    .write_trailer  = shmframe_write_trailer,
+    .deinit         = shmframe_deinit,
+};
@@ -0,0 +1,464 @@
+/*
+ * Stream information files
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
+
+#include "avio_internal.h"
+#include "demux.h"
+#include "internal.h"
+#include "streaminfo.h"
+
+#define STREAM_INFO_TAG      MKBETAG('F', 'F', 'S', 'N')
+#define STREAM_INFO_VERSION  2
+#define STREAM_INFO_MAX_KEY  (1 << 16)
+
+typedef struct StreamInfo {
+    AVCodecParameters *par;
+    int64_t start_time;
+    int64_t duration;
+    int64_t nb_frames;
+    AVRational r_frame_rate;
+    AVRational avg_frame_rate;
+    AVRational sample_aspect_ratio;
+    int disposition;
+    int codec_info_nb_frames;
+} StreamInfo;
+
+int ff_stream_info_key(AVFormatContext *s, char **key)
+{
+    int64_t size = s->pb ? avio_size(s->pb) : -1;
+    AVBPrint bp;
+    int ret;
+
+    *key = NULL;
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "%s %"PRId64" %u", s->iformat->name, size, s->nb_streams);
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        const AVStream *st = s->streams[i];
+        av_bprintf(&bp, " %d:%d:%d:%d/%d", st->id, st->codecpar->codec_type,
+                   st->codecpar->codec_id, st->time_base.num, st->time_base.den);
+    }
+    if (size > 0 && s->pb->seekable & AVIO_SEEKABLE_NORMAL) {
+        uint8_t hash[FF_INPUT_HASH_SIZE];
+
+        ret = ff_hash_input_ends(s->pb, size, hash);
+        if (ret < 0) {
+            av_bprint_finalize(&bp, NULL);
+            return ret;
+        }
+        av_bprintf(&bp, " ");
+        for (int i = 0; i < sizeof(hash); i++)
+            av_bprintf(&bp, "%02x", hash[i]);
+    }
+    return av_bprint_finalize(&bp, key);
+}
+
+static void write_rational(AVIOContext *pb, AVRational q)
+{
+    avio_wb32(pb, q.num);
+    avio_wb32(pb, q.den);
+}
+
+static AVRational read_rational(AVIOContext *pb)
+{
+    AVRational q;
+    q.num = avio_rb32(pb);
+    q.den = avio_rb32(pb);
+    return q;
+}
+
+/* The CPB properties are the only side data added by probing */
+static void write_cpb_properties(AVIOContext *pb, const AVCodecParameters *par)
+{
+    const AVPacketSideData *sd = av_packet_side_data_get(par->coded_side_data,
+                                                         par->nb_coded_side_data,
+                                                         AV_PKT_DATA_CPB_PROPERTIES);
+    const AVCPBProperties *props = sd ? (const AVCPBProperties *)sd->data : NULL;
+
+    avio_w8(pb, !!props);
+    if (!props)
+        return;
+    avio_wb64(pb, props->max_bitrate);
+    avio_wb64(pb, props->min_bitrate);
+    avio_wb64(pb, props->avg_bitrate);
+    avio_wb64(pb, props->buffer_size);
+    avio_wb64(pb, props->vbv_delay);
+}
+
+static int read_cpb_properties(AVIOContext *pb, AVCodecParameters *par)
+{
+    AVCPBProperties *props;
+    size_t size;
+
+    if (!avio_r8(pb))
+        return 0;
+    props = av_cpb_properties_alloc(&size);
+    if (!props)
+        return AVERROR(ENOMEM);
+    props->max_bitrate = avio_rb64(pb);
+    props->min_bitrate = avio_rb64(pb);
+    props->avg_bitrate = avio_rb64(pb);
+    props->buffer_size = avio_rb64(pb);
+    props->vbv_delay   = avio_rb64(pb);
+    if (!av_packet_side_data_add(&par->coded_side_data, &par->nb_coded_side_data,
+                                 AV_PKT_DATA_CPB_PROPERTIES, props, size, 0)) {
+        av_free(props);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+static void write_codecpar(AVIOContext *pb, const AVCodecParameters *par)
+{
+    const AVChannelLayout *ch_layout = &par->ch_layout;
+    int custom = ch_layout->order == AV_CHANNEL_ORDER_CUSTOM;
+
+    avio_wb32(pb, par->codec_type);
+    avio_wb32(pb, par->codec_id);
+    avio_wb32(pb, par->codec_tag);
+    avio_wb32(pb, par->format);
+    avio_wb64(pb, par->bit_rate);
+    avio_wb32(pb, par->bits_per_coded_sample);
+    avio_wb32(pb, par->bits_per_raw_sample);
+    avio_wb32(pb, par->profile);
+    avio_wb32(pb, par->level);
+    avio_wb32(pb, par->width);
+    avio_wb32(pb, par->height);
+    write_rational(pb, par->sample_aspect_ratio);
+    write_rational(pb, par->framerate);
+    avio_wb32(pb, par->field_order);
+    avio_wb32(pb, par->color_range);
+    avio_wb32(pb, par->color_primaries);
+    avio_wb32(pb, par->color_trc);
+    avio_wb32(pb, par->color_space);
+    avio_wb32(pb, par->chroma_location);
+    avio_wb32(pb, par->video_delay);
+    /* a custom channel map is not stored, only its channel count */
+    avio_wb32(pb, custom ? AV_CHANNEL_ORDER_UNSPEC : ch_layout->order);
+    avio_wb32(pb, ch_layout->nb_channels);
+    avio_wb64(pb, custom ? 0 : ch_layout->u.mask);
+    avio_wb32(pb, par->sample_rate);
+    avio_wb32(pb, par->block_align);
+    avio_wb32(pb, par->frame_size);
+    avio_wb32(pb, par->initial_padding);
+    avio_wb32(pb, par->trailing_padding);
+    avio_wb32(pb, par->seek_preroll);
+    avio_wb32(pb, par->extradata_size);
+    avio_write(pb, par->extradata, par->extradata_size);
+    write_cpb_properties(pb, par);
+}
+
+static int read_codecpar(AVIOContext *pb, AVCodecParameters *par)
+{
+    AVChannelLayout *ch_layout = &par->ch_layout;
+    unsigned extradata_size;
+
+    par->codec_type            = avio_rb32(pb);
+    par->codec_id              = avio_rb32(pb);
+    par->codec_tag             = avio_rb32(pb);
+    par->format                = avio_rb32(pb);
+    par->bit_rate              = avio_rb64(pb);
+    par->bits_per_coded_sample = avio_rb32(pb);
+    par->bits_per_raw_sample   = avio_rb32(pb);
+    par->profile               = avio_rb32(pb);
+    par->level                 = avio_rb32(pb);
+    par->width                 = avio_rb32(pb);
+    par->height                = avio_rb32(pb);
+    par->sample_aspect_ratio   = read_rational(pb);
+    par->framerate             = read_rational(pb);
+    par->field_order           = avio_rb32(pb);
+    par->color_range           = avio_rb32(pb);
+    par->color_primaries       = avio_rb32(pb);
+    par->color_trc             = avio_rb32(pb);
+    par->color_space           = avio_rb32(pb);
+    par->chroma_location       = avio_rb32(pb);
+    par->video_delay           = avio_rb32(pb);
+    ch_layout->order           = avio_rb32(pb);
+    ch_layout->nb_channels     = avio_rb32(pb);
+    ch_layout->u.mask          = avio_rb64(pb);
+    par->sample_rate           = avio_rb32(pb);
+    par->block_align           = avio_rb32(pb);
+    par->frame_size            = avio_rb32(pb);
+    par->initial_padding       = avio_rb32(pb);
+    par->trailing_padding      = avio_rb32(pb);
+    par->seek_preroll          = avio_rb32(pb);
+
+    if (ch_layout->order != AV_CHANNEL_ORDER_UNSPEC &&
+        ch_layout->order != AV_CHANNEL_ORDER_NATIVE &&
+        ch_layout->order != AV_CHANNEL_ORDER_AMBISONIC ||
+        ch_layout->nb_channels < 0)
+        return AVERROR_INVALIDDATA;
+    if (ch_layout->order == AV_CHANNEL_ORDER_UNSPEC)
+        ch_layout->u.mask = 0;
+    if (!av_channel_layout_check(ch_layout) && ch_layout->nb_channels)
+        return AVERROR_INVALIDDATA;
+
+    extradata_size = avio_rb32(pb);
+    if (extradata_size) {
+        int ret;
+        if (extradata_size > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+            return AVERROR_INVALIDDATA;
+        ret = ff_get_extradata(NULL, par, pb, extradata_size);
+        if (ret < 0)
+            return ret;
+    }
+    return read_cpb_properties(pb, par);
+}
+
+/* Set the probed values, keeping what the header found that is not stored */
+static int apply_codecpar(AVCodecParameters *dst, const AVCodecParameters *src)
+{
+    AVChannelLayout ch_layout = { 0 };
+    int ret;
+
+    if (src->ch_layout.order != AV_CHANNEL_ORDER_UNSPEC ||
+        dst->ch_layout.nb_channels != src->ch_layout.nb_channels) {
+        ret = av_channel_layout_copy(&ch_layout, &src->ch_layout);
+        if (ret < 0)
+            return ret;
+        av_channel_layout_uninit(&dst->ch_layout);
+        dst->ch_layout = ch_layout;
+    }
+    if (src->extradata_size) {
+        ret = ff_alloc_extradata(dst, src->extradata_size);
+        if (ret < 0)
+            return ret;
+        memcpy(dst->extradata, src->extradata, src->extradata_size);
+    }
+    if (src->nb_coded_side_data &&
+        !av_packet_side_data_get(dst->coded_side_data, dst->nb_coded_side_data,
+                                 AV_PKT_DATA_CPB_PROPERTIES)) {
+        const AVPacketSideData *sd = &src->coded_side_data[0];
+        AVPacketSideData *dst_sd = av_packet_side_data_new(&dst->coded_side_data,
+                                                           &dst->nb_coded_side_data,
+                                                           sd->type, sd->size, 0);
+        if (!dst_sd)
+            return AVERROR(ENOMEM);
+        memcpy(dst_sd->data, sd->data, sd->size);
+    }
+
+    dst->codec_type            = src->codec_type;
+    dst->codec_id              = src->codec_id;
+    dst->codec_tag             = src->codec_tag;
+    dst->format                = src->format;
+    dst->bit_rate              = src->bit_rate;
+    dst->bits_per_coded_sample = src->bits_per_coded_sample;
+    dst->bits_per_raw_sample   = src->bits_per_raw_sample;
+    dst->profile               = src->profile;
+    dst->level                 = src->level;
+    dst->width                 = src->width;
+    dst->height                = src->height;
+    dst->sample_aspect_ratio   = src->sample_aspect_ratio;
+    dst->framerate             = src->framerate;
+    dst->field_order           = src->field_order;
+    dst->color_range           = src->color_range;
+    dst->color_primaries       = src->color_primaries;
+    dst->color_trc             = src->color_trc;
+    dst->color_space           = src->color_space;
+    dst->chroma_location       = src->chroma_location;
+    dst->video_delay           = src->video_delay;
+    dst->sample_rate           = src->sample_rate;
+    dst->block_align           = src->block_align;
+    dst->frame_size            = src->frame_size;
+    dst->initial_padding       = src->initial_padding;
+    dst->trailing_padding      = src->trailing_padding;
+    dst->seek_preroll          = src->seek_preroll;
+    return 0;
+}
+
+int ff_stream_info_read(AVFormatContext *s, const char *url, const char *key)
+{
+    AVIOContext *pb = NULL;
+    StreamInfo *info = NULL;
+    char *file_key = NULL;
+    int64_t start_time, duration, bit_rate;
+    int duration_estimation_method;
+    unsigned key_len, version, nb_streams = 0;
+    int ret;
+
+    ret = s->io_open(s, &pb, url, AVIO_FLAG_READ, NULL);
+    if (ret < 0) {
+        av_log(s, AV_LOG_DEBUG, "No stream information loaded from %s: %s\n",
+               url, av_err2str(ret));
+        return 0;
+    }
+
+    if (avio_rb32(pb) != STREAM_INFO_TAG)
+        goto invalid;
+    version = avio_rb32(pb);
+    if (version != STREAM_INFO_VERSION) {
+        av_log(s, AV_LOG_VERBOSE, "Ignoring the stream information %s of version %u\n",
+               url, version);
+        ret = 0;
+        goto end;
+    }
+    key_len = avio_rb32(pb);
+    if (key_len > STREAM_INFO_MAX_KEY)
+        goto invalid;
+    file_key = av_malloc(key_len + 1);
+    if (!file_key) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if (ffio_read_size(pb, file_key, key_len) < 0)
+        goto invalid;
+    file_key[key_len] = 0;
+    if (strcmp(file_key, key)) {
+        av_log(s, AV_LOG_VERBOSE, "Ignoring the stream information %s of another input\n", url);
+        ret = 0;
+        goto end;
+    }
+
+    start_time                 = avio_rb64(pb);
+    duration                   = avio_rb64(pb);
+    bit_rate                   = avio_rb64(pb);
+    duration_estimation_method = avio_rb32(pb);
+    nb_streams                 = avio_rb32(pb);
+    /* streams added while probing are created by the demuxer again, not here */
+    if (nb_streams != s->nb_streams)
+        goto invalid;
+
+    info = av_calloc(nb_streams, sizeof(*info));
+    if (!info) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (unsigned i = 0; i < nb_streams; i++) {
+        StreamInfo *si = &info[i];
+
+        si->par = avcodec_parameters_alloc();
+        if (!si->par) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        si->start_time          = avio_rb64(pb);
+        si->duration            = avio_rb64(pb);
+        si->nb_frames           = avio_rb64(pb);
+        si->r_frame_rate        = read_rational(pb);
+        si->avg_frame_rate      = read_rational(pb);
+        si->sample_aspect_ratio = read_rational(pb);
+        si->disposition         = avio_rb32(pb);
+        si->codec_info_nb_frames = avio_rb32(pb);
+        ret = read_codecpar(pb, si->par);
+        if (ret == AVERROR_INVALIDDATA || pb->error || avio_feof(pb))
+            goto invalid;
+        if (ret < 0)
+            goto end;
+    }
+    if (pb->error || avio_feof(pb))
+        goto invalid;
+
+    for (unsigned i = 0; i < nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        const StreamInfo *si = &info[i];
+
+        ret = apply_codecpar(st->codecpar, si->par);
+        if (ret < 0)
+            goto end;
+        st->start_time          = si->start_time;
+        st->duration            = si->duration;
+        st->nb_frames           = si->nb_frames;
+        st->r_frame_rate        = si->r_frame_rate;
+        st->avg_frame_rate      = si->avg_frame_rate;
+        st->sample_aspect_ratio = si->sample_aspect_ratio;
+        st->disposition         = si->disposition;
+        ffstream(st)->codec_info_nb_frames = si->codec_info_nb_frames;
+        ffstream(st)->need_context_update  = 1;
+    }
+    s->start_time                 = start_time;
+    s->duration                   = duration;
+    s->bit_rate                   = bit_rate;
+    s->duration_estimation_method = duration_estimation_method;
+
+    av_log(s, AV_LOG_VERBOSE, "Loaded the stream information %s\n", url);
+    ret = 1;
+    goto end;
+
+invalid:
+    av_log(s, AV_LOG_WARNING, "Ignoring the invalid stream information %s\n", url);
+    ret = 0;
+end:
+    for (unsigned i = 0; info && i < nb_streams; i++)
+        avcodec_parameters_free(&info[i].par);
+    av_free(info);
+    av_free(file_key);
+    ff_format_io_close(s, &pb);
+    return ret;
+}
+
+int ff_stream_info_write(AVFormatContext *s, const char *url, const char *key)
+{
+    AVIOContext *pb = NULL;
+    char *tmp;
+    int ret;
+
+    /* written next to it and renamed, so that readers never see a partial
+     * file */
+    tmp = av_asprintf("%s.tmp", url);
+    if (!tmp)
+        return AVERROR(ENOMEM);
+    ret = s->io_open(s, &pb, tmp, AVIO_FLAG_WRITE, NULL);
+    if (ret < 0)
+        goto fail;
+
+    avio_wb32(pb, STREAM_INFO_TAG);
+    avio_wb32(pb, STREAM_INFO_VERSION);
+    avio_wb32(pb, strlen(key));
+    avio_write(pb, key, strlen(key));
+    avio_wb64(pb, s->start_time);
+    avio_wb64(pb, s->duration);
+    avio_wb64(pb, s->bit_rate);
+    avio_wb32(pb, s->duration_estimation_method);
+    avio_wb32(pb, s->nb_streams);
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        const AVStream *st = s->streams[i];
+
+        avio_wb64(pb, st->start_time);
+        avio_wb64(pb, st->duration);
+        avio_wb64(pb, st->nb_frames);
+        write_rational(pb, st->r_frame_rate);
+        write_rational(pb, st->avg_frame_rate);
+        write_rational(pb, st->sample_aspect_ratio);
+        avio_wb32(pb, st->disposition);
+        avio_wb32(pb, cffstream(st)->codec_info_nb_frames);
+        write_codecpar(pb, st->codecpar);
+    }
+    ret = ff_format_io_close(s, &pb);
+    if (ret < 0)
+        goto fail;
+
+    ret = ff_rename(tmp, url, s);
+    if (ret >= 0)
+        av_log(s, AV_LOG_VERBOSE, "Wrote the stream information %s\n", url);
+    av_free(tmp);
+    return ret;
+
+fail:
+    av_log(s, AV_LOG_ERROR, "Could not write the stream information %s: %s\n",
+           url, av_err2str(ret));
+    av_free(tmp);
+    return ret;
+}
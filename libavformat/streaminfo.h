@@ -0,0 +1,57 @@
+/*
+ * Stream information files
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_STREAMINFO_H
+#define AVFORMAT_STREAMINFO_H
+
+#include "avformat.h"
+
+/**
+ * @file
+ * Storage of the results of avformat_find_stream_info(), so that the probing
+ * can be skipped when the same input is opened again.
+ */
+
+/**
+ * Build the key identifying the input of s as opened by the demuxer:
+ * the format, the input size, the streams created by the header and, for
+ * seekable input, a hash of its first and last bytes.
+ *
+ * @param[out] key set to an allocated string
+ * @return 0 on success, a negative error code on failure
+ */
+int ff_stream_info_key(AVFormatContext *s, char **key);
+
+/**
+ * Load the stream information stored at url, if it was written for an input
+ * with the given key, and set it on the streams of s. The caller still has to
+ * finish what avformat_find_stream_info() does after probing.
+ *
+ * @return 1 if the stream information was set, 0 if there is no usable file,
+ *         a negative error code on failure
+ */
+int ff_stream_info_read(AVFormatContext *s, const char *url, const char *key);
+
+/**
+ * Store the stream information of s to url.
+ */
+int ff_stream_info_write(AVFormatContext *s, const char *url, const char *key);
+
+#endif /* AVFORMAT_STREAMINFO_H */
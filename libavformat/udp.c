@@ -26,6 +26,7 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() with glibc */
 
 #include "avformat.h"
 #include "libavutil/avassert.h"
@@ -69,6 +70,10 @@
 #include "libavutil/thread.h"
 #endif
 
+#if HAVE_SENDMMSG
+#include <netinet/udp.h>
+#endif
+
 #ifndef IPV6_ADD_MEMBERSHIP
 #define IPV6_ADD_MEMBERSHIP IPV6_JOIN_GROUP
 #define IPV6_DROP_MEMBERSHIP IPV6_LEAVE_GROUP
@@ -78,6 +83,9 @@
 #define UDP_RX_BUF_SIZE 393216
 #define UDP_MAX_PKT_SIZE 65536
 #define UDP_HEADER_SIZE 8
+/* limits of a single send with UDP_SEGMENT */
+#define UDP_GSO_MAX_SIZE 65507
+#define UDP_GSO_MAX_SEGMENTS 64
 
 typedef struct UDPQueuedPacketHeader {
     int pkt_size;
@@ -116,6 +124,16 @@ typedef struct UDPContext {
     int thread_started;
 #endif
     uint8_t tmp[UDP_MAX_PKT_SIZE + sizeof(UDPQueuedPacketHeader)];
+    int batch_size;
+    int gso;
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    /* datagrams received or sent per call by the circular buffer thread */
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    struct sockaddr_storage *msg_addrs;
+    uint8_t *batch_buf;
+    int batch_buf_size;
+#endif
     int remaining_in_dg;
     char *localaddr;
     int timeout;
@@ -147,6 +165,8 @@ static const AVOption options[] = {
     { "dscp",           "DSCP class for outgoing packets",                 OFFSET(dscp),           AV_OPT_TYPE_INT,    { .i64 = -1 },    -1, 63,      E },
     { "connect",        "set if connect() should be called on socket",     OFFSET(is_connected),   AV_OPT_TYPE_BOOL,   { .i64 =  0 },     0, 1,       .flags = D|E },
     { "fifo_size",      "set the UDP circular buffer size (in 188-byte packets)", OFFSET(circular_buffer_size), AV_OPT_TYPE_INT, {.i64 = HAVE_PTHREAD_CANCEL ? 7*4096 : 0}, 0, INT_MAX, D },
+    { "batch_size",     "Maximum number of datagrams per system call of the circular buffer thread", OFFSET(batch_size), AV_OPT_TYPE_INT, { .i64 = 16 }, 1, 1024, .flags = D|E },
+    { "gso",            "Send batches of equally sized datagrams using UDP segmentation offload", OFFSET(gso), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     { "overrun_nonfatal", "survive in case of UDP receiving circular buffer overrun", OFFSET(overrun_nonfatal), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1,    D },
     { "timeout",        "set raise error timeout, in microseconds (only in read mode)",OFFSET(timeout),         AV_OPT_TYPE_INT,  {.i64 = 0}, 0, INT_MAX, D },
     { "sources",        "Source list",                                     OFFSET(sources),        AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
@@ -526,6 +546,182 @@ static int udp_get_file_handle(URLContext *h)
 }
 
 #if HAVE_PTHREAD_CANCEL
+/* Queue a received datagram for udp_read(); called with the mutex held */
+static int rx_fifo_write(URLContext *h, UDPQueuedPacketHeader *pkt_header,
+                         const uint8_t *data)
+{
+    UDPContext *s = h->priv_data;
+
+    if (ff_ip_check_source_lists(&pkt_header->addr, &s->filters))
+        return 0;
+
+    if (av_fifo_can_write(s->rx_fifo) < pkt_header->pkt_size + sizeof(*pkt_header)) {
+        /* No Space left */
+        if (s->overrun_nonfatal) {
+            av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
+                    "Surviving due to overrun_nonfatal option\n");
+            return 0;
+        } else {
+            av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                    "To avoid, increase fifo_size URL option. "
+                    "To survive in such case, use overrun_nonfatal option\n");
+            return AVERROR(EIO);
+        }
+    }
+    av_fifo_write(s->rx_fifo, pkt_header, sizeof(*pkt_header));
+    av_fifo_write(s->rx_fifo, data, pkt_header->pkt_size);
+    return 0;
+}
+
+static int tx_send(UDPContext *s, const uint8_t *p, int len)
+{
+    while (len) {
+        int ret;
+        av_assert0(len > 0);
+        if (!s->is_connected) {
+            ret = sendto (s->udp_fd, p, len, 0,
+                        (struct sockaddr *) &s->dest_addr,
+                        s->dest_addr_len);
+        } else
+            ret = send(s->udp_fd, p, len, 0);
+        if (ret >= 0) {
+            len -= ret;
+            p   += ret;
+        } else {
+            ret = ff_neterrno();
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+                return ret;
+        }
+    }
+    return 0;
+}
+
+#if HAVE_SENDMMSG
+#ifdef UDP_SEGMENT
+/* Send size bytes from buf as datagrams of seg_size bytes, the last one
+ * possibly shorter, which the kernel or the NIC split up. */
+static int tx_send_gso(UDPContext *s, uint8_t *buf, int size, int seg_size)
+{
+    union {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } control = { 0 };
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    uint16_t gso_size = seg_size;
+
+    if (!s->is_connected) {
+        msg.msg_name    = &s->dest_addr;
+        msg.msg_namelen = s->dest_addr_len;
+    }
+    cmsg->cmsg_level = IPPROTO_UDP;
+    cmsg->cmsg_type  = UDP_SEGMENT;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(gso_size));
+    memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+
+    while (sendmsg(s->udp_fd, &msg, 0) < 0) {
+        int ret = ff_neterrno();
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+            return ret;
+    }
+    return 0;
+}
+#endif
+
+/* Send the nb_pkts datagrams described by s->iovs, stored back to back
+ * in buf */
+static int tx_send_batch(URLContext *h, uint8_t *buf, int size, int nb_pkts)
+{
+    UDPContext *s = h->priv_data;
+    int done = 0;
+
+#ifdef UDP_SEGMENT
+    if (s->gso && size <= UDP_GSO_MAX_SIZE && nb_pkts <= UDP_GSO_MAX_SEGMENTS) {
+        int seg_size = s->iovs[0].iov_len;
+        int i;
+
+        /* all datagrams but the last one must have the same size */
+        for (i = 1; i < nb_pkts - 1; i++)
+            if (s->iovs[i].iov_len != seg_size)
+                break;
+        if (seg_size && i == nb_pkts - 1 && s->iovs[i].iov_len <= seg_size) {
+            int ret = tx_send_gso(s, buf, size, seg_size);
+            if (ret >= 0)
+                return 0;
+            av_log(h, AV_LOG_WARNING, "Sending with UDP segmentation offload "
+                   "failed (%s), disabling it\n", av_err2str(ret));
+            s->gso = 0;
+        }
+    }
+#endif
+
+    while (done < nb_pkts) {
+        int ret = sendmmsg(s->udp_fd, s->msgs + done, nb_pkts - done, 0);
+        if (ret >= 0) {
+            done += ret;
+        } else {
+            ret = ff_neterrno();
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+                return ret;
+        }
+    }
+    return 0;
+}
+#endif
+
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+static void free_batch(UDPContext *s)
+{
+    av_freep(&s->batch_buf);
+    av_freep(&s->msgs);
+    av_freep(&s->iovs);
+    av_freep(&s->msg_addrs);
+}
+
+/* Set up the buffers for receiving or sending batch_size datagrams per
+ * system call in the circular buffer thread */
+static int alloc_batch(URLContext *h, int is_output)
+{
+    UDPContext *s = h->priv_data;
+    /* a datagram larger than max_packet_size can still be written directly */
+    int64_t buf_size = is_output ?
+        (int64_t)(s->batch_size - 1) * h->max_packet_size + sizeof(s->tmp) :
+        (int64_t)s->batch_size * UDP_MAX_PKT_SIZE;
+
+    if (buf_size > INT_MAX)
+        return AVERROR(EINVAL);
+    s->batch_buf_size = buf_size;
+    s->batch_buf = av_malloc(s->batch_buf_size);
+    s->msgs      = av_calloc(s->batch_size, sizeof(*s->msgs));
+    s->iovs      = av_calloc(s->batch_size, sizeof(*s->iovs));
+    if (!is_output)
+        s->msg_addrs = av_calloc(s->batch_size, sizeof(*s->msg_addrs));
+    if (!s->batch_buf || !s->msgs || !s->iovs || (!is_output && !s->msg_addrs))
+        return AVERROR(ENOMEM);
+
+    for (int i = 0; i < s->batch_size; i++) {
+        struct msghdr *hdr = &s->msgs[i].msg_hdr;
+        hdr->msg_iov    = &s->iovs[i];
+        hdr->msg_iovlen = 1;
+        if (!is_output) {
+            s->iovs[i].iov_base = s->batch_buf + i * UDP_MAX_PKT_SIZE;
+            s->iovs[i].iov_len  = UDP_MAX_PKT_SIZE;
+            hdr->msg_name       = &s->msg_addrs[i];
+        } else if (!s->is_connected) {
+            hdr->msg_name    = &s->dest_addr;
+            hdr->msg_namelen = s->dest_addr_len;
+        }
+    }
+    return 0;
+}
+#endif
+
 static void *circular_buffer_task_rx( void *_URLContext)
 {
     URLContext *h = _URLContext;
@@ -543,42 +739,49 @@ static void *circular_buffer_task_rx( void *_URLContext)
     }
     while(1) {
         UDPQueuedPacketHeader pkt_header;
+        int ret;
         pkt_header.addr_len = sizeof(pkt_header.addr);
 
         pthread_mutex_unlock(&s->mutex);
         /* Blocking operations are always cancellation points;
            see "General Information" / "Thread Cancellation Overview"
-           in Single Unix. */
+           in Single Unix. recvmmsg() is one in all its implementations. */
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
-        pkt_header.pkt_size = recvfrom(s->udp_fd, s->tmp + sizeof(pkt_header), sizeof(s->tmp) - sizeof(pkt_header), 0, (struct sockaddr *)&pkt_header.addr, &pkt_header.addr_len);
+#if HAVE_RECVMMSG
+        if (s->msgs) {
+            for (int i = 0; i < s->batch_size; i++)
+                s->msgs[i].msg_hdr.msg_namelen = sizeof(s->msg_addrs[i]);
+            ret = recvmmsg(s->udp_fd, s->msgs, s->batch_size, MSG_WAITFORONE, NULL);
+        } else
+#endif
+        ret = pkt_header.pkt_size = recvfrom(s->udp_fd, s->tmp, UDP_MAX_PKT_SIZE, 0, (struct sockaddr *)&pkt_header.addr, &pkt_header.addr_len);
         pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
         pthread_mutex_lock(&s->mutex);
-        if (pkt_header.pkt_size < 0) {
+        if (ret < 0) {
             if (ff_neterrno() != AVERROR(EAGAIN) && ff_neterrno() != AVERROR(EINTR)) {
                 s->circular_buffer_error = ff_neterrno();
                 goto end;
             }
             continue;
         }
-        if (ff_ip_check_source_lists(&pkt_header.addr, &s->filters))
-            continue;
-        memcpy(s->tmp, &pkt_header, sizeof(pkt_header));
-
-        if (av_fifo_can_write(s->rx_fifo) < pkt_header.pkt_size + sizeof(pkt_header)) {
-            /* No Space left */
-            if (s->overrun_nonfatal) {
-                av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
-                        "Surviving due to overrun_nonfatal option\n");
-                continue;
-            } else {
-                av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
-                        "To avoid, increase fifo_size URL option. "
-                        "To survive in such case, use overrun_nonfatal option\n");
-                s->circular_buffer_error = AVERROR(EIO);
-                goto end;
+#if HAVE_RECVMMSG
+        if (s->msgs) {
+            int nb_pkts = ret;
+            for (int i = 0; i < nb_pkts; i++) {
+                pkt_header.pkt_size = s->msgs[i].msg_len;
+                pkt_header.addr     = s->msg_addrs[i];
+                pkt_header.addr_len = s->msgs[i].msg_hdr.msg_namelen;
+                ret = rx_fifo_write(h, &pkt_header, s->iovs[i].iov_base);
+                if (ret < 0)
+                    break;
             }
+        } else
+#endif
+        ret = rx_fifo_write(h, &pkt_header, s->tmp);
+        if (ret < 0) {
+            s->circular_buffer_error = ret;
+            goto end;
         }
-        av_fifo_write(s->rx_fifo, s->tmp, pkt_header.pkt_size + sizeof(pkt_header));
         pthread_cond_signal(&s->cond);
     }
 
@@ -597,6 +800,17 @@ static void *circular_buffer_task_tx( void *_URLContext)
     int64_t sent_bits = 0;
     int64_t burst_interval = s->bitrate ? (s->burst_bits * 1000000 / s->bitrate) : 0;
     int64_t max_delay = s->bitrate ?  ((int64_t)h->max_packet_size * 8 * 1000000 / s->bitrate + 1) : 0;
+    uint8_t *buf = s->tmp;
+    int buf_size = sizeof(s->tmp);
+    int max_pkts = 1;
+
+#if HAVE_SENDMMSG
+    if (s->msgs) {
+        buf      = s->batch_buf;
+        buf_size = s->batch_buf_size;
+        max_pkts = s->batch_size;
+    }
+#endif
 
     ff_thread_setname("udp-tx");
 
@@ -609,8 +823,8 @@ static void *circular_buffer_task_tx( void *_URLContext)
     }
 
     for(;;) {
-        int len;
-        const uint8_t *p;
+        int len, ret;
+        int size = 0, nb_pkts = 0;
         uint8_t tmp[4];
         int64_t timestamp;
 
@@ -623,58 +837,70 @@ static void *circular_buffer_task_tx( void *_URLContext)
             len = av_fifo_can_read(s->tx_fifo);
         }
 
-        av_fifo_read(s->tx_fifo, tmp, 4);
-        len = AV_RL32(tmp);
+        /* Datagrams queued after the first one are sent along with it only
+         * if they are due already, so that batching keeps the pacing. */
+        for (;;) {
+            av_fifo_read(s->tx_fifo, tmp, 4);
+            len = AV_RL32(tmp);
 
-        av_assert0(len >= 0);
-        av_assert0(len <= sizeof(s->tmp));
+            av_assert0(len >= 0);
+            av_assert0(len <= sizeof(s->tmp));
 
-        av_fifo_read(s->tx_fifo, s->tmp, len);
+            av_fifo_read(s->tx_fifo, buf + size, len);
+#if HAVE_SENDMMSG
+            if (s->msgs) {
+                s->iovs[nb_pkts].iov_base = buf + size;
+                s->iovs[nb_pkts].iov_len  = len;
+            }
+#endif
+            size += len;
+            nb_pkts++;
 
-        pthread_mutex_unlock(&s->mutex);
+            pthread_mutex_unlock(&s->mutex);
 
-        if (s->bitrate) {
-            timestamp = av_gettime_relative();
-            if (timestamp < target_timestamp) {
-                int64_t delay = target_timestamp - timestamp;
-                if (delay > max_delay) {
-                    delay = max_delay;
-                    start_timestamp = timestamp + delay;
-                    sent_bits = 0;
-                }
-                av_usleep(delay);
-            } else {
-                if (timestamp - burst_interval > target_timestamp) {
-                    start_timestamp = timestamp - burst_interval;
-                    sent_bits = 0;
+            if (s->bitrate) {
+                timestamp = av_gettime_relative();
+                if (timestamp < target_timestamp) {
+                    int64_t delay = target_timestamp - timestamp;
+                    if (delay > max_delay) {
+                        delay = max_delay;
+                        start_timestamp = timestamp + delay;
+                        sent_bits = 0;
+                    }
+                    av_usleep(delay);
+                } else {
+                    if (timestamp - burst_interval > target_timestamp) {
+                        start_timestamp = timestamp - burst_interval;
+                        sent_bits = 0;
+                    }
                 }
+                sent_bits += len * 8;
+                target_timestamp = start_timestamp + sent_bits * 1000000 / s->bitrate;
             }
-            sent_bits += len * 8;
-            target_timestamp = start_timestamp + sent_bits * 1000000 / s->bitrate;
+
+            pthread_mutex_lock(&s->mutex);
+
+            if (nb_pkts == max_pkts || av_fifo_can_read(s->tx_fifo) < 4)
+                break;
+            av_fifo_peek(s->tx_fifo, tmp, 4, 0);
+            if (size + AV_RL32(tmp) > buf_size ||
+                (s->bitrate && av_gettime_relative() < target_timestamp))
+                break;
         }
 
-        p = s->tmp;
-        while (len) {
-            int ret;
-            av_assert0(len > 0);
-            if (!s->is_connected) {
-                ret = sendto (s->udp_fd, p, len, 0,
-                            (struct sockaddr *) &s->dest_addr,
-                            s->dest_addr_len);
-            } else
-                ret = send(s->udp_fd, p, len, 0);
-            if (ret >= 0) {
-                len -= ret;
-                p   += ret;
-            } else {
-                ret = ff_neterrno();
-                if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR)) {
-                    pthread_mutex_lock(&s->mutex);
-                    s->circular_buffer_error = ret;
-                    pthread_mutex_unlock(&s->mutex);
-                    return NULL;
-                }
-            }
+        pthread_mutex_unlock(&s->mutex);
+
+#if HAVE_SENDMMSG
+        if (nb_pkts > 1)
+            ret = tx_send_batch(h, buf, size, nb_pkts);
+        else
+#endif
+        ret = tx_send(s, buf, len);
+        if (ret < 0) {
+            pthread_mutex_lock(&s->mutex);
+            s->circular_buffer_error = ret;
+            pthread_mutex_unlock(&s->mutex);
+            return NULL;
         }
 
         pthread_mutex_lock(&s->mutex);
@@ -724,6 +950,11 @@ static int udp_open(URLContext *h, const char *uri, int flags)
                        "on this build (pthread support is required)\n", optnames[i]);
         }
     }
+#if !HAVE_SENDMMSG || !defined(UDP_SEGMENT)
+    if (s->gso)
+        av_log(h, AV_LOG_WARNING, "'gso' option was set but it is not "
+               "supported on this build\n");
+#endif
     if (s->sources) {
         if ((ret = ff_ip_parse_sources(h, s->sources, &s->filters)) < 0)
             goto fail;
@@ -926,6 +1157,13 @@ static int udp_open(URLContext *h, const char *uri, int flags)
             s->tx_fifo = fifo;
         else
             s->rx_fifo = fifo;
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+        if (s->batch_size > 1 && (is_output ? HAVE_SENDMMSG : HAVE_RECVMMSG)) {
+            ret = alloc_batch(h, is_output);
+            if (ret < 0)
+                goto fail;
+        }
+#endif
         ret = pthread_mutex_init(&s->mutex, NULL);
         if (ret != 0) {
             av_log(h, AV_LOG_ERROR, "pthread_mutex_init failed : %s\n", strerror(ret));
@@ -960,6 +1198,9 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         closesocket(udp_fd);
     av_fifo_freep2(&s->rx_fifo);
     av_fifo_freep2(&s->tx_fifo);
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    free_batch(s);
+#endif
     ff_ip_reset_filters(&s->filters);
     return ret;
 }
@@ -1133,6 +1374,9 @@ static int udp_close(URLContext *h)
     closesocket(s->udp_fd);
     av_fifo_freep2(&s->rx_fifo);
     av_fifo_freep2(&s->tx_fifo);
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    free_batch(s);
+#endif
     ff_ip_reset_filters(&s->filters);
     return 0;
 }
@@ -0,0 +1,502 @@
+/*
+ * Background uploads for segmenting muxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "libavutil/avassert.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "avio_internal.h"
+#include "internal.h"
+#include "upload.h"
+
+#if HAVE_THREADS
+
+/* delay before the first retry of a failed upload, doubled for every retry */
+#define UPLOAD_RETRY_DELAY      200000
+#define UPLOAD_RETRY_DELAY_MAX 5000000
+
+typedef struct UploadJob {
+    struct UploadJob *next;
+
+    char *url;
+    AVDictionary *opts;
+    uint8_t *data;
+    int size;
+    int flags;
+    int running;
+
+    int64_t queue_time;
+} UploadJob;
+
+typedef struct UploadOpen {
+    AVIOContext *pb;
+    char *url;
+    AVDictionary *opts;
+} UploadOpen;
+
+typedef struct UploadStats {
+    int64_t nb_uploads;      ///< successful uploads
+    int64_t bytes;           ///< size of these uploads
+    int64_t upload_time;     ///< time spent uploading them, in microseconds
+    int64_t latency;         ///< time between queueing and completion
+    int64_t max_latency;
+    int64_t nb_retries;
+    int64_t nb_failures;
+    int64_t nb_dropped;      ///< uploads superseded before they started
+    int64_t nb_stalls;       ///< number of times the muxer waited for room
+    int64_t stall_time;      ///< time spent waiting, in microseconds
+} UploadStats;
+
+struct FFUploadQueue {
+    AVFormatContext *s;
+    int max_pending;
+    int max_retries;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cond;
+    pthread_cond_t  done_cond;
+    pthread_t *threads;
+    int nb_threads;
+    int exit;
+
+    /* queued and running uploads, in queueing order */
+    UploadJob *jobs;
+    int nb_jobs;
+    /* error of the first failed upload not reported yet */
+    int error;
+    UploadStats stats;
+
+    /* only accessed from the muxer thread */
+    UploadOpen *open;
+    int nb_open;
+};
+
+static void job_free(UploadJob **pjob)
+{
+    UploadJob *job = *pjob;
+
+    av_freep(&job->url);
+    av_dict_free(&job->opts);
+    av_freep(&job->data);
+    av_freep(pjob);
+}
+
+/* Unlink a job from the queue; called with the lock held */
+static void job_remove(FFUploadQueue *q, UploadJob *job)
+{
+    UploadJob **p = &q->jobs;
+
+    while (*p != job)
+        p = &(*p)->next;
+    *p = job->next;
+    q->nb_jobs--;
+}
+
+/* The first job which may start; called with the lock held */
+static UploadJob *job_next(FFUploadQueue *q)
+{
+    for (UploadJob *job = q->jobs; job; job = job->next) {
+        int ready = !job->running &&
+                    (!(job->flags & FF_UPLOAD_ORDERED) || job == q->jobs);
+
+        for (UploadJob *prev = q->jobs; ready && prev != job; prev = prev->next)
+            if (!strcmp(prev->url, job->url))
+                ready = 0;
+        if (ready)
+            return job;
+    }
+    return NULL;
+}
+
+static int upload_once(FFUploadQueue *q, UploadJob *job)
+{
+    AVFormatContext *s = q->s;
+    AVDictionary *opts = NULL;
+    AVIOContext *pb = NULL;
+    int ret, ret2;
+
+    ret = av_dict_copy(&opts, job->opts, 0);
+    if (ret >= 0)
+        ret = s->io_open(s, &pb, job->url, AVIO_FLAG_WRITE, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    avio_write(pb, job->data, job->size);
+    avio_flush(pb);
+    ret  = pb->error;
+    ret2 = ff_format_io_close(s, &pb);
+
+    return ret < 0 ? ret : ret2;
+}
+
+static void *upload_worker(void *arg)
+{
+    FFUploadQueue *q = arg;
+
+    ff_thread_setname("upload");
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->exit) {
+        UploadJob *job = job_next(q);
+        int64_t start, delay = UPLOAD_RETRY_DELAY;
+        int ret, retries = 0;
+
+        if (!job) {
+            pthread_cond_wait(&q->work_cond, &q->lock);
+            continue;
+        }
+        job->running = 1;
+        start = av_gettime_relative();
+
+        while (1) {
+            pthread_mutex_unlock(&q->lock);
+            ret = upload_once(q, job);
+            pthread_mutex_lock(&q->lock);
+
+            if (ret >= 0 || ret == AVERROR_EXIT || retries >= q->max_retries ||
+                q->exit)
+                break;
+
+            av_log(q->s, AV_LOG_WARNING, "Uploading '%s' failed: %s, retrying "
+                   "in %.1f s\n", job->url, av_err2str(ret), delay / 1000000.0);
+            retries++;
+            q->stats.nb_retries++;
+
+            {
+                int64_t wake = av_gettime() + delay;
+                struct timespec ts = { .tv_sec  =  wake / 1000000,
+                                       .tv_nsec = (wake % 1000000) * 1000 };
+                while (!q->exit &&
+                       pthread_cond_timedwait(&q->work_cond, &q->lock, &ts) != ETIMEDOUT)
+                    ;
+            }
+            delay = FFMIN(2 * delay, UPLOAD_RETRY_DELAY_MAX);
+        }
+
+        if (ret >= 0) {
+            int64_t end     = av_gettime_relative();
+            int64_t latency = end - job->queue_time;
+
+            q->stats.nb_uploads++;
+            q->stats.bytes       += job->size;
+            q->stats.upload_time += end - start;
+            q->stats.latency     += latency;
+            q->stats.max_latency  = FFMAX(q->stats.max_latency, latency);
+            av_log(q->s, AV_LOG_DEBUG, "Uploaded '%s': %d bytes in %.3f s, "
+                   "%.3f s after queueing, %d retries\n", job->url, job->size,
+                   (end - start) / 1000000.0, latency / 1000000.0, retries);
+        } else {
+            q->stats.nb_failures++;
+            if (!q->error)
+                q->error = ret;
+            av_log(q->s, AV_LOG_ERROR, "Failed to upload '%s': %s\n",
+                   job->url, av_err2str(ret));
+        }
+
+        job_remove(q, job);
+        job_free(&job);
+        /* jobs waiting for this one may start now */
+        pthread_cond_broadcast(&q->work_cond);
+        pthread_cond_broadcast(&q->done_cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return NULL;
+}
+
+int ff_upload_alloc(FFUploadQueue **pq, AVFormatContext *s, int nb_threads,
+                    int max_pending, int max_retries)
+{
+    FFUploadQueue *q;
+    int ret;
+
+    av_assert0(nb_threads > 0 && max_pending > 0);
+
+    q = av_mallocz(sizeof(*q));
+    if (!q)
+        return AVERROR(ENOMEM);
+    q->s           = s;
+    q->max_pending = max_pending;
+    q->max_retries = max_retries;
+
+    q->threads = av_calloc(nb_threads, sizeof(*q->threads));
+    if (!q->threads) {
+        av_freep(&q);
+        return AVERROR(ENOMEM);
+    }
+
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->work_cond, NULL);
+    pthread_cond_init(&q->done_cond, NULL);
+
+    for (; q->nb_threads < nb_threads; q->nb_threads++) {
+        ret = pthread_create(&q->threads[q->nb_threads], NULL, upload_worker, q);
+        if (ret) {
+            ret = AVERROR(ret);
+            ff_upload_free(&q);
+            return ret;
+        }
+    }
+
+    *pq = q;
+    return 0;
+}
+
+int ff_upload_open(FFUploadQueue *q, AVIOContext **pb, const char *url,
+                   const AVDictionary *options)
+{
+    UploadOpen *o;
+    int ret;
+
+    pthread_mutex_lock(&q->lock);
+    ret = q->error;
+    q->error = 0;
+    pthread_mutex_unlock(&q->lock);
+    if (ret < 0)
+        return ret;
+
+    o = av_dynarray2_add((void **)&q->open, &q->nb_open, sizeof(*q->open), NULL);
+    if (!o)
+        return AVERROR(ENOMEM);
+    memset(o, 0, sizeof(*o));
+
+    o->url = av_strdup(url);
+    if (!o->url || av_dict_copy(&o->opts, options, 0) < 0 ||
+        (ret = avio_open_dyn_buf(&o->pb)) < 0) {
+        av_freep(&o->url);
+        av_dict_free(&o->opts);
+        q->nb_open--;
+        return AVERROR(ENOMEM);
+    }
+
+    *pb = o->pb;
+    return 0;
+}
+
+static UploadOpen *find_open(const FFUploadQueue *q, const AVIOContext *pb)
+{
+    for (int i = 0; pb && i < q->nb_open; i++)
+        if (q->open[i].pb == pb)
+            return &q->open[i];
+    return NULL;
+}
+
+int ff_upload_is_open(const FFUploadQueue *q, const AVIOContext *pb)
+{
+    return !!find_open(q, pb);
+}
+
+/* Forget an open AVIOContext, which has been closed already */
+static void open_remove(FFUploadQueue *q, UploadOpen *o)
+{
+    av_freep(&o->url);
+    av_dict_free(&o->opts);
+    *o = q->open[--q->nb_open];
+}
+
+int ff_upload_close(FFUploadQueue *q, AVIOContext **pb, int flags)
+{
+    UploadOpen *o = find_open(q, *pb);
+    UploadJob *job;
+    int64_t stall_start = 0;
+
+    av_assert0(o);
+
+    job = av_mallocz(sizeof(*job));
+    if (!job) {
+        ffio_free_dyn_buf(&o->pb);
+        open_remove(q, o);
+        *pb = NULL;
+        return AVERROR(ENOMEM);
+    }
+    job->size  = avio_close_dyn_buf(o->pb, &job->data);
+    job->url   = o->url;
+    job->opts  = o->opts;
+    job->flags = flags;
+    o->url  = NULL;
+    o->opts = NULL;
+    open_remove(q, o);
+    *pb = NULL;
+
+    if (job->size < 0 || !job->data) {
+        int ret = job->size < 0 ? job->size : AVERROR(ENOMEM);
+        job_free(&job);
+        return ret;
+    }
+
+    pthread_mutex_lock(&q->lock);
+
+    /* a newer playlist makes the one waiting to be uploaded useless */
+    if (flags & FF_UPLOAD_ORDERED) {
+        for (UploadJob *old = q->jobs; old; old = old->next) {
+            if (!old->running && (old->flags & FF_UPLOAD_ORDERED) &&
+                !strcmp(old->url, job->url)) {
+                job_remove(q, old);
+                job_free(&old);
+                q->stats.nb_dropped++;
+                break;
+            }
+        }
+    }
+
+    while (q->nb_jobs >= q->max_pending) {
+        if (!stall_start) {
+            stall_start = av_gettime_relative();
+            q->stats.nb_stalls++;
+        }
+        pthread_cond_wait(&q->done_cond, &q->lock);
+    }
+    if (stall_start)
+        q->stats.stall_time += av_gettime_relative() - stall_start;
+
+    job->queue_time = av_gettime_relative();
+    {
+        UploadJob **p = &q->jobs;
+        while (*p)
+            p = &(*p)->next;
+        *p = job;
+    }
+    q->nb_jobs++;
+    pthread_cond_broadcast(&q->work_cond);
+
+    pthread_mutex_unlock(&q->lock);
+
+    return 0;
+}
+
+void ff_upload_discard(FFUploadQueue *q, AVIOContext **pb)
+{
+    UploadOpen *o = find_open(q, *pb);
+
+    av_assert0(o);
+
+    ffio_free_dyn_buf(&o->pb);
+    open_remove(q, o);
+    *pb = NULL;
+}
+
+int ff_upload_flush(FFUploadQueue *q)
+{
+    int ret;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->nb_jobs)
+        pthread_cond_wait(&q->done_cond, &q->lock);
+    ret = q->error;
+    q->error = 0;
+    pthread_mutex_unlock(&q->lock);
+
+    return ret;
+}
+
+void ff_upload_free(FFUploadQueue **pq)
+{
+    FFUploadQueue *q = *pq;
+    const UploadStats *st;
+
+    if (!q)
+        return;
+    st = &q->stats;
+
+    pthread_mutex_lock(&q->lock);
+    for (UploadJob *job = q->jobs, *next; job; job = next) {
+        next = job->next;
+        if (!job->running) {
+            job_remove(q, job);
+            job_free(&job);
+            q->stats.nb_dropped++;
+        }
+    }
+    q->exit = 1;
+    pthread_cond_broadcast(&q->work_cond);
+    pthread_mutex_unlock(&q->lock);
+
+    for (int i = 0; i < q->nb_threads; i++)
+        pthread_join(q->threads[i], NULL);
+    av_assert0(!q->jobs);
+
+    while (q->nb_open) {
+        ffio_free_dyn_buf(&q->open[0].pb);
+        open_remove(q, &q->open[0]);
+    }
+
+    if (st->nb_uploads || st->nb_failures)
+        av_log(q->s, AV_LOG_VERBOSE, "Uploaded %"PRId64" files, %"PRId64" bytes "
+               "at %.0f kbit/s per connection, latency %.3f s on average and "
+               "%.3f s at most, %"PRId64" retries, %"PRId64" failed, "
+               "%"PRId64" dropped, muxer waited %"PRId64" times for %.3f s "
+               "in total\n", st->nb_uploads, st->bytes,
+               st->upload_time ? st->bytes * 8000.0 / st->upload_time : 0.0,
+               st->nb_uploads ? st->latency / 1000000.0 / st->nb_uploads : 0.0,
+               st->max_latency / 1000000.0, st->nb_retries, st->nb_failures,
+               st->nb_dropped, st->nb_stalls, st->stall_time / 1000000.0);
+
+    pthread_cond_destroy(&q->done_cond);
+    pthread_cond_destroy(&q->work_cond);
+    pthread_mutex_destroy(&q->lock);
+    av_freep(&q->open);
+    av_freep(&q->threads);
+    av_freep(pq);
+}
+
+#else
+
+int ff_upload_alloc(FFUploadQueue **q, AVFormatContext *s, int nb_threads,
+                    int max_pending, int max_retries)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_upload_open(FFUploadQueue *q, AVIOContext **pb, const char *url,
+                   const AVDictionary *options)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_upload_is_open(const FFUploadQueue *q, const AVIOContext *pb)
+{
+    return 0;
+}
+
+int ff_upload_close(FFUploadQueue *q, AVIOContext **pb, int flags)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_upload_discard(FFUploadQueue *q, AVIOContext **pb)
+{
+}
+
+int ff_upload_flush(FFUploadQueue *q)
+{
+    return 0;
+}
+
+void ff_upload_free(FFUploadQueue **q)
+{
+}
+
+#endif /* HAVE_THREADS */
@@ -0,0 +1,109 @@
+/*
+ * Background uploads for segmenting muxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_UPLOAD_H
+#define AVFORMAT_UPLOAD_H
+
+#include "libavutil/dict.h"
+#include "avformat.h"
+
+/**
+ * @file
+ * Background uploads for segmenting muxers (HLS, DASH).
+ *
+ * FFUploadQueue lets a muxer write a file into memory and hand it over to
+ * a pool of threads, which open the url with the io_open() callback of the
+ * muxer, write the data and close it with io_close2(), retrying on failure.
+ * The muxer thread only waits when the queue is full.
+ *
+ * Uploads run concurrently, except that an upload does not start before the
+ * uploads queued earlier for the same url are done, and an ordered upload
+ * (a playlist or manifest) does not start before all the uploads queued
+ * earlier are done, so that it never references files not available yet.
+ * A queued upload which did not start yet is dropped when a newer one is
+ * queued for the same url.
+ *
+ * All functions must be called from the muxer thread.
+ */
+
+/**
+ * Do not start the upload before all the uploads queued before it are done.
+ */
+#define FF_UPLOAD_ORDERED 1
+
+typedef struct FFUploadQueue FFUploadQueue;
+
+/**
+ * Allocate an upload queue.
+ *
+ * @param s           muxer whose io_open() and io_close2() callbacks are
+ *                    used from the upload threads, and which provides the
+ *                    interrupt callback
+ * @param nb_threads  number of concurrent uploads
+ * @param max_pending maximum number of files queued or being uploaded
+ * @param max_retries number of times a failed upload is retried
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_upload_alloc(FFUploadQueue **q, AVFormatContext *s, int nb_threads,
+                    int max_pending, int max_retries);
+
+/**
+ * Open an in-memory AVIOContext for writing a file to be uploaded to url.
+ *
+ * @param options options for opening the url, copied
+ * @return 0 on success, a negative AVERROR code on failure, including the
+ *         error of an upload which failed since the previous call
+ */
+int ff_upload_open(FFUploadQueue *q, AVIOContext **pb, const char *url,
+                   const AVDictionary *options);
+
+/**
+ * @return 1 if pb was opened with ff_upload_open() and is not closed yet
+ */
+int ff_upload_is_open(const FFUploadQueue *q, const AVIOContext *pb);
+
+/**
+ * Close an AVIOContext opened with ff_upload_open() and queue its data for
+ * upload, waiting if the queue is full. *pb is set to NULL.
+ *
+ * @param flags FF_UPLOAD_* flags
+ */
+int ff_upload_close(FFUploadQueue *q, AVIOContext **pb, int flags);
+
+/**
+ * Close an AVIOContext opened with ff_upload_open() without uploading it.
+ */
+void ff_upload_discard(FFUploadQueue *q, AVIOContext **pb);
+
+/**
+ * Wait until all queued uploads are done.
+ *
+ * @return 0 if they all succeeded, the error of the first failed upload
+ *         not reported yet otherwise
+ */
+int ff_upload_flush(FFUploadQueue *q);
+
+/**
+ * Drop the uploads which did not start, wait for the others, log the upload
+ * statistics and free the queue, including the AVIOContexts still open.
+ */
+void ff_upload_free(FFUploadQueue **q);
+
+#endif /* AVFORMAT_UPLOAD_H */
@@ -26,6 +26,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -85,6 +86,7 @@ typedef struct URLProtocol {
     int (*url_get_multi_file_handle)(URLContext *h, int **handles,
                                      int *numhandles);
     int (*url_get_short_seek)(URLContext *h);
+    const AVBufferRef *(*url_get_mapping)(URLContext *h);
     int (*url_shutdown)(URLContext *h, int flags);
     const AVClass *priv_data_class;
     int priv_data_size;
@@ -265,6 +267,15 @@ int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles);
  */
 int ffurl_get_short_seek(void *urlcontext);
 
+/**
+ * Return the buffer the whole resource is mapped to in memory, offsets into
+ * it being the same as the URL positions.
+ *
+ * @return the mapping, owned by the URLContext, or NULL if the resource is
+ *         not mapped.
+ */
+const AVBufferRef *ffurl_get_mapping(URLContext *h);
+
 /**
  * Signal the URLContext that we are done reading or writing the stream.
  *
@@ -32,6 +32,7 @@
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/parseutils.h"
+#include "libavutil/sha.h"
 #include "libavutil/time.h"
 #include "libavutil/time_internal.h"
 
@@ -111,6 +112,71 @@ FF_ENABLE_DEPRECATION_WARNINGS
     return append_packet_chunked(s, pkt, size);
 }
 
+int ff_codec_ignores_padding(enum AVCodecID codec_id)
+{
+    return codec_id == AV_CODEC_ID_RAWVIDEO ||
+           (codec_id >= AV_CODEC_ID_PCM_S16LE &&
+            codec_id <  AV_CODEC_ID_ADPCM_IMA_QT &&
+            av_get_exact_bits_per_sample(codec_id));
+}
+
+#define INPUT_HASH_BLOCK (64 * 1024)
+
+int ff_hash_input_ends(AVIOContext *pb, int64_t size, uint8_t *hash)
+{
+    const int64_t offsets[2] = { 0, FFMAX(size - INPUT_HASH_BLOCK, 0) };
+    int64_t pos = avio_tell(pb);
+    struct AVSHA *sha = av_sha_alloc();
+    uint8_t *buf = av_malloc(INPUT_HASH_BLOCK);
+    int ret = 0;
+
+    if (!sha || !buf) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    av_sha_init(sha, FF_INPUT_HASH_SIZE * 8);
+    for (int i = 0; i < FF_ARRAY_ELEMS(offsets); i++) {
+        int len = FFMIN(size - offsets[i], INPUT_HASH_BLOCK);
+
+        if ((ret = avio_seek(pb, offsets[i], SEEK_SET)) < 0 ||
+            (ret = ffio_read_size(pb, buf, len)) < 0)
+            goto end;
+        av_sha_update(sha, buf, len);
+    }
+    av_sha_final(sha, hash);
+    ret = 0;
+end:
+    if (avio_seek(pb, pos, SEEK_SET) < 0 && ret >= 0)
+        ret = AVERROR(EIO);
+    av_free(buf);
+    av_free(sha);
+    return ret;
+}
+
+int ff_get_packet_mapped(AVIOContext *s, const AVStream *st,
+                         AVPacket *pkt, int size)
+{
+    AVBufferRef *buf;
+    int64_t pos = avio_tell(s);
+    int ret;
+
+    ret = ffio_read_mapped(s, size,
+                           ff_codec_ignores_padding(st->codecpar->codec_id),
+                           &buf);
+    if (ret == AVERROR(ENOSYS))
+        return av_get_packet(s, pkt, size);
+    if (ret < 0)
+        return ret;
+
+    av_packet_unref(pkt);
+    pkt->buf  = buf;
+    pkt->data = buf->data;
+    pkt->size = size;
+    pkt->pos  = pos;
+
+    return size;
+}
+
 int av_append_packet(AVIOContext *s, AVPacket *pkt, int size)
 {
     if (!pkt->size)
@@ -731,6 +731,174 @@ concat(){
     fi
 }
 
+# Open a copy of the input $1 with the seek index file option of its demuxer:
+# the first run writes the index, a seek loads it, and the index is ignored and
+# written again once the end of the input, or the index itself, changed.
+seekindex(){
+    srcfile=${outdir}/${test}.${1##*.}
+    idxfile=${outdir}/${test}.idx
+    cleanfiles="$cleanfiles $srcfile $idxfile"
+    cp $1 $srcfile || return
+    rm -f $idxfile
+
+    index_log(){
+        ffmpeg -v verbose -index_file $(target_path $idxfile) "$@" -c copy -f null - 2>&1 |
+            grep -o "[A-Z][a-z]* the [a-z ]*seek index"
+    }
+
+    index_log -i $(target_path $srcfile)
+    do_md5sum $idxfile | awk '{print $1}'
+    index_log -ss 3 -i $(target_path $srcfile)
+    framecrc -index_file $(target_path $idxfile) -ss 3 -i $(target_path $srcfile) -c copy || return
+
+    patch_bytes $srcfile $(($(wc -c < $srcfile) - 8)) "\\377"
+    index_log -i $(target_path $srcfile)
+    printf "FFSI\\001" > $idxfile
+    index_log -i $(target_path $srcfile)
+    printf "FFSO" > $idxfile
+    index_log -i $(target_path $srcfile)
+}
+
+# Probe a copy of the input $1 with a stream information file: the first run
+# probes the streams and writes the file, the second one loads it and must
+# give the same streams, and the file is ignored once the input changed.
+streaminfo(){
+    srcfile=${outdir}/${test}.${1##*.}
+    infofile=${outdir}/${test}.info
+    logfile=${outdir}/${test}.log
+    cleanfiles="$cleanfiles $srcfile $infofile $logfile"
+    cp $1 $srcfile || return
+    rm -f $infofile
+
+    probe_info(){
+        run ffprobe${PROGSUF}${EXECSUF} -bitexact -v debug -print_filename ${srcfile##*/} \
+            -stream_info_file $(target_path $infofile) -show_streams -show_format \
+            -of compact $(target_path $srcfile) 2> $logfile || return
+        grep -o -e "[A-Z][a-z]* the [a-z ]*stream information" -e "Stream #.*" $logfile
+    }
+
+    probe_info
+    probe_info
+    patch_bytes $srcfile $(($(wc -c < $srcfile) - 8)) "\\377"
+    probe_info > /dev/null
+    grep -o "[A-Z][a-z]* the [a-z ]*stream information" $logfile
+}
+
+# Write Low-Latency HLS partial segments of the streams encoded with the
+# options "$@", print every playlist written and the checksums of the parts.
+hls_parts(){
+    m3u8file=${outdir}/${test}.m3u8
+    cleanfiles="$cleanfiles $m3u8file"
+
+    ffmpeg "$@" -f hls -hls_segment_type fmp4 -hls_list_size 0 \
+        -hls_segment_filename $(target_path ${outdir}/${test}-%d.m4s) \
+        -hls_fmp4_init_filename $(target_path ${outdir}/${test}-init.mp4) \
+        pipe:1 > $m3u8file || return
+    cleanfiles="$cleanfiles ${outdir}/${test}-init.mp4"
+    playlists=$(sed -e 's,URI=".*/,URI=",' $m3u8file)
+    echo "$playlists"
+
+    for part in $(echo "$playlists" | sed -n 's/^#EXT-X-PART:.*URI="\([^"]*\)".*/\1/p' | sort -u); do
+        cleanfiles="$cleanfiles ${outdir}/$part ${outdir}/${part%.*.m4s}.m4s"
+        echo $part $(do_md5sum ${outdir}/$part | awk '{print $1}')
+    done
+}
+
+# Encode the streams once with the options "$@" into a file of format $1 and
+# a file of format $2 sharing the encoder through -map_enc, then print the
+# packets of both files.
+map_enc(){
+    fmt1=$1
+    fmt2=$2
+    shift 2
+    file1=${outdir}/${test}-1.${fmt1}
+    file2=${outdir}/${test}-2.${fmt2}
+    cleanfiles="$cleanfiles $file1 $file2"
+
+    ffmpeg -y "$@" -fflags +bitexact -f $fmt1 $(target_path $file1) \
+        -map_enc 0:0 -fflags +bitexact -f $fmt2 $(target_path $file2) || return
+    framecrc -i $(target_path $file1) -c copy || return
+    framecrc -i $(target_path $file2) -c copy
+}
+
+# Read a file through the cache protocol with the options "$@", printing the
+# md5 of the packets and what the persistent cache reported.
+cache_read(){
+    logfile=${outdir}/${test}.log
+    cleanfiles="$cleanfiles $logfile"
+
+    ffmpeg -v verbose -cache_dir $(target_path $cachedir) "$@" -c copy -f md5 - 2> $logfile || return
+    sed -n '/^\[cache @/{s/^\[cache @ [^]]*\] //;s/[0-9a-f]\{40\}/KEY/;p;}' $logfile
+}
+
+# Read a file twice through a persistent cache, then read it again after it
+# changed, and another file evicting it from the cache.
+cache_dir(){
+    cachedir=${outdir}/${test}.cache
+    file1=${outdir}/${test}-1.mkv
+    file2=${outdir}/${test}-2.mkv
+    cleanfiles="$cleanfiles $file1 $file2"
+    rm -rf $cachedir
+
+    enc_opts="-vf scale -pix_fmt yuv420p -c:v mpeg4 -flags +bitexact -fflags +bitexact -f matroska -y"
+    ffmpeg -f lavfi -i testsrc=s=64x48:r=10:d=2 $enc_opts $(target_path $file1) || return
+    ffmpeg -f lavfi -i testsrc=s=64x48:r=10:d=3 $enc_opts $(target_path $file2) || return
+
+    echo "# read"
+    cache_read -i cache:$(target_path $file1) || return
+    echo "# read again"
+    cache_read -i cache:$(target_path $file1) || return
+    cp $file2 $file1
+    echo "# read after changing the file"
+    cache_read -i cache:$(target_path $file1) || return
+    echo "# read another file"
+    cache_read -cache_max_size 15000 -i cache:$(target_path $file2) || return
+    rm -rf $cachedir
+}
+
+# Demux the segmented stream $1 with and without prefetching its segments
+# and print the packets read, which must not differ.
+prefetch_framecrc(){
+    src=$1
+    shift
+    reffile=${outdir}/${test}.noprefetch
+    cleanfiles="$cleanfiles $reffile"
+
+    framecrc -i $src "$@" > $reffile || return
+    framecrc -prefetch_segments 2 -i $src "$@" | diff -u $reffile - || return
+    cat $reffile
+}
+
+# Pass the streams encoded with the options "$@" from a shmframe writer to a
+# reader process through a small ring, and print the packets read.
+shmframe(){
+    shmfile=${outdir}/${test}.shm
+    cleanfiles="$cleanfiles $shmfile"
+    rm -f $shmfile
+
+    ffmpeg "$@" -f shmframe -min_readers 1 -nb_slots 4 $(target_path $shmfile) 2> /dev/null &
+    writer=$!
+    framecrc -f shmframe -timeout 10 -i $(target_path $shmfile) -c copy
+    ret=$?
+    wait $writer || return
+    return $ret
+}
+
+reserve_moov(){
+    mkvfile=${outdir}/${test}.mkv
+    mp4file=${outdir}/${test}.mp4
+    cleanfiles="$cleanfiles $mkvfile $mp4file"
+
+    # matroska provides the stream durations the reservation is estimated from
+    ffmpeg -f lavfi -i testsrc=s=64x48:r=10:d=2 -vf scale -pix_fmt yuv420p \
+        -c:v mpeg4 -fflags +bitexact -f matroska -y $(target_path $mkvfile) || return
+    ffmpeg -i $(target_path $mkvfile) -c copy "$@" -movflags +faststart+reserve_moov \
+        -fflags +bitexact -f mp4 -y $(target_path $mp4file) || return
+    do_md5sum $mp4file
+    run ffprobe${PROGSUF}${EXECSUF} -v trace $(target_path $mp4file) 2>&1 |
+        sed -n "s/.*type:'\(....\)' parent:'root' sz: \([0-9]*\) .*/\1 \2/p"
+}
+
 venc_data(){
     file=$1
     stream=$2
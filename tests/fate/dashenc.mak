@@ -24,5 +24,18 @@ fate-dash-mpd-timing: tests/data/dash_mpd_timing.mpd
 fate-dash-mpd-timing: CMD = sed -n -e /suggestedPresentationDelay=/p -e /availabilityStartTime=/p $(TARGET_PATH)/tests/data/dash_mpd_timing.mpd
 fate-dash-mpd-timing: CMP = diff
 
+tests/data/dash_prefetch.mpd: TAG = GEN
+tests/data/dash_prefetch.mpd: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin -loglevel error \
+	-f lavfi -i "testsrc=size=64x48:rate=10:d=3" -pix_fmt yuv420p \
+	-c:v mpeg4 -g 5 -flags +bitexact -fflags +bitexact -seg_duration 0.5 \
+	-init_seg_name 'dash_prefetch-init.m4s' -media_seg_name 'dash_prefetch-$$Number$$.m4s' \
+	-f dash $(TARGET_PATH)/tests/data/dash_prefetch.mpd
+
+# reading the fragments from the prefetch buffers gives the same packets
+FATE_DASHENC_LAVFI-$(call ALLYES, TESTSRC_FILTER SCALE_FILTER LAVFI_INDEV MPEG4_ENCODER DASH_MUXER MP4_MUXER DASH_DEMUXER MOV_DEMUXER FRAMECRC_MUXER FILE_PROTOCOL) += fate-dash-prefetch
+fate-dash-prefetch: tests/data/dash_prefetch.mpd
+fate-dash-prefetch: CMD = prefetch_framecrc $(TARGET_PATH)/tests/data/dash_prefetch.mpd -map 0 -c copy
+
 FATE_FFMPEG += $(FATE_DASHENC_LAVFI-yes)
 fate-dashenc: $(FATE_DASHENC_LAVFI-yes)
@@ -189,6 +189,78 @@ fate-ts-timed-id3-hls-demux: CMD = ffprobe_demux $(TARGET_PATH)/tests/data/id3.m
 FATE_SAMPLES_DEMUX-$(call PARSERDEM, JPEGXS, IMAGE_JPEGXS_PIPE, CONCAT_PROTOCOL) += fate-jxs-concat-demux
 fate-jxs-concat-demux: CMD = framecrc "-i concat:$(TARGET_SAMPLES)/jxs/lena.jxs|$(TARGET_SAMPLES)/jxs/lena.jxs -c:v copy"
 
+# Packets referencing a mapped input (file protocol -mmap 1) must be the
+# same as the ones read normally. In mmap.mov only the PCM packets are
+# mapped, the MPEG-4 ones are copied since their padding is not zero; all
+# the blocks of mmap.mkv are mapped.
+tests/data/mmap.mov: TAG = GEN
+tests/data/mmap.mov: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+	-f lavfi -i testsrc=s=160x120:r=10:d=1 -f lavfi -i sine=d=1 \
+	-c:v mpeg4 -c:a pcm_s16le -flags +bitexact -fflags +bitexact \
+	-y $(TARGET_PATH)/$@ 2>/dev/null
+
+tests/data/mmap.mkv: TAG = GEN
+tests/data/mmap.mkv: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+	-f lavfi -i testsrc=s=160x120:r=10:d=1 -f lavfi -i sine=d=1 \
+	-c:v rawvideo -pix_fmt yuv420p -c:a pcm_s16le -flags +bitexact -fflags +bitexact \
+	-y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_MMAP-$(call FRAMECRC, MOV, , MOV_MUXER MPEG4_ENCODER LAVFI_INDEV TESTSRC_FILTER SINE_FILTER) += fate-mmap-mov fate-mmap-mov-read
+FATE_MMAP-$(call FRAMECRC, MATROSKA, , MATROSKA_MUXER LAVFI_INDEV TESTSRC_FILTER SINE_FILTER SCALE_FILTER) += fate-mmap-mkv fate-mmap-mkv-read
+fate-mmap-mov fate-mmap-mov-read: tests/data/mmap.mov
+fate-mmap-mov: CMD = framecrc -mmap 1 -i $(TARGET_PATH)/tests/data/mmap.mov -c copy
+fate-mmap-mov-read: CMD = framecrc -i $(TARGET_PATH)/tests/data/mmap.mov -c copy
+fate-mmap-mov-read: REF = $(SRC_PATH)/tests/ref/fate/mmap-mov
+fate-mmap-mkv fate-mmap-mkv-read: tests/data/mmap.mkv
+fate-mmap-mkv: CMD = framecrc -mmap 1 -i $(TARGET_PATH)/tests/data/mmap.mkv -c copy
+fate-mmap-mkv-read: CMD = framecrc -i $(TARGET_PATH)/tests/data/mmap.mkv -c copy
+fate-mmap-mkv-read: REF = $(SRC_PATH)/tests/ref/fate/mmap-mkv
+
+FATE_FFMPEG += $(FATE_MMAP-yes)
+fate-mmap: $(FATE_MMAP-yes)
+
+# Seek index sidecar files, for a fragmented MP4 file without sidx or mfra
+# and a Matroska file without Cues.
+tests/data/seekindex.mp4: TAG = GEN
+tests/data/seekindex.mp4: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+	-f lavfi -i testsrc=s=160x120:r=10:d=5 -c:v mpeg4 -g 10 \
+	-flags +bitexact -fflags +bitexact -movflags frag_keyframe+empty_moov \
+	-y $(TARGET_PATH)/$@ 2>/dev/null
+
+tests/data/seekindex.mkv: TAG = GEN
+tests/data/seekindex.mkv: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+	-f lavfi -i testsrc=s=160x120:r=10:d=5 -c:v mpeg4 -g 10 \
+	-flags +bitexact -fflags +bitexact -live 1 \
+	-y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_SEEKINDEX-$(call FRAMECRC, MOV, , MOV_MUXER MPEG4_ENCODER NULL_MUXER LAVFI_INDEV TESTSRC_FILTER) += fate-seekindex-mp4
+FATE_SEEKINDEX-$(call FRAMECRC, MATROSKA, , MATROSKA_MUXER MPEG4_ENCODER NULL_MUXER LAVFI_INDEV TESTSRC_FILTER) += fate-seekindex-mkv
+fate-seekindex-mp4: tests/data/seekindex.mp4
+fate-seekindex-mp4: CMD = seekindex tests/data/seekindex.mp4
+fate-seekindex-mkv: tests/data/seekindex.mkv
+fate-seekindex-mkv: CMD = seekindex tests/data/seekindex.mkv
+
+FATE_FFMPEG += $(FATE_SEEKINDEX-yes)
+fate-seekindex: $(FATE_SEEKINDEX-yes)
+
+# Stream information file (stream_info_file option)
+FATE_STREAMINFO-$(call DEMDEC, MOV, MPEG4 PCM_S16LE, MOV_MUXER MPEG4_ENCODER LAVFI_INDEV TESTSRC_FILTER SINE_FILTER) += fate-streaminfo-mov
+fate-streaminfo-mov: tests/data/mmap.mov
+fate-streaminfo-mov: CMD = streaminfo tests/data/mmap.mov
+
+FATE_FFMPEG_FFPROBE += $(FATE_STREAMINFO-yes)
+fate-streaminfo: $(FATE_STREAMINFO-yes)
+
+# Round trip through a shmframe ring between two processes
+FATE_SHMFRAME-$(call FRAMECRC, SHMFRAME, , SHMFRAME_MUXER RAWVIDEO_ENCODER PCM_S16LE_ENCODER LAVFI_INDEV TESTSRC_FILTER SINE_FILTER) += fate-shmframe
+fate-shmframe: CMD = shmframe -f lavfi -i testsrc=s=64x48:r=10 -f lavfi -i sine=d=2 -t 2 -c:v rawvideo -c:a pcm_s16le -fflags +bitexact
+
+FATE_FFMPEG += $(FATE_SHMFRAME-yes)
+
 FATE_SAMPLES_DEMUX += $(FATE_SAMPLES_DEMUX-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_SAMPLES_DEMUX)
 FATE_FFPROBE_DEMUX   += $(FATE_FFPROBE_DEMUX-yes)
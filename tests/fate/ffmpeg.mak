@@ -16,6 +16,28 @@ fate-ffmpeg-filter_colorkey: CMD = framecrc -auto_conversion_filters -idct simpl
 FATE_FFMPEG-$(call FILTERFRAMECRC, COLOR) += fate-ffmpeg-lavfi
 fate-ffmpeg-lavfi: CMD = framecrc -lavfi color=d=1:r=5 -fflags +bitexact
 
+# the persistent cache of the cache protocol: hits, revalidation and eviction
+ifeq ($(HAVE_FCNTL),yes)
+FATE_FFMPEG-$(call FILTERFRAMECRC, TESTSRC SCALE, LAVFI_INDEV MPEG4_ENCODER MATROSKA_MUXER MATROSKA_DEMUXER \
+                                   MD5_MUXER CACHE_PROTOCOL FILE_PROTOCOL) += fate-cache-dir
+endif
+fate-cache-dir: CMD = cache_dir
+
+# chunked encoding with two workers, the chunks are muxed in their original order
+FATE_FFMPEG-$(call FILTERFRAMECRC, TESTSRC SCALE, LAVFI_INDEV MPEG4_ENCODER) += fate-ffmpeg-enc-chunks
+fate-ffmpeg-enc-chunks: CMD = framecrc -f lavfi -i testsrc=s=64x48:r=10:d=3 -vf scale -pix_fmt yuv420p \
+                                       -c:v mpeg4 -enc_chunks 2 -enc_chunk_frames 4 -threads 1 -flags +bitexact
+
+# an encoder shared by two outputs: the second output gets the headers of a
+# global-header encoder in band from dump_extra (mp4 -> mpegts), or gets them
+# out of band extracted from the first packet (mpegts -> mp4)
+FATE_FFMPEG-$(call FILTERFRAMECRC, TESTSRC SCALE, LAVFI_INDEV MPEG4_ENCODER MP4_MUXER MPEGTS_MUXER \
+                                   MOV_DEMUXER MPEGTS_DEMUXER DUMP_EXTRADATA_BSF FILE_PROTOCOL) \
+    += fate-ffmpeg-map-enc-mp4-mpegts fate-ffmpeg-map-enc-mpegts-mp4
+MAP_ENC_SRC = -f lavfi -i testsrc=s=64x48:r=10:d=1 -vf scale -pix_fmt yuv420p -c:v mpeg4 -g 5 -flags +bitexact
+fate-ffmpeg-map-enc-mp4-mpegts: CMD = map_enc mp4 mpegts $(MAP_ENC_SRC)
+fate-ffmpeg-map-enc-mpegts-mp4: CMD = map_enc mpegts mp4 $(MAP_ENC_SRC)
+
 FATE_FFMPEG-$(call ENCDEC2, MPEG4, RAWVIDEO, AVI, RAWVIDEO_DEMUXER FRAMECRC_MUXER) += fate-force_key_frames
 fate-force_key_frames: tests/data/vsynth1.yuv
 fate-force_key_frames: CMD = enc_dec \
@@ -233,6 +233,22 @@ fate-hls-iframes-single-fmp4: tests/data/hls_iframes_single_fmp4.m3u8
 fate-hls-iframes-single-fmp4: CMD = sed -n -e /^\#EXT-X-MAP:/p -e /^\#EXT-X-BYTERANGE:/p $(TARGET_PATH)/tests/data/hls_iframes_single_fmp4.m3u8
 fate-hls-iframes-single-fmp4: CMP = diff
 
+FATE_HLSENC_LAVFI-$(call ALLYES, TESTSRC_FILTER SCALE_FILTER LAVFI_INDEV MPEG4_ENCODER HLS_MUXER MOV_MUXER FILE_PROTOCOL PIPE_PROTOCOL) += fate-hls-parts
+fate-hls-parts: CMD = hls_parts -f lavfi -i testsrc=size=64x48:rate=10:d=3 -vf scale -pix_fmt yuv420p -c:v mpeg4 -g 5 -flags +bitexact -fflags +bitexact -hls_time 1 -hls_part_time 0.3
+
+tests/data/hls_prefetch.m3u8: TAG = GEN
+tests/data/hls_prefetch.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i testsrc=size=64x48:rate=10:d=3 -pix_fmt yuv420p -c:v mpeg2video -g 5 \
+        -flags +bitexact -fflags +bitexact -f hls -hls_time 0.5 -hls_list_size 0 \
+        -hls_segment_filename $(TARGET_PATH)/tests/data/hls_prefetch_%d.ts \
+        $(TARGET_PATH)/tests/data/hls_prefetch.m3u8 2>/dev/null
+
+# reading the segments from the prefetch buffers gives the same packets
+FATE_HLSENC_LAVFI-$(call ALLYES, TESTSRC_FILTER SCALE_FILTER LAVFI_INDEV MPEG2VIDEO_ENCODER HLS_MUXER MPEGTS_MUXER HLS_DEMUXER MPEGTS_DEMUXER MPEGVIDEO_PARSER FILE_PROTOCOL) += fate-hls-prefetch
+fate-hls-prefetch: tests/data/hls_prefetch.m3u8
+fate-hls-prefetch: CMD = prefetch_framecrc $(TARGET_PATH)/tests/data/hls_prefetch.m3u8 -map 0 -c copy
+
 FATE_HLSENC_LAVFI-yes := $(if $(call FRAMECRC), $(FATE_HLSENC_LAVFI-yes))
 
 FATE_FFMPEG += $(FATE_HLSENC_LAVFI-yes)
@@ -309,6 +309,13 @@ fate-mov-vfr: CMD = md5 -filter_complex testsrc=size=2x2:duration=1,setpts=N*N:s
 fate-mov-vfr: CMP = oneline
 fate-mov-vfr: REF = 1558b4a9398d8635783c93f84eb5a60d
 
+# faststart with reserve_moov: the moov fits the space reserved from the
+# stream durations, or a large udta overflows it and the second pass is run
+FATE_MOV_FFMPEG_FFPROBE-$(call TRANSCODE, MPEG4, MP4 MATROSKA, LAVFI_INDEV TESTSRC_FILTER SCALE_FILTER MOV_DEMUXER) \
+                          += fate-mov-reserve-moov fate-mov-reserve-moov-overflow
+fate-mov-reserve-moov: CMD = reserve_moov
+fate-mov-reserve-moov-overflow: CMD = reserve_moov -metadata comment=$$(printf %012000d 0)
+
 FATE_MOV_FFMPEG_FFPROBE-$(call ALLYES, COLOR_FILTER SETPTS_FILTER MPEG4_ENCODER \
                                       MOV_MUXER MOV_DEMUXER FILE_PROTOCOL)      \
                                       += fate-mov-vfr-bframes-derived-duration
@@ -49,7 +49,11 @@ fate-mpegts-lcevc-vvc-dual-track: CMD = stream_demux mpegts $(TARGET_SAMPLES)/lc
   "" "-c:v copy -map 0:1" \
   "-show_entries stream_group=index,id,nb_streams,type:stream=index,id,codec_name"
 
+FATE_MPEGTS_FFMPEG-$(call ALLYES, TESTSRC_FILTER LAVFI_INDEV SCALE_FILTER MPEG2VIDEO_ENCODER MPEGTS_MUXER FILE_PROTOCOL) += fate-mpegts-cbr
+fate-mpegts-cbr: CMD = md5 -f lavfi -i testsrc=size=352x288:rate=25 -t 2 -vf scale -pix_fmt yuv420p -threads 1 -c:v mpeg2video -b:v 1M -flags +bitexact -fflags +bitexact -f mpegts -muxrate 2M
+
 FATE_SAMPLES_FFPROBE += $(FATE_MPEGTS_PROBE-yes)
 FATE_SAMPLES_FFMPEG_FFPROBE += $(FATE_MPEGTS_FFMPEG_FFPROBE-yes)
+FATE_FFMPEG += $(FATE_MPEGTS_FFMPEG-yes)
 
-fate-mpegts: $(FATE_MPEGTS_PROBE-yes) $(FATE_MPEGTS_FFMPEG_FFPROBE-yes)
+fate-mpegts: $(FATE_MPEGTS_PROBE-yes) $(FATE_MPEGTS_FFMPEG_FFPROBE-yes) $(FATE_MPEGTS_FFMPEG-yes)